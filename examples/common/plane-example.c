@@ -86,8 +86,12 @@ _configure_cb (GulkanWindow         *window,
     = gulkan_renderer_get_context (GULKAN_RENDERER (priv->renderer));
   VkInstance instance = gulkan_context_get_instance_handle (context);
 
-  VkSurfaceKHR surface;
-  if (gulkan_window_create_surface (window, instance, &surface) != VK_SUCCESS)
+  /* Reuse the surface, so the swapchain can be recreated from the old one */
+  VkSurfaceKHR surface = gulkan_swapchain_renderer_get_surface (
+    GULKAN_SWAPCHAIN_RENDERER (priv->renderer));
+  if (surface == VK_NULL_HANDLE
+      && gulkan_window_create_surface (window, instance, &surface)
+           != VK_SUCCESS)
     {
       g_printerr ("Creating surface failed.");
       return;
@@ -96,25 +100,24 @@ _configure_cb (GulkanWindow         *window,
   if (!gulkan_swapchain_renderer_resize (
         GULKAN_SWAPCHAIN_RENDERER (priv->renderer), surface, event->extent))
     g_warning ("Resize failed.");
+
+  /* The plane is static, it only needs to be drawn when the window changed */
+  gulkan_renderer_queue_draw (GULKAN_RENDERER (priv->renderer));
 }
 
 static gboolean
-_draw_cb (gpointer data)
+_events_cb (gpointer data)
 {
   PlaneExample        *self = (PlaneExample *) data;
   PlaneExamplePrivate *priv = plane_example_get_instance_private (self);
 
-  gulkan_window_poll_events (priv->window);
-
   if (priv->should_quit)
     {
       g_main_loop_quit (priv->loop);
-      return FALSE;
+      return G_SOURCE_REMOVE;
     }
 
-  gulkan_renderer_draw (GULKAN_RENDERER (priv->renderer));
-
-  return TRUE;
+  return G_SOURCE_CONTINUE;
 }
 
 static void
@@ -152,8 +155,11 @@ plane_example_initialize (PlaneExample *self,
 
   instance_ext_list = g_slist_concat (instance_ext_list, window_ext_list);
 
+  /* Present wait is optional and only used for frame pacing */
   const gchar *device_extensions[] = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+    VK_KHR_PRESENT_ID_EXTENSION_NAME,
+    VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
   };
 
   for (uint64_t i = 0; i < G_N_ELEMENTS (device_extensions); i++)
@@ -208,6 +214,13 @@ void
 plane_example_run (PlaneExample *self)
 {
   PlaneExamplePrivate *priv = plane_example_get_instance_private (self);
-  g_timeout_add (1, _draw_cb, self);
+
+  GSource *source = gulkan_window_create_source (priv->window);
+  g_source_set_callback (source, _events_cb, self, NULL);
+  g_source_attach (source, NULL);
+
   g_main_loop_run (priv->loop);
+
+  g_source_destroy (source);
+  g_source_unref (source);
 }
@@ -150,10 +150,12 @@ struct _Example
   VkExtent2D last_window_size;
   VkOffset2D last_window_position;
 
-  GulkanUniformBuffer *transformation_ubo;
+  /* One per frame slot, so a queued frame never reads a buffer being written */
+  GulkanUniformBuffer **transformation_ubos;
+  GulkanDescriptorSet **descriptor_sets;
+  uint32_t              slot_count;
 
   GulkanPipeline       *pipeline;
-  GulkanDescriptorSet  *descriptor_set;
   GulkanDescriptorPool *descriptor_pool;
 };
 
@@ -170,9 +172,14 @@ _finalize (GObject *gobject)
   GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
   gulkan_device_wait_idle (gulkan_context_get_device (context));
 
-  g_object_unref (self->descriptor_set);
+  for (uint32_t i = 0; i < self->slot_count; i++)
+    {
+      g_clear_object (&self->descriptor_sets[i]);
+      g_clear_object (&self->transformation_ubos[i]);
+    }
+  g_free (self->descriptor_sets);
+  g_free (self->transformation_ubos);
   g_object_unref (self->pipeline);
-  g_object_unref (self->transformation_ubo);
 
   G_OBJECT_CLASS (gulkan_example_parent_class)->finalize (gobject);
 
@@ -187,12 +194,15 @@ gulkan_example_init (Example *self)
                               (VkExtent2D){.width = 1280, .height = 720});
   self->should_quit = FALSE;
   self->loop = g_main_loop_new (NULL, FALSE);
+  self->transformation_ubos = NULL;
+  self->descriptor_sets = NULL;
+  self->slot_count = 0;
   gulkan_swapchain_renderer_initialize (GULKAN_SWAPCHAIN_RENDERER (self),
                                         background_color, NULL);
 }
 
 static void
-_update_uniform_buffer (Example *self)
+_update_uniform_buffer (Example *self, uint32_t slot)
 {
   int64_t t = gulkan_renderer_get_msec_since_start (GULKAN_RENDERER (self));
   t /= 5;
@@ -221,7 +231,8 @@ _update_uniform_buffer (Example *self)
   /* The mat3 normalMatrix is laid out as 3 vec4s. */
   memcpy (ubo.normal_matrix, ubo.mv_matrix, sizeof ubo.normal_matrix);
 
-  gulkan_uniform_buffer_update (self->transformation_ubo, (gpointer) &ubo);
+  gulkan_uniform_buffer_update (self->transformation_ubos[slot],
+                                (gpointer) &ubo);
 }
 
 static void
@@ -261,8 +272,12 @@ _configure_cb (GulkanWindow *window, GulkanConfigureEvent *event, Example *self)
   GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
   VkInstance     instance = gulkan_context_get_instance_handle (context);
 
-  VkSurfaceKHR surface;
-  if (gulkan_window_create_surface (window, instance, &surface) != VK_SUCCESS)
+  /* Reuse the surface, so the swapchain can be recreated from the old one */
+  VkSurfaceKHR surface = gulkan_swapchain_renderer_get_surface (
+    GULKAN_SWAPCHAIN_RENDERER (self));
+  if (surface == VK_NULL_HANDLE
+      && gulkan_window_create_surface (window, instance, &surface)
+           != VK_SUCCESS)
     {
       g_printerr ("Creating surface failed.");
       return;
@@ -281,21 +296,17 @@ _close_cb (GulkanWindow *window, Example *self)
 }
 
 static gboolean
-_iterate (gpointer _self)
+_events_cb (gpointer _self)
 {
   Example *self = (Example *) _self;
 
-  gulkan_window_poll_events (self->window);
-
   if (self->should_quit)
     {
       g_main_loop_quit (self->loop);
-      return FALSE;
+      return G_SOURCE_REMOVE;
     }
 
-  _update_uniform_buffer (self);
-
-  return gulkan_renderer_draw (GULKAN_RENDERER (self));
+  return G_SOURCE_CONTINUE;
 }
 
 static void
@@ -362,11 +373,6 @@ _init (Example *self)
   if (!self->vb)
     return FALSE;
 
-  self->transformation_ubo
-    = gulkan_uniform_buffer_new (gulkan_device, sizeof (Transformation));
-  if (!self->transformation_ubo)
-    return FALSE;
-
   VkDescriptorSetLayoutBinding bindings[] = {
     {
       .binding = 0,
@@ -375,12 +381,29 @@ _init (Example *self)
       .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
     },
   };
-  self->descriptor_pool = GULKAN_DESCRIPTOR_POOL_NEW (context, bindings, 1);
-  self->descriptor_set
-    = gulkan_descriptor_pool_create_set (self->descriptor_pool);
+  GulkanSwapchainRenderer *renderer = GULKAN_SWAPCHAIN_RENDERER (self);
+  self->slot_count = gulkan_swapchain_renderer_get_max_queued_frames (renderer);
 
-  gulkan_descriptor_set_update_buffer (self->descriptor_set, 0,
-                                       self->transformation_ubo);
+  self->descriptor_pool = GULKAN_DESCRIPTOR_POOL_NEW (context, bindings,
+                                                      self->slot_count);
+
+  self->transformation_ubos = g_new0 (GulkanUniformBuffer *, self->slot_count);
+  self->descriptor_sets = g_new0 (GulkanDescriptorSet *, self->slot_count);
+  for (uint32_t i = 0; i < self->slot_count; i++)
+    {
+      self->transformation_ubos[i]
+        = gulkan_uniform_buffer_new (gulkan_device, sizeof (Transformation));
+      if (!self->transformation_ubos[i])
+        return FALSE;
+
+      self->descriptor_sets[i]
+        = gulkan_descriptor_pool_create_set (self->descriptor_pool);
+      gulkan_descriptor_set_update_buffer (self->descriptor_sets[i], 0,
+                                           self->transformation_ubos[i]);
+    }
+
+  /* The transformation changes every frame, see _init_draw_cmd */
+  gulkan_swapchain_renderer_set_record_each_frame (renderer, TRUE);
 
   g_signal_connect (self->window, "configure", (GCallback) _configure_cb, self);
   g_signal_connect (self->window, "pointer-position",
@@ -390,6 +413,13 @@ _init (Example *self)
 
   g_signal_connect (self->window, "pointer-axis", (GCallback) _pointer_axis_cb,
                     self);
+
+  /* Render at the pace of the compositor, and not at all while hidden */
+  gulkan_swapchain_renderer_set_frame_window (renderer, self->window);
+
+  /* Pointer events are flushed once per frame, before frame-ready */
+  gulkan_window_set_coalesce_input (self->window, TRUE);
+
   return TRUE;
 }
 
@@ -398,12 +428,16 @@ _init_draw_cmd (GulkanSwapchainRenderer *renderer, VkCommandBuffer cmd_buffer)
 {
   Example *self = GULKAN_EXAMPLE (renderer);
 
+  /* The frame that last used the slot is done, so its buffer can be written */
+  uint32_t slot = gulkan_swapchain_renderer_get_frame_slot (renderer);
+  _update_uniform_buffer (self, slot);
+
   gulkan_pipeline_bind (self->pipeline, cmd_buffer);
 
   VkPipelineLayout layout
     = gulkan_descriptor_pool_get_pipeline_layout (self->descriptor_pool);
 
-  gulkan_descriptor_set_bind (self->descriptor_set, layout, cmd_buffer);
+  gulkan_descriptor_set_bind (self->descriptor_sets[slot], layout, cmd_buffer);
 
   gulkan_vertex_buffer_bind_with_offsets (self->vb, cmd_buffer);
   // Draw faces seperately
@@ -435,7 +469,7 @@ _init_pipeline (GulkanSwapchainRenderer *renderer, gconstpointer data)
     .attribs = attrib_desc,
     .attrib_count = gulkan_vertex_buffer_get_attrib_count (self->vb),
     .bindings = binding_desc,
-    .binding_count = gulkan_vertex_buffer_get_attrib_count (self->vb),
+    .binding_count = gulkan_vertex_buffer_get_binding_count (self->vb),
     .blend_attachments = (VkPipelineColorBlendAttachmentState[]){
       {
         .colorWriteMask =
@@ -488,9 +522,15 @@ main ()
       return -1;
     }
 
-  g_timeout_add (1, _iterate, self);
+  GSource *source = gulkan_window_create_source (self->window);
+  g_source_set_callback (source, _events_cb, self, NULL);
+  g_source_attach (source, NULL);
+
   g_main_loop_run (self->loop);
 
+  g_source_destroy (source);
+  g_source_unref (source);
+
   g_object_unref (self);
 
   return 0;
@@ -316,8 +316,12 @@ _configure_cb (GulkanWindow *window, GulkanConfigureEvent *event, Example *self)
   GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
   VkInstance     instance = gulkan_context_get_instance_handle (context);
 
-  VkSurfaceKHR surface;
-  if (gulkan_window_create_surface (window, instance, &surface) != VK_SUCCESS)
+  /* Reuse the surface, so the swapchain can be recreated from the old one */
+  VkSurfaceKHR surface = gulkan_swapchain_renderer_get_surface (
+    GULKAN_SWAPCHAIN_RENDERER (self));
+  if (surface == VK_NULL_HANDLE
+      && gulkan_window_create_surface (window, instance, &surface)
+           != VK_SUCCESS)
     {
       g_printerr ("Creating surface failed.");
       return;
@@ -329,18 +333,25 @@ _configure_cb (GulkanWindow *window, GulkanConfigureEvent *event, Example *self)
 }
 
 static gboolean
-_iterate (gpointer _self)
+_events_cb (gpointer _self)
 {
   Example *self = (Example *) _self;
 
-  gulkan_window_poll_events (self->window);
-
   if (self->should_quit)
     {
       g_main_loop_quit (self->loop);
-      return FALSE;
+      return G_SOURCE_REMOVE;
     }
 
+  return G_SOURCE_CONTINUE;
+}
+
+/* Paced by presentation, the swapchain blocks when frames are queued */
+static gboolean
+_iterate (gpointer _self)
+{
+  Example *self = (Example *) _self;
+
   _update_uniform_buffer (self);
 
   return gulkan_renderer_draw (GULKAN_RENDERER (self));
@@ -497,7 +508,7 @@ _init_pipeline (GulkanSwapchainRenderer *renderer, gconstpointer data)
     .attribs = attrib_desc,
     .attrib_count = gulkan_vertex_buffer_get_attrib_count (self->vb),
     .bindings = binding_desc,
-    .binding_count = gulkan_vertex_buffer_get_attrib_count (self->vb),
+    .binding_count = gulkan_vertex_buffer_get_binding_count (self->vb),
     .blend_attachments = (VkPipelineColorBlendAttachmentState[]){
       {
         .colorWriteMask =
@@ -550,9 +561,16 @@ main ()
       return -1;
     }
 
-  g_timeout_add (1, _iterate, self);
+  GSource *source = gulkan_window_create_source (self->window);
+  g_source_set_callback (source, _events_cb, self, NULL);
+  g_source_attach (source, NULL);
+
+  g_idle_add (_iterate, self);
   g_main_loop_run (self->loop);
 
+  g_source_destroy (source);
+  g_source_unref (source);
+
   g_object_unref (self);
 
   return 0;
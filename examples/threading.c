@@ -214,8 +214,12 @@ _configure_cb (GulkanWindow *window, GulkanConfigureEvent *event, Example *self)
     = gulkan_renderer_get_context (GULKAN_RENDERER (self->renderer));
   VkInstance instance = gulkan_context_get_instance_handle (context);
 
-  VkSurfaceKHR surface;
-  if (gulkan_window_create_surface (window, instance, &surface) != VK_SUCCESS)
+  /* Reuse the surface, so the swapchain can be recreated from the old one */
+  VkSurfaceKHR surface = gulkan_swapchain_renderer_get_surface (
+    GULKAN_SWAPCHAIN_RENDERER (self->renderer));
+  if (surface == VK_NULL_HANDLE
+      && gulkan_window_create_surface (window, instance, &surface)
+           != VK_SUCCESS)
     {
       g_printerr ("Creating surface failed.");
       return;
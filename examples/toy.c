@@ -449,8 +449,12 @@ _configure_cb (GulkanWindow *window, GulkanConfigureEvent *event, Example *self)
   GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
   VkInstance     instance = gulkan_context_get_instance_handle (context);
 
-  VkSurfaceKHR surface;
-  if (gulkan_window_create_surface (window, instance, &surface) != VK_SUCCESS)
+  /* Reuse the surface, so the swapchain can be recreated from the old one */
+  VkSurfaceKHR surface = gulkan_swapchain_renderer_get_surface (
+    GULKAN_SWAPCHAIN_RENDERER (self));
+  if (surface == VK_NULL_HANDLE
+      && gulkan_window_create_surface (window, instance, &surface)
+           != VK_SUCCESS)
     {
       g_printerr ("Creating surface failed.");
       return;
@@ -472,18 +476,25 @@ _close_cb (GulkanWindow *window, Example *self)
 }
 
 static gboolean
-_iterate (gpointer _self)
+_events_cb (gpointer _self)
 {
   Example *self = (Example *) _self;
 
-  gulkan_window_poll_events (self->window);
-
   if (self->should_quit)
     {
       g_main_loop_quit (self->loop);
-      return FALSE;
+      return G_SOURCE_REMOVE;
     }
 
+  return G_SOURCE_CONTINUE;
+}
+
+/* Paced by presentation, the swapchain blocks when frames are queued */
+static gboolean
+_iterate (gpointer _self)
+{
+  Example *self = (Example *) _self;
+
   _update_uniform_buffer (self);
 
   return gulkan_renderer_draw (GULKAN_RENDERER (self));
@@ -1172,9 +1183,16 @@ main (int argc, char *argv[])
       return EXIT_FAILURE;
     }
 
-  g_timeout_add (1, _iterate, self);
+  GSource *source = gulkan_window_create_source (self->window);
+  g_source_set_callback (source, _events_cb, self, NULL);
+  g_source_attach (source, NULL);
+
+  g_idle_add (_iterate, self);
   g_main_loop_run (self->loop);
 
+  g_source_destroy (source);
+  g_source_unref (source);
+
   g_object_unref (self);
 
   return EXIT_SUCCESS;
@@ -15,6 +15,10 @@ struct _GulkanBuffer
 
   VkBuffer       handle;
   VkDeviceMemory memory;
+  VkDeviceSize   memory_size;
+  gboolean       coherent;
+
+  VkExternalMemoryHandleTypeFlags export_handle_types;
 };
 
 G_DEFINE_TYPE (GulkanBuffer, gulkan_buffer, G_TYPE_OBJECT)
@@ -24,6 +28,9 @@ gulkan_buffer_init (GulkanBuffer *self)
 {
   self->handle = VK_NULL_HANDLE;
   self->device = VK_NULL_HANDLE;
+  self->memory_size = 0;
+  self->coherent = FALSE;
+  self->export_handle_types = 0;
 }
 
 static void
@@ -59,20 +66,88 @@ _align_to_non_coherent_atom_size (GulkanBuffer *self,
   return r ? allocation_size + (atom_size - r) : allocation_size;
 }
 
+/*
+ * Handle types out of OPAQUE_FD and DMA_BUF the driver can export for usage
+ * from a single allocation. A type is only added when its extension is
+ * enabled and it is compatible with the types chosen before it.
+ */
+static VkExternalMemoryHandleTypeFlags
+_get_exportable_handle_types (GulkanBuffer       *self,
+                              VkBufferUsageFlags  usage,
+                              gboolean           *dedicated_only)
+{
+  VkPhysicalDevice physical_device
+    = gulkan_device_get_physical_handle (self->device);
+
+  VkExternalMemoryHandleTypeFlagBits types[] = {
+    VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+    VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+  };
+
+  VkExternalMemoryHandleTypeFlags supported = 0;
+  *dedicated_only = FALSE;
+  for (uint32_t i = 0; i < G_N_ELEMENTS (types); i++)
+    {
+      if (!gulkan_device_supports_memory_handle_type (self->device, types[i]))
+        continue;
+
+      VkPhysicalDeviceExternalBufferInfo info = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_BUFFER_INFO,
+        .usage = usage,
+        .handleType = types[i],
+      };
+      VkExternalBufferProperties props = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_BUFFER_PROPERTIES,
+      };
+      vkGetPhysicalDeviceExternalBufferProperties (physical_device, &info,
+                                                   &props);
+
+      VkExternalMemoryProperties *memory_props
+        = &props.externalMemoryProperties;
+      if (!(memory_props->externalMemoryFeatures
+            & VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT))
+        continue;
+
+      if ((memory_props->compatibleHandleTypes & supported) != supported)
+        continue;
+
+      supported |= types[i];
+      if (memory_props->externalMemoryFeatures
+          & VK_EXTERNAL_MEMORY_FEATURE_DEDICATED_ONLY_BIT)
+        *dedicated_only = TRUE;
+    }
+
+  return supported;
+}
+
 static gboolean
 _create (GulkanBuffer         *self,
          VkDeviceSize          size,
          VkBufferUsageFlags    usage,
-         VkMemoryPropertyFlags properties)
+         VkMemoryPropertyFlags properties,
+         gboolean              exportable)
 {
+  gboolean dedicated_only = FALSE;
+  if (exportable)
+    {
+      self->export_handle_types
+        = _get_exportable_handle_types (self, usage, &dedicated_only);
+      if (self->export_handle_types == 0)
+        {
+          g_printerr ("Buffer memory can't be exported on this device.\n");
+          return FALSE;
+        }
+    }
+
+  /* External memory can prevent suballocation, so only use it on request */
   VkExternalMemoryBufferCreateInfo external_info = {
     .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
-    .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+    .handleTypes = self->export_handle_types,
   };
 
   VkBufferCreateInfo buffer_info = {
     .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-    .pNext = &external_info,
+    .pNext = exportable ? &external_info : NULL,
     .size = size,
     .usage = usage,
   };
@@ -85,8 +160,20 @@ _create (GulkanBuffer         *self,
   VkMemoryRequirements requirements;
   vkGetBufferMemoryRequirements (device, self->handle, &requirements);
 
+  VkMemoryDedicatedAllocateInfo dedicated_info = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+    .buffer = self->handle,
+  };
+
+  VkExportMemoryAllocateInfo export_info = {
+    .sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
+    .pNext = dedicated_only ? &dedicated_info : NULL,
+    .handleTypes = self->export_handle_types,
+  };
+
   VkMemoryAllocateInfo alloc_info = {
     .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .pNext = exportable ? &export_info : NULL,
     .allocationSize = _align_to_non_coherent_atom_size (self,
                                                         requirements.size),
   };
@@ -103,6 +190,9 @@ _create (GulkanBuffer         *self,
   res = vkAllocateMemory (device, &alloc_info, NULL, &self->memory);
   vk_check_error ("vkAllocateMemory", res, FALSE);
 
+  self->memory_size = alloc_info.allocationSize;
+  self->coherent = (properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
   res = vkBindBufferMemory (device, self->handle, self->memory, 0);
   vk_check_error ("vkBindBufferMemory", res, FALSE);
 
@@ -118,7 +208,37 @@ gulkan_buffer_new (GulkanDevice         *device,
   GulkanBuffer *self = (GulkanBuffer *) g_object_new (GULKAN_TYPE_BUFFER, 0);
   self->device = device;
 
-  if (!_create (self, size, usage, properties))
+  if (!_create (self, size, usage, properties, FALSE))
+    {
+      g_object_unref (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+/**
+ * gulkan_buffer_new_exportable:
+ * @device: a #GulkanDevice
+ * @size: size in bytes
+ * @usage: #VkBufferUsageFlags
+ * @properties: #VkMemoryPropertyFlags
+ *
+ * Creates a buffer whose memory can be shared with gulkan_buffer_export_fd().
+ * Buffers from gulkan_buffer_new() can't be exported.
+ *
+ * Returns: (transfer full) (nullable): a new #GulkanBuffer
+ */
+GulkanBuffer *
+gulkan_buffer_new_exportable (GulkanDevice         *device,
+                              VkDeviceSize          size,
+                              VkBufferUsageFlags    usage,
+                              VkMemoryPropertyFlags properties)
+{
+  GulkanBuffer *self = (GulkanBuffer *) g_object_new (GULKAN_TYPE_BUFFER, 0);
+  self->device = device;
+
+  if (!_create (self, size, usage, properties, TRUE))
     {
       g_object_unref (self);
       return NULL;
@@ -137,7 +257,7 @@ gulkan_buffer_new_from_data (GulkanDevice         *device,
   GulkanBuffer *self = (GulkanBuffer *) g_object_new (GULKAN_TYPE_BUFFER, 0);
   self->device = device;
 
-  if (!_create (self, size, usage, properties))
+  if (!_create (self, size, usage, properties, FALSE))
     {
       g_object_unref (self);
       return NULL;
@@ -200,6 +320,48 @@ gulkan_buffer_upload (GulkanBuffer *self, const void *data, VkDeviceSize size)
   return TRUE;
 }
 
+/**
+ * gulkan_buffer_flush_range:
+ * @self: a mapped #GulkanBuffer
+ * @offset: byte offset of the written range
+ * @size: size of the written range in bytes
+ *
+ * Makes host writes to the range visible to the device. The range is
+ * widened to nonCoherentAtomSize, nothing is done for coherent memory.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_buffer_flush_range (GulkanBuffer *self,
+                           VkDeviceSize  offset,
+                           VkDeviceSize  size)
+{
+  if (self->coherent || size == 0)
+    return TRUE;
+
+  VkPhysicalDeviceProperties *props
+    = gulkan_device_get_physical_device_properties (self->device);
+  VkDeviceSize atom_size = props->limits.nonCoherentAtomSize;
+
+  VkDeviceSize start = offset - offset % atom_size;
+  VkDeviceSize end = _align_to_non_coherent_atom_size (self, offset + size);
+  if (end > self->memory_size)
+    end = self->memory_size;
+
+  VkMappedMemoryRange memory_range = {
+    .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+    .memory = self->memory,
+    .offset = start,
+    .size = end - start,
+  };
+
+  VkDevice device = gulkan_device_get_handle (self->device);
+  VkResult res = vkFlushMappedMemoryRanges (device, 1, &memory_range);
+  vk_check_error ("vkFlushMappedMemoryRanges", res, FALSE);
+
+  return TRUE;
+}
+
 /**
  * gulkan_buffer_get_handle:
  * @self: a #GulkanBuffer
@@ -223,3 +385,28 @@ gulkan_buffer_get_memory_handle (GulkanBuffer *self)
 {
   return self->memory;
 }
+
+/**
+ * gulkan_buffer_export_fd:
+ * @self: a #GulkanBuffer created with gulkan_buffer_new_exportable()
+ * @handle_type: %VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT or
+ * %VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT
+ * @fd: (out): the exported file descriptor, owned by the caller
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_buffer_export_fd (GulkanBuffer                      *self,
+                         VkExternalMemoryHandleTypeFlagBits handle_type,
+                         int                               *fd)
+{
+  if (!(self->export_handle_types & handle_type))
+    {
+      g_printerr ("Buffer was not created exportable as handle type %d.\n",
+                  handle_type);
+      return FALSE;
+    }
+
+  return gulkan_device_export_memory_fd (self->device, self->memory,
+                                         handle_type, fd);
+}
@@ -27,6 +27,12 @@ gulkan_buffer_new (GulkanDevice         *device,
                    VkBufferUsageFlags    usage,
                    VkMemoryPropertyFlags properties);
 
+GulkanBuffer *
+gulkan_buffer_new_exportable (GulkanDevice         *device,
+                              VkDeviceSize          size,
+                              VkBufferUsageFlags    usage,
+                              VkMemoryPropertyFlags properties);
+
 GulkanBuffer *
 gulkan_buffer_new_from_data (GulkanDevice         *device,
                              const void           *data,
@@ -43,12 +49,22 @@ gulkan_buffer_unmap (GulkanBuffer *self);
 gboolean
 gulkan_buffer_upload (GulkanBuffer *self, const void *data, VkDeviceSize size);
 
+gboolean
+gulkan_buffer_flush_range (GulkanBuffer *self,
+                           VkDeviceSize  offset,
+                           VkDeviceSize  size);
+
 VkBuffer
 gulkan_buffer_get_handle (GulkanBuffer *self);
 
 VkDeviceMemory
 gulkan_buffer_get_memory_handle (GulkanBuffer *self);
 
+gboolean
+gulkan_buffer_export_fd (GulkanBuffer                      *self,
+                         VkExternalMemoryHandleTypeFlagBits handle_type,
+                         int                               *fd);
+
 G_END_DECLS
 
 #endif /* GULKAN_BUFFER_H_ */
@@ -0,0 +1,217 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "gulkan-compute-pipeline.h"
+
+struct _GulkanComputePipeline
+{
+  GObject parent;
+
+  GulkanContext *context;
+
+  VkPipeline       handle;
+  VkPipelineLayout layout;
+
+  VkExtent3D local_size;
+};
+
+G_DEFINE_TYPE (GulkanComputePipeline, gulkan_compute_pipeline, G_TYPE_OBJECT)
+
+static void
+gulkan_compute_pipeline_init (GulkanComputePipeline *self)
+{
+  self->context = NULL;
+  self->handle = VK_NULL_HANDLE;
+  self->layout = VK_NULL_HANDLE;
+  self->local_size = (VkExtent3D){1, 1, 1};
+}
+
+static gboolean
+_init (GulkanComputePipeline       *self,
+       GulkanDescriptorPool        *descriptor_pool,
+       GulkanComputePipelineConfig *config)
+{
+  GulkanDevice *device = gulkan_context_get_device (self->context);
+
+  VkShaderModule cs = config->shader;
+  if (cs == VK_NULL_HANDLE)
+    {
+      if (!gulkan_device_create_shader_module (device, config->shader_uri,
+                                               &cs))
+        return FALSE;
+    }
+
+  self->layout = gulkan_descriptor_pool_get_pipeline_layout (descriptor_pool);
+
+  VkComputePipelineCreateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .stage = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = cs,
+      .pName = "main",
+      .pSpecializationInfo = config->specialization,
+    },
+    .layout = self->layout,
+  };
+
+  VkDevice vk_device = gulkan_context_get_device_handle (self->context);
+  VkResult res;
+  res = vkCreateComputePipelines (vk_device, VK_NULL_HANDLE, 1, &info, NULL,
+                                  &self->handle);
+
+  vkDestroyShaderModule (vk_device, cs, NULL);
+
+  vk_check_error ("vkCreateComputePipelines", res, FALSE);
+
+  return TRUE;
+}
+
+/**
+ * gulkan_compute_pipeline_new:
+ * @context: a #GulkanContext
+ * @descriptor_pool: a #GulkanDescriptorPool providing the pipeline layout
+ * @config: a #GulkanComputePipelineConfig
+ *
+ * The shader module in @config is consumed, like in gulkan_pipeline_new().
+ *
+ * Returns: (transfer full) (nullable): a new #GulkanComputePipeline
+ */
+GulkanComputePipeline *
+gulkan_compute_pipeline_new (GulkanContext               *context,
+                             GulkanDescriptorPool        *descriptor_pool,
+                             GulkanComputePipelineConfig *config)
+{
+  GulkanComputePipeline *self = (GulkanComputePipeline *)
+    g_object_new (GULKAN_TYPE_COMPUTE_PIPELINE, 0);
+  self->context = g_object_ref (context);
+
+  self->local_size = (VkExtent3D){
+    .width = MAX (config->local_size.width, 1),
+    .height = MAX (config->local_size.height, 1),
+    .depth = MAX (config->local_size.depth, 1),
+  };
+
+  if (!_init (self, descriptor_pool, config))
+    {
+      g_object_unref (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+static void
+_finalize (GObject *gobject)
+{
+  GulkanComputePipeline *self = GULKAN_COMPUTE_PIPELINE (gobject);
+  if (self->handle != VK_NULL_HANDLE)
+    {
+      VkDevice device = gulkan_context_get_device_handle (self->context);
+      vkDestroyPipeline (device, self->handle, NULL);
+    }
+  g_clear_object (&self->context);
+  G_OBJECT_CLASS (gulkan_compute_pipeline_parent_class)->finalize (gobject);
+}
+
+static void
+gulkan_compute_pipeline_class_init (GulkanComputePipelineClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  object_class->finalize = _finalize;
+}
+
+void
+gulkan_compute_pipeline_bind (GulkanComputePipeline *self,
+                              VkCommandBuffer        cmd_buffer)
+{
+  vkCmdBindPipeline (cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, self->handle);
+}
+
+static uint32_t
+_div_round_up (uint32_t n, uint32_t d)
+{
+  return (n + d - 1) / d;
+}
+
+/**
+ * gulkan_compute_pipeline_get_group_count:
+ * @self: a #GulkanComputePipeline
+ * @extent: number of invocations needed in each dimension
+ *
+ * Rounds up, so shaders need to bounds check invocations outside @extent.
+ *
+ * Returns: the number of workgroups covering @extent
+ */
+VkExtent3D
+gulkan_compute_pipeline_get_group_count (GulkanComputePipeline *self,
+                                         VkExtent3D             extent)
+{
+  return (VkExtent3D){
+    .width = _div_round_up (MAX (extent.width, 1), self->local_size.width),
+    .height = _div_round_up (MAX (extent.height, 1), self->local_size.height),
+    .depth = _div_round_up (MAX (extent.depth, 1), self->local_size.depth),
+  };
+}
+
+/**
+ * gulkan_compute_pipeline_dispatch:
+ * @self: a #GulkanComputePipeline
+ * @cmd_buffer: a #VkCommandBuffer with the pipeline bound
+ * @extent: number of invocations needed in each dimension
+ */
+void
+gulkan_compute_pipeline_dispatch (GulkanComputePipeline *self,
+                                  VkCommandBuffer        cmd_buffer,
+                                  VkExtent3D             extent)
+{
+  VkExtent3D groups = gulkan_compute_pipeline_get_group_count (self, extent);
+  vkCmdDispatch (cmd_buffer, groups.width, groups.height, groups.depth);
+}
+
+/**
+ * gulkan_compute_pipeline_dispatch_2d:
+ * @self: a #GulkanComputePipeline
+ * @cmd_buffer: a #VkCommandBuffer with the pipeline bound
+ * @extent: the size of the image to process
+ */
+void
+gulkan_compute_pipeline_dispatch_2d (GulkanComputePipeline *self,
+                                     VkCommandBuffer        cmd_buffer,
+                                     VkExtent2D             extent)
+{
+  VkExtent3D extent_3d = {
+    .width = extent.width,
+    .height = extent.height,
+    .depth = 1,
+  };
+  gulkan_compute_pipeline_dispatch (self, cmd_buffer, extent_3d);
+}
+
+/**
+ * gulkan_compute_pipeline_get_handle:
+ * @self: a #GulkanComputePipeline
+ *
+ * Returns: (transfer none): a #VkPipeline
+ */
+VkPipeline
+gulkan_compute_pipeline_get_handle (GulkanComputePipeline *self)
+{
+  return self->handle;
+}
+
+/**
+ * gulkan_compute_pipeline_get_layout:
+ * @self: a #GulkanComputePipeline
+ *
+ * Returns: (transfer none): the #VkPipelineLayout of the descriptor pool
+ */
+VkPipelineLayout
+gulkan_compute_pipeline_get_layout (GulkanComputePipeline *self)
+{
+  return self->layout;
+}
@@ -0,0 +1,71 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GULKAN_COMPUTE_PIPELINE_H_
+#define GULKAN_COMPUTE_PIPELINE_H_
+
+#include <glib-object.h>
+
+#include "gulkan-context.h"
+#include "gulkan-descriptor-pool.h"
+
+G_BEGIN_DECLS
+
+#define GULKAN_TYPE_COMPUTE_PIPELINE gulkan_compute_pipeline_get_type ()
+G_DECLARE_FINAL_TYPE (GulkanComputePipeline,
+                      gulkan_compute_pipeline,
+                      GULKAN,
+                      COMPUTE_PIPELINE,
+                      GObject)
+
+/**
+ * GulkanComputePipelineConfig:
+ * @shader_uri: resource path of the SPIR-V compute shader
+ * @shader: an existing #VkShaderModule, used instead of @shader_uri
+ * @local_size: workgroup size declared in the shader with local_size_x/y/z
+ * @specialization: (nullable): specialization constants for the shader
+ */
+typedef struct
+{
+  const char                 *shader_uri;
+  VkShaderModule              shader;
+  VkExtent3D                  local_size;
+  const VkSpecializationInfo *specialization;
+} GulkanComputePipelineConfig;
+
+GulkanComputePipeline *
+gulkan_compute_pipeline_new (GulkanContext               *context,
+                             GulkanDescriptorPool        *descriptor_pool,
+                             GulkanComputePipelineConfig *config);
+
+void
+gulkan_compute_pipeline_bind (GulkanComputePipeline *self,
+                              VkCommandBuffer        cmd_buffer);
+
+VkExtent3D
+gulkan_compute_pipeline_get_group_count (GulkanComputePipeline *self,
+                                         VkExtent3D             extent);
+
+void
+gulkan_compute_pipeline_dispatch (GulkanComputePipeline *self,
+                                  VkCommandBuffer        cmd_buffer,
+                                  VkExtent3D             extent);
+
+void
+gulkan_compute_pipeline_dispatch_2d (GulkanComputePipeline *self,
+                                     VkCommandBuffer        cmd_buffer,
+                                     VkExtent2D             extent);
+
+VkPipeline
+gulkan_compute_pipeline_get_handle (GulkanComputePipeline *self);
+
+VkPipelineLayout
+gulkan_compute_pipeline_get_layout (GulkanComputePipeline *self);
+
+G_END_DECLS
+
+#endif /* GULKAN_COMPUTE_PIPELINE_H_ */
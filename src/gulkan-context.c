@@ -106,6 +106,43 @@ gulkan_context_new_from_instance (GulkanInstance  *instance,
   return self;
 }
 
+/**
+ * gulkan_context_new_from_device:
+ * @instance: (transfer full): a created #GulkanInstance
+ * @device: (transfer full): a #GulkanDevice that was not created yet
+ * @device_ext_list: (element-type utf8): a list of device extensions
+ * @physical_device: a #VkPhysicalDevice. Pass VK_NULL_HANDLE to let Gulkan
+ * choose one.
+ *
+ * Allows configuring @device, for example with
+ * gulkan_device_set_queue_count(), before it is created.
+ *
+ * Returns: (transfer full): a new #GulkanContext
+ */
+GulkanContext *
+gulkan_context_new_from_device (GulkanInstance  *instance,
+                                GulkanDevice    *device,
+                                GSList          *device_ext_list,
+                                VkPhysicalDevice physical_device)
+{
+  GulkanContext *self = (GulkanContext *) g_object_new (GULKAN_TYPE_CONTEXT, 0);
+
+  GulkanContextPrivate *priv = gulkan_context_get_instance_private (self);
+  g_object_unref (priv->instance);
+  g_object_unref (priv->device);
+  priv->instance = instance;
+  priv->device = device;
+
+  if (!gulkan_device_create (priv->device, priv->instance, physical_device,
+                             device_ext_list))
+    {
+      g_printerr ("Failed to create device.\n");
+      g_object_unref (self);
+      return NULL;
+    }
+  return self;
+}
+
 /**
  * gulkan_context_new_from_vk:
  * @vk_instance: An externally created VkInstance
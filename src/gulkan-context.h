@@ -45,6 +45,12 @@ gulkan_context_new_from_instance (GulkanInstance  *instance,
                                   GSList          *device_ext_list,
                                   VkPhysicalDevice physical_device);
 
+GulkanContext *
+gulkan_context_new_from_device (GulkanInstance  *instance,
+                                GulkanDevice    *device,
+                                GSList          *device_ext_list,
+                                VkPhysicalDevice physical_device);
+
 GulkanContext *
 gulkan_context_new_from_vk (VkInstance       vk_instance,
                             VkPhysicalDevice vk_physical_device,
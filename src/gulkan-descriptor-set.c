@@ -89,6 +89,21 @@ gulkan_descriptor_set_bind (GulkanDescriptorSet *self,
                            0, 1, &self->handle, 0, NULL);
 }
 
+/**
+ * gulkan_descriptor_set_bind_compute:
+ * @self: a #GulkanDescriptorSet
+ * @layout: the #VkPipelineLayout of the compute pipeline
+ * @cmd_buffer: a #VkCommandBuffer
+ */
+void
+gulkan_descriptor_set_bind_compute (GulkanDescriptorSet *self,
+                                    VkPipelineLayout     layout,
+                                    VkCommandBuffer      cmd_buffer)
+{
+  vkCmdBindDescriptorSets (cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout,
+                           0, 1, &self->handle, 0, NULL);
+}
+
 void
 gulkan_descriptor_set_update_buffer_at (GulkanDescriptorSet *self,
                                         guint                index,
@@ -213,3 +228,62 @@ gulkan_descriptor_set_update_view_sampler (GulkanDescriptorSet *self,
   VkDevice device = gulkan_context_get_device_handle (self->context);
   vkUpdateDescriptorSets (device, 1, write_sets, 0, NULL);
 }
+
+/**
+ * gulkan_descriptor_set_update_storage_image:
+ * @self: a #GulkanDescriptorSet
+ * @index: the binding
+ * @view: a #VkImageView of an image created with %VK_IMAGE_USAGE_STORAGE_BIT
+ *
+ * The image needs to be in %VK_IMAGE_LAYOUT_GENERAL when used.
+ */
+void
+gulkan_descriptor_set_update_storage_image (GulkanDescriptorSet *self,
+                                            guint                index,
+                                            VkImageView          view)
+{
+  VkWriteDescriptorSet write_set = {
+    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+    .dstSet = self->handle,
+    .dstBinding = index,
+    .dstArrayElement = 0,
+    .descriptorCount = 1,
+    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    .pImageInfo = &(VkDescriptorImageInfo){
+      .imageView = view,
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    },
+  };
+
+  VkDevice device = gulkan_context_get_device_handle (self->context);
+  vkUpdateDescriptorSets (device, 1, &write_set, 0, NULL);
+}
+
+/**
+ * gulkan_descriptor_set_update_storage_buffer:
+ * @self: a #GulkanDescriptorSet
+ * @index: the binding
+ * @buffer: a #GulkanBuffer created with %VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+ */
+void
+gulkan_descriptor_set_update_storage_buffer (GulkanDescriptorSet *self,
+                                             guint                index,
+                                             GulkanBuffer        *buffer)
+{
+  VkWriteDescriptorSet write_set = {
+    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+    .dstSet = self->handle,
+    .dstBinding = index,
+    .dstArrayElement = 0,
+    .descriptorCount = 1,
+    .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    .pBufferInfo = &(VkDescriptorBufferInfo){
+      .buffer = gulkan_buffer_get_handle (buffer),
+      .offset = 0,
+      .range = VK_WHOLE_SIZE,
+    },
+  };
+
+  VkDevice device = gulkan_context_get_device_handle (self->context);
+  vkUpdateDescriptorSets (device, 1, &write_set, 0, NULL);
+}
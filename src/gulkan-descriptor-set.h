@@ -11,6 +11,7 @@
 #include <glib-object.h>
 #include <vulkan/vulkan.h>
 
+#include "gulkan-buffer.h"
 #include "gulkan-texture.h"
 #include "gulkan-uniform-buffer.h"
 
@@ -34,6 +35,11 @@ gulkan_descriptor_set_bind (GulkanDescriptorSet *self,
                             VkPipelineLayout     layout,
                             VkCommandBuffer      cmd_buffer);
 
+void
+gulkan_descriptor_set_bind_compute (GulkanDescriptorSet *self,
+                                    VkPipelineLayout     layout,
+                                    VkCommandBuffer      cmd_buffer);
+
 void
 gulkan_descriptor_set_update_buffer (GulkanDescriptorSet *self,
                                      guint                index,
@@ -62,6 +68,16 @@ gulkan_descriptor_set_update_view_sampler (GulkanDescriptorSet *self,
                                            VkImageView          view,
                                            VkSampler            sampler);
 
+void
+gulkan_descriptor_set_update_storage_image (GulkanDescriptorSet *self,
+                                            guint                index,
+                                            VkImageView          view);
+
+void
+gulkan_descriptor_set_update_storage_buffer (GulkanDescriptorSet *self,
+                                             guint                index,
+                                             GulkanBuffer        *buffer);
+
 G_END_DECLS
 
 #endif /* GULKAN_DESCRIPTOR_SET_H_ */
@@ -20,22 +20,168 @@ struct _GulkanDevice
 
   VkPhysicalDeviceMemoryProperties memory_properties;
 
-  GulkanQueue *graphics_queue;
-  GulkanQueue *transfer_queue;
+  GPtrArray *queues[GULKAN_QUEUE_TYPE_COUNT];
+  uint32_t   queue_counts[GULKAN_QUEUE_TYPE_COUNT];
 
-  PFN_vkGetMemoryFdKHR extVkGetMemoryFdKHR;
+  PFN_vkGetMemoryFdKHR       extVkGetMemoryFdKHR;
+  PFN_vkGetSemaphoreFdKHR    extVkGetSemaphoreFdKHR;
+  PFN_vkImportSemaphoreFdKHR extVkImportSemaphoreFdKHR;
+
+  PFN_vkCmdBeginRenderingKHR extVkCmdBeginRenderingKHR;
+  PFN_vkCmdEndRenderingKHR   extVkCmdEndRenderingKHR;
+
+  PFN_vkWaitForPresentKHR extVkWaitForPresentKHR;
+
+  PFN_vkCmdDrawIndexedIndirectCountKHR extVkCmdDrawIndexedIndirectCountKHR;
+
+  gboolean incremental_present_enabled;
+  gboolean multi_draw_indirect_enabled;
+  gboolean memory_fd_enabled;
+  gboolean memory_dma_buf_enabled;
+
+  GHashTable *samplers;
+  GMutex      sampler_mutex;
+
+  gboolean ycbcr_conversion_enabled;
+  GArray  *ycbcr_conversions;
+
+  GHashTable *formats;
+  GMutex      format_mutex;
 };
 
+typedef struct
+{
+  VkFormatProperties                properties;
+  gboolean                          queried_modifiers;
+  uint32_t                          modifier_count;
+  VkDrmFormatModifierPropertiesEXT *modifiers;
+} GulkanFormatEntry;
+
+/*
+ * The pNext chain is not part of the key, only the handle of an optional
+ * VkSamplerYcbcrConversionInfo.
+ */
+typedef struct
+{
+  VkSamplerCreateInfo      info;
+  VkSamplerYcbcrConversion conversion;
+} GulkanSamplerKey;
+
+typedef struct
+{
+  GulkanSamplerKey key;
+  VkSampler        handle;
+  guint            ref_count;
+} GulkanSamplerEntry;
+
+typedef struct
+{
+  VkSamplerYcbcrConversionCreateInfo info;
+  VkSamplerYcbcrConversion           handle;
+} GulkanYcbcrConversionEntry;
+
 G_DEFINE_TYPE (GulkanDevice, gulkan_device, G_TYPE_OBJECT)
 
+static guint
+_float_bits (float value)
+{
+  guint32 bits;
+  memcpy (&bits, &value, sizeof (bits));
+  return bits;
+}
+
+static guint
+_sampler_info_hash (gconstpointer key)
+{
+  const GulkanSamplerKey    *sampler_key = key;
+  const VkSamplerCreateInfo *info = &sampler_key->info;
+
+  guint hash = g_direct_hash ((gconstpointer) sampler_key->conversion);
+  hash = hash * 31 + info->flags;
+  hash = hash * 31 + info->magFilter;
+  hash = hash * 31 + info->minFilter;
+  hash = hash * 31 + info->mipmapMode;
+  hash = hash * 31 + info->addressModeU;
+  hash = hash * 31 + info->addressModeV;
+  hash = hash * 31 + info->addressModeW;
+  hash = hash * 31 + _float_bits (info->mipLodBias);
+  hash = hash * 31 + info->anisotropyEnable;
+  hash = hash * 31 + _float_bits (info->maxAnisotropy);
+  hash = hash * 31 + info->compareEnable;
+  hash = hash * 31 + info->compareOp;
+  hash = hash * 31 + _float_bits (info->minLod);
+  hash = hash * 31 + _float_bits (info->maxLod);
+  hash = hash * 31 + info->borderColor;
+  hash = hash * 31 + info->unnormalizedCoordinates;
+
+  return hash;
+}
+
+static gboolean
+_sampler_info_equal (gconstpointer a, gconstpointer b)
+{
+  const GulkanSamplerKey *key_a = a;
+  const GulkanSamplerKey *key_b = b;
+  if (key_a->conversion != key_b->conversion)
+    return FALSE;
+
+  const VkSamplerCreateInfo *x = &key_a->info;
+  const VkSamplerCreateInfo *y = &key_b->info;
+
+  return x->flags == y->flags && x->magFilter == y->magFilter
+         && x->minFilter == y->minFilter && x->mipmapMode == y->mipmapMode
+         && x->addressModeU == y->addressModeU
+         && x->addressModeV == y->addressModeV
+         && x->addressModeW == y->addressModeW
+         && _float_bits (x->mipLodBias) == _float_bits (y->mipLodBias)
+         && x->anisotropyEnable == y->anisotropyEnable
+         && _float_bits (x->maxAnisotropy) == _float_bits (y->maxAnisotropy)
+         && x->compareEnable == y->compareEnable
+         && x->compareOp == y->compareOp
+         && _float_bits (x->minLod) == _float_bits (y->minLod)
+         && _float_bits (x->maxLod) == _float_bits (y->maxLod)
+         && x->borderColor == y->borderColor
+         && x->unnormalizedCoordinates == y->unnormalizedCoordinates;
+}
+
+static void
+_free_format_entry (gpointer data)
+{
+  GulkanFormatEntry *entry = data;
+  g_free (entry->modifiers);
+  g_free (entry);
+}
+
 static void
 gulkan_device_init (GulkanDevice *self)
 {
   self->device = VK_NULL_HANDLE;
   self->physical_device = VK_NULL_HANDLE;
-  self->transfer_queue = NULL;
-  self->graphics_queue = NULL;
+  for (int i = 0; i < GULKAN_QUEUE_TYPE_COUNT; i++)
+    {
+      self->queues[i] = NULL;
+      self->queue_counts[i] = 1;
+    }
   self->extVkGetMemoryFdKHR = 0;
+  self->extVkGetSemaphoreFdKHR = 0;
+  self->extVkImportSemaphoreFdKHR = 0;
+  self->extVkCmdBeginRenderingKHR = 0;
+  self->extVkCmdEndRenderingKHR = 0;
+  self->extVkWaitForPresentKHR = 0;
+  self->extVkCmdDrawIndexedIndirectCountKHR = 0;
+  self->incremental_present_enabled = FALSE;
+  self->multi_draw_indirect_enabled = FALSE;
+  self->memory_fd_enabled = FALSE;
+  self->memory_dma_buf_enabled = FALSE;
+  self->samplers = g_hash_table_new_full (_sampler_info_hash,
+                                          _sampler_info_equal, NULL, g_free);
+  g_mutex_init (&self->sampler_mutex);
+  self->ycbcr_conversion_enabled = FALSE;
+  self->ycbcr_conversions = g_array_new (FALSE, FALSE,
+                                         sizeof (GulkanYcbcrConversionEntry));
+  self->formats = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                         _free_format_entry);
+  g_mutex_init (&self->format_mutex);
 }
 
 GulkanDevice *
@@ -48,8 +194,30 @@ static void
 _finalize (GObject *gobject)
 {
   GulkanDevice *self = GULKAN_DEVICE (gobject);
-  g_clear_object (&self->transfer_queue);
-  g_clear_object (&self->graphics_queue);
+  for (int i = 0; i < GULKAN_QUEUE_TYPE_COUNT; i++)
+    g_clear_pointer (&self->queues[i], g_ptr_array_unref);
+
+  GHashTableIter iter;
+  gpointer       entry;
+  g_hash_table_iter_init (&iter, self->samplers);
+  while (g_hash_table_iter_next (&iter, NULL, &entry))
+    vkDestroySampler (self->device, ((GulkanSamplerEntry *) entry)->handle,
+                      NULL);
+  g_hash_table_unref (self->samplers);
+  g_mutex_clear (&self->sampler_mutex);
+
+  for (guint i = 0; i < self->ycbcr_conversions->len; i++)
+    {
+      GulkanYcbcrConversionEntry *conversion
+        = &g_array_index (self->ycbcr_conversions, GulkanYcbcrConversionEntry,
+                          i);
+      vkDestroySamplerYcbcrConversion (self->device, conversion->handle, NULL);
+    }
+  g_array_unref (self->ycbcr_conversions);
+
+  g_hash_table_unref (self->formats);
+  g_mutex_clear (&self->format_mutex);
+
   vkDestroyDevice (self->device, NULL);
   G_OBJECT_CLASS (gulkan_device_parent_class)->finalize (gobject);
 }
@@ -147,8 +315,8 @@ find_queue_index_for_flags (VkQueueFlagBits          flags,
 
 static gboolean
 _find_queue_families (GulkanDevice *self,
-                      uint32_t     *graphics_queue_index,
-                      uint32_t     *transfer_queue_index)
+                      uint32_t     *families,
+                      uint32_t     *available)
 {
   /* Find the first graphics queue */
   uint32_t num_queues = 0;
@@ -167,6 +335,10 @@ _find_queue_families (GulkanDevice *self,
       return FALSE;
     }
 
+  uint32_t *graphics_queue_index = &families[GULKAN_QUEUE_GRAPHICS];
+  uint32_t *transfer_queue_index = &families[GULKAN_QUEUE_TRANSFER];
+  uint32_t *compute_queue_index = &families[GULKAN_QUEUE_COMPUTE];
+
   *graphics_queue_index = UINT32_MAX;
   if (!find_queue_index_for_flags (VK_QUEUE_GRAPHICS_BIT, (VkQueueFlagBits) 0,
                                    num_queues, queue_family_props,
@@ -199,17 +371,92 @@ _find_queue_families (GulkanDevice *self,
         }
     }
 
+  *compute_queue_index = UINT32_MAX;
+  if (find_queue_index_for_flags (VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT,
+                                  num_queues, queue_family_props,
+                                  compute_queue_index))
+    {
+      g_debug ("Got async compute queue");
+    }
+  else
+    {
+      g_debug ("No async compute queue found, using the graphics queue");
+      *compute_queue_index = *graphics_queue_index;
+    }
+
+  for (int i = 0; i < GULKAN_QUEUE_TYPE_COUNT; i++)
+    available[i] = queue_family_props[families[i]].queueCount;
+
   g_free (queue_family_props);
   return TRUE;
 }
 
+static GulkanQueue *
+_find_queue (GulkanDevice *self, uint32_t family_index, uint32_t queue_index)
+{
+  for (int type = 0; type < GULKAN_QUEUE_TYPE_COUNT; type++)
+    {
+      if (!self->queues[type])
+        continue;
+
+      for (guint i = 0; i < self->queues[type]->len; i++)
+        {
+          GulkanQueue *queue = g_ptr_array_index (self->queues[type], i);
+          if (gulkan_queue_get_family_index (queue) == family_index
+              && gulkan_queue_get_queue_index (queue) == queue_index)
+            return queue;
+        }
+    }
+  return NULL;
+}
+
+/*
+ * Types sharing a family get consecutive queues of it. When a family has
+ * fewer queues than requested, the same GulkanQueue is handed out again.
+ */
+static gboolean
+_create_queues (GulkanDevice   *self,
+                const uint32_t *families,
+                const uint32_t *available)
+{
+  for (int type = 0; type < GULKAN_QUEUE_TYPE_COUNT; type++)
+    {
+      self->queues[type] = g_ptr_array_new_with_free_func (g_object_unref);
+
+      uint32_t offset = 0;
+      for (int prev = 0; prev < type; prev++)
+        if (families[prev] == families[type])
+          offset += self->queue_counts[prev];
+
+      for (uint32_t i = 0; i < self->queue_counts[type]; i++)
+        {
+          uint32_t     queue_index = (offset + i) % available[type];
+          GulkanQueue *queue = _find_queue (self, families[type], queue_index);
+          if (queue)
+            g_object_ref (queue);
+          else
+            queue = gulkan_queue_new_for_index (self, families[type],
+                                                queue_index);
+          g_ptr_array_add (self->queues[type], queue);
+        }
+    }
+
+  return TRUE;
+}
+
 static gboolean
-_create_queues (GulkanDevice *self,
-                uint32_t      graphics_queue_index,
-                uint32_t      transfer_queue_index)
+_initialize_queues (GulkanDevice *self)
 {
-  self->graphics_queue = gulkan_queue_new (self, graphics_queue_index);
-  self->transfer_queue = gulkan_queue_new (self, transfer_queue_index);
+  for (int type = 0; type < GULKAN_QUEUE_TYPE_COUNT; type++)
+    for (guint i = 0; i < self->queues[type]->len; i++)
+      {
+        GulkanQueue *queue = g_ptr_array_index (self->queues[type], i);
+        if (gulkan_queue_get_handle (queue) != VK_NULL_HANDLE)
+          continue;
+        if (!gulkan_queue_initialize (queue))
+          return FALSE;
+      }
+
   return TRUE;
 }
 
@@ -272,6 +519,61 @@ _init_device_extensions (GulkanDevice *self,
   return TRUE;
 }
 
+/*
+ * One create info per distinct family. Queue priorities follow the order
+ * in which _create_queues hands out the queues of a family.
+ */
+static uint32_t
+_get_queue_create_infos (GulkanDevice            *self,
+                         const uint32_t          *families,
+                         const uint32_t          *available,
+                         VkDeviceQueueCreateInfo *queue_infos,
+                         float                  **priorities)
+{
+  static const float type_priorities[GULKAN_QUEUE_TYPE_COUNT] = {
+    [GULKAN_QUEUE_GRAPHICS] = 1.0f,
+    [GULKAN_QUEUE_TRANSFER] = 0.8f,
+    [GULKAN_QUEUE_COMPUTE] = 0.9f,
+  };
+
+  uint32_t num_infos = 0;
+  for (int type = 0; type < GULKAN_QUEUE_TYPE_COUNT; type++)
+    {
+      gboolean seen = FALSE;
+      for (int prev = 0; prev < type; prev++)
+        if (families[prev] == families[type])
+          seen = TRUE;
+      if (seen)
+        continue;
+
+      uint32_t count = 0;
+      for (int t = type; t < GULKAN_QUEUE_TYPE_COUNT; t++)
+        if (families[t] == families[type])
+          count += self->queue_counts[t];
+      count = MIN (count, available[type]);
+
+      float   *family_priorities = g_new (float, count);
+      uint32_t q = 0;
+      for (int t = type; t < GULKAN_QUEUE_TYPE_COUNT; t++)
+        if (families[t] == families[type])
+          for (uint32_t i = 0; i < self->queue_counts[t] && q < count; i++)
+            family_priorities[q++] = type_priorities[t];
+
+      g_debug ("Creating %d queues in family %d", count, families[type]);
+
+      priorities[num_infos] = family_priorities;
+      queue_infos[num_infos] = (VkDeviceQueueCreateInfo){
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = families[type],
+        .queueCount = count,
+        .pQueuePriorities = family_priorities,
+      };
+      num_infos++;
+    }
+
+  return num_infos;
+}
+
 /**
  * gulkan_device_create:
  * @self: a #GulkanDevice
@@ -293,13 +595,12 @@ gulkan_device_create (GulkanDevice    *self,
   if (!_get_physical_device_props (self))
     return FALSE;
 
-  uint32_t graphics_queue_index;
-  uint32_t transfer_queue_index;
-  if (!_find_queue_families (self, &graphics_queue_index,
-                             &transfer_queue_index))
+  uint32_t families[GULKAN_QUEUE_TYPE_COUNT];
+  uint32_t available[GULKAN_QUEUE_TYPE_COUNT];
+  if (!_find_queue_families (self, families, available))
     return FALSE;
 
-  if (!_create_queues (self, graphics_queue_index, transfer_queue_index))
+  if (!_create_queues (self, families, available))
     return FALSE;
 
   uint32_t num_extensions = 0;
@@ -317,6 +618,10 @@ gulkan_device_create (GulkanDevice    *self,
     }
 
   gboolean requested_multiview = FALSE;
+  gboolean requested_dynamic_rendering = FALSE;
+  gboolean requested_present_id = FALSE;
+  gboolean requested_present_wait = FALSE;
+  gboolean requested_draw_indirect_count = FALSE;
 
   if (num_enabled > 0)
     {
@@ -327,6 +632,47 @@ gulkan_device_create (GulkanDevice    *self,
             {
               requested_multiview = TRUE;
             }
+          else if (strcmp (extension_names[i],
+                           VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)
+                   == 0)
+            {
+              requested_dynamic_rendering = TRUE;
+            }
+          else if (strcmp (extension_names[i], VK_KHR_PRESENT_ID_EXTENSION_NAME)
+                   == 0)
+            {
+              requested_present_id = TRUE;
+            }
+          else if (strcmp (extension_names[i],
+                           VK_KHR_PRESENT_WAIT_EXTENSION_NAME)
+                   == 0)
+            {
+              requested_present_wait = TRUE;
+            }
+          else if (strcmp (extension_names[i],
+                           VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME)
+                   == 0)
+            {
+              self->incremental_present_enabled = TRUE;
+            }
+          else if (strcmp (extension_names[i],
+                           VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)
+                   == 0)
+            {
+              requested_draw_indirect_count = TRUE;
+            }
+          else if (strcmp (extension_names[i],
+                           VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME)
+                   == 0)
+            {
+              self->memory_fd_enabled = TRUE;
+            }
+          else if (strcmp (extension_names[i],
+                           VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME)
+                   == 0)
+            {
+              self->memory_dma_buf_enabled = TRUE;
+            }
           g_debug ("%s", extension_names[i]);
         }
     }
@@ -334,30 +680,25 @@ gulkan_device_create (GulkanDevice    *self,
   VkPhysicalDeviceFeatures physical_device_features;
   vkGetPhysicalDeviceFeatures (self->physical_device,
                                &physical_device_features);
-
-  VkDeviceCreateInfo device_info =
-    {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-      .queueCreateInfoCount = 2,
-      .pQueueCreateInfos =
-          (VkDeviceQueueCreateInfo[]) {
-            {
-              .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-              .queueFamilyIndex = gulkan_queue_get_family_index(self->graphics_queue),
-              .queueCount = 1,
-              .pQueuePriorities = (const float[]) { 1.0f }
-            },
-            {
-              .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-              .queueFamilyIndex = gulkan_queue_get_family_index (self->transfer_queue),
-              .queueCount = 1,
-              .pQueuePriorities = (const float[]) { 0.8f }
-            },
-          },
-      .enabledExtensionCount = num_enabled,
-      .ppEnabledExtensionNames = (const char* const*) extension_names,
-      .pEnabledFeatures = &physical_device_features,
-    };
+  self->multi_draw_indirect_enabled = physical_device_features
+                                        .multiDrawIndirect;
+
+  VkDeviceQueueCreateInfo queue_infos[GULKAN_QUEUE_TYPE_COUNT];
+  float                  *priorities[GULKAN_QUEUE_TYPE_COUNT];
+  uint32_t                num_queue_infos = _get_queue_create_infos (self,
+                                                                     families,
+                                                                     available,
+                                                                     queue_infos,
+                                                                     priorities);
+
+  VkDeviceCreateInfo device_info = {
+    .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+    .queueCreateInfoCount = num_queue_infos,
+    .pQueueCreateInfos = queue_infos,
+    .enabledExtensionCount = num_enabled,
+    .ppEnabledExtensionNames = (const char *const *) extension_names,
+    .pEnabledFeatures = &physical_device_features,
+  };
 
   VkPhysicalDeviceMultiviewFeatures multiview_features = {
     .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES,
@@ -371,15 +712,84 @@ gulkan_device_create (GulkanDevice    *self,
       device_info.pNext = (const void *) &multiview_features;
     }
 
+  /* Core in 1.1, but optional. Needed for sampling multi-planar YUV images */
+  VkPhysicalDeviceSamplerYcbcrConversionFeatures ycbcr_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES,
+  };
+  VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+  };
+  /* Present wait is only useful along with present ids to wait for */
+  VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+  };
+  VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+    .pNext = &present_id_features,
+  };
+  VkPhysicalDeviceFeatures2 features2 = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = &ycbcr_features,
+  };
+  void **query_next = &ycbcr_features.pNext;
+  if (requested_dynamic_rendering)
+    {
+      *query_next = &dynamic_rendering_features;
+      query_next = &dynamic_rendering_features.pNext;
+    }
+  if (requested_present_id && requested_present_wait)
+    *query_next = &present_wait_features;
+  vkGetPhysicalDeviceFeatures2 (self->physical_device, &features2);
+
+  if (ycbcr_features.samplerYcbcrConversion)
+    {
+      ycbcr_features.pNext = (void *) device_info.pNext;
+      device_info.pNext = (const void *) &ycbcr_features;
+      self->ycbcr_conversion_enabled = TRUE;
+    }
+
+  if (dynamic_rendering_features.dynamicRendering)
+    {
+      dynamic_rendering_features.pNext = (void *) device_info.pNext;
+      device_info.pNext = (const void *) &dynamic_rendering_features;
+    }
+
+  gboolean enable_present_wait = present_id_features.presentId
+                                 && present_wait_features.presentWait;
+  if (enable_present_wait)
+    {
+      present_id_features.pNext = (void *) device_info.pNext;
+      present_wait_features.pNext = &present_id_features;
+      device_info.pNext = (const void *) &present_wait_features;
+    }
+
   VkResult res = vkCreateDevice (self->physical_device, &device_info, NULL,
                                  &self->device);
+
+  for (uint32_t i = 0; i < num_queue_infos; i++)
+    g_free (priorities[i]);
+
   vk_check_error ("vkCreateDevice", res, FALSE);
 
-  if (!gulkan_queue_initialize (self->graphics_queue))
+  if (!_initialize_queues (self))
     return FALSE;
 
-  if (!gulkan_queue_initialize (self->transfer_queue))
-    return FALSE;
+  if (dynamic_rendering_features.dynamicRendering)
+    {
+      self->extVkCmdBeginRenderingKHR = (PFN_vkCmdBeginRenderingKHR)
+        vkGetDeviceProcAddr (self->device, "vkCmdBeginRenderingKHR");
+      self->extVkCmdEndRenderingKHR = (PFN_vkCmdEndRenderingKHR)
+        vkGetDeviceProcAddr (self->device, "vkCmdEndRenderingKHR");
+    }
+
+  if (enable_present_wait)
+    self->extVkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)
+      vkGetDeviceProcAddr (self->device, "vkWaitForPresentKHR");
+
+  if (requested_draw_indirect_count)
+    self->extVkCmdDrawIndexedIndirectCountKHR
+      = (PFN_vkCmdDrawIndexedIndirectCountKHR)
+        vkGetDeviceProcAddr (self->device, "vkCmdDrawIndexedIndirectCountKHR");
 
   if (num_enabled > 0)
     {
@@ -414,13 +824,20 @@ gulkan_device_create_from_vk (GulkanDevice    *self,
   if (!_get_physical_device_props (self))
     return FALSE;
 
-  if (!_create_queues (self, graphics_queue_index, transfer_queue_index))
-    return FALSE;
+  /* We don't know how many queues the external device has */
+  const uint32_t families[GULKAN_QUEUE_TYPE_COUNT] = {
+    [GULKAN_QUEUE_GRAPHICS] = graphics_queue_index,
+    [GULKAN_QUEUE_TRANSFER] = transfer_queue_index,
+    [GULKAN_QUEUE_COMPUTE] = graphics_queue_index,
+  };
+  const uint32_t available[GULKAN_QUEUE_TYPE_COUNT] = {1, 1, 1};
+  for (int i = 0; i < GULKAN_QUEUE_TYPE_COUNT; i++)
+    self->queue_counts[i] = 1;
 
-  if (!gulkan_queue_initialize (self->graphics_queue))
+  if (!_create_queues (self, families, available))
     return FALSE;
 
-  if (!gulkan_queue_initialize (self->transfer_queue))
+  if (!_initialize_queues (self))
     return FALSE;
 
   return TRUE;
@@ -485,7 +902,7 @@ gulkan_device_get_physical_handle (GulkanDevice *self)
 GulkanQueue *
 gulkan_device_get_graphics_queue (GulkanDevice *self)
 {
-  return self->graphics_queue;
+  return gulkan_device_get_queue (self, GULKAN_QUEUE_GRAPHICS, 0);
 }
 
 /**
@@ -497,13 +914,98 @@ gulkan_device_get_graphics_queue (GulkanDevice *self)
 GulkanQueue *
 gulkan_device_get_transfer_queue (GulkanDevice *self)
 {
-  return self->transfer_queue;
+  return gulkan_device_get_queue (self, GULKAN_QUEUE_TRANSFER, 0);
+}
+
+/**
+ * gulkan_device_get_compute_queue:
+ * @self: a #GulkanDevice
+ *
+ * Prefers a queue from a family without graphics support, so work can run
+ * concurrently with rendering. Falls back to a queue of the graphics family.
+ *
+ * Returns: (transfer none): a #GulkanQueue
+ */
+GulkanQueue *
+gulkan_device_get_compute_queue (GulkanDevice *self)
+{
+  return gulkan_device_get_queue (self, GULKAN_QUEUE_COMPUTE, 0);
+}
+
+/**
+ * gulkan_device_get_queue:
+ * @self: a #GulkanDevice
+ * @type: a #GulkanQueueType
+ * @index: index of the queue, smaller than the configured count
+ *
+ * Returns: (transfer none): a #GulkanQueue or %NULL
+ */
+GulkanQueue *
+gulkan_device_get_queue (GulkanDevice   *self,
+                         GulkanQueueType type,
+                         uint32_t        index)
+{
+  GPtrArray *queues = self->queues[type];
+  if (!queues || index >= queues->len)
+    return NULL;
+  return g_ptr_array_index (queues, index);
+}
+
+/**
+ * gulkan_device_set_queue_count:
+ * @self: a #GulkanDevice
+ * @type: a #GulkanQueueType
+ * @count: number of queues to create, at least 1
+ *
+ * Needs to be called before gulkan_device_create(). Each queue has its own
+ * command pool. If the family has fewer queues, queues are shared.
+ */
+void
+gulkan_device_set_queue_count (GulkanDevice   *self,
+                               GulkanQueueType type,
+                               uint32_t        count)
+{
+  g_return_if_fail (count > 0);
+  g_return_if_fail (self->device == VK_NULL_HANDLE);
+  self->queue_counts[type] = count;
+}
+
+/**
+ * gulkan_device_get_queue_count:
+ * @self: a #GulkanDevice
+ * @type: a #GulkanQueueType
+ *
+ * Returns: the number of queues of @type
+ */
+uint32_t
+gulkan_device_get_queue_count (GulkanDevice *self, GulkanQueueType type)
+{
+  return self->queues[type] ? self->queues[type]->len : 0;
 }
 
 gboolean
 gulkan_device_get_memory_fd (GulkanDevice  *self,
                              VkDeviceMemory image_memory,
                              int           *fd)
+{
+  return gulkan_device_export_memory_fd (
+    self, image_memory, VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT, fd);
+}
+
+/**
+ * gulkan_device_export_memory_fd:
+ * @self: a #GulkanDevice
+ * @memory: memory allocated with a #VkExportMemoryAllocateInfo
+ * @handle_type: one of the handle types @memory was allocated for
+ * @fd: (out): the exported file descriptor, owned by the caller
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_device_export_memory_fd (GulkanDevice                      *self,
+                                VkDeviceMemory                     memory,
+                                VkExternalMemoryHandleTypeFlagBits handle_type,
+                                int                               *fd)
 {
   if (!self->extVkGetMemoryFdKHR)
     self->extVkGetMemoryFdKHR = (PFN_vkGetMemoryFdKHR)
@@ -517,19 +1019,356 @@ gulkan_device_get_memory_fd (GulkanDevice  *self,
 
   VkMemoryGetFdInfoKHR vkFDInfo = {
     .sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR,
-    .memory = image_memory,
-    .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT_KHR,
+    .memory = memory,
+    .handleType = handle_type,
   };
 
   if (self->extVkGetMemoryFdKHR (self->device, &vkFDInfo, fd) != VK_SUCCESS)
     {
       g_printerr ("Gulkan Device: Could not get file descriptor for memory!\n");
-      g_object_unref (self);
       return FALSE;
     }
   return TRUE;
 }
 
+/**
+ * gulkan_device_supports_dynamic_rendering:
+ * @self: a #GulkanDevice
+ *
+ * Dynamic rendering is enabled when %VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+ * along with its dependencies %VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME and
+ * %VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME, was requested on creation and
+ * the device supports the feature.
+ *
+ * Returns: %TRUE if gulkan_device_cmd_begin_rendering() can be used
+ */
+gboolean
+gulkan_device_supports_dynamic_rendering (GulkanDevice *self)
+{
+  return self->extVkCmdBeginRenderingKHR != NULL
+         && self->extVkCmdEndRenderingKHR != NULL;
+}
+
+/**
+ * gulkan_device_cmd_begin_rendering:
+ * @self: a #GulkanDevice
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ * @info: the attachments to render to
+ *
+ * Begins a render pass instance without #VkRenderPass or #VkFramebuffer
+ * objects. Requires gulkan_device_supports_dynamic_rendering().
+ */
+void
+gulkan_device_cmd_begin_rendering (GulkanDevice             *self,
+                                   VkCommandBuffer           cmd_buffer,
+                                   const VkRenderingInfoKHR *info)
+{
+  g_return_if_fail (self->extVkCmdBeginRenderingKHR != NULL);
+  self->extVkCmdBeginRenderingKHR (cmd_buffer, info);
+}
+
+/**
+ * gulkan_device_cmd_end_rendering:
+ * @self: a #GulkanDevice
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ */
+void
+gulkan_device_cmd_end_rendering (GulkanDevice *self, VkCommandBuffer cmd_buffer)
+{
+  g_return_if_fail (self->extVkCmdEndRenderingKHR != NULL);
+  self->extVkCmdEndRenderingKHR (cmd_buffer);
+}
+
+/**
+ * gulkan_device_supports_present_wait:
+ * @self: a #GulkanDevice
+ *
+ * Present wait is enabled when %VK_KHR_PRESENT_ID_EXTENSION_NAME and
+ * %VK_KHR_PRESENT_WAIT_EXTENSION_NAME were requested on creation and the
+ * device supports both features.
+ *
+ * Returns: %TRUE if presents can be tagged with ids and waited for
+ */
+gboolean
+gulkan_device_supports_present_wait (GulkanDevice *self)
+{
+  return self->extVkWaitForPresentKHR != NULL;
+}
+
+/**
+ * gulkan_device_supports_incremental_present:
+ * @self: a #GulkanDevice
+ *
+ * Returns: %TRUE if %VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME was requested
+ * on creation and is supported, so presents can pass damaged regions
+ */
+gboolean
+gulkan_device_supports_incremental_present (GulkanDevice *self)
+{
+  return self->incremental_present_enabled;
+}
+
+/**
+ * gulkan_device_supports_memory_handle_type:
+ * @self: a #GulkanDevice
+ * @handle_type: %VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT or
+ * %VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT
+ *
+ * Opaque fds need %VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME, dmabufs
+ * additionally %VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME.
+ *
+ * Returns: %TRUE if the extensions for @handle_type were requested on
+ * creation and are supported
+ */
+gboolean
+gulkan_device_supports_memory_handle_type (
+  GulkanDevice                      *self,
+  VkExternalMemoryHandleTypeFlagBits handle_type)
+{
+  switch (handle_type)
+    {
+      case VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT:
+        return self->memory_fd_enabled;
+      case VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT:
+        return self->memory_fd_enabled && self->memory_dma_buf_enabled;
+      default:
+        return FALSE;
+    }
+}
+
+/**
+ * gulkan_device_supports_multi_draw_indirect:
+ * @self: a #GulkanDevice
+ *
+ * Returns: %TRUE if a single indirect draw may issue more than one command
+ */
+gboolean
+gulkan_device_supports_multi_draw_indirect (GulkanDevice *self)
+{
+  return self->multi_draw_indirect_enabled;
+}
+
+/**
+ * gulkan_device_supports_draw_indirect_count:
+ * @self: a #GulkanDevice
+ *
+ * Returns: %TRUE if %VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME was requested
+ * on creation and is supported, so the draw count can be read from a buffer
+ */
+gboolean
+gulkan_device_supports_draw_indirect_count (GulkanDevice *self)
+{
+  return self->extVkCmdDrawIndexedIndirectCountKHR != NULL;
+}
+
+/**
+ * gulkan_device_cmd_draw_indexed_indirect_count:
+ * @self: a #GulkanDevice
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ * @buffer: the buffer holding #VkDrawIndexedIndirectCommand entries
+ * @offset: byte offset of the first command in @buffer
+ * @count_buffer: the buffer holding the draw count
+ * @count_offset: byte offset of the draw count in @count_buffer
+ * @max_draw_count: upper bound for the draw count
+ * @stride: byte stride between commands
+ *
+ * Requires gulkan_device_supports_draw_indirect_count().
+ */
+void
+gulkan_device_cmd_draw_indexed_indirect_count (GulkanDevice   *self,
+                                               VkCommandBuffer cmd_buffer,
+                                               VkBuffer        buffer,
+                                               VkDeviceSize    offset,
+                                               VkBuffer        count_buffer,
+                                               VkDeviceSize    count_offset,
+                                               uint32_t        max_draw_count,
+                                               uint32_t        stride)
+{
+  g_return_if_fail (self->extVkCmdDrawIndexedIndirectCountKHR != NULL);
+  self->extVkCmdDrawIndexedIndirectCountKHR (cmd_buffer, buffer, offset,
+                                             count_buffer, count_offset,
+                                             max_draw_count, stride);
+}
+
+/**
+ * gulkan_device_wait_for_present:
+ * @self: a #GulkanDevice
+ * @swapchain: a #VkSwapchainKHR
+ * @present_id: the id passed in #VkPresentIdKHR
+ * @timeout: timeout in nanoseconds
+ *
+ * Waits until the present with @present_id, or a later one, is visible.
+ * Requires gulkan_device_supports_present_wait().
+ *
+ * Returns: the #VkResult of vkWaitForPresentKHR
+ */
+VkResult
+gulkan_device_wait_for_present (GulkanDevice  *self,
+                                VkSwapchainKHR swapchain,
+                                uint64_t       present_id,
+                                uint64_t       timeout)
+{
+  if (!self->extVkWaitForPresentKHR)
+    return VK_ERROR_EXTENSION_NOT_PRESENT;
+
+  return self->extVkWaitForPresentKHR (self->device, swapchain, present_id,
+                                       timeout);
+}
+
+/**
+ * gulkan_device_supports_semaphore_fd:
+ * @self: a #GulkanDevice
+ * @handle_type: %VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT or
+ * %VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT
+ *
+ * Returns: %TRUE if semaphores of @handle_type can be exported and imported
+ */
+gboolean
+gulkan_device_supports_semaphore_fd (
+  GulkanDevice                         *self,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type)
+{
+  VkPhysicalDeviceExternalSemaphoreInfo info = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO,
+    .handleType = handle_type,
+  };
+  VkExternalSemaphoreProperties props = {
+    .sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES,
+  };
+  vkGetPhysicalDeviceExternalSemaphoreProperties (self->physical_device, &info,
+                                                  &props);
+
+  VkExternalSemaphoreFeatureFlags needed
+    = VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT
+      | VK_EXTERNAL_SEMAPHORE_FEATURE_IMPORTABLE_BIT;
+  return (props.externalSemaphoreFeatures & needed) == needed;
+}
+
+/**
+ * gulkan_device_create_export_semaphore:
+ * @self: a #GulkanDevice
+ * @handle_type: the handle type the semaphore will be exported as
+ *
+ * Returns: a new #VkSemaphore owned by the caller, or VK_NULL_HANDLE
+ */
+VkSemaphore
+gulkan_device_create_export_semaphore (
+  GulkanDevice                         *self,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type)
+{
+  VkExportSemaphoreCreateInfo export_info = {
+    .sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO,
+    .handleTypes = handle_type,
+  };
+  VkSemaphoreCreateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &export_info,
+  };
+
+  VkSemaphore semaphore;
+  VkResult    res = vkCreateSemaphore (self->device, &info, NULL, &semaphore);
+  vk_check_error ("vkCreateSemaphore", res, VK_NULL_HANDLE);
+
+  return semaphore;
+}
+
+/**
+ * gulkan_device_export_semaphore_fd:
+ * @self: a #GulkanDevice
+ * @semaphore: a semaphore from gulkan_device_create_export_semaphore()
+ * @handle_type: the handle type the semaphore was created for
+ * @fd: (out): the exported file descriptor, owned by the caller
+ *
+ * A sync_file can only be exported after a signal operation was submitted.
+ * Exporting it resets the semaphore, so it can be signaled again.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_device_export_semaphore_fd (
+  GulkanDevice                         *self,
+  VkSemaphore                           semaphore,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type,
+  int                                  *fd)
+{
+  if (!self->extVkGetSemaphoreFdKHR)
+    self->extVkGetSemaphoreFdKHR = (PFN_vkGetSemaphoreFdKHR)
+      vkGetDeviceProcAddr (self->device, "vkGetSemaphoreFdKHR");
+
+  if (!self->extVkGetSemaphoreFdKHR)
+    {
+      g_printerr ("Gulkan Device: Could not load vkGetSemaphoreFdKHR\n");
+      return FALSE;
+    }
+
+  VkSemaphoreGetFdInfoKHR info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR,
+    .semaphore = semaphore,
+    .handleType = handle_type,
+  };
+
+  VkResult res = self->extVkGetSemaphoreFdKHR (self->device, &info, fd);
+  vk_check_error ("vkGetSemaphoreFdKHR", res, FALSE);
+
+  return TRUE;
+}
+
+/**
+ * gulkan_device_import_semaphore_fd:
+ * @self: a #GulkanDevice
+ * @fd: a sync_file or opaque semaphore fd. Ownership is transferred to Vulkan
+ * on success.
+ * @handle_type: the handle type of @fd
+ *
+ * Sync files are imported temporarily, so the payload is consumed by the
+ * first wait on the semaphore.
+ *
+ * Returns: a new #VkSemaphore owned by the caller, or VK_NULL_HANDLE
+ */
+VkSemaphore
+gulkan_device_import_semaphore_fd (
+  GulkanDevice                         *self,
+  int                                   fd,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type)
+{
+  if (!self->extVkImportSemaphoreFdKHR)
+    self->extVkImportSemaphoreFdKHR = (PFN_vkImportSemaphoreFdKHR)
+      vkGetDeviceProcAddr (self->device, "vkImportSemaphoreFdKHR");
+
+  if (!self->extVkImportSemaphoreFdKHR)
+    {
+      g_printerr ("Gulkan Device: Could not load vkImportSemaphoreFdKHR\n");
+      return VK_NULL_HANDLE;
+    }
+
+  VkSemaphoreCreateInfo semaphore_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+  };
+  VkSemaphore semaphore;
+  VkResult    res = vkCreateSemaphore (self->device, &semaphore_info, NULL,
+                                       &semaphore);
+  vk_check_error ("vkCreateSemaphore", res, VK_NULL_HANDLE);
+
+  VkImportSemaphoreFdInfoKHR import_info = {
+    .sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR,
+    .semaphore = semaphore,
+    .flags = handle_type == VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT
+               ? VK_SEMAPHORE_IMPORT_TEMPORARY_BIT
+               : 0,
+    .handleType = handle_type,
+    .fd = fd,
+  };
+
+  res = self->extVkImportSemaphoreFdKHR (self->device, &import_info);
+  if (gulkan_has_error (res, "vkImportSemaphoreFdKHR", __FILE__, __LINE__))
+    {
+      vkDestroySemaphore (self->device, semaphore, NULL);
+      return VK_NULL_HANDLE;
+    }
+
+  return semaphore;
+}
+
 void
 gulkan_device_wait_idle (GulkanDevice *self)
 {
@@ -650,6 +1489,327 @@ gulkan_device_get_physical_device_properties (GulkanDevice *self)
   return &self->physical_props;
 }
 
+/**
+ * gulkan_device_request_sampler:
+ * @self: a #GulkanDevice
+ * @info: a #VkSamplerCreateInfo
+ *
+ * Samplers are shared between all callers requesting the same parameters.
+ * Each request needs to be paired with gulkan_device_release_sampler().
+ * The only supported pNext is a #VkSamplerYcbcrConversionInfo.
+ *
+ * Returns: (transfer none): a #VkSampler or VK_NULL_HANDLE on failure.
+ */
+VkSampler
+gulkan_device_request_sampler (GulkanDevice              *self,
+                               const VkSamplerCreateInfo *info)
+{
+  GulkanSamplerKey key = {
+    .info = *info,
+    .conversion = VK_NULL_HANDLE,
+  };
+  key.info.pNext = NULL;
+
+  const VkSamplerYcbcrConversionInfo *conversion_info = info->pNext;
+  if (conversion_info != NULL)
+    {
+      if (conversion_info->sType
+            != VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO
+          || conversion_info->pNext != NULL)
+        {
+          g_warning ("Cached samplers only support a YCbCr conversion in "
+                     "their pNext chain.\n");
+          return VK_NULL_HANDLE;
+        }
+      key.conversion = conversion_info->conversion;
+    }
+
+  g_mutex_lock (&self->sampler_mutex);
+
+  GulkanSamplerEntry *entry = g_hash_table_lookup (self->samplers, &key);
+  if (entry)
+    {
+      entry->ref_count++;
+      g_mutex_unlock (&self->sampler_mutex);
+      return entry->handle;
+    }
+
+  VkSampler sampler;
+  VkResult  res = vkCreateSampler (self->device, info, NULL, &sampler);
+  if (gulkan_has_error (res, "vkCreateSampler", __FILE__, __LINE__))
+    {
+      g_mutex_unlock (&self->sampler_mutex);
+      return VK_NULL_HANDLE;
+    }
+
+  entry = g_new (GulkanSamplerEntry, 1);
+  entry->key = key;
+  entry->handle = sampler;
+  entry->ref_count = 1;
+  g_hash_table_insert (self->samplers, &entry->key, entry);
+
+  g_debug ("Created shared sampler, %d in cache.",
+           g_hash_table_size (self->samplers));
+
+  g_mutex_unlock (&self->sampler_mutex);
+
+  return sampler;
+}
+
+static gboolean
+_sampler_entry_has_handle (gpointer key, gpointer value, gpointer user_data)
+{
+  (void) key;
+  return ((GulkanSamplerEntry *) value)->handle == *(VkSampler *) user_data;
+}
+
+void
+gulkan_device_release_sampler (GulkanDevice *self, VkSampler sampler)
+{
+  g_mutex_lock (&self->sampler_mutex);
+
+  GulkanSamplerEntry *entry = g_hash_table_find (self->samplers,
+                                                 _sampler_entry_has_handle,
+                                                 &sampler);
+  if (!entry)
+    {
+      g_mutex_unlock (&self->sampler_mutex);
+      g_warning ("Trying to release a sampler that is not cached.\n");
+      return;
+    }
+
+  if (--entry->ref_count == 0)
+    {
+      vkDestroySampler (self->device, entry->handle, NULL);
+      g_hash_table_remove (self->samplers, &entry->key);
+    }
+
+  g_mutex_unlock (&self->sampler_mutex);
+}
+
+static gboolean
+_ycbcr_conversion_info_equal (const VkSamplerYcbcrConversionCreateInfo *a,
+                              const VkSamplerYcbcrConversionCreateInfo *b)
+{
+  return a->format == b->format && a->ycbcrModel == b->ycbcrModel
+         && a->ycbcrRange == b->ycbcrRange
+         && a->components.r == b->components.r
+         && a->components.g == b->components.g
+         && a->components.b == b->components.b
+         && a->components.a == b->components.a
+         && a->xChromaOffset == b->xChromaOffset
+         && a->yChromaOffset == b->yChromaOffset
+         && a->chromaFilter == b->chromaFilter
+         && a->forceExplicitReconstruction == b->forceExplicitReconstruction;
+}
+
+/**
+ * gulkan_device_supports_ycbcr_conversion:
+ * @self: a #GulkanDevice
+ *
+ * Returns: %TRUE if the samplerYcbcrConversion feature is enabled
+ */
+gboolean
+gulkan_device_supports_ycbcr_conversion (GulkanDevice *self)
+{
+  return self->ycbcr_conversion_enabled;
+}
+
+/**
+ * gulkan_device_request_ycbcr_conversion:
+ * @self: a #GulkanDevice
+ * @info: a #VkSamplerYcbcrConversionCreateInfo without pNext chain
+ *
+ * Conversions are created once per set of parameters and live as long as the
+ * device, since video streams keep using the same few of them.
+ *
+ * Returns: (transfer none): a #VkSamplerYcbcrConversion or VK_NULL_HANDLE
+ * if the feature is not available.
+ */
+VkSamplerYcbcrConversion
+gulkan_device_request_ycbcr_conversion (
+  GulkanDevice                             *self,
+  const VkSamplerYcbcrConversionCreateInfo *info)
+{
+  if (!self->ycbcr_conversion_enabled)
+    {
+      g_printerr ("samplerYcbcrConversion feature not enabled.\n");
+      return VK_NULL_HANDLE;
+    }
+
+  g_mutex_lock (&self->sampler_mutex);
+
+  for (guint i = 0; i < self->ycbcr_conversions->len; i++)
+    {
+      GulkanYcbcrConversionEntry *entry
+        = &g_array_index (self->ycbcr_conversions, GulkanYcbcrConversionEntry,
+                          i);
+      if (_ycbcr_conversion_info_equal (&entry->info, info))
+        {
+          g_mutex_unlock (&self->sampler_mutex);
+          return entry->handle;
+        }
+    }
+
+  GulkanYcbcrConversionEntry entry = {
+    .info = *info,
+  };
+  entry.info.pNext = NULL;
+
+  VkResult res = vkCreateSamplerYcbcrConversion (self->device, info, NULL,
+                                                 &entry.handle);
+  if (gulkan_has_error (res, "vkCreateSamplerYcbcrConversion", __FILE__,
+                        __LINE__))
+    {
+      g_mutex_unlock (&self->sampler_mutex);
+      return VK_NULL_HANDLE;
+    }
+
+  g_array_append_val (self->ycbcr_conversions, entry);
+
+  g_mutex_unlock (&self->sampler_mutex);
+
+  return entry.handle;
+}
+
+/* Needs to be called with the format mutex locked */
+static GulkanFormatEntry *
+_get_format_entry (GulkanDevice *self, VkFormat format)
+{
+  GulkanFormatEntry *entry = g_hash_table_lookup (self->formats,
+                                                  GINT_TO_POINTER (format));
+  if (entry)
+    return entry;
+
+  entry = g_new0 (GulkanFormatEntry, 1);
+  vkGetPhysicalDeviceFormatProperties (self->physical_device, format,
+                                       &entry->properties);
+  g_hash_table_insert (self->formats, GINT_TO_POINTER (format), entry);
+
+  return entry;
+}
+
+/* Needs to be called with the format mutex locked */
+static void
+_query_modifiers (GulkanDevice *self, VkFormat format, GulkanFormatEntry *entry)
+{
+  VkDrmFormatModifierPropertiesListEXT modifier_prop_list = {
+    .sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT,
+  };
+  VkFormatProperties2 format_props = {
+    .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
+    .pNext = &modifier_prop_list,
+  };
+  vkGetPhysicalDeviceFormatProperties2 (self->physical_device, format,
+                                        &format_props);
+
+  entry->modifiers = g_new0 (VkDrmFormatModifierPropertiesEXT,
+                             modifier_prop_list.drmFormatModifierCount);
+  modifier_prop_list.pDrmFormatModifierProperties = entry->modifiers;
+  vkGetPhysicalDeviceFormatProperties2 (self->physical_device, format,
+                                        &format_props);
+
+  entry->modifier_count = modifier_prop_list.drmFormatModifierCount;
+  entry->queried_modifiers = TRUE;
+
+  g_debug ("%s: %d supported modifiers:", vk_format_string (format),
+           entry->modifier_count);
+  for (uint32_t i = 0; i < entry->modifier_count; i++)
+    {
+      VkDrmFormatModifierPropertiesEXT *m = &entry->modifiers[i];
+      g_debug ("modifier %lu: planes %d tiling features %d,",
+               m->drmFormatModifier, m->drmFormatModifierPlaneCount,
+               m->drmFormatModifierTilingFeatures);
+    }
+}
+
+/**
+ * gulkan_device_get_format_properties:
+ * @self: a #GulkanDevice
+ * @format: a #VkFormat
+ *
+ * Format properties are queried from the driver once and cached.
+ *
+ * Returns: the #VkFormatProperties of @format
+ */
+VkFormatProperties
+gulkan_device_get_format_properties (GulkanDevice *self, VkFormat format)
+{
+  g_mutex_lock (&self->format_mutex);
+  VkFormatProperties properties = _get_format_entry (self, format)->properties;
+  g_mutex_unlock (&self->format_mutex);
+  return properties;
+}
+
+gboolean
+gulkan_device_format_supports (GulkanDevice        *self,
+                               VkFormat             format,
+                               VkImageTiling        tiling,
+                               VkFormatFeatureFlags features)
+{
+  VkFormatProperties properties = gulkan_device_get_format_properties (self,
+                                                                       format);
+  switch (tiling)
+    {
+      case VK_IMAGE_TILING_OPTIMAL:
+        return (properties.optimalTilingFeatures & features) == features;
+      case VK_IMAGE_TILING_LINEAR:
+        return (properties.linearTilingFeatures & features) == features;
+      default:
+        g_warning ("Unhandled tiling %d.\n", tiling);
+        return FALSE;
+    }
+}
+
+/**
+ * gulkan_device_get_drm_format_modifiers:
+ * @self: a #GulkanDevice
+ * @format: a #VkFormat
+ * @count: (out): number of modifiers
+ *
+ * Requires VK_EXT_image_drm_format_modifier. The list is queried on first
+ * use and cached for the lifetime of the device.
+ *
+ * Returns: (transfer none): the modifiers supported for @format
+ */
+const VkDrmFormatModifierPropertiesEXT *
+gulkan_device_get_drm_format_modifiers (GulkanDevice *self,
+                                        VkFormat      format,
+                                        uint32_t     *count)
+{
+  g_mutex_lock (&self->format_mutex);
+  GulkanFormatEntry *entry = _get_format_entry (self, format);
+  if (!entry->queried_modifiers)
+    _query_modifiers (self, format, entry);
+  g_mutex_unlock (&self->format_mutex);
+
+  *count = entry->modifier_count;
+  return entry->modifiers;
+}
+
+gboolean
+gulkan_device_get_drm_format_modifier_properties (
+  GulkanDevice                     *self,
+  VkFormat                          format,
+  uint64_t                          modifier,
+  VkDrmFormatModifierPropertiesEXT *properties)
+{
+  uint32_t                                count;
+  const VkDrmFormatModifierPropertiesEXT *modifiers
+    = gulkan_device_get_drm_format_modifiers (self, format, &count);
+
+  for (uint32_t i = 0; i < count; i++)
+    {
+      if (modifiers[i].drmFormatModifier == modifier)
+        {
+          *properties = modifiers[i];
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
 static gboolean
 _load_resource (const gchar *path, GBytes **res)
 {
@@ -21,6 +21,21 @@
 
 G_BEGIN_DECLS
 
+/**
+ * GulkanQueueType:
+ * @GULKAN_QUEUE_GRAPHICS: Queues supporting graphics
+ * @GULKAN_QUEUE_TRANSFER: Queues for uploads, preferably without graphics
+ * @GULKAN_QUEUE_COMPUTE: Queues for compute, preferably without graphics
+ * @GULKAN_QUEUE_TYPE_COUNT: Number of queue types
+ */
+typedef enum
+{
+  GULKAN_QUEUE_GRAPHICS,
+  GULKAN_QUEUE_TRANSFER,
+  GULKAN_QUEUE_COMPUTE,
+  GULKAN_QUEUE_TYPE_COUNT,
+} GulkanQueueType;
+
 #define GULKAN_TYPE_DEVICE gulkan_device_get_type ()
 G_DECLARE_FINAL_TYPE (GulkanDevice, gulkan_device, GULKAN, DEVICE, GObject)
 
@@ -58,6 +73,79 @@ gulkan_device_get_memory_fd (GulkanDevice  *self,
                              VkDeviceMemory image_memory,
                              int           *fd);
 
+gboolean
+gulkan_device_export_memory_fd (GulkanDevice                      *self,
+                                VkDeviceMemory                     memory,
+                                VkExternalMemoryHandleTypeFlagBits handle_type,
+                                int                               *fd);
+
+gboolean
+gulkan_device_supports_dynamic_rendering (GulkanDevice *self);
+
+void
+gulkan_device_cmd_begin_rendering (GulkanDevice             *self,
+                                   VkCommandBuffer           cmd_buffer,
+                                   const VkRenderingInfoKHR *info);
+
+void
+gulkan_device_cmd_end_rendering (GulkanDevice *self, VkCommandBuffer cmd_buffer);
+
+gboolean
+gulkan_device_supports_present_wait (GulkanDevice *self);
+
+gboolean
+gulkan_device_supports_incremental_present (GulkanDevice *self);
+
+gboolean
+gulkan_device_supports_memory_handle_type (
+  GulkanDevice                      *self,
+  VkExternalMemoryHandleTypeFlagBits handle_type);
+
+gboolean
+gulkan_device_supports_multi_draw_indirect (GulkanDevice *self);
+
+gboolean
+gulkan_device_supports_draw_indirect_count (GulkanDevice *self);
+
+void
+gulkan_device_cmd_draw_indexed_indirect_count (GulkanDevice   *self,
+                                               VkCommandBuffer cmd_buffer,
+                                               VkBuffer        buffer,
+                                               VkDeviceSize    offset,
+                                               VkBuffer        count_buffer,
+                                               VkDeviceSize    count_offset,
+                                               uint32_t        max_draw_count,
+                                               uint32_t        stride);
+
+VkResult
+gulkan_device_wait_for_present (GulkanDevice  *self,
+                                VkSwapchainKHR swapchain,
+                                uint64_t       present_id,
+                                uint64_t       timeout);
+
+gboolean
+gulkan_device_supports_semaphore_fd (
+  GulkanDevice                         *self,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type);
+
+VkSemaphore
+gulkan_device_create_export_semaphore (
+  GulkanDevice                         *self,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type);
+
+gboolean
+gulkan_device_export_semaphore_fd (
+  GulkanDevice                         *self,
+  VkSemaphore                           semaphore,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type,
+  int                                  *fd);
+
+VkSemaphore
+gulkan_device_import_semaphore_fd (
+  GulkanDevice                         *self,
+  int                                   fd,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type);
+
 void
 gulkan_device_wait_idle (GulkanDevice *self);
 
@@ -76,6 +164,22 @@ gulkan_device_get_graphics_queue (GulkanDevice *self);
 GulkanQueue *
 gulkan_device_get_transfer_queue (GulkanDevice *self);
 
+GulkanQueue *
+gulkan_device_get_compute_queue (GulkanDevice *self);
+
+GulkanQueue *
+gulkan_device_get_queue (GulkanDevice   *self,
+                         GulkanQueueType type,
+                         uint32_t        index);
+
+void
+gulkan_device_set_queue_count (GulkanDevice   *self,
+                               GulkanQueueType type,
+                               uint32_t        count);
+
+uint32_t
+gulkan_device_get_queue_count (GulkanDevice *self, GulkanQueueType type);
+
 VkPhysicalDeviceProperties *
 gulkan_device_get_physical_device_properties (GulkanDevice *self);
 
@@ -84,6 +188,42 @@ gulkan_device_create_shader_module (GulkanDevice   *self,
                                     const gchar    *resource_name,
                                     VkShaderModule *module);
 
+VkSampler
+gulkan_device_request_sampler (GulkanDevice              *self,
+                               const VkSamplerCreateInfo *info);
+
+void
+gulkan_device_release_sampler (GulkanDevice *self, VkSampler sampler);
+
+gboolean
+gulkan_device_supports_ycbcr_conversion (GulkanDevice *self);
+
+VkSamplerYcbcrConversion
+gulkan_device_request_ycbcr_conversion (
+  GulkanDevice                             *self,
+  const VkSamplerYcbcrConversionCreateInfo *info);
+
+VkFormatProperties
+gulkan_device_get_format_properties (GulkanDevice *self, VkFormat format);
+
+gboolean
+gulkan_device_format_supports (GulkanDevice        *self,
+                               VkFormat             format,
+                               VkImageTiling        tiling,
+                               VkFormatFeatureFlags features);
+
+const VkDrmFormatModifierPropertiesEXT *
+gulkan_device_get_drm_format_modifiers (GulkanDevice *self,
+                                        VkFormat      format,
+                                        uint32_t     *count);
+
+gboolean
+gulkan_device_get_drm_format_modifier_properties (
+  GulkanDevice                     *self,
+  VkFormat                          format,
+  uint64_t                          modifier,
+  VkDrmFormatModifierPropertiesEXT *properties);
+
 G_END_DECLS
 
 #endif /* GULKAN_DEVICE_H_ */
@@ -0,0 +1,319 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "gulkan-dmabuf-cache.h"
+
+#include <sys/stat.h>
+
+/* Bounds the memory kept alive when buffers are never removed */
+#define DEFAULT_MAX_ENTRIES 64
+#define DEFAULT_MAX_IDLE_FRAMES 60
+
+/*
+ * A dmabuf is identified by the inode of its fds, which stays the same when
+ * a client sends new fds for the same buffer. The imported texture keeps the
+ * dmabuf alive, so the inode can't be reused while it is cached.
+ */
+typedef struct
+{
+  dev_t    dev[GULKAN_DMABUF_MAX_PLANES];
+  ino_t    ino[GULKAN_DMABUF_MAX_PLANES];
+  int32_t  width;
+  int32_t  height;
+  uint32_t format;
+  uint64_t modifier;
+  int      n_planes;
+  uint32_t offset[GULKAN_DMABUF_MAX_PLANES];
+  uint32_t stride[GULKAN_DMABUF_MAX_PLANES];
+} GulkanDmabufKey;
+
+typedef struct
+{
+  GulkanDmabufKey key;
+  GulkanTexture  *texture;
+  GList          *lru_link;
+  uint64_t        last_frame;
+} GulkanDmabufEntry;
+
+struct _GulkanDmabufCache
+{
+  GObject parent;
+
+  GulkanContext *context;
+
+  GHashTable *entries;
+  /* Most recently used entries first */
+  GQueue   lru;
+  guint    max_entries;
+  guint    max_idle_frames;
+  uint64_t frame;
+};
+
+G_DEFINE_TYPE (GulkanDmabufCache, gulkan_dmabuf_cache, G_TYPE_OBJECT)
+
+static guint
+_key_hash (gconstpointer data)
+{
+  const GulkanDmabufKey *key = data;
+
+  guint hash = key->format;
+  hash = hash * 31 + (guint) (key->modifier ^ (key->modifier >> 32));
+  hash = hash * 31 + (guint) key->width;
+  hash = hash * 31 + (guint) key->height;
+  for (int i = 0; i < key->n_planes; i++)
+    {
+      hash = hash * 31 + (guint) key->dev[i];
+      hash = hash * 31 + (guint) key->ino[i];
+      hash = hash * 31 + key->offset[i];
+      hash = hash * 31 + key->stride[i];
+    }
+  return hash;
+}
+
+static gboolean
+_key_equal (gconstpointer a, gconstpointer b)
+{
+  const GulkanDmabufKey *x = a;
+  const GulkanDmabufKey *y = b;
+
+  if (x->format != y->format || x->modifier != y->modifier
+      || x->width != y->width || x->height != y->height
+      || x->n_planes != y->n_planes)
+    return FALSE;
+
+  for (int i = 0; i < x->n_planes; i++)
+    {
+      if (x->dev[i] != y->dev[i] || x->ino[i] != y->ino[i]
+          || x->offset[i] != y->offset[i] || x->stride[i] != y->stride[i])
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+_free_entry (gpointer data)
+{
+  GulkanDmabufEntry *entry = data;
+  g_object_unref (entry->texture);
+  g_free (entry);
+}
+
+static void
+gulkan_dmabuf_cache_init (GulkanDmabufCache *self)
+{
+  self->context = NULL;
+  self->entries = g_hash_table_new_full (_key_hash, _key_equal, NULL,
+                                         _free_entry);
+  g_queue_init (&self->lru);
+  self->max_entries = DEFAULT_MAX_ENTRIES;
+  self->max_idle_frames = DEFAULT_MAX_IDLE_FRAMES;
+  self->frame = 0;
+}
+
+static void
+_finalize (GObject *gobject)
+{
+  GulkanDmabufCache *self = GULKAN_DMABUF_CACHE (gobject);
+  g_queue_clear (&self->lru);
+  g_hash_table_unref (self->entries);
+  g_clear_object (&self->context);
+  G_OBJECT_CLASS (gulkan_dmabuf_cache_parent_class)->finalize (gobject);
+}
+
+static void
+gulkan_dmabuf_cache_class_init (GulkanDmabufCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  object_class->finalize = _finalize;
+}
+
+/**
+ * gulkan_dmabuf_cache_new:
+ * @context: a #GulkanContext
+ * @max_entries: the number of textures to keep, 0 for a default of 64
+ *
+ * When @max_entries is reached the least recently used texture is evicted.
+ * Textures that were not looked up for a while are evicted as well, see
+ * gulkan_dmabuf_cache_next_frame().
+ *
+ * Returns: (transfer full): a new #GulkanDmabufCache
+ */
+GulkanDmabufCache *
+gulkan_dmabuf_cache_new (GulkanContext *context, guint max_entries)
+{
+  GulkanDmabufCache *self = (GulkanDmabufCache *)
+    g_object_new (GULKAN_TYPE_DMABUF_CACHE, 0);
+  self->context = g_object_ref (context);
+  if (max_entries > 0)
+    self->max_entries = max_entries;
+  return self;
+}
+
+static gboolean
+_init_key (GulkanDmabufKey *key, struct GulkanDmabufAttributes *attribs)
+{
+  if (attribs->n_planes < 1 || attribs->n_planes > GULKAN_DMABUF_MAX_PLANES)
+    return FALSE;
+
+  *key = (GulkanDmabufKey){
+    .width = attribs->width,
+    .height = attribs->height,
+    .format = attribs->format,
+    .modifier = attribs->modifier,
+    .n_planes = attribs->n_planes,
+  };
+
+  for (int i = 0; i < attribs->n_planes; i++)
+    {
+      struct stat st;
+      if (fstat (attribs->fd[i], &st) != 0)
+        {
+          g_printerr ("Could not stat dmabuf fd %d\n", attribs->fd[i]);
+          return FALSE;
+        }
+      key->dev[i] = st.st_dev;
+      key->ino[i] = st.st_ino;
+      key->offset[i] = attribs->offset[i];
+      key->stride[i] = attribs->stride[i];
+    }
+
+  return TRUE;
+}
+
+static void
+_remove_entry (GulkanDmabufCache *self, GulkanDmabufEntry *entry)
+{
+  g_queue_delete_link (&self->lru, entry->lru_link);
+  g_hash_table_remove (self->entries, &entry->key);
+}
+
+/**
+ * gulkan_dmabuf_cache_get_texture:
+ * @self: a #GulkanDmabufCache
+ * @attribs: a #GulkanDmabufAttributes
+ *
+ * Returns the texture imported for the same buffer before, or imports it.
+ * The fds in @attribs are not consumed.
+ *
+ * Returns: (transfer full) (nullable): a #GulkanTexture
+ */
+GulkanTexture *
+gulkan_dmabuf_cache_get_texture (GulkanDmabufCache             *self,
+                                 struct GulkanDmabufAttributes *attribs)
+{
+  GulkanDmabufKey key;
+  if (!_init_key (&key, attribs))
+    return NULL;
+
+  GulkanDmabufEntry *entry = g_hash_table_lookup (self->entries, &key);
+  if (entry)
+    {
+      g_queue_unlink (&self->lru, entry->lru_link);
+      g_queue_push_head_link (&self->lru, entry->lru_link);
+      entry->last_frame = self->frame;
+      return g_object_ref (entry->texture);
+    }
+
+  GulkanTexture *texture = gulkan_texture_new_from_dmabuf_attribs (self->context,
+                                                                   attribs);
+  if (!texture)
+    return NULL;
+
+  if (g_hash_table_size (self->entries) >= self->max_entries)
+    _remove_entry (self, g_queue_peek_tail (&self->lru));
+
+  entry = g_new (GulkanDmabufEntry, 1);
+  entry->key = key;
+  entry->texture = g_object_ref (texture);
+  entry->last_frame = self->frame;
+  g_queue_push_head (&self->lru, entry);
+  entry->lru_link = g_queue_peek_head_link (&self->lru);
+  g_hash_table_insert (self->entries, &entry->key, entry);
+
+  g_debug ("Imported dmabuf, %d in cache.", g_hash_table_size (self->entries));
+
+  return texture;
+}
+
+/**
+ * gulkan_dmabuf_cache_remove:
+ * @self: a #GulkanDmabufCache
+ * @attribs: a #GulkanDmabufAttributes
+ *
+ * Drops the texture when the buffer is destroyed, for example on
+ * wl_buffer destruction. Otherwise the memory stays alive until the entry
+ * is evicted.
+ */
+void
+gulkan_dmabuf_cache_remove (GulkanDmabufCache             *self,
+                            struct GulkanDmabufAttributes *attribs)
+{
+  GulkanDmabufKey key;
+  if (!_init_key (&key, attribs))
+    return;
+
+  GulkanDmabufEntry *entry = g_hash_table_lookup (self->entries, &key);
+  if (entry)
+    _remove_entry (self, entry);
+}
+
+/**
+ * gulkan_dmabuf_cache_next_frame:
+ * @self: a #GulkanDmabufCache
+ *
+ * Call once per frame. Evicts the textures that were not looked up for more
+ * than the idle frames set with gulkan_dmabuf_cache_set_max_idle_frames(),
+ * so destroyed buffers are released without gulkan_dmabuf_cache_remove().
+ */
+void
+gulkan_dmabuf_cache_next_frame (GulkanDmabufCache *self)
+{
+  self->frame++;
+
+  if (self->max_idle_frames == 0)
+    return;
+
+  GulkanDmabufEntry *entry;
+  while ((entry = g_queue_peek_tail (&self->lru))
+         && self->frame - entry->last_frame > self->max_idle_frames)
+    _remove_entry (self, entry);
+}
+
+/**
+ * gulkan_dmabuf_cache_set_max_idle_frames:
+ * @self: a #GulkanDmabufCache
+ * @frames: frames a texture is kept without being looked up, 0 to keep it
+ * until it is removed or evicted by @max_entries
+ *
+ * Defaults to 60 frames.
+ */
+void
+gulkan_dmabuf_cache_set_max_idle_frames (GulkanDmabufCache *self,
+                                         guint              frames)
+{
+  self->max_idle_frames = frames;
+}
+
+/**
+ * gulkan_dmabuf_cache_clear:
+ * @self: a #GulkanDmabufCache
+ *
+ * Drops all cached textures, for example when the client disconnects.
+ */
+void
+gulkan_dmabuf_cache_clear (GulkanDmabufCache *self)
+{
+  g_queue_clear (&self->lru);
+  g_hash_table_remove_all (self->entries);
+}
+
+guint
+gulkan_dmabuf_cache_get_size (GulkanDmabufCache *self)
+{
+  return g_hash_table_size (self->entries);
+}
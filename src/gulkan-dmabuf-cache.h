@@ -0,0 +1,55 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GULKAN_DMABUF_CACHE_H_
+#define GULKAN_DMABUF_CACHE_H_
+
+#if !defined(GULKAN_INSIDE) && !defined(GULKAN_COMPILATION)
+#error "Only <gulkan.h> can be included directly."
+#endif
+
+#include <glib-object.h>
+
+#include "gulkan-context.h"
+#include "gulkan-texture.h"
+
+G_BEGIN_DECLS
+
+#define GULKAN_TYPE_DMABUF_CACHE gulkan_dmabuf_cache_get_type ()
+G_DECLARE_FINAL_TYPE (GulkanDmabufCache,
+                      gulkan_dmabuf_cache,
+                      GULKAN,
+                      DMABUF_CACHE,
+                      GObject)
+
+GulkanDmabufCache *
+gulkan_dmabuf_cache_new (GulkanContext *context, guint max_entries);
+
+GulkanTexture *
+gulkan_dmabuf_cache_get_texture (GulkanDmabufCache             *self,
+                                 struct GulkanDmabufAttributes *attribs);
+
+void
+gulkan_dmabuf_cache_remove (GulkanDmabufCache             *self,
+                            struct GulkanDmabufAttributes *attribs);
+
+void
+gulkan_dmabuf_cache_next_frame (GulkanDmabufCache *self);
+
+void
+gulkan_dmabuf_cache_set_max_idle_frames (GulkanDmabufCache *self,
+                                         guint              frames);
+
+void
+gulkan_dmabuf_cache_clear (GulkanDmabufCache *self);
+
+guint
+gulkan_dmabuf_cache_get_size (GulkanDmabufCache *self);
+
+G_END_DECLS
+
+#endif /* GULKAN_DMABUF_CACHE_H_ */
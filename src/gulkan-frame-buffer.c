@@ -25,8 +25,17 @@ struct _GulkanFrameBuffer
   VkDeviceMemory depth_stencil_memory;
   VkImageView    depth_stencil_image_view;
 
+  /* Transient multisampled color, resolved into the color image */
+  VkImage        msaa_image;
+  VkDeviceMemory msaa_memory;
+  VkImageView    msaa_image_view;
+
   VkFramebuffer framebuffer;
 
+  /* Not owned when created from an image, used for dynamic rendering */
+  VkImage  color_attachment;
+  uint32_t layer_count;
+
   VkExtent2D extent;
 
   gboolean use_depth;
@@ -54,6 +63,12 @@ gulkan_frame_buffer_init (GulkanFrameBuffer *self)
   self->depth_stencil_image = VK_NULL_HANDLE;
   self->depth_stencil_memory = VK_NULL_HANDLE;
   self->depth_stencil_image_view = VK_NULL_HANDLE;
+  self->msaa_image = VK_NULL_HANDLE;
+  self->msaa_memory = VK_NULL_HANDLE;
+  self->msaa_image_view = VK_NULL_HANDLE;
+  self->framebuffer = VK_NULL_HANDLE;
+  self->color_attachment = VK_NULL_HANDLE;
+  self->layer_count = 1;
 }
 
 static void
@@ -78,7 +93,15 @@ gulkan_frame_buffer_finalize (GObject *gobject)
   if (self->depth_stencil_memory != VK_NULL_HANDLE)
     vkFreeMemory (device, self->depth_stencil_memory, NULL);
 
-  vkDestroyFramebuffer (device, self->framebuffer, NULL);
+  if (self->msaa_image_view != VK_NULL_HANDLE)
+    vkDestroyImageView (device, self->msaa_image_view, NULL);
+  if (self->msaa_image != VK_NULL_HANDLE)
+    vkDestroyImage (device, self->msaa_image, NULL);
+  if (self->msaa_memory != VK_NULL_HANDLE)
+    vkFreeMemory (device, self->msaa_memory, NULL);
+
+  if (self->framebuffer != VK_NULL_HANDLE)
+    vkDestroyFramebuffer (device, self->framebuffer, NULL);
 }
 
 static gboolean
@@ -145,6 +168,8 @@ _get_access_flags (VkImageLayout layout)
         return VK_ACCESS_TRANSFER_WRITE_BIT;
       case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
         return VK_ACCESS_SHADER_READ_BIT;
+      case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+        return 0;
       default:
         g_warning ("Unhandled access mask case for layout %d.\n", layout);
     }
@@ -240,16 +265,9 @@ _init_target (GulkanFrameBuffer    *self,
 {
   VkDevice vk_device = gulkan_device_get_handle (self->device);
 
-  VkExternalMemoryImageCreateInfo external_info = {
-    .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
-    .pNext = NULL,
-    .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
-  };
-
-  /* Depth/stencil target */
+  /* Render targets are never exported, so they don't need external memory */
   VkImageCreateInfo image_info = {
     .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-    .pNext = &external_info,
     .imageType = VK_IMAGE_TYPE_2D,
     .extent = {
       .width = self->extent.width,
@@ -281,7 +299,23 @@ _init_target (GulkanFrameBuffer    *self,
     .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
     .allocationSize = memory_requirements.size,
   };
-  if (!gulkan_device_memory_type_from_properties (
+
+  /*
+   * Transient attachments never leave tile memory on tilers, which can back
+   * them lazily. Other GPUs don't have such a memory type.
+   */
+  gboolean is_transient = (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+                          != 0;
+  gboolean has_lazy_memory
+    = is_transient
+      && gulkan_device_memory_type_from_properties (
+        self->device, memory_requirements.memoryTypeBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+          | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+        &memory_info.memoryTypeIndex);
+
+  if (!has_lazy_memory
+      && !gulkan_device_memory_type_from_properties (
         self->device, memory_requirements.memoryTypeBits,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memory_info.memoryTypeIndex))
     {
@@ -303,6 +337,10 @@ _init_target (GulkanFrameBuffer    *self,
       return FALSE;
     }
 
+  /* Transient contents are undefined at the start of each pass anyway */
+  if (is_transient)
+    return TRUE;
+
   if (!_transfer_layout (*out_image, self->device, 1, is_depth_format,
                          VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL))
     {
@@ -313,21 +351,56 @@ _init_target (GulkanFrameBuffer    *self,
   return TRUE;
 }
 
+/* Depth is only used within the pass and never stored */
+static gboolean
+_init_depth_target (GulkanFrameBuffer    *self,
+                    VkSampleCountFlagBits sample_count,
+                    uint32_t              layer_count)
+{
+  VkFormat depth_format = VK_FORMAT_D32_SFLOAT;
+  if (!_init_target (self, sample_count, depth_format, TRUE,
+                     VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+                       | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                     layer_count, &self->depth_stencil_image,
+                     &self->depth_stencil_memory))
+    return FALSE;
+
+  if (!_create_image_view (self, self->depth_stencil_image, depth_format,
+                           VK_IMAGE_ASPECT_DEPTH_BIT, layer_count,
+                           &self->depth_stencil_image_view))
+    return FALSE;
+
+  return TRUE;
+}
+
 static gboolean
 _init_frame_buffer (GulkanFrameBuffer *self, GulkanRenderPass *render_pass)
 {
+  /* Attachments are used directly with dynamic rendering */
+  if (render_pass == NULL)
+    return TRUE;
+
   VkDevice vk_device = gulkan_device_get_handle (self->device);
 
   VkRenderPass rp = gulkan_render_pass_get_handle (render_pass);
 
+  /* Same order as the attachments of the #GulkanRenderPass */
+  VkImageView attachments[3];
+  uint32_t    attachment_count = 0;
+  if (self->msaa_image_view != VK_NULL_HANDLE)
+    attachments[attachment_count++] = self->msaa_image_view;
+  else
+    attachments[attachment_count++] = self->color_image_view;
+  if (self->use_depth)
+    attachments[attachment_count++] = self->depth_stencil_image_view;
+  if (self->msaa_image_view != VK_NULL_HANDLE)
+    attachments[attachment_count++] = self->color_image_view;
+
   VkFramebufferCreateInfo framebuffer_info = {
     .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
     .renderPass = rp,
-    .attachmentCount = self->use_depth ? 2 : 1,
-    .pAttachments = (VkImageView[]) {
-      self->color_image_view,
-      self->use_depth ? self->depth_stencil_image_view : NULL,
-    },
+    .attachmentCount = attachment_count,
+    .pAttachments = attachments,
     .width = self->extent.width,
     .height = self->extent.height,
     .layers = 1,
@@ -355,6 +428,8 @@ _initialize_from_image (GulkanFrameBuffer *self,
   self->device = device;
   self->extent = extent;
   self->use_depth = FALSE;
+  self->color_attachment = color_image;
+  self->layer_count = layer_count;
 
   if (!_create_image_view (self, color_image, color_format,
                            VK_IMAGE_ASPECT_COLOR_BIT, layer_count,
@@ -380,21 +455,57 @@ _initialize_from_image_with_depth (GulkanFrameBuffer    *self,
   self->device = device;
   self->extent = extent;
   self->use_depth = TRUE;
+  self->color_attachment = color_image;
+  self->layer_count = layer_count;
 
   if (!_create_image_view (self, color_image, color_format,
                            VK_IMAGE_ASPECT_COLOR_BIT, layer_count,
                            &self->color_image_view))
     return FALSE;
 
-  VkFormat depth_format = VK_FORMAT_D32_SFLOAT;
-  if (!_init_target (self, sample_count, depth_format, TRUE,
-                     VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, layer_count,
-                     &self->depth_stencil_image, &self->depth_stencil_memory))
+  if (!_init_depth_target (self, sample_count, layer_count))
     return FALSE;
 
-  if (!_create_image_view (self, self->depth_stencil_image, depth_format,
-                           VK_IMAGE_ASPECT_DEPTH_BIT, layer_count,
-                           &self->depth_stencil_image_view))
+  if (!_init_frame_buffer (self, render_pass))
+    return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+_initialize_msaa_from_image (GulkanFrameBuffer    *self,
+                             GulkanDevice         *device,
+                             GulkanRenderPass     *render_pass,
+                             VkImage               color_image,
+                             VkExtent2D            extent,
+                             VkSampleCountFlagBits sample_count,
+                             VkFormat              color_format,
+                             gboolean              use_depth,
+                             uint32_t              layer_count)
+{
+  self->device = device;
+  self->extent = extent;
+  self->use_depth = use_depth;
+  self->color_attachment = color_image;
+  self->layer_count = layer_count;
+
+  if (!_create_image_view (self, color_image, color_format,
+                           VK_IMAGE_ASPECT_COLOR_BIT, layer_count,
+                           &self->color_image_view))
+    return FALSE;
+
+  if (!_init_target (self, sample_count, color_format, FALSE,
+                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                       | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                     layer_count, &self->msaa_image, &self->msaa_memory))
+    return FALSE;
+
+  if (!_create_image_view (self, self->msaa_image, color_format,
+                           VK_IMAGE_ASPECT_COLOR_BIT, layer_count,
+                           &self->msaa_image_view))
+    return FALSE;
+
+  if (use_depth && !_init_depth_target (self, sample_count, layer_count))
     return FALSE;
 
   if (!_init_frame_buffer (self, render_pass))
@@ -420,8 +531,8 @@ _initialize (GulkanFrameBuffer    *self,
   self->device = device;
   self->extent = extent;
 
-  if (!_init_target (self, sample_count, color_format, FALSE, layer_count,
-                     usage, &self->color_image, &self->color_memory))
+  if (!_init_target (self, sample_count, color_format, FALSE, usage,
+                     layer_count, &self->color_image, &self->color_memory))
     return FALSE;
 
   if (use_depth)
@@ -462,6 +573,91 @@ gulkan_frame_buffer_new (GulkanDevice         *device,
   return self;
 }
 
+/**
+ * gulkan_frame_buffer_new_msaa:
+ * @device: a #GulkanDevice
+ * @render_pass: (nullable): a #GulkanRenderPass from
+ * gulkan_render_pass_new_msaa(), or %NULL for dynamic rendering
+ * @extent: the size of the attachments
+ * @sample_count: the sample count of the multisampled attachments
+ * @color_format: the #VkFormat of the color attachments
+ * @use_depth: whether to create a depth attachment
+ * @layer_count: the number of layers
+ *
+ * Creates a single sampled color image the multisampled color is resolved
+ * into. The multisampled color and depth attachments are transient, and
+ * backed by lazily allocated memory where available.
+ *
+ * Returns: (transfer full) (nullable): a new #GulkanFrameBuffer
+ */
+GulkanFrameBuffer *
+gulkan_frame_buffer_new_msaa (GulkanDevice         *device,
+                              GulkanRenderPass     *render_pass,
+                              VkExtent2D            extent,
+                              VkSampleCountFlagBits sample_count,
+                              VkFormat              color_format,
+                              gboolean              use_depth,
+                              uint32_t              layer_count)
+{
+  GulkanFrameBuffer *self = (GulkanFrameBuffer *)
+    g_object_new (GULKAN_TYPE_FRAME_BUFFER, 0);
+
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                            | VK_IMAGE_USAGE_SAMPLED_BIT
+                            | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+  self->device = device;
+  self->extent = extent;
+
+  if (!_init_target (self, VK_SAMPLE_COUNT_1_BIT, color_format, FALSE, usage,
+                     layer_count, &self->color_image, &self->color_memory)
+      || !_initialize_msaa_from_image (self, device, render_pass,
+                                       self->color_image, extent, sample_count,
+                                       color_format, use_depth, layer_count))
+    {
+      g_object_unref (self);
+      return NULL;
+    }
+  return self;
+}
+
+/**
+ * gulkan_frame_buffer_new_from_image_msaa:
+ * @device: a #GulkanDevice
+ * @render_pass: (nullable): a #GulkanRenderPass from
+ * gulkan_render_pass_new_msaa(), or %NULL for dynamic rendering
+ * @color_image: the single sampled image to resolve into, e.g. a swapchain
+ * image
+ * @extent: the size of the attachments
+ * @sample_count: the sample count of the multisampled attachments
+ * @color_format: the #VkFormat of @color_image
+ * @use_depth: whether to create a depth attachment
+ * @layer_count: the number of layers
+ *
+ * Returns: (transfer full) (nullable): a new #GulkanFrameBuffer
+ */
+GulkanFrameBuffer *
+gulkan_frame_buffer_new_from_image_msaa (GulkanDevice         *device,
+                                         GulkanRenderPass     *render_pass,
+                                         VkImage               color_image,
+                                         VkExtent2D            extent,
+                                         VkSampleCountFlagBits sample_count,
+                                         VkFormat              color_format,
+                                         gboolean              use_depth,
+                                         uint32_t              layer_count)
+{
+  GulkanFrameBuffer *self = (GulkanFrameBuffer *)
+    g_object_new (GULKAN_TYPE_FRAME_BUFFER, 0);
+  if (!_initialize_msaa_from_image (self, device, render_pass, color_image,
+                                    extent, sample_count, color_format,
+                                    use_depth, layer_count))
+    {
+      g_object_unref (self);
+      return NULL;
+    }
+  return self;
+}
+
 GulkanFrameBuffer *
 gulkan_frame_buffer_new_from_image_with_depth (GulkanDevice     *device,
                                                GulkanRenderPass *render_pass,
@@ -526,3 +722,184 @@ gulkan_frame_buffer_get_handle (GulkanFrameBuffer *self)
 {
   return self->framebuffer;
 }
+
+/**
+ * gulkan_frame_buffer_get_color_image_view:
+ * @self: a #GulkanFrameBuffer
+ *
+ * Returns: (transfer none): a #VkImageView
+ */
+VkImageView
+gulkan_frame_buffer_get_color_image_view (GulkanFrameBuffer *self)
+{
+  return self->color_image_view;
+}
+
+/**
+ * gulkan_frame_buffer_get_depth_image_view:
+ * @self: a #GulkanFrameBuffer
+ *
+ * Returns: (transfer none): a #VkImageView, or %VK_NULL_HANDLE without depth
+ */
+VkImageView
+gulkan_frame_buffer_get_depth_image_view (GulkanFrameBuffer *self)
+{
+  return self->depth_stencil_image_view;
+}
+
+static void
+_record_attachment_barrier (GulkanFrameBuffer   *self,
+                            VkCommandBuffer      cmd_buffer,
+                            VkImage              image,
+                            VkImageAspectFlags   aspect,
+                            VkAccessFlags        src_access_mask,
+                            VkAccessFlags        dst_access_mask,
+                            VkImageLayout        src_layout,
+                            VkImageLayout        dst_layout,
+                            VkPipelineStageFlags src_stage_mask,
+                            VkPipelineStageFlags dst_stage_mask)
+{
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = src_access_mask,
+    .dstAccessMask = dst_access_mask,
+    .oldLayout = src_layout,
+    .newLayout = dst_layout,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = image,
+    .subresourceRange = {
+      .aspectMask = aspect,
+      .baseMipLevel = 0,
+      .levelCount = 1,
+      .baseArrayLayer = 0,
+      .layerCount = self->layer_count,
+    },
+  };
+
+  vkCmdPipelineBarrier (cmd_buffer, src_stage_mask, dst_stage_mask, 0, 0, NULL,
+                        0, NULL, 1, &barrier);
+}
+
+/**
+ * gulkan_frame_buffer_begin_rendering:
+ * @self: a #GulkanFrameBuffer created without a #GulkanRenderPass
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ * @clear_color: the color the color attachment is cleared to
+ *
+ * Begins dynamic rendering to the attachments of @self, with the same load and
+ * store behaviour as a #GulkanRenderPass. Previous contents are discarded.
+ * Requires gulkan_device_supports_dynamic_rendering().
+ */
+void
+gulkan_frame_buffer_begin_rendering (GulkanFrameBuffer *self,
+                                     VkCommandBuffer    cmd_buffer,
+                                     VkClearColorValue  clear_color)
+{
+  _record_attachment_barrier (self, cmd_buffer, self->color_attachment,
+                              VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                              VK_IMAGE_LAYOUT_UNDEFINED,
+                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                              VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                              VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+  if (self->msaa_image != VK_NULL_HANDLE)
+    _record_attachment_barrier (self, cmd_buffer, self->msaa_image,
+                                VK_IMAGE_ASPECT_COLOR_BIT, 0,
+                                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                                VK_IMAGE_LAYOUT_UNDEFINED,
+                                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+  if (self->use_depth)
+    _record_attachment_barrier (
+      self, cmd_buffer, self->depth_stencil_image, VK_IMAGE_ASPECT_DEPTH_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+        | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+      VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+      VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT);
+
+  VkRenderingAttachmentInfoKHR color_attachment = {
+    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+    .imageView = self->color_image_view,
+    .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+    .clearValue = {
+      .color = clear_color,
+    },
+  };
+
+  /* Resolve at the end of rendering, the samples themselves are discarded */
+  if (self->msaa_image_view != VK_NULL_HANDLE)
+    {
+      color_attachment.imageView = self->msaa_image_view;
+      color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      color_attachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT_KHR;
+      color_attachment.resolveImageView = self->color_image_view;
+      color_attachment.resolveImageLayout
+        = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    }
+
+  VkRenderingAttachmentInfoKHR depth_attachment = {
+    .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+    .imageView = self->depth_stencil_image_view,
+    .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+    .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+    .clearValue = {
+      .depthStencil = {
+        .depth = 1.0f,
+        .stencil = 0,
+      },
+    },
+  };
+
+  /* Layered targets are rendered with multiview, like the multiview pass */
+  VkRenderingInfoKHR info = {
+    .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+    .renderArea = {
+      .offset = {0, 0},
+      .extent = self->extent,
+    },
+    .layerCount = 1,
+    .viewMask = self->layer_count > 1 ? (1u << self->layer_count) - 1 : 0,
+    .colorAttachmentCount = 1,
+    .pColorAttachments = &color_attachment,
+    .pDepthAttachment = self->use_depth ? &depth_attachment : NULL,
+  };
+
+  gulkan_device_cmd_begin_rendering (self->device, cmd_buffer, &info);
+}
+
+/**
+ * gulkan_frame_buffer_end_rendering:
+ * @self: a #GulkanFrameBuffer
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ * @final_color_layout: the layout the color attachment is transitioned to
+ *
+ * Ends rendering started with gulkan_frame_buffer_begin_rendering().
+ */
+void
+gulkan_frame_buffer_end_rendering (GulkanFrameBuffer *self,
+                                   VkCommandBuffer    cmd_buffer,
+                                   VkImageLayout      final_color_layout)
+{
+  gulkan_device_cmd_end_rendering (self->device, cmd_buffer);
+
+  if (final_color_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+    return;
+
+  _record_attachment_barrier (self, cmd_buffer, self->color_attachment,
+                              VK_IMAGE_ASPECT_COLOR_BIT,
+                              VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                              _get_access_flags (final_color_layout),
+                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                              final_color_layout,
+                              VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                              VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+}
@@ -37,6 +37,25 @@ gulkan_frame_buffer_new (GulkanDevice         *device,
                          gboolean              use_depth,
                          uint32_t              layer_count);
 
+GulkanFrameBuffer *
+gulkan_frame_buffer_new_msaa (GulkanDevice         *device,
+                              GulkanRenderPass     *render_pass,
+                              VkExtent2D            extent,
+                              VkSampleCountFlagBits sample_count,
+                              VkFormat              color_format,
+                              gboolean              use_depth,
+                              uint32_t              layer_count);
+
+GulkanFrameBuffer *
+gulkan_frame_buffer_new_from_image_msaa (GulkanDevice         *device,
+                                         GulkanRenderPass     *render_pass,
+                                         VkImage               color_image,
+                                         VkExtent2D            extent,
+                                         VkSampleCountFlagBits sample_count,
+                                         VkFormat              color_format,
+                                         gboolean              use_depth,
+                                         uint32_t              layer_count);
+
 GulkanFrameBuffer *
 gulkan_frame_buffer_new_from_image_with_depth (GulkanDevice     *device,
                                                GulkanRenderPass *render_pass,
@@ -61,6 +80,22 @@ gulkan_frame_buffer_get_color_image (GulkanFrameBuffer *self);
 VkFramebuffer
 gulkan_frame_buffer_get_handle (GulkanFrameBuffer *self);
 
+VkImageView
+gulkan_frame_buffer_get_color_image_view (GulkanFrameBuffer *self);
+
+VkImageView
+gulkan_frame_buffer_get_depth_image_view (GulkanFrameBuffer *self);
+
+void
+gulkan_frame_buffer_begin_rendering (GulkanFrameBuffer *self,
+                                     VkCommandBuffer    cmd_buffer,
+                                     VkClearColorValue  clear_color);
+
+void
+gulkan_frame_buffer_end_rendering (GulkanFrameBuffer *self,
+                                   VkCommandBuffer    cmd_buffer,
+                                   VkImageLayout      final_color_layout);
+
 G_END_DECLS
 
 #endif /* GULKAN_FRAME_BUFFER_H_ */
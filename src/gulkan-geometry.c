@@ -7,6 +7,20 @@
 
 #include "gulkan-geometry.h"
 
+/* Position and color, the layout of gulkan_vertex_buffer_append_with_color */
+static void
+_write_with_color (float *dst, graphene_vec4_t *vec, const float color[3])
+{
+  float position[4];
+  graphene_vec4_to_float (vec, position);
+  dst[0] = position[0];
+  dst[1] = position[1];
+  dst[2] = position[2];
+  dst[3] = color[0];
+  dst[4] = color[1];
+  dst[5] = color[2];
+}
+
 void
 gulkan_geometry_append_axes (GulkanVertexBuffer *self,
                              graphene_vec4_t    *center,
@@ -16,6 +30,7 @@ gulkan_geometry_append_axes (GulkanVertexBuffer *self,
   graphene_vec4_t center_transformed;
   graphene_matrix_transform_vec4 (mat, center, &center_transformed);
 
+  float vertices[6 * 6];
   for (int i = 0; i < 3; ++i)
     {
       float point_float[4] = {0, 0, 0, 1};
@@ -25,16 +40,14 @@ gulkan_geometry_append_axes (GulkanVertexBuffer *self,
       graphene_matrix_transform_vec4 (mat, &point, &point);
 
       /* R, G, B for X, Y, Z */
-      float color_float[3] = {0, 0, 0};
-      color_float[i] = 1.0;
-      graphene_vec3_t color;
-      graphene_vec3_init_from_float (&color, color_float);
-
-      gulkan_vertex_buffer_append_with_color (self, &center_transformed,
-                                              &color);
+      float color[3] = {0, 0, 0};
+      color[i] = 1.0;
 
-      gulkan_vertex_buffer_append_with_color (self, &point, &color);
+      _write_with_color (&vertices[i * 12], &center_transformed, color);
+      _write_with_color (&vertices[i * 12 + 6], &point, color);
     }
+
+  gulkan_vertex_buffer_append_vertices (self, vertices, 6, 6);
 }
 
 void
@@ -50,11 +63,13 @@ gulkan_geometry_append_ray (GulkanVertexBuffer *self,
   graphene_vec4_init (&end, 0, 0, -length, 1);
   graphene_matrix_transform_vec4 (mat, &end, &end);
 
-  graphene_vec3_t color;
-  graphene_vec3_init (&color, .8f, .8f, .9f);
+  const float color[3] = {.8f, .8f, .9f};
+
+  float vertices[2 * 6];
+  _write_with_color (&vertices[0], &start, color);
+  _write_with_color (&vertices[6], &end, color);
 
-  gulkan_vertex_buffer_append_with_color (self, &start, &color);
-  gulkan_vertex_buffer_append_with_color (self, &end, &color);
+  gulkan_vertex_buffer_append_vertices (self, vertices, 2, 6);
 }
 
 void
@@ -74,11 +89,21 @@ gulkan_geometry_append_plane (GulkanVertexBuffer *self,
   graphene_matrix_transform_vec4 (mat, &c, &c);
   graphene_matrix_transform_vec4 (mat, &d, &d);
 
+  float pa[4], pb[4], pc[4], pd[4];
+  graphene_vec4_to_float (&a, pa);
+  graphene_vec4_to_float (&b, pb);
+  graphene_vec4_to_float (&c, pc);
+  graphene_vec4_to_float (&d, pd);
+
   /* Create triangles */
-  gulkan_vertex_buffer_append_position_uv (self, &a, 0, 1);
-  gulkan_vertex_buffer_append_position_uv (self, &b, 1, 1);
-  gulkan_vertex_buffer_append_position_uv (self, &c, 1, 0);
-  gulkan_vertex_buffer_append_position_uv (self, &c, 1, 0);
-  gulkan_vertex_buffer_append_position_uv (self, &d, 0, 0);
-  gulkan_vertex_buffer_append_position_uv (self, &a, 0, 1);
+  float vertices[6 * 5] = {
+    pa[0], pa[1], pa[2], 0, 1, // a
+    pb[0], pb[1], pb[2], 1, 1, // b
+    pc[0], pc[1], pc[2], 1, 0, // c
+    pc[0], pc[1], pc[2], 1, 0, // c
+    pd[0], pd[1], pd[2], 0, 0, // d
+    pa[0], pa[1], pa[2], 0, 1, // a
+  };
+
+  gulkan_vertex_buffer_append_vertices (self, vertices, 6, 5);
 }
@@ -0,0 +1,21 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GULKAN_INDIRECT_BUFFER_PRIVATE_H_
+#define GULKAN_INDIRECT_BUFFER_PRIVATE_H_
+
+#include "gulkan-indirect-buffer.h"
+
+G_BEGIN_DECLS
+
+/* Mapped commands of the selected slice, max_draws of them */
+const VkDrawIndexedIndirectCommand *
+gulkan_indirect_buffer_get_commands (GulkanIndirectBuffer *self);
+
+G_END_DECLS
+
+#endif /* GULKAN_INDIRECT_BUFFER_PRIVATE_H_ */
@@ -0,0 +1,535 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "gulkan-indirect-buffer-private.h"
+
+/**
+ * GulkanIndirectBuffer:
+ *
+ * An array of #VkDrawIndexedIndirectCommand entries along with a draw
+ * count. Commands can be written from the CPU, or by a compute pass that
+ * binds both buffers as storage buffers, culls its objects and appends the
+ * visible ones by atomically incrementing the count.
+ *
+ * Index and vertex buffers are not bound, bind the shared mesh buffers
+ * before drawing.
+ *
+ * Commands past the draw count are kept zeroed, so drawing the whole
+ * capacity without a count buffer only adds empty draws.
+ *
+ * Commands and count have one slice per frame slot, so a frame can write
+ * its draws while the GPU still reads the ones of frames in flight. The
+ * slice is selected by the frame_slot of gulkan_indirect_buffer_reset(),
+ * gulkan_indirect_buffer_set_commands() and
+ * gulkan_indirect_buffer_cmd_reset_count(), the other calls use the last
+ * selected one.
+ */
+struct _GulkanIndirectBuffer
+{
+  GObject parent;
+
+  GulkanDevice *device;
+
+  GulkanBuffer *buffer;
+  uint8_t      *commands_map;
+  VkDeviceSize  slice_size;
+
+  GulkanBuffer *count_buffer;
+  uint8_t      *count_map;
+  VkDeviceSize  count_slice_size;
+
+  /* The commands and count of the current slice */
+  VkDrawIndexedIndirectCommand *commands;
+  uint32_t                     *count;
+
+  uint32_t slice_count;
+  uint32_t slice;
+  uint32_t max_draws;
+};
+
+G_DEFINE_TYPE (GulkanIndirectBuffer, gulkan_indirect_buffer, G_TYPE_OBJECT)
+
+static void
+gulkan_indirect_buffer_init (GulkanIndirectBuffer *self)
+{
+  self->device = NULL;
+  self->buffer = NULL;
+  self->commands_map = NULL;
+  self->slice_size = 0;
+  self->count_buffer = NULL;
+  self->count_map = NULL;
+  self->count_slice_size = 0;
+  self->commands = NULL;
+  self->count = NULL;
+  self->slice_count = 0;
+  self->slice = 0;
+  self->max_draws = 0;
+}
+
+static void
+_finalize (GObject *gobject)
+{
+  GulkanIndirectBuffer *self = GULKAN_INDIRECT_BUFFER (gobject);
+
+  if (self->commands_map)
+    gulkan_buffer_unmap (self->buffer);
+  if (self->count_map)
+    gulkan_buffer_unmap (self->count_buffer);
+
+  g_clear_object (&self->buffer);
+  g_clear_object (&self->count_buffer);
+  g_clear_object (&self->device);
+
+  G_OBJECT_CLASS (gulkan_indirect_buffer_parent_class)->finalize (gobject);
+}
+
+static void
+gulkan_indirect_buffer_class_init (GulkanIndirectBufferClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  object_class->finalize = _finalize;
+}
+
+static void
+_select_slice (GulkanIndirectBuffer *self, uint32_t frame_slot)
+{
+  self->slice = frame_slot % self->slice_count;
+  uint8_t *commands = self->commands_map + self->slice * self->slice_size;
+  uint8_t *count = self->count_map + self->slice * self->count_slice_size;
+  self->commands = (VkDrawIndexedIndirectCommand *) commands;
+  self->count = (uint32_t *) count;
+}
+
+static gboolean
+_allocate_and_map (GulkanIndirectBuffer *self)
+{
+  VkBufferUsageFlags usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                             | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                             | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                     | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  /* Slices are bound as storage buffers by compute passes */
+  VkPhysicalDeviceProperties *props
+    = gulkan_device_get_physical_device_properties (self->device);
+  VkDeviceSize alignment = MAX (props->limits.minStorageBufferOffsetAlignment,
+                                4);
+
+  VkDeviceSize commands_size = sizeof (VkDrawIndexedIndirectCommand)
+                               * self->max_draws;
+  self->slice_size = (commands_size + alignment - 1) / alignment * alignment;
+  self->count_slice_size = alignment;
+
+  self->buffer = gulkan_buffer_new (self->device,
+                                    self->slice_size * self->slice_count,
+                                    usage, properties);
+  if (!self->buffer)
+    {
+      g_printerr ("Could not create indirect buffer.\n");
+      return FALSE;
+    }
+
+  self->count_buffer = gulkan_buffer_new (self->device,
+                                          self->count_slice_size
+                                            * self->slice_count,
+                                          usage, properties);
+  if (!self->count_buffer)
+    {
+      g_printerr ("Could not create indirect count buffer.\n");
+      return FALSE;
+    }
+
+  if (!gulkan_buffer_map (self->buffer, (void **) &self->commands_map))
+    return FALSE;
+
+  if (!gulkan_buffer_map (self->count_buffer, (void **) &self->count_map))
+    return FALSE;
+
+  memset (self->commands_map, 0, self->slice_size * self->slice_count);
+  memset (self->count_map, 0, self->count_slice_size * self->slice_count);
+
+  _select_slice (self, 0);
+
+  return TRUE;
+}
+
+/**
+ * gulkan_indirect_buffer_new:
+ * @device: a #GulkanDevice
+ * @max_draws: the number of commands a frame can draw
+ * @frame_count: number of frames that may be in flight, for example
+ * gulkan_swapchain_renderer_get_max_queued_frames()
+ *
+ * Returns: (transfer full): a new #GulkanIndirectBuffer or %NULL on failure
+ */
+GulkanIndirectBuffer *
+gulkan_indirect_buffer_new (GulkanDevice *device,
+                            uint32_t      max_draws,
+                            uint32_t      frame_count)
+{
+  g_return_val_if_fail (max_draws > 0, NULL);
+
+  GulkanIndirectBuffer *self = (GulkanIndirectBuffer *)
+    g_object_new (GULKAN_TYPE_INDIRECT_BUFFER, 0);
+  self->device = g_object_ref (device);
+  self->max_draws = max_draws;
+  self->slice_count = MAX (frame_count, 1);
+
+  if (!_allocate_and_map (self))
+    {
+      g_object_unref (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+/**
+ * gulkan_indirect_buffer_reset:
+ * @self: a #GulkanIndirectBuffer
+ * @frame_slot: the frame slot that draws the commands
+ *
+ * Selects the slice of @frame_slot, sets its draw count to 0 and clears its
+ * commands from the CPU, before appending the commands of a frame. The
+ * frame that used the slice before needs to be finished, which is the case
+ * for gulkan_swapchain_renderer_get_frame_slot() while recording.
+ */
+void
+gulkan_indirect_buffer_reset (GulkanIndirectBuffer *self, uint32_t frame_slot)
+{
+  _select_slice (self, frame_slot);
+
+  memset (self->commands, 0,
+          sizeof (VkDrawIndexedIndirectCommand) * self->max_draws);
+  *self->count = 0;
+}
+
+/**
+ * gulkan_indirect_buffer_append:
+ * @self: a #GulkanIndirectBuffer
+ * @command: the command to append
+ *
+ * Appends to the slice selected by the last gulkan_indirect_buffer_reset().
+ *
+ * Returns: %FALSE if the buffer is full
+ */
+gboolean
+gulkan_indirect_buffer_append (GulkanIndirectBuffer               *self,
+                               const VkDrawIndexedIndirectCommand *command)
+{
+  if (*self->count >= self->max_draws)
+    {
+      g_warning ("Indirect buffer is full (%u draws).", self->max_draws);
+      return FALSE;
+    }
+
+  self->commands[*self->count] = *command;
+  (*self->count)++;
+
+  return TRUE;
+}
+
+/**
+ * gulkan_indirect_buffer_set_commands:
+ * @self: a #GulkanIndirectBuffer
+ * @frame_slot: the frame slot that draws the commands
+ * @cmds: (array length=count): the commands
+ * @count: number of @cmds
+ *
+ * Selects the slice of @frame_slot like gulkan_indirect_buffer_reset(),
+ * replaces its commands and sets its draw count to @count. The commands
+ * after @count are cleared.
+ *
+ * Returns: %FALSE if @count exceeds the capacity
+ */
+gboolean
+gulkan_indirect_buffer_set_commands (
+  GulkanIndirectBuffer               *self,
+  uint32_t                            frame_slot,
+  const VkDrawIndexedIndirectCommand *cmds,
+  uint32_t                            count)
+{
+  if (count > self->max_draws)
+    {
+      g_warning ("%u draws exceed indirect buffer size of %u.", count,
+                 self->max_draws);
+      return FALSE;
+    }
+
+  _select_slice (self, frame_slot);
+
+  memcpy (self->commands, cmds,
+          sizeof (VkDrawIndexedIndirectCommand) * count);
+  memset (&self->commands[count], 0,
+          sizeof (VkDrawIndexedIndirectCommand) * (self->max_draws - count));
+  *self->count = count;
+
+  return TRUE;
+}
+
+/**
+ * gulkan_indirect_buffer_get_draw_count:
+ * @self: a #GulkanIndirectBuffer
+ *
+ * Returns: the draw count of the selected slice, as last written by the CPU
+ * or a finished GPU pass
+ */
+uint32_t
+gulkan_indirect_buffer_get_draw_count (GulkanIndirectBuffer *self)
+{
+  return *self->count;
+}
+
+uint32_t
+gulkan_indirect_buffer_get_max_draws (GulkanIndirectBuffer *self)
+{
+  return self->max_draws;
+}
+
+/**
+ * gulkan_indirect_buffer_get_buffer:
+ * @self: a #GulkanIndirectBuffer
+ *
+ * Returns: (transfer none): the #GulkanBuffer holding the commands of all
+ * slices
+ */
+GulkanBuffer *
+gulkan_indirect_buffer_get_buffer (GulkanIndirectBuffer *self)
+{
+  return self->buffer;
+}
+
+/**
+ * gulkan_indirect_buffer_get_offset:
+ * @self: a #GulkanIndirectBuffer
+ *
+ * Returns: the offset of the selected slice in
+ * gulkan_indirect_buffer_get_buffer(), for binding it to a compute pass
+ */
+VkDeviceSize
+gulkan_indirect_buffer_get_offset (GulkanIndirectBuffer *self)
+{
+  return self->slice * self->slice_size;
+}
+
+/**
+ * gulkan_indirect_buffer_get_count_buffer:
+ * @self: a #GulkanIndirectBuffer
+ *
+ * Returns: (transfer none): the #GulkanBuffer holding a uint32_t draw count
+ * for each slice
+ */
+GulkanBuffer *
+gulkan_indirect_buffer_get_count_buffer (GulkanIndirectBuffer *self)
+{
+  return self->count_buffer;
+}
+
+/**
+ * gulkan_indirect_buffer_get_count_offset:
+ * @self: a #GulkanIndirectBuffer
+ *
+ * Returns: the offset of the draw count of the selected slice in
+ * gulkan_indirect_buffer_get_count_buffer()
+ */
+VkDeviceSize
+gulkan_indirect_buffer_get_count_offset (GulkanIndirectBuffer *self)
+{
+  return self->slice * self->count_slice_size;
+}
+
+const VkDrawIndexedIndirectCommand *
+gulkan_indirect_buffer_get_commands (GulkanIndirectBuffer *self)
+{
+  return self->commands;
+}
+
+/**
+ * gulkan_indirect_buffer_cmd_reset_count:
+ * @self: a #GulkanIndirectBuffer
+ * @frame_slot: the frame slot that draws the commands
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ *
+ * Selects the slice of @frame_slot and records a clear of its draw count
+ * and commands, to be done before a compute pass appends commands. Commands
+ * of an earlier frame in the slice would otherwise be drawn by
+ * gulkan_indirect_buffer_draw_count() without
+ * gulkan_device_supports_draw_indirect_count(). Must be recorded outside of
+ * a render pass.
+ */
+void
+gulkan_indirect_buffer_cmd_reset_count (GulkanIndirectBuffer *self,
+                                        uint32_t              frame_slot,
+                                        VkCommandBuffer       cmd_buffer)
+{
+  _select_slice (self, frame_slot);
+
+  VkBuffer     buffer = gulkan_buffer_get_handle (self->buffer);
+  VkBuffer     count_buffer = gulkan_buffer_get_handle (self->count_buffer);
+  VkDeviceSize offset = gulkan_indirect_buffer_get_offset (self);
+  VkDeviceSize count_offset = gulkan_indirect_buffer_get_count_offset (self);
+  vkCmdFillBuffer (cmd_buffer, buffer, offset, self->slice_size, 0);
+  vkCmdFillBuffer (cmd_buffer, count_buffer, count_offset, sizeof (uint32_t),
+                   0);
+
+  /* The compute pass may be skipped, so indirect draws read them as well */
+  VkAccessFlags dst_access = VK_ACCESS_SHADER_READ_BIT
+                             | VK_ACCESS_SHADER_WRITE_BIT
+                             | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+  VkBufferMemoryBarrier barriers[2] = {
+    {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = dst_access,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = buffer,
+      .offset = offset,
+      .size = self->slice_size,
+    },
+    {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = dst_access,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = count_buffer,
+      .offset = count_offset,
+      .size = sizeof (uint32_t),
+    },
+  };
+
+  vkCmdPipelineBarrier (cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                          | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                        0, 0, NULL, 2, barriers, 0, NULL);
+}
+
+/**
+ * gulkan_indirect_buffer_cmd_barrier:
+ * @self: a #GulkanIndirectBuffer
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ *
+ * Makes commands and count written by a compute pass visible to the
+ * indirect draws recorded after it.
+ */
+void
+gulkan_indirect_buffer_cmd_barrier (GulkanIndirectBuffer *self,
+                                    VkCommandBuffer       cmd_buffer)
+{
+  VkBufferMemoryBarrier barriers[2] = {
+    {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = gulkan_buffer_get_handle (self->buffer),
+      .offset = 0,
+      .size = VK_WHOLE_SIZE,
+    },
+    {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = gulkan_buffer_get_handle (self->count_buffer),
+      .offset = 0,
+      .size = VK_WHOLE_SIZE,
+    },
+  };
+
+  vkCmdPipelineBarrier (cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, NULL, 2,
+                        barriers, 0, NULL);
+}
+
+/* The most draws a single indirect call may do */
+static uint32_t
+_get_max_draw_count (GulkanIndirectBuffer *self)
+{
+  VkPhysicalDeviceProperties *props
+    = gulkan_device_get_physical_device_properties (self->device);
+  return MAX (props->limits.maxDrawIndirectCount, 1);
+}
+
+static void
+_draw_commands (GulkanIndirectBuffer *self,
+                VkCommandBuffer       cmd_buffer,
+                uint32_t              count)
+{
+  VkBuffer     buffer = gulkan_buffer_get_handle (self->buffer);
+  VkDeviceSize offset = gulkan_indirect_buffer_get_offset (self);
+  uint32_t     stride = sizeof (VkDrawIndexedIndirectCommand);
+  uint32_t     max_draw_count
+    = gulkan_device_supports_multi_draw_indirect (self->device)
+        ? _get_max_draw_count (self)
+        : 1;
+
+  for (uint32_t first = 0; first < count; first += max_draw_count)
+    vkCmdDrawIndexedIndirect (cmd_buffer, buffer,
+                              offset + (VkDeviceSize) first * stride,
+                              MIN (count - first, max_draw_count), stride);
+}
+
+/**
+ * gulkan_indirect_buffer_draw:
+ * @self: a #GulkanIndirectBuffer
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ *
+ * Draws the commands of the selected slice written from the CPU with a
+ * single multi-draw, or one indirect draw per command when
+ * multiDrawIndirect is not supported. Multi-draws are split at
+ * maxDrawIndirectCount.
+ *
+ * The draw count is recorded into @cmd_buffer, appending or replacing
+ * commands afterwards requires recording again.
+ */
+void
+gulkan_indirect_buffer_draw (GulkanIndirectBuffer *self,
+                             VkCommandBuffer       cmd_buffer)
+{
+  if (*self->count == 0)
+    return;
+
+  _draw_commands (self, cmd_buffer, *self->count);
+}
+
+/**
+ * gulkan_indirect_buffer_draw_count:
+ * @self: a #GulkanIndirectBuffer
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ *
+ * Draws as many commands of the selected slice as its count buffer holds
+ * when the commands are executed, so a compute pass recorded before can
+ * decide the count. At most maxDrawIndirectCount commands are drawn.
+ *
+ * Without gulkan_device_supports_draw_indirect_count() all commands up to
+ * the capacity are drawn. Commands that were never written are zeroed, culled
+ * commands then need an instanceCount of 0.
+ */
+void
+gulkan_indirect_buffer_draw_count (GulkanIndirectBuffer *self,
+                                   VkCommandBuffer       cmd_buffer)
+{
+  if (!gulkan_device_supports_draw_indirect_count (self->device))
+    {
+      _draw_commands (self, cmd_buffer, self->max_draws);
+      return;
+    }
+
+  uint32_t max_draw_count = MIN (self->max_draws, _get_max_draw_count (self));
+
+  gulkan_device_cmd_draw_indexed_indirect_count (
+    self->device, cmd_buffer, gulkan_buffer_get_handle (self->buffer),
+    gulkan_indirect_buffer_get_offset (self),
+    gulkan_buffer_get_handle (self->count_buffer),
+    gulkan_indirect_buffer_get_count_offset (self), max_draw_count,
+    sizeof (VkDrawIndexedIndirectCommand));
+}
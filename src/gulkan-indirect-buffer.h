@@ -0,0 +1,86 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GULKAN_INDIRECT_BUFFER_H_
+#define GULKAN_INDIRECT_BUFFER_H_
+
+#if !defined(GULKAN_INSIDE) && !defined(GULKAN_COMPILATION)
+#error "Only <gulkan.h> can be included directly."
+#endif
+
+#include <glib-object.h>
+#include <vulkan/vulkan.h>
+
+#include "gulkan-buffer.h"
+#include "gulkan-device.h"
+
+G_BEGIN_DECLS
+
+#define GULKAN_TYPE_INDIRECT_BUFFER gulkan_indirect_buffer_get_type ()
+G_DECLARE_FINAL_TYPE (GulkanIndirectBuffer,
+                      gulkan_indirect_buffer,
+                      GULKAN,
+                      INDIRECT_BUFFER,
+                      GObject)
+
+GulkanIndirectBuffer *
+gulkan_indirect_buffer_new (GulkanDevice *device,
+                            uint32_t      max_draws,
+                            uint32_t      frame_count);
+
+void
+gulkan_indirect_buffer_reset (GulkanIndirectBuffer *self, uint32_t frame_slot);
+
+gboolean
+gulkan_indirect_buffer_append (GulkanIndirectBuffer               *self,
+                               const VkDrawIndexedIndirectCommand *command);
+
+gboolean
+gulkan_indirect_buffer_set_commands (
+  GulkanIndirectBuffer               *self,
+  uint32_t                            frame_slot,
+  const VkDrawIndexedIndirectCommand *cmds,
+  uint32_t                            count);
+
+uint32_t
+gulkan_indirect_buffer_get_draw_count (GulkanIndirectBuffer *self);
+
+uint32_t
+gulkan_indirect_buffer_get_max_draws (GulkanIndirectBuffer *self);
+
+GulkanBuffer *
+gulkan_indirect_buffer_get_buffer (GulkanIndirectBuffer *self);
+
+VkDeviceSize
+gulkan_indirect_buffer_get_offset (GulkanIndirectBuffer *self);
+
+GulkanBuffer *
+gulkan_indirect_buffer_get_count_buffer (GulkanIndirectBuffer *self);
+
+VkDeviceSize
+gulkan_indirect_buffer_get_count_offset (GulkanIndirectBuffer *self);
+
+void
+gulkan_indirect_buffer_cmd_reset_count (GulkanIndirectBuffer *self,
+                                        uint32_t              frame_slot,
+                                        VkCommandBuffer       cmd_buffer);
+
+void
+gulkan_indirect_buffer_cmd_barrier (GulkanIndirectBuffer *self,
+                                    VkCommandBuffer       cmd_buffer);
+
+void
+gulkan_indirect_buffer_draw (GulkanIndirectBuffer *self,
+                             VkCommandBuffer       cmd_buffer);
+
+void
+gulkan_indirect_buffer_draw_count (GulkanIndirectBuffer *self,
+                                   VkCommandBuffer       cmd_buffer);
+
+G_END_DECLS
+
+#endif /* GULKAN_INDIRECT_BUFFER_H_ */
@@ -0,0 +1,661 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "gulkan-mesh-pool.h"
+
+/**
+ * GulkanMeshPool:
+ *
+ * Packs many meshes into one shared vertex and one shared 32 bit index
+ * buffer, so all of them can be drawn after a single bind, or with one
+ * #GulkanIndirectBuffer multi-draw.
+ *
+ * Ranges of removed meshes are only reused after as many
+ * gulkan_mesh_pool_collect() calls as there are frames in flight, so frames
+ * still reading them are not affected. Collecting also compacts the pool
+ * incrementally by moving meshes from the end into lower holes.
+ */
+
+typedef struct
+{
+  uint32_t offset;
+  uint32_t count;
+} GulkanPoolRange;
+
+typedef struct
+{
+  GulkanPoolRange range;
+  uint64_t        frame;
+} GulkanRetiredRange;
+
+typedef struct
+{
+  GulkanBuffer *buffer;
+  uint8_t      *map;
+  VkDeviceSize  element_size;
+  uint32_t      capacity;
+  GArray       *free_ranges;
+  GArray       *retired;
+} GulkanPoolArena;
+
+struct _GulkanMeshPool
+{
+  GObject parent;
+
+  GulkanDevice *device;
+
+  GulkanPoolArena vertices;
+  GulkanPoolArena indices;
+
+  GHashTable *meshes;
+  guint       next_mesh;
+
+  uint64_t frame;
+  uint32_t frames_in_flight;
+};
+
+G_DEFINE_TYPE (GulkanMeshPool, gulkan_mesh_pool, G_TYPE_OBJECT)
+
+static void
+_arena_finalize (GulkanPoolArena *arena)
+{
+  if (arena->map)
+    gulkan_buffer_unmap (arena->buffer);
+  g_clear_object (&arena->buffer);
+  g_array_free (arena->free_ranges, TRUE);
+  g_array_free (arena->retired, TRUE);
+}
+
+static void
+_finalize (GObject *gobject)
+{
+  GulkanMeshPool *self = GULKAN_MESH_POOL (gobject);
+
+  _arena_finalize (&self->vertices);
+  _arena_finalize (&self->indices);
+
+  g_hash_table_unref (self->meshes);
+  g_clear_object (&self->device);
+
+  G_OBJECT_CLASS (gulkan_mesh_pool_parent_class)->finalize (gobject);
+}
+
+static void
+gulkan_mesh_pool_class_init (GulkanMeshPoolClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  object_class->finalize = _finalize;
+}
+
+static void
+_arena_init (GulkanPoolArena *arena)
+{
+  arena->buffer = NULL;
+  arena->map = NULL;
+  arena->element_size = 0;
+  arena->capacity = 0;
+  arena->free_ranges = g_array_new (FALSE, FALSE, sizeof (GulkanPoolRange));
+  arena->retired = g_array_new (FALSE, FALSE, sizeof (GulkanRetiredRange));
+}
+
+static void
+gulkan_mesh_pool_init (GulkanMeshPool *self)
+{
+  self->device = NULL;
+  _arena_init (&self->vertices);
+  _arena_init (&self->indices);
+  self->meshes = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                        g_free);
+  self->next_mesh = 1;
+  self->frame = 0;
+  self->frames_in_flight = 2;
+}
+
+static gboolean
+_arena_allocate (GulkanPoolArena   *arena,
+                 GulkanDevice      *device,
+                 VkDeviceSize       element_size,
+                 uint32_t           capacity,
+                 VkBufferUsageFlags usage)
+{
+  arena->element_size = element_size;
+  arena->capacity = capacity;
+
+  /* Mapped for writing, the device can read it back with a copy. */
+  usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+           | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+  arena->buffer = gulkan_buffer_new (device, element_size * capacity, usage,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                       | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (!arena->buffer)
+    return FALSE;
+
+  if (!gulkan_buffer_map (arena->buffer, (void **) &arena->map))
+    {
+      arena->map = NULL;
+      return FALSE;
+    }
+
+  GulkanPoolRange all = {.offset = 0, .count = capacity};
+  g_array_append_val (arena->free_ranges, all);
+
+  return TRUE;
+}
+
+/* First fit. Free ranges are sorted by offset. */
+static gboolean
+_arena_take (GulkanPoolArena *arena, uint32_t count, uint32_t *offset)
+{
+  for (guint i = 0; i < arena->free_ranges->len; i++)
+    {
+      GulkanPoolRange *hole = &g_array_index (arena->free_ranges,
+                                              GulkanPoolRange, i);
+      if (hole->count < count)
+        continue;
+
+      *offset = hole->offset;
+      hole->offset += count;
+      hole->count -= count;
+      if (hole->count == 0)
+        g_array_remove_index (arena->free_ranges, i);
+
+      return TRUE;
+    }
+  return FALSE;
+}
+
+/* Same as _arena_take, but only accepts holes that start below limit. */
+static gboolean
+_arena_take_below (GulkanPoolArena *arena,
+                   uint32_t         count,
+                   uint32_t         limit,
+                   uint32_t        *offset)
+{
+  for (guint i = 0; i < arena->free_ranges->len; i++)
+    {
+      GulkanPoolRange *hole = &g_array_index (arena->free_ranges,
+                                              GulkanPoolRange, i);
+      if (hole->offset >= limit)
+        return FALSE;
+      if (hole->count >= count)
+        return _arena_take (arena, count, offset);
+    }
+  return FALSE;
+}
+
+static gboolean
+_arena_has_hole_below (GulkanPoolArena *arena, uint32_t count, uint32_t limit)
+{
+  for (guint i = 0; i < arena->free_ranges->len; i++)
+    {
+      GulkanPoolRange *hole = &g_array_index (arena->free_ranges,
+                                              GulkanPoolRange, i);
+      if (hole->offset >= limit)
+        return FALSE;
+      if (hole->count >= count)
+        return TRUE;
+    }
+  return FALSE;
+}
+
+/* Inserts sorted and merges with adjacent holes. */
+static void
+_arena_free (GulkanPoolArena *arena, GulkanPoolRange range)
+{
+  guint i = 0;
+  while (i < arena->free_ranges->len
+         && g_array_index (arena->free_ranges, GulkanPoolRange, i).offset
+              < range.offset)
+    i++;
+
+  g_array_insert_val (arena->free_ranges, i, range);
+
+  if (i + 1 < arena->free_ranges->len)
+    {
+      GulkanPoolRange *cur = &g_array_index (arena->free_ranges,
+                                             GulkanPoolRange, i);
+      GulkanPoolRange *next = cur + 1;
+      if (cur->offset + cur->count == next->offset)
+        {
+          cur->count += next->count;
+          g_array_remove_index (arena->free_ranges, i + 1);
+        }
+    }
+
+  if (i > 0)
+    {
+      GulkanPoolRange *prev = &g_array_index (arena->free_ranges,
+                                              GulkanPoolRange, i - 1);
+      GulkanPoolRange *cur = prev + 1;
+      if (prev->offset + prev->count == cur->offset)
+        {
+          prev->count += cur->count;
+          g_array_remove_index (arena->free_ranges, i);
+        }
+    }
+}
+
+static void
+_arena_retire (GulkanPoolArena *arena, GulkanPoolRange range, uint64_t frame)
+{
+  GulkanRetiredRange retired = {.range = range, .frame = frame};
+  g_array_append_val (arena->retired, retired);
+}
+
+static void
+_arena_release (GulkanPoolArena *arena, uint64_t frame, uint32_t delay)
+{
+  guint i = 0;
+  while (i < arena->retired->len)
+    {
+      GulkanRetiredRange *r = &g_array_index (arena->retired,
+                                              GulkanRetiredRange, i);
+      if (r->frame + delay <= frame)
+        {
+          _arena_free (arena, r->range);
+          g_array_remove_index_fast (arena->retired, i);
+        }
+      else
+        {
+          i++;
+        }
+    }
+}
+
+static void
+_arena_write (GulkanPoolArena *arena,
+              uint32_t         offset,
+              const void      *data,
+              uint32_t         count)
+{
+  memcpy (arena->map + offset * arena->element_size, data,
+          count * arena->element_size);
+}
+
+/**
+ * gulkan_mesh_pool_new:
+ * @device: a #GulkanDevice
+ * @vertex_stride: size of one interleaved vertex in bytes
+ * @max_vertices: capacity of the shared vertex buffer
+ * @max_indices: capacity of the shared index buffer
+ *
+ * Returns: (transfer full): a new #GulkanMeshPool or %NULL on failure
+ */
+GulkanMeshPool *
+gulkan_mesh_pool_new (GulkanDevice *device,
+                      VkDeviceSize  vertex_stride,
+                      uint32_t      max_vertices,
+                      uint32_t      max_indices)
+{
+  GulkanMeshPool *self = (GulkanMeshPool *)
+    g_object_new (GULKAN_TYPE_MESH_POOL, 0);
+  self->device = g_object_ref (device);
+
+  if (!_arena_allocate (&self->vertices, device, vertex_stride, max_vertices,
+                        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+      || !_arena_allocate (&self->indices, device, sizeof (uint32_t),
+                           max_indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT))
+    {
+      g_printerr ("Could not allocate mesh pool buffers.\n");
+      g_object_unref (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+/**
+ * gulkan_mesh_pool_set_frames_in_flight:
+ * @self: a #GulkanMeshPool
+ * @count: number of frames that may still read from the pool
+ *
+ * Defaults to 2.
+ */
+void
+gulkan_mesh_pool_set_frames_in_flight (GulkanMeshPool *self, uint32_t count)
+{
+  self->frames_in_flight = count;
+}
+
+/**
+ * gulkan_mesh_pool_add:
+ * @self: a #GulkanMeshPool
+ * @vertices: @vertex_count interleaved vertices
+ * @vertex_count: number of vertices
+ * @indices: (array length=index_count): indices relative to the first vertex
+ * @index_count: number of indices
+ *
+ * Returns: a handle for the mesh, or 0 when the pool is full
+ */
+guint
+gulkan_mesh_pool_add (GulkanMeshPool *self,
+                      const void     *vertices,
+                      uint32_t        vertex_count,
+                      const uint32_t *indices,
+                      uint32_t        index_count)
+{
+  g_return_val_if_fail (vertex_count > 0 && index_count > 0, 0);
+
+  uint32_t vertex_offset;
+  uint32_t first_index;
+
+  if (!_arena_take (&self->vertices, vertex_count, &vertex_offset))
+    {
+      g_printerr ("Mesh pool has no room for %u vertices.\n", vertex_count);
+      return 0;
+    }
+
+  if (!_arena_take (&self->indices, index_count, &first_index))
+    {
+      g_printerr ("Mesh pool has no room for %u indices.\n", index_count);
+      _arena_free (&self->vertices, (GulkanPoolRange){
+                                      .offset = vertex_offset,
+                                      .count = vertex_count,
+                                    });
+      return 0;
+    }
+
+  _arena_write (&self->vertices, vertex_offset, vertices, vertex_count);
+  _arena_write (&self->indices, first_index, indices, index_count);
+
+  GulkanMeshRange *range = g_malloc (sizeof (GulkanMeshRange));
+  *range = (GulkanMeshRange){
+    .vertex_offset = (int32_t) vertex_offset,
+    .vertex_count = vertex_count,
+    .first_index = first_index,
+    .index_count = index_count,
+  };
+
+  guint mesh = self->next_mesh++;
+  g_hash_table_insert (self->meshes, GUINT_TO_POINTER (mesh), range);
+
+  return mesh;
+}
+
+/**
+ * gulkan_mesh_pool_remove:
+ * @self: a #GulkanMeshPool
+ * @mesh: a handle returned by gulkan_mesh_pool_add()
+ */
+void
+gulkan_mesh_pool_remove (GulkanMeshPool *self, guint mesh)
+{
+  GulkanMeshRange *range = g_hash_table_lookup (self->meshes,
+                                                GUINT_TO_POINTER (mesh));
+  if (!range)
+    {
+      g_warning ("Removing unknown mesh %u.", mesh);
+      return;
+    }
+
+  _arena_retire (&self->vertices,
+                 (GulkanPoolRange){
+                   .offset = (uint32_t) range->vertex_offset,
+                   .count = range->vertex_count,
+                 },
+                 self->frame);
+  _arena_retire (&self->indices,
+                 (GulkanPoolRange){
+                   .offset = range->first_index,
+                   .count = range->index_count,
+                 },
+                 self->frame);
+
+  g_hash_table_remove (self->meshes, GUINT_TO_POINTER (mesh));
+}
+
+/**
+ * gulkan_mesh_pool_get_range:
+ * @self: a #GulkanMeshPool
+ * @mesh: a mesh handle
+ * @range: (out): the current location of the mesh
+ *
+ * Returns: %FALSE if @mesh is unknown
+ */
+gboolean
+gulkan_mesh_pool_get_range (GulkanMeshPool  *self,
+                            guint            mesh,
+                            GulkanMeshRange *range)
+{
+  GulkanMeshRange *found = g_hash_table_lookup (self->meshes,
+                                                GUINT_TO_POINTER (mesh));
+  if (!found)
+    return FALSE;
+
+  *range = *found;
+  return TRUE;
+}
+
+/**
+ * gulkan_mesh_pool_get_draw_command:
+ * @self: a #GulkanMeshPool
+ * @mesh: a mesh handle
+ * @instances: number of instances to draw
+ * @command: (out): a command for a #GulkanIndirectBuffer
+ *
+ * Returns: %FALSE if @mesh is unknown
+ */
+gboolean
+gulkan_mesh_pool_get_draw_command (GulkanMeshPool               *self,
+                                   guint                         mesh,
+                                   uint32_t                      instances,
+                                   VkDrawIndexedIndirectCommand *command)
+{
+  GulkanMeshRange range;
+  if (!gulkan_mesh_pool_get_range (self, mesh, &range))
+    return FALSE;
+
+  *command = (VkDrawIndexedIndirectCommand){
+    .indexCount = range.index_count,
+    .instanceCount = instances,
+    .firstIndex = range.first_index,
+    .vertexOffset = range.vertex_offset,
+    .firstInstance = 0,
+  };
+  return TRUE;
+}
+
+/* Moves the highest mesh that fits into a lower hole, returns bytes moved. */
+static VkDeviceSize
+_compact_vertices (GulkanMeshPool *self, VkDeviceSize budget)
+{
+  GulkanPoolArena *arena = &self->vertices;
+  GulkanMeshRange *best = NULL;
+
+  GHashTableIter iter;
+  gpointer       value;
+  g_hash_table_iter_init (&iter, self->meshes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GulkanMeshRange *range = value;
+      if (best && range->vertex_offset <= best->vertex_offset)
+        continue;
+      if (range->vertex_count * arena->element_size > budget)
+        continue;
+      if (_arena_has_hole_below (arena, range->vertex_count,
+                                 (uint32_t) range->vertex_offset))
+        best = range;
+    }
+
+  if (!best)
+    return 0;
+
+  uint32_t offset;
+  if (!_arena_take_below (arena, best->vertex_count,
+                          (uint32_t) best->vertex_offset, &offset))
+    return 0;
+
+  _arena_write (arena, offset,
+                arena->map + best->vertex_offset * arena->element_size,
+                best->vertex_count);
+  _arena_retire (arena,
+                 (GulkanPoolRange){
+                   .offset = (uint32_t) best->vertex_offset,
+                   .count = best->vertex_count,
+                 },
+                 self->frame);
+  best->vertex_offset = (int32_t) offset;
+
+  return best->vertex_count * arena->element_size;
+}
+
+static VkDeviceSize
+_compact_indices (GulkanMeshPool *self, VkDeviceSize budget)
+{
+  GulkanPoolArena *arena = &self->indices;
+  GulkanMeshRange *best = NULL;
+
+  GHashTableIter iter;
+  gpointer       value;
+  g_hash_table_iter_init (&iter, self->meshes);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      GulkanMeshRange *range = value;
+      if (best && range->first_index <= best->first_index)
+        continue;
+      if (range->index_count * arena->element_size > budget)
+        continue;
+      if (_arena_has_hole_below (arena, range->index_count,
+                                 range->first_index))
+        best = range;
+    }
+
+  if (!best)
+    return 0;
+
+  uint32_t offset;
+  if (!_arena_take_below (arena, best->index_count, best->first_index,
+                          &offset))
+    return 0;
+
+  _arena_write (arena, offset,
+                arena->map + best->first_index * arena->element_size,
+                best->index_count);
+  _arena_retire (arena,
+                 (GulkanPoolRange){
+                   .offset = best->first_index,
+                   .count = best->index_count,
+                 },
+                 self->frame);
+  best->first_index = offset;
+
+  return best->index_count * arena->element_size;
+}
+
+/**
+ * gulkan_mesh_pool_collect:
+ * @self: a #GulkanMeshPool
+ * @max_bytes: how much mesh data may be moved by this call
+ *
+ * Call once per frame, after the fence of the oldest frame in flight was
+ * waited for. Releases ranges no frame can read anymore and moves meshes
+ * into lower holes, until @max_bytes were copied. Pass 0 to only release.
+ *
+ * Returns: %TRUE if a mesh moved, so draws recorded with its old range
+ * need to be recorded again.
+ */
+gboolean
+gulkan_mesh_pool_collect (GulkanMeshPool *self, VkDeviceSize max_bytes)
+{
+  self->frame++;
+  _arena_release (&self->vertices, self->frame, self->frames_in_flight);
+  _arena_release (&self->indices, self->frame, self->frames_in_flight);
+
+  gboolean     moved = FALSE;
+  VkDeviceSize budget = max_bytes;
+  while (budget > 0)
+    {
+      VkDeviceSize vertex_bytes = _compact_vertices (self, budget);
+      budget -= vertex_bytes;
+      VkDeviceSize index_bytes = _compact_indices (self, budget);
+      budget -= index_bytes;
+
+      if (vertex_bytes == 0 && index_bytes == 0)
+        break;
+      moved = TRUE;
+    }
+
+  return moved;
+}
+
+/**
+ * gulkan_mesh_pool_bind:
+ * @self: a #GulkanMeshPool
+ * @cmd_buffer: a #VkCommandBuffer in recording state
+ *
+ * Binds the shared vertex buffer to binding 0 and the shared index buffer.
+ */
+void
+gulkan_mesh_pool_bind (GulkanMeshPool *self, VkCommandBuffer cmd_buffer)
+{
+  VkDeviceSize offset = 0;
+  VkBuffer     vertex_buffer = gulkan_buffer_get_handle (self->vertices.buffer);
+  VkBuffer     index_buffer = gulkan_buffer_get_handle (self->indices.buffer);
+  vkCmdBindVertexBuffers (cmd_buffer, 0, 1, &vertex_buffer, &offset);
+  vkCmdBindIndexBuffer (cmd_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+/**
+ * gulkan_mesh_pool_draw:
+ * @self: a #GulkanMeshPool
+ * @cmd_buffer: a #VkCommandBuffer the pool is bound in
+ * @mesh: a mesh handle
+ * @instances: number of instances to draw
+ */
+void
+gulkan_mesh_pool_draw (GulkanMeshPool *self,
+                       VkCommandBuffer cmd_buffer,
+                       guint           mesh,
+                       uint32_t        instances)
+{
+  GulkanMeshRange range;
+  if (!gulkan_mesh_pool_get_range (self, mesh, &range))
+    {
+      g_warning ("Drawing unknown mesh %u.", mesh);
+      return;
+    }
+
+  vkCmdDrawIndexed (cmd_buffer, range.index_count, instances,
+                    range.first_index, range.vertex_offset, 0);
+}
+
+/**
+ * gulkan_mesh_pool_get_mesh_count:
+ * @self: a #GulkanMeshPool
+ *
+ * Returns: the number of meshes in the pool, removed ones are not counted
+ */
+uint32_t
+gulkan_mesh_pool_get_mesh_count (GulkanMeshPool *self)
+{
+  return g_hash_table_size (self->meshes);
+}
+
+/**
+ * gulkan_mesh_pool_get_vertex_buffer:
+ * @self: a #GulkanMeshPool
+ *
+ * Returns: (transfer none): the shared vertex #GulkanBuffer
+ */
+GulkanBuffer *
+gulkan_mesh_pool_get_vertex_buffer (GulkanMeshPool *self)
+{
+  return self->vertices.buffer;
+}
+
+/**
+ * gulkan_mesh_pool_get_index_buffer:
+ * @self: a #GulkanMeshPool
+ *
+ * Returns: (transfer none): the shared uint32_t index #GulkanBuffer
+ */
+GulkanBuffer *
+gulkan_mesh_pool_get_index_buffer (GulkanMeshPool *self)
+{
+  return self->indices.buffer;
+}
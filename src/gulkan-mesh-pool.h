@@ -0,0 +1,101 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GULKAN_MESH_POOL_H_
+#define GULKAN_MESH_POOL_H_
+
+#if !defined(GULKAN_INSIDE) && !defined(GULKAN_COMPILATION)
+#error "Only <gulkan.h> can be included directly."
+#endif
+
+#include <glib-object.h>
+#include <vulkan/vulkan.h>
+
+#include "gulkan-buffer.h"
+#include "gulkan-device.h"
+
+G_BEGIN_DECLS
+
+#define GULKAN_TYPE_MESH_POOL gulkan_mesh_pool_get_type ()
+G_DECLARE_FINAL_TYPE (GulkanMeshPool,
+                      gulkan_mesh_pool,
+                      GULKAN,
+                      MESH_POOL,
+                      GObject)
+
+/**
+ * GulkanMeshRange:
+ * @vertex_offset: first vertex of the mesh in the shared vertex buffer
+ * @vertex_count: number of vertices
+ * @first_index: first index of the mesh in the shared index buffer
+ * @index_count: number of indices
+ *
+ * Where a mesh currently lives in the pool. Indices are relative to
+ * @vertex_offset, which is passed as vertexOffset when drawing.
+ */
+typedef struct
+{
+  int32_t  vertex_offset;
+  uint32_t vertex_count;
+  uint32_t first_index;
+  uint32_t index_count;
+} GulkanMeshRange;
+
+GulkanMeshPool *
+gulkan_mesh_pool_new (GulkanDevice *device,
+                      VkDeviceSize  vertex_stride,
+                      uint32_t      max_vertices,
+                      uint32_t      max_indices);
+
+void
+gulkan_mesh_pool_set_frames_in_flight (GulkanMeshPool *self, uint32_t count);
+
+guint
+gulkan_mesh_pool_add (GulkanMeshPool *self,
+                      const void     *vertices,
+                      uint32_t        vertex_count,
+                      const uint32_t *indices,
+                      uint32_t        index_count);
+
+void
+gulkan_mesh_pool_remove (GulkanMeshPool *self, guint mesh);
+
+gboolean
+gulkan_mesh_pool_get_range (GulkanMeshPool  *self,
+                            guint            mesh,
+                            GulkanMeshRange *range);
+
+gboolean
+gulkan_mesh_pool_get_draw_command (GulkanMeshPool               *self,
+                                   guint                         mesh,
+                                   uint32_t                      instances,
+                                   VkDrawIndexedIndirectCommand *command);
+
+gboolean
+gulkan_mesh_pool_collect (GulkanMeshPool *self, VkDeviceSize max_bytes);
+
+void
+gulkan_mesh_pool_bind (GulkanMeshPool *self, VkCommandBuffer cmd_buffer);
+
+void
+gulkan_mesh_pool_draw (GulkanMeshPool *self,
+                       VkCommandBuffer cmd_buffer,
+                       guint           mesh,
+                       uint32_t        instances);
+
+uint32_t
+gulkan_mesh_pool_get_mesh_count (GulkanMeshPool *self);
+
+GulkanBuffer *
+gulkan_mesh_pool_get_vertex_buffer (GulkanMeshPool *self);
+
+GulkanBuffer *
+gulkan_mesh_pool_get_index_buffer (GulkanMeshPool *self);
+
+G_END_DECLS
+
+#endif /* GULKAN_MESH_POOL_H_ */
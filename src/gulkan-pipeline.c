@@ -35,6 +35,21 @@ _init (GulkanPipeline       *self,
 {
   GulkanDevice *device = gulkan_context_get_device (self->context);
 
+  if (render_pass == NULL)
+    {
+      if (!gulkan_device_supports_dynamic_rendering (device))
+        {
+          g_printerr ("Pipeline without render pass requires dynamic "
+                      "rendering.\n");
+          return FALSE;
+        }
+      if (config->color_format == VK_FORMAT_UNDEFINED)
+        {
+          g_printerr ("Pipeline without render pass needs a color format.\n");
+          return FALSE;
+        }
+    }
+
   VkShaderModule vs = config->vertex_shader;
   if (vs == VK_NULL_HANDLE)
     {
@@ -105,8 +120,22 @@ _init (GulkanPipeline       *self,
       dynamic_info = &static_dynamic_info;
     }
 
+  /*
+   * Without a render pass the pipeline only depends on attachment formats.
+   * The config is packed, so its members can't be pointed at.
+   */
+  VkFormat                         color_format = config->color_format;
+  VkPipelineRenderingCreateInfoKHR rendering_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+    .viewMask = config->view_mask,
+    .colorAttachmentCount = 1,
+    .pColorAttachmentFormats = &color_format,
+    .depthAttachmentFormat = config->depth_format,
+  };
+
   VkGraphicsPipelineCreateInfo info = {
     .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+    .pNext = render_pass ? NULL : &rendering_info,
     .layout = layout,
     .pVertexInputState = &(VkPipelineVertexInputStateCreateInfo) {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
@@ -153,7 +182,8 @@ _init (GulkanPipeline       *self,
         .pName = "main",
       },
     },
-    .renderPass = gulkan_render_pass_get_handle (render_pass),
+    .renderPass = render_pass ? gulkan_render_pass_get_handle (render_pass)
+                              : VK_NULL_HANDLE,
     .subpass = 0,
   };
 
@@ -172,6 +202,18 @@ _init (GulkanPipeline       *self,
   return TRUE;
 }
 
+/**
+ * gulkan_pipeline_new:
+ * @context: a #GulkanContext
+ * @descriptor_pool: a #GulkanDescriptorPool providing the pipeline layout
+ * @render_pass: (nullable): a #GulkanRenderPass, or %NULL for dynamic rendering
+ * @config: a #GulkanPipelineConfig
+ *
+ * Without @render_pass the pipeline is created for the attachment formats in
+ * @config and can be used with any target of those formats.
+ *
+ * Returns: (transfer full) (nullable): a new #GulkanPipeline
+ */
 GulkanPipeline *
 gulkan_pipeline_new (GulkanContext        *context,
                      GulkanDescriptorPool *descriptor_pool,
@@ -41,6 +41,10 @@ typedef struct __attribute__ ((__packed__))
   const VkPipelineRasterizationStateCreateInfo *rasterization_state;
   gboolean                                      dynamic_viewport;
   gboolean                                      flip_y;
+  /* Attachment formats, only used for dynamic rendering */
+  VkFormat color_format;
+  VkFormat depth_format;
+  uint32_t view_mask;
 } GulkanPipelineConfig;
 
 GulkanPipeline *
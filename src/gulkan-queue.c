@@ -14,6 +14,7 @@ struct _GulkanQueue
   GObject parent;
 
   uint32_t family_index;
+  uint32_t queue_index;
 
   VkQueue handle;
   VkFence fence;
@@ -24,8 +25,29 @@ struct _GulkanQueue
 
   GMutex pool_mutex;
   GMutex queue_mutex;
+
+  GSList *submissions;
+  GArray *acquires;
 };
 
+/* An asynchronous submission and what needs to live until it finished */
+typedef struct
+{
+  VkFence          fence;
+  GulkanCmdBuffer *cmd_buffer;
+  GPtrArray       *resources;
+  VkSemaphore     *semaphores;
+  uint32_t         semaphore_count;
+} GulkanQueueSubmission;
+
+typedef struct
+{
+  VkSemaphore          semaphore;
+  VkPipelineStageFlags stage_mask;
+  VkImageMemoryBarrier barrier;
+  GObject             *resource;
+} GulkanQueueAcquire;
+
 G_DEFINE_TYPE (GulkanQueue, gulkan_queue, G_TYPE_OBJECT)
 
 static void
@@ -33,8 +55,11 @@ gulkan_queue_init (GulkanQueue *self)
 {
   self->handle = VK_NULL_HANDLE;
   self->pool = VK_NULL_HANDLE;
+  self->fence = VK_NULL_HANDLE;
   g_mutex_init (&self->pool_mutex);
   g_mutex_init (&self->queue_mutex);
+  self->submissions = NULL;
+  self->acquires = g_array_new (FALSE, FALSE, sizeof (GulkanQueueAcquire));
 }
 
 /**
@@ -68,24 +93,84 @@ _init_pool (GulkanQueue *self)
 
 GulkanQueue *
 gulkan_queue_new (GulkanDevice *device, uint32_t family_index)
+{
+  return gulkan_queue_new_for_index (device, family_index, 0);
+}
+
+GulkanQueue *
+gulkan_queue_new_for_index (GulkanDevice *device,
+                            uint32_t      family_index,
+                            uint32_t      queue_index)
 {
   GulkanQueue *self = g_object_new (GULKAN_TYPE_QUEUE, 0);
   self->device = device;
   self->family_index = family_index;
+  self->queue_index = queue_index;
 
   return self;
 }
 
+static void
+_free_submission (GulkanQueue *self, GulkanQueueSubmission *submission)
+{
+  VkDevice device = gulkan_device_get_handle (self->device);
+
+  vkDestroyFence (device, submission->fence, NULL);
+  gulkan_queue_free_cmd_buffer (self, submission->cmd_buffer);
+  g_clear_pointer (&submission->resources, g_ptr_array_unref);
+
+  for (uint32_t i = 0; i < submission->semaphore_count; i++)
+    vkDestroySemaphore (device, submission->semaphores[i], NULL);
+  g_free (submission->semaphores);
+
+  g_free (submission);
+}
+
+/* Needs to be called with the queue mutex locked */
+static void
+_retire_submissions (GulkanQueue *self, gboolean wait)
+{
+  VkDevice device = gulkan_device_get_handle (self->device);
+
+  GSList *pending = NULL;
+  for (GSList *l = self->submissions; l; l = l->next)
+    {
+      GulkanQueueSubmission *submission = l->data;
+      if (wait)
+        vkWaitForFences (device, 1, &submission->fence, VK_TRUE, UINT64_MAX);
+      else if (vkGetFenceStatus (device, submission->fence) != VK_SUCCESS)
+        {
+          pending = g_slist_prepend (pending, submission);
+          continue;
+        }
+      _free_submission (self, submission);
+    }
+
+  g_slist_free (self->submissions);
+  self->submissions = pending;
+}
+
 static void
 _finalize (GObject *gobject)
 {
   GulkanQueue *self = GULKAN_QUEUE (gobject);
 
+  VkDevice device = gulkan_device_get_handle (self->device);
+
+  _retire_submissions (self, TRUE);
+
+  for (guint i = 0; i < self->acquires->len; i++)
+    {
+      GulkanQueueAcquire *acquire = &g_array_index (self->acquires,
+                                                    GulkanQueueAcquire, i);
+      vkDestroySemaphore (device, acquire->semaphore, NULL);
+      g_clear_object (&acquire->resource);
+    }
+  g_array_unref (self->acquires);
+
   g_mutex_clear (&self->pool_mutex);
   g_mutex_clear (&self->queue_mutex);
 
-  VkDevice device = gulkan_device_get_handle (self->device);
-
   vkDestroyFence (device, self->fence, NULL);
 
   if (self->pool != VK_NULL_HANDLE)
@@ -130,6 +215,12 @@ gulkan_queue_get_family_index (GulkanQueue *self)
   return self->family_index;
 }
 
+uint32_t
+gulkan_queue_get_queue_index (GulkanQueue *self)
+{
+  return self->queue_index;
+}
+
 /**
  * gulkan_queue_get_handle:
  * @self: a #GulkanQueue
@@ -146,7 +237,8 @@ gboolean
 gulkan_queue_initialize (GulkanQueue *self)
 {
   VkDevice device = gulkan_device_get_handle (self->device);
-  vkGetDeviceQueue (device, self->family_index, 0, &self->handle);
+  vkGetDeviceQueue (device, self->family_index, self->queue_index,
+                    &self->handle);
 
   if (!_init_pool (self))
     {
@@ -201,6 +293,9 @@ gulkan_queue_submit (GulkanQueue *self, GulkanCmdBuffer *cmd_buffer)
 {
   VkCommandBuffer cmd_buffer_handle = gulkan_cmd_buffer_get_handle (cmd_buffer);
 
+  if (!gulkan_queue_flush_acquires (self))
+    return FALSE;
+
   g_mutex_lock (&self->queue_mutex);
   VkDevice d = gulkan_device_get_handle (self->device);
   VkResult res = vkWaitForFences (d, 1, &self->fence, VK_TRUE, UINT64_MAX);
@@ -216,6 +311,8 @@ gulkan_queue_submit (GulkanQueue *self, GulkanCmdBuffer *cmd_buffer)
 
   vkQueueWaitIdle (self->handle);
 
+  _retire_submissions (self, FALSE);
+
   g_mutex_unlock (&self->queue_mutex);
   vk_check_error ("vkQueueSubmit", res, FALSE);
 
@@ -233,3 +330,212 @@ gulkan_queue_end_submit (GulkanQueue *self, GulkanCmdBuffer *cmd_buffer)
 
   return TRUE;
 }
+
+static gboolean
+_submit_tracked (GulkanQueue                *self,
+                 GulkanCmdBuffer            *cmd_buffer,
+                 uint32_t                    wait_count,
+                 const VkSemaphore          *wait_semaphores,
+                 const VkPipelineStageFlags *wait_stage_masks,
+                 VkSemaphore                 signal_semaphore,
+                 GPtrArray                  *resources,
+                 gboolean                    own_wait_semaphores)
+{
+  VkDevice device = gulkan_device_get_handle (self->device);
+
+  VkFenceCreateInfo fence_info = {
+    .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+  };
+
+  VkFence  fence;
+  VkResult res = vkCreateFence (device, &fence_info, NULL, &fence);
+  vk_check_error ("vkCreateFence", res, FALSE);
+
+  VkCommandBuffer cmd_buffer_handle = gulkan_cmd_buffer_get_handle (cmd_buffer);
+
+  VkSubmitInfo submit_info = {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .waitSemaphoreCount = wait_count,
+    .pWaitSemaphores = wait_semaphores,
+    .pWaitDstStageMask = wait_stage_masks,
+    .commandBufferCount = 1,
+    .pCommandBuffers = &cmd_buffer_handle,
+    .signalSemaphoreCount = signal_semaphore != VK_NULL_HANDLE ? 1 : 0,
+    .pSignalSemaphores = &signal_semaphore,
+  };
+
+  g_mutex_lock (&self->queue_mutex);
+  _retire_submissions (self, FALSE);
+
+  res = vkQueueSubmit (self->handle, 1, &submit_info, fence);
+  if (res == VK_SUCCESS)
+    {
+      GulkanQueueSubmission *submission = g_new0 (GulkanQueueSubmission, 1);
+      submission->fence = fence;
+      submission->cmd_buffer = cmd_buffer;
+      if (resources)
+        submission->resources = g_ptr_array_ref (resources);
+      if (own_wait_semaphores)
+        {
+          submission->semaphores = g_new (VkSemaphore, wait_count);
+          memcpy (submission->semaphores, wait_semaphores,
+                  sizeof (VkSemaphore) * wait_count);
+          submission->semaphore_count = wait_count;
+        }
+      self->submissions = g_slist_prepend (self->submissions, submission);
+    }
+  g_mutex_unlock (&self->queue_mutex);
+
+  if (res != VK_SUCCESS)
+    vkDestroyFence (device, fence, NULL);
+  vk_check_error ("vkQueueSubmit", res, FALSE);
+
+  return TRUE;
+}
+
+/**
+ * gulkan_queue_submit_async:
+ * @self: a #GulkanQueue
+ * @cmd_buffer: (transfer full): an ended #GulkanCmdBuffer
+ * @wait_count: number of semaphores to wait on
+ * @wait_semaphores: semaphores to wait on before execution
+ * @wait_stage_masks: stages at which each semaphore wait happens
+ * @signal_semaphore: a semaphore to signal on completion or VK_NULL_HANDLE
+ * @resource: (nullable): an object to keep alive until completion
+ *
+ * Submits without waiting for the queue to become idle. The command buffer
+ * and @resource are released once the GPU finished executing.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_queue_submit_async (GulkanQueue                *self,
+                           GulkanCmdBuffer            *cmd_buffer,
+                           uint32_t                    wait_count,
+                           const VkSemaphore          *wait_semaphores,
+                           const VkPipelineStageFlags *wait_stage_masks,
+                           VkSemaphore                 signal_semaphore,
+                           GObject                    *resource)
+{
+  GPtrArray *resources = NULL;
+  if (resource)
+    {
+      resources = g_ptr_array_new_with_free_func (g_object_unref);
+      g_ptr_array_add (resources, g_object_ref (resource));
+    }
+
+  gboolean ret = _submit_tracked (self, cmd_buffer, wait_count,
+                                  wait_semaphores, wait_stage_masks,
+                                  signal_semaphore, resources, FALSE);
+
+  if (resources)
+    g_ptr_array_unref (resources);
+
+  return ret;
+}
+
+/**
+ * gulkan_queue_add_acquire:
+ * @self: a #GulkanQueue
+ * @semaphore: (transfer full): signaled by the releasing queue
+ * @stage_mask: stages that wait for the acquired image
+ * @barrier: the acquire half of a queue family ownership transfer
+ * @resource: (nullable): the object owning the image in @barrier
+ *
+ * Queues an ownership acquire that is submitted with the next call to
+ * gulkan_queue_flush_acquires(). A reference to @resource is held until
+ * the acquire finished executing.
+ */
+void
+gulkan_queue_add_acquire (GulkanQueue                *self,
+                          VkSemaphore                 semaphore,
+                          VkPipelineStageFlags        stage_mask,
+                          const VkImageMemoryBarrier *barrier,
+                          GObject                    *resource)
+{
+  GulkanQueueAcquire acquire = {
+    .semaphore = semaphore,
+    .stage_mask = stage_mask,
+    .barrier = *barrier,
+    .resource = resource ? g_object_ref (resource) : NULL,
+  };
+
+  g_mutex_lock (&self->queue_mutex);
+  g_array_append_val (self->acquires, acquire);
+  g_mutex_unlock (&self->queue_mutex);
+}
+
+/**
+ * gulkan_queue_flush_acquires:
+ * @self: a #GulkanQueue
+ *
+ * Submits all pending ownership acquires. Work submitted to this queue
+ * afterwards can safely use the acquired resources.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_queue_flush_acquires (GulkanQueue *self)
+{
+  g_mutex_lock (&self->queue_mutex);
+  GArray *acquires = self->acquires;
+  if (acquires->len == 0)
+    {
+      g_mutex_unlock (&self->queue_mutex);
+      return TRUE;
+    }
+  self->acquires = g_array_new (FALSE, FALSE, sizeof (GulkanQueueAcquire));
+  g_mutex_unlock (&self->queue_mutex);
+
+  VkImageMemoryBarrier *barriers = g_new (VkImageMemoryBarrier, acquires->len);
+  VkSemaphore          *semaphores = g_new (VkSemaphore, acquires->len);
+  VkPipelineStageFlags *stage_masks = g_new (VkPipelineStageFlags,
+                                             acquires->len);
+  VkPipelineStageFlags  dst_stage_mask = 0;
+  GPtrArray            *resources = g_ptr_array_new_with_free_func (
+    g_object_unref);
+  for (guint i = 0; i < acquires->len; i++)
+    {
+      GulkanQueueAcquire *acquire = &g_array_index (acquires,
+                                                    GulkanQueueAcquire, i);
+      barriers[i] = acquire->barrier;
+      semaphores[i] = acquire->semaphore;
+      stage_masks[i] = acquire->stage_mask;
+      dst_stage_mask |= acquire->stage_mask;
+      if (acquire->resource)
+        g_ptr_array_add (resources, acquire->resource);
+    }
+
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (self);
+
+  g_mutex_lock (&self->pool_mutex);
+  gboolean ret = gulkan_cmd_buffer_begin_one_time (cmd_buffer);
+  if (ret)
+    vkCmdPipelineBarrier (gulkan_cmd_buffer_get_handle (cmd_buffer),
+                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage_mask, 0,
+                          0, NULL, 0, NULL, acquires->len, barriers);
+  g_mutex_unlock (&self->pool_mutex);
+
+  if (ret)
+    ret = gulkan_cmd_buffer_end (cmd_buffer);
+
+  if (ret)
+    ret = _submit_tracked (self, cmd_buffer, acquires->len, semaphores,
+                           stage_masks, VK_NULL_HANDLE, resources, TRUE);
+
+  if (!ret)
+    {
+      VkDevice device = gulkan_device_get_handle (self->device);
+      for (guint i = 0; i < acquires->len; i++)
+        vkDestroySemaphore (device, semaphores[i], NULL);
+      gulkan_queue_free_cmd_buffer (self, cmd_buffer);
+    }
+
+  g_free (barriers);
+  g_free (semaphores);
+  g_free (stage_masks);
+  g_ptr_array_unref (resources);
+  g_array_unref (acquires);
+
+  return ret;
+}
@@ -30,6 +30,11 @@ G_DECLARE_FINAL_TYPE (GulkanQueue, gulkan_queue, GULKAN, QUEUE, GObject)
 GulkanQueue *
 gulkan_queue_new (GulkanDevice *device, uint32_t family_index);
 
+GulkanQueue *
+gulkan_queue_new_for_index (GulkanDevice *device,
+                            uint32_t      family_index,
+                            uint32_t      queue_index);
+
 VkCommandPool
 gulkan_queue_get_command_pool (GulkanQueue *self);
 
@@ -39,6 +44,9 @@ gulkan_queue_supports_surface (GulkanQueue *self, VkSurfaceKHR surface);
 uint32_t
 gulkan_queue_get_family_index (GulkanQueue *self);
 
+uint32_t
+gulkan_queue_get_queue_index (GulkanQueue *self);
+
 VkQueue
 gulkan_queue_get_handle (GulkanQueue *self);
 
@@ -59,6 +67,25 @@ gulkan_queue_end_submit (GulkanQueue *self, GulkanCmdBuffer *cmd_buffer);
 GMutex *
 gulkan_queue_get_pool_mutex (GulkanQueue *self);
 
+gboolean
+gulkan_queue_submit_async (GulkanQueue                *self,
+                           GulkanCmdBuffer            *cmd_buffer,
+                           uint32_t                    wait_count,
+                           const VkSemaphore          *wait_semaphores,
+                           const VkPipelineStageFlags *wait_stage_masks,
+                           VkSemaphore                 signal_semaphore,
+                           GObject                    *resource);
+
+void
+gulkan_queue_add_acquire (GulkanQueue                *self,
+                          VkSemaphore                 semaphore,
+                          VkPipelineStageFlags        stage_mask,
+                          const VkImageMemoryBarrier *barrier,
+                          GObject                    *resource);
+
+gboolean
+gulkan_queue_flush_acquires (GulkanQueue *self);
+
 G_END_DECLS
 
 #endif /* GULKAN_QUEUE_H_ */
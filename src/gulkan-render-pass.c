@@ -17,6 +17,8 @@ struct _GulkanRenderPass
   VkRenderPass render_pass;
 
   gboolean use_depth;
+  gboolean resolve;
+  gboolean preserve;
 };
 
 G_DEFINE_TYPE (GulkanRenderPass, gulkan_render_pass, G_TYPE_OBJECT)
@@ -45,6 +47,7 @@ static void
 gulkan_render_pass_init (GulkanRenderPass *self)
 {
   self->render_pass = VK_NULL_HANDLE;
+  self->preserve = FALSE;
 }
 
 static gboolean
@@ -54,48 +57,97 @@ _init (GulkanRenderPass     *self,
        VkFormat              color_format,
        VkImageLayout         final_color_layout,
        gboolean              use_depth,
+       gboolean              resolve,
        const void           *next)
 {
   self->use_depth = use_depth;
+  self->resolve = resolve;
   self->device = g_object_ref (device);
 
   VkDevice vk_device = gulkan_device_get_handle (self->device);
 
-  VkAttachmentDescription *attachements = (VkAttachmentDescription[]){
+  /*
+   * Depth is never read back, and with an in-pass resolve neither is the
+   * multisampled color, so both can stay in tile memory. Preserving passes
+   * keep the color outside of the render area, which only works without a
+   * resolve.
+   */
+  VkAttachmentDescription attachements[3] = {
     {
       .format = color_format,
       .samples = samples,
       .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .storeOp = resolve ? VK_ATTACHMENT_STORE_OP_DONT_CARE
+                         : VK_ATTACHMENT_STORE_OP_STORE,
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-      .finalLayout = final_color_layout,
+      .initialLayout = self->preserve ? final_color_layout
+                                      : VK_IMAGE_LAYOUT_UNDEFINED,
+      .finalLayout = resolve ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                             : final_color_layout,
       .flags = 0,
     },
-    {
+  };
+  uint32_t attachment_count = 1;
+
+  VkAttachmentReference depth_attachement = {
+    .attachment = attachment_count,
+    .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+  };
+
+  if (self->use_depth)
+    attachements[attachment_count++] = (VkAttachmentDescription){
       .format = VK_FORMAT_D32_SFLOAT,
       .samples = samples,
       .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
       .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
       .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
       .flags = 0,
-    },
+    };
+
+  VkAttachmentReference resolve_attachement = {
+    .attachment = attachment_count,
+    .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
   };
 
-  VkAttachmentReference depth_attachement = {
-    .attachment = 1,
-    .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+  if (self->resolve)
+    attachements[attachment_count++] = (VkAttachmentDescription){
+      .format = color_format,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .finalLayout = final_color_layout,
+      .flags = 0,
+    };
+
+  /*
+   * Color writes of earlier submissions, e.g. the previous frame, need to
+   * land before this pass loads or overwrites the attachment. Preserving
+   * passes load it, the others only write. All passes get the same
+   * dependency, so they stay compatible with each other.
+   */
+  VkSubpassDependency dependency = {
+    .srcSubpass = VK_SUBPASS_EXTERNAL,
+    .dstSubpass = 0,
+    .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+    .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+    .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT
+                     | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    .dependencyFlags = 0,
   };
 
   VkRenderPassCreateInfo renderpass_info = {
     .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
     .pNext = next,
     .flags = 0,
-    .attachmentCount = self->use_depth ? 2 : 1,
+    .attachmentCount = attachment_count,
     .pAttachments = attachements,
     .subpassCount = 1,
     .pSubpasses = &(VkSubpassDescription) {
@@ -106,10 +158,10 @@ _init (GulkanRenderPass     *self,
         .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
       },
       .pDepthStencilAttachment = self->use_depth ? &depth_attachement : NULL,
-      .pResolveAttachments = NULL,
+      .pResolveAttachments = self->resolve ? &resolve_attachement : NULL,
      },
-    .dependencyCount = 0,
-    .pDependencies = NULL,
+    .dependencyCount = 1,
+    .pDependencies = &dependency,
   };
 
   VkResult res = vkCreateRenderPass (vk_device, &renderpass_info, NULL,
@@ -130,7 +182,81 @@ gulkan_render_pass_new (GulkanDevice         *device,
     g_object_new (GULKAN_TYPE_RENDER_PASS, 0);
 
   if (!_init (self, device, samples, color_format, final_color_layout,
-              use_depth, NULL))
+              use_depth, FALSE, NULL))
+    {
+      g_object_unref (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+/**
+ * gulkan_render_pass_new_msaa:
+ * @device: a #GulkanDevice
+ * @samples: the sample count of the multisampled color and depth attachments
+ * @color_format: the #VkFormat of the color attachments
+ * @final_color_layout: the layout of the resolved color attachment
+ * @use_depth: whether to use a depth attachment
+ *
+ * Creates a pass which resolves the multisampled color attachment into a
+ * single sampled one at the end of the subpass. The multisampled attachments
+ * are not stored, so they can be transient. Use with
+ * gulkan_frame_buffer_new_msaa() or gulkan_frame_buffer_new_from_image_msaa().
+ *
+ * Returns: (transfer full) (nullable): a new #GulkanRenderPass
+ */
+GulkanRenderPass *
+gulkan_render_pass_new_msaa (GulkanDevice         *device,
+                             VkSampleCountFlagBits samples,
+                             VkFormat              color_format,
+                             VkImageLayout         final_color_layout,
+                             gboolean              use_depth)
+{
+  GulkanRenderPass *self = (GulkanRenderPass *)
+    g_object_new (GULKAN_TYPE_RENDER_PASS, 0);
+
+  if (!_init (self, device, samples, color_format, final_color_layout,
+              use_depth, TRUE, NULL))
+    {
+      g_object_unref (self);
+      return NULL;
+    }
+
+  return self;
+}
+
+/**
+ * gulkan_render_pass_new_preserving:
+ * @device: a #GulkanDevice
+ * @samples: the sample count of the attachments
+ * @color_format: the #VkFormat of the color attachment
+ * @final_color_layout: the layout of the color attachment, before and after
+ * the pass
+ * @use_depth: whether to use a depth attachment
+ *
+ * Creates a pass for updating a part of an image that was rendered before.
+ * The color attachment is only cleared inside the render area passed to
+ * gulkan_render_pass_begin_area(), and is kept outside of it. The image
+ * needs to be in @final_color_layout already. Frame buffers and pipelines of
+ * a pass from gulkan_render_pass_new() with the same arguments can be used.
+ *
+ * Returns: (transfer full) (nullable): a new #GulkanRenderPass
+ */
+GulkanRenderPass *
+gulkan_render_pass_new_preserving (GulkanDevice         *device,
+                                   VkSampleCountFlagBits samples,
+                                   VkFormat              color_format,
+                                   VkImageLayout         final_color_layout,
+                                   gboolean              use_depth)
+{
+  GulkanRenderPass *self = (GulkanRenderPass *)
+    g_object_new (GULKAN_TYPE_RENDER_PASS, 0);
+
+  self->preserve = TRUE;
+
+  if (!_init (self, device, samples, color_format, final_color_layout,
+              use_depth, FALSE, NULL))
     {
       g_object_unref (self);
       return NULL;
@@ -170,7 +296,7 @@ gulkan_render_pass_new_multiview (GulkanDevice         *device,
   };
 
   if (!_init (self, device, samples, color_format, final_color_layout,
-              use_depth, &multiview_info))
+              use_depth, FALSE, &multiview_info))
     {
       g_object_unref (self);
       return NULL;
@@ -185,18 +311,41 @@ gulkan_render_pass_begin (GulkanRenderPass  *self,
                           VkClearColorValue  clear_color,
                           GulkanFrameBuffer *frame_buffer,
                           VkCommandBuffer    cmd_buffer)
+{
+  VkRect2D area = {
+    .offset = {
+      .x = 0,
+      .y = 0,
+    },
+    .extent = extent,
+  };
+  gulkan_render_pass_begin_area (self, area, clear_color, frame_buffer,
+                                 cmd_buffer);
+}
+
+/**
+ * gulkan_render_pass_begin_area:
+ * @self: a #GulkanRenderPass
+ * @area: the render area
+ * @clear_color: a #VkClearColorValue
+ * @frame_buffer: a #GulkanFrameBuffer
+ * @cmd_buffer: a #VkCommandBuffer
+ *
+ * Like gulkan_render_pass_begin(), but load, store and clear operations are
+ * restricted to @area.
+ */
+void
+gulkan_render_pass_begin_area (GulkanRenderPass  *self,
+                               VkRect2D           area,
+                               VkClearColorValue  clear_color,
+                               GulkanFrameBuffer *frame_buffer,
+                               VkCommandBuffer    cmd_buffer)
 {
   VkRenderPassBeginInfo render_pass_info = {
     .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
     .renderPass = self->render_pass,
     .framebuffer = gulkan_frame_buffer_get_handle (frame_buffer),
-    .renderArea = {
-      .offset = {
-        .x = 0,
-        .y = 0,
-      },
-      .extent = extent,
-    },
+    .renderArea = area,
     .clearValueCount = self->use_depth ? 2 : 1,
     .pClearValues = (VkClearValue[]) {
       {
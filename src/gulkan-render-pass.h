@@ -38,6 +38,20 @@ gulkan_render_pass_new (GulkanDevice         *device,
                         VkImageLayout         final_color_layout,
                         gboolean              use_depth);
 
+GulkanRenderPass *
+gulkan_render_pass_new_msaa (GulkanDevice         *device,
+                             VkSampleCountFlagBits samples,
+                             VkFormat              color_format,
+                             VkImageLayout         final_color_layout,
+                             gboolean              use_depth);
+
+GulkanRenderPass *
+gulkan_render_pass_new_preserving (GulkanDevice         *device,
+                                   VkSampleCountFlagBits samples,
+                                   VkFormat              color_format,
+                                   VkImageLayout         final_color_layout,
+                                   gboolean              use_depth);
+
 GulkanRenderPass *
 gulkan_render_pass_new_multiview (GulkanDevice         *device,
                                   VkSampleCountFlagBits samples,
@@ -52,6 +66,13 @@ gulkan_render_pass_begin (GulkanRenderPass  *self,
                           GulkanFrameBuffer *frame_buffer,
                           VkCommandBuffer    cmd_buffer);
 
+void
+gulkan_render_pass_begin_area (GulkanRenderPass  *self,
+                               VkRect2D           area,
+                               VkClearColorValue  clear_color,
+                               GulkanFrameBuffer *frame_buffer,
+                               VkCommandBuffer    cmd_buffer);
+
 VkRenderPass
 gulkan_render_pass_get_handle (GulkanRenderPass *self);
 
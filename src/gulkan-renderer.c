@@ -20,6 +20,8 @@ typedef struct _GulkanRendererPrivate
 
   VkExtent2D extent;
 
+  guint draw_source;
+
 } GulkanRendererPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (GulkanRenderer, gulkan_renderer, G_TYPE_OBJECT)
@@ -39,6 +41,7 @@ gulkan_renderer_init (GulkanRenderer *self)
 {
   GulkanRendererPrivate *priv = gulkan_renderer_get_instance_private (self);
   gettimeofday (&priv->start, NULL);
+  priv->draw_source = 0;
 }
 
 static void
@@ -46,6 +49,8 @@ gulkan_renderer_finalize (GObject *gobject)
 {
   GulkanRenderer        *self = GULKAN_RENDERER (gobject);
   GulkanRendererPrivate *priv = gulkan_renderer_get_instance_private (self);
+  if (priv->draw_source)
+    g_source_remove (priv->draw_source);
   if (priv->context)
     g_object_unref (priv->context);
   G_OBJECT_CLASS (gulkan_renderer_parent_class)->finalize (gobject);
@@ -123,3 +128,35 @@ gulkan_renderer_draw (GulkanRenderer *self)
     return FALSE;
   return klass->draw (self);
 }
+
+static gboolean
+_queued_draw_cb (gpointer data)
+{
+  GulkanRenderer        *self = GULKAN_RENDERER (data);
+  GulkanRendererPrivate *priv = gulkan_renderer_get_instance_private (self);
+
+  priv->draw_source = 0;
+  gulkan_renderer_draw (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * gulkan_renderer_queue_draw:
+ * @self: a #GulkanRenderer
+ *
+ * Schedules a single gulkan_renderer_draw() on the default main context, once
+ * pending events were handled. Repeated calls before the draw are coalesced,
+ * so content changes can request redraws instead of drawing in a loop.
+ */
+void
+gulkan_renderer_queue_draw (GulkanRenderer *self)
+{
+  GulkanRendererPrivate *priv = gulkan_renderer_get_instance_private (self);
+
+  if (priv->draw_source)
+    return;
+
+  priv->draw_source = g_idle_add_full (G_PRIORITY_HIGH_IDLE, _queued_draw_cb,
+                                       self, NULL);
+}
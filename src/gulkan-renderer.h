@@ -56,6 +56,9 @@ gulkan_renderer_get_msec_since_start (GulkanRenderer *self);
 gboolean
 gulkan_renderer_draw (GulkanRenderer *self);
 
+void
+gulkan_renderer_queue_draw (GulkanRenderer *self);
+
 G_END_DECLS
 
 #endif /* GULKAN_RENDERER_H_ */
@@ -9,31 +9,85 @@
 #include "gulkan-frame-buffer.h"
 #include "gulkan-swapchain.h"
 
+/* Resources of a swapchain image */
 typedef struct RenderBuffer
 {
   GulkanFrameBuffer *fb;
   VkFence            fence;
   VkCommandBuffer    cmd_buffer;
+  VkSemaphore        submit_to_present_semaphore;
+
+  /* Damage since the image was last rendered, for partial rendering */
+  gboolean full_damage;
+  VkRect2D damage;
+  /* Render area the command buffer was recorded with */
+  VkRect2D recorded_area;
 } RenderBuffer;
 
+/* A frame that can be queued before the image it renders to is known */
+typedef struct FrameSlot
+{
+  VkSemaphore acquire_to_submit_semaphore;
+  /* Image whose fence signals the semaphore can be reused, or -1 */
+  int64_t     last_index;
+  uint64_t    present_id;
+  gint64      start_time;
+} FrameSlot;
+
+#define GULKAN_DEFAULT_QUEUED_FRAMES 2
+#define GULKAN_PRESENT_WAIT_TIMEOUT_NS 1000000000ull
+/* Dropped frames are retried after this long, when driven by a window */
+#define GULKAN_FRAME_RETRY_MS 100
+
+enum
+{
+  SWAPCHAIN_REBUILT,
+  LAST_SIGNAL
+};
+
+static guint signals[LAST_SIGNAL] = {0};
+
 typedef struct _GulkanSwapchainRendererPrivate
 {
   GulkanRenderer parent;
 
   RenderBuffer *buffers;
+  uint32_t      buffer_count;
 
   GulkanRenderPass *pass;
   GulkanSwapchain  *swapchain;
 
   VkClearColorValue clear_color;
 
-  VkSemaphore acquire_to_submit_semaphore;
-  VkSemaphore submit_to_present_semaphore;
+  FrameSlot *slots;
+  uint32_t   slot_count;
+  uint64_t   frame_count;
+
+  VkPresentModeKHR present_mode;
+  uint32_t         image_count;
+  uint32_t         max_queued_frames;
+  gint64           present_latency;
 
   gconstpointer pipeline_data;
 
   VkFormat format;
 
+  gboolean use_dynamic_rendering;
+  gboolean initialized;
+
+  /* Damage of the next frame, empty for a full frame */
+  GArray           *damage;
+  gboolean          partial_render;
+  GulkanRenderPass *partial_pass;
+
+  /* Record the command buffer of an image whenever it is drawn */
+  gboolean record_each_frame;
+
+  /* Draws are driven by frame-ready of this window, if set */
+  GulkanWindow *frame_window;
+  gulong        frame_ready_handler;
+  guint         frame_retry_source;
+
 } GulkanSwapchainRendererPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (GulkanSwapchainRenderer,
@@ -48,6 +102,68 @@ gulkan_swapchain_renderer_init (GulkanSwapchainRenderer *self)
   priv->format = VK_FORMAT_B8G8R8A8_SRGB;
   priv->swapchain = NULL;
   priv->pass = NULL;
+  priv->buffers = NULL;
+  priv->buffer_count = 0;
+  priv->slots = NULL;
+  priv->slot_count = 0;
+  priv->frame_count = 0;
+  priv->present_mode = VK_PRESENT_MODE_FIFO_KHR;
+  priv->image_count = 0;
+  priv->max_queued_frames = GULKAN_DEFAULT_QUEUED_FRAMES;
+  priv->present_latency = -1;
+  priv->use_dynamic_rendering = FALSE;
+  priv->initialized = FALSE;
+  priv->frame_window = NULL;
+  priv->frame_ready_handler = 0;
+  priv->frame_retry_source = 0;
+  priv->damage = g_array_new (FALSE, FALSE, sizeof (VkRect2D));
+  priv->partial_render = FALSE;
+  priv->partial_pass = NULL;
+  priv->record_each_frame = FALSE;
+}
+
+static void
+_free_render_buffer (GulkanSwapchainRenderer *self, RenderBuffer *b)
+{
+  GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
+  GulkanDevice  *gulkan_device = gulkan_context_get_device (context);
+  VkDevice       device = gulkan_device_get_handle (gulkan_device);
+  GulkanQueue   *gulkan_queue = gulkan_device_get_graphics_queue (gulkan_device);
+  GMutex        *mutex = gulkan_queue_get_pool_mutex (gulkan_queue);
+
+  g_clear_object (&b->fb);
+  vkDestroyFence (device, b->fence, NULL);
+  vkDestroySemaphore (device, b->submit_to_present_semaphore, NULL);
+
+  g_mutex_lock (mutex);
+  vkFreeCommandBuffers (device, gulkan_queue_get_command_pool (gulkan_queue), 1,
+                        &b->cmd_buffer);
+  g_mutex_unlock (mutex);
+}
+
+/* Wait until no submitted frame uses the swapchain images anymore */
+static gboolean
+_wait_render_buffers (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  if (priv->buffer_count == 0)
+    return TRUE;
+
+  GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
+  VkDevice       device = gulkan_context_get_device_handle (context);
+
+  VkFence *fences = g_malloc (sizeof (VkFence) * priv->buffer_count);
+  for (uint32_t i = 0; i < priv->buffer_count; i++)
+    fences[i] = priv->buffers[i].fence;
+
+  VkResult res = vkWaitForFences (device, priv->buffer_count, fences, VK_TRUE,
+                                  UINT64_MAX);
+  g_free (fences);
+  vk_check_error ("vkWaitForFences", res, FALSE);
+
+  return TRUE;
 }
 
 static void
@@ -57,75 +173,92 @@ _finalize (GObject *gobject)
   GulkanSwapchainRendererPrivate *priv
     = gulkan_swapchain_renderer_get_instance_private (self);
 
+  gulkan_swapchain_renderer_set_frame_window (self, NULL);
+  g_array_unref (priv->damage);
+
   GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
   if (context)
     {
       VkDevice device = gulkan_context_get_device_handle (context);
 
-      if (priv->swapchain)
-        {
-          for (uint32_t i = 0; i < gulkan_swapchain_get_size (priv->swapchain);
-               i++)
-            {
-              g_object_unref (priv->buffers[i].fb);
-              vkDestroyFence (device, priv->buffers[i].fence, NULL);
-            }
-          g_object_unref (priv->swapchain);
-        }
+      _wait_render_buffers (self);
+      for (uint32_t i = 0; i < priv->buffer_count; i++)
+        _free_render_buffer (self, &priv->buffers[i]);
+      g_clear_object (&priv->swapchain);
 
-      vkDestroySemaphore (device, priv->acquire_to_submit_semaphore, NULL);
-      vkDestroySemaphore (device, priv->submit_to_present_semaphore, NULL);
+      for (uint32_t i = 0; i < priv->slot_count; i++)
+        vkDestroySemaphore (device, priv->slots[i].acquire_to_submit_semaphore,
+                            NULL);
 
       g_clear_object (&priv->pass);
+      g_clear_object (&priv->partial_pass);
       g_free (priv->buffers);
+      g_free (priv->slots);
     }
 
   G_OBJECT_CLASS (gulkan_swapchain_renderer_parent_class)->finalize (gobject);
 }
 
+/*
+ * One slot per frame that may be queued ahead. Changing the count waits for
+ * all frames, since the acquire semaphores may still be pending.
+ */
 static gboolean
-_init_sync (GulkanSwapchainRenderer *self)
+_init_frame_slots (GulkanSwapchainRenderer *self)
 {
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  if (priv->slot_count == priv->max_queued_frames)
+    return TRUE;
+
   GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
   VkDevice       device = gulkan_context_get_device_handle (context);
 
+  if (!_wait_render_buffers (self))
+    return FALSE;
+
+  for (uint32_t i = 0; i < priv->slot_count; i++)
+    vkDestroySemaphore (device, priv->slots[i].acquire_to_submit_semaphore,
+                        NULL);
+
+  priv->slot_count = priv->max_queued_frames;
+  priv->slots = g_renew (FrameSlot, priv->slots, priv->slot_count);
+
   VkSemaphoreCreateInfo info = {
     .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
   };
 
-  GulkanSwapchainRendererPrivate *priv
-    = gulkan_swapchain_renderer_get_instance_private (self);
-
-  VkResult res;
-  res = vkCreateSemaphore (device, &info, NULL,
-                           &priv->acquire_to_submit_semaphore);
-  vk_check_error ("vkCreateSemaphore", res, TRUE);
-  res = vkCreateSemaphore (device, &info, NULL,
-                           &priv->submit_to_present_semaphore);
-  vk_check_error ("vkCreateSemaphore", res, TRUE);
+  for (uint32_t i = 0; i < priv->slot_count; i++)
+    {
+      FrameSlot *slot = &priv->slots[i];
+      slot->last_index = -1;
+      slot->present_id = 0;
+      slot->start_time = 0;
+
+      VkResult res = vkCreateSemaphore (device, &info, NULL,
+                                        &slot->acquire_to_submit_semaphore);
+      if (res != VK_SUCCESS)
+        {
+          priv->slot_count = i;
+          vk_check_error ("vkCreateSemaphore", res, FALSE);
+        }
+    }
 
   return TRUE;
 }
 
 static gboolean
-_init_render_buffer (GulkanSwapchainRenderer *self,
-                     RenderBuffer            *b,
-                     VkImage                  image)
+_init_render_buffer (GulkanSwapchainRenderer *self, RenderBuffer *b)
 {
-  GulkanSwapchainRendererPrivate *priv
-    = gulkan_swapchain_renderer_get_instance_private (self);
-
   GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
   GulkanDevice  *gulkan_device = gulkan_context_get_device (context);
   VkDevice       device = gulkan_device_get_handle (gulkan_device);
-  VkExtent2D     extent = gulkan_renderer_get_extent (GULKAN_RENDERER (self));
-  VkFormat       format = gulkan_swapchain_get_format (priv->swapchain);
 
-  b->fb = gulkan_frame_buffer_new_from_image (gulkan_device, priv->pass, image,
-                                              extent, format, 1);
-
-  if (!b->fb)
-    return FALSE;
+  b->fb = NULL;
+  b->full_damage = TRUE;
+  b->damage = (VkRect2D){0};
+  b->recorded_area = (VkRect2D){0};
 
   VkFenceCreateInfo fence_info = {
     .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
@@ -135,8 +268,18 @@ _init_render_buffer (GulkanSwapchainRenderer *self,
   VkResult res = vkCreateFence (device, &fence_info, NULL, &b->fence);
   vk_check_error ("vkCreateFence", res, FALSE);
 
+  VkSemaphoreCreateInfo semaphore_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+  };
+
+  /* Only reused once the image is acquired again, after it was presented */
+  res = vkCreateSemaphore (device, &semaphore_info, NULL,
+                           &b->submit_to_present_semaphore);
+  vk_check_error ("vkCreateSemaphore", res, FALSE);
+
   GulkanQueue  *gulkan_queue = gulkan_device_get_graphics_queue (gulkan_device);
   VkCommandPool pool = gulkan_queue_get_command_pool (gulkan_queue);
+  GMutex       *mutex = gulkan_queue_get_pool_mutex (gulkan_queue);
   VkCommandBufferAllocateInfo alloc_info = {
     .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
     .commandPool = pool,
@@ -144,12 +287,18 @@ _init_render_buffer (GulkanSwapchainRenderer *self,
     .commandBufferCount = 1,
   };
 
+  g_mutex_lock (mutex);
   res = vkAllocateCommandBuffers (device, &alloc_info, &b->cmd_buffer);
+  g_mutex_unlock (mutex);
   vk_check_error ("vkAllocateCommandBuffers", res, FALSE);
 
   return TRUE;
 }
 
+/*
+ * Fences and command buffers are kept across resizes, only the frame buffers
+ * depend on the swapchain images. The image count can change on recreation.
+ */
 static gboolean
 _init_render_buffers (GulkanSwapchainRenderer *self)
 {
@@ -157,14 +306,44 @@ _init_render_buffers (GulkanSwapchainRenderer *self)
     = gulkan_swapchain_renderer_get_instance_private (self);
 
   uint32_t size = gulkan_swapchain_get_size (priv->swapchain);
+
+  for (uint32_t i = size; i < priv->buffer_count; i++)
+    _free_render_buffer (self, &priv->buffers[i]);
+
+  if (size > priv->buffer_count)
+    {
+      priv->buffers = g_renew (RenderBuffer, priv->buffers, size);
+      for (uint32_t i = priv->buffer_count; i < size; i++)
+        if (!_init_render_buffer (self, &priv->buffers[i]))
+          {
+            priv->buffer_count = i;
+            return FALSE;
+          }
+    }
+  priv->buffer_count = size;
+
   VkImage *images = g_malloc (sizeof (VkImage) * size);
   gulkan_swapchain_get_images (priv->swapchain, images);
 
-  priv->buffers = g_malloc (sizeof (RenderBuffer) * size);
+  GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
+  GulkanDevice  *gulkan_device = gulkan_context_get_device (context);
+  VkExtent2D     extent = gulkan_renderer_get_extent (GULKAN_RENDERER (self));
+  VkFormat       format = gulkan_swapchain_get_format (priv->swapchain);
 
   for (uint32_t i = 0; i < size; i++)
-    if (!_init_render_buffer (self, &priv->buffers[i], images[i]))
-      return FALSE;
+    {
+      RenderBuffer *b = &priv->buffers[i];
+      b->full_damage = TRUE;
+      g_clear_object (&b->fb);
+      b->fb = gulkan_frame_buffer_new_from_image (gulkan_device, priv->pass,
+                                                  images[i], extent, format, 1);
+      if (!b->fb)
+        {
+          g_printerr ("Error: Creating framebuffer failed.\n");
+          g_free (images);
+          return FALSE;
+        }
+    }
 
   g_free (images);
 
@@ -175,7 +354,8 @@ _init_render_buffers (GulkanSwapchainRenderer *self)
  * gulkan_swapchain_renderer_get_render_pass:
  * @self: a #GulkanSwapchainRenderer
  *
- * Returns: (transfer none): the #GulkanRenderPass
+ * Returns: (transfer none) (nullable): the #GulkanRenderPass, or %NULL when
+ * rendering dynamically
  */
 GulkanRenderPass *
 gulkan_swapchain_renderer_get_render_pass (GulkanSwapchainRenderer *self)
@@ -186,201 +366,629 @@ gulkan_swapchain_renderer_get_render_pass (GulkanSwapchainRenderer *self)
   return priv->pass;
 }
 
-static gboolean
-_draw (GulkanRenderer *renderer)
+/**
+ * gulkan_swapchain_renderer_set_dynamic_rendering:
+ * @self: a #GulkanSwapchainRenderer
+ * @use_dynamic_rendering: whether to render without #VkRenderPass and
+ * #VkFramebuffer objects
+ *
+ * Needs to be set before the first resize. Falls back to a #GulkanRenderPass
+ * when the device does not support dynamic rendering. Pipelines for dynamic
+ * rendering are created with a %NULL render pass and the color format from
+ * gulkan_swapchain_renderer_get_format().
+ */
+void
+gulkan_swapchain_renderer_set_dynamic_rendering (GulkanSwapchainRenderer *self,
+                                                 gboolean use_dynamic_rendering)
 {
-  GulkanSwapchainRenderer        *self = GULKAN_SWAPCHAIN_RENDERER (renderer);
   GulkanSwapchainRendererPrivate *priv
     = gulkan_swapchain_renderer_get_instance_private (self);
 
-  // Wait for swapchain to init. XCB backend needs this.
-  if (!priv->swapchain)
+  if (priv->initialized)
     {
-      return TRUE;
+      g_warning ("Dynamic rendering needs to be set before initialization.");
+      return;
     }
 
-  uint32_t index;
-  if (!gulkan_swapchain_acquire (priv->swapchain,
-                                 priv->acquire_to_submit_semaphore, &index))
-    return TRUE;
-
-  g_assert (index <= gulkan_swapchain_get_size (priv->swapchain));
-
-  RenderBuffer *b = &priv->buffers[index];
+  priv->use_dynamic_rendering = use_dynamic_rendering;
+}
 
-  GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
-  GulkanDevice  *gulkan_device = gulkan_context_get_device (context);
-  VkDevice       device = gulkan_device_get_handle (gulkan_device);
+/**
+ * gulkan_swapchain_renderer_get_format:
+ * @self: a #GulkanSwapchainRenderer
+ *
+ * Returns: the #VkFormat of the swapchain images
+ */
+VkFormat
+gulkan_swapchain_renderer_get_format (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
 
-  VkResult res;
-  res = vkWaitForFences (device, 1, &b->fence, VK_TRUE, UINT64_MAX);
-  vk_check_error ("vkWaitForFences", res, FALSE);
+  if (priv->swapchain)
+    return gulkan_swapchain_get_format (priv->swapchain);
 
-  res = vkResetFences (device, 1, &b->fence);
-  vk_check_error ("vkResetFences", res, FALSE);
+  return priv->format;
+}
 
-  GulkanQueue *gulkan_queue = gulkan_device_get_graphics_queue (gulkan_device);
-  VkQueue      queue = gulkan_queue_get_handle (gulkan_queue);
+/*
+ * Keeps at most max_queued_frames presents in flight by waiting until the
+ * oldest of them is shown, which bounds the input to display latency.
+ */
+static void
+_pace_frames (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
 
-  VkSubmitInfo submit_info = {
-    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-    .waitSemaphoreCount = 1,
-    .pWaitSemaphores = &priv->acquire_to_submit_semaphore,
-    .pWaitDstStageMask =
-      (VkPipelineStageFlags[]){
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-      },
-    .commandBufferCount = 1,
-    .pCommandBuffers = &b->cmd_buffer,
-    .signalSemaphoreCount = 1,
-    .pSignalSemaphores = &priv->submit_to_present_semaphore,
-  };
+  uint64_t present_id = gulkan_swapchain_get_present_id (priv->swapchain);
+  if (present_id < priv->max_queued_frames)
+    return;
 
-  res = vkQueueSubmit (queue, 1, &submit_info, b->fence);
-  vk_check_error ("vkQueueSubmit", res, FALSE);
+  uint64_t wait_id = present_id - priv->max_queued_frames + 1;
 
-  gulkan_swapchain_present (priv->swapchain, &priv->submit_to_present_semaphore,
-                            index);
+  if (!gulkan_swapchain_wait_for_present (priv->swapchain, wait_id,
+                                          GULKAN_PRESENT_WAIT_TIMEOUT_NS))
+    return;
 
-  return TRUE;
+  gint64 now = g_get_monotonic_time ();
+  for (uint32_t i = 0; i < priv->slot_count; i++)
+    if (priv->slots[i].present_id == wait_id)
+      {
+        priv->present_latency = now - priv->slots[i].start_time;
+        break;
+      }
 }
 
-gboolean
-gulkan_swapchain_renderer_init_draw_cmd_buffers (GulkanSwapchainRenderer *self)
+/* Minimized windows report a zero extent and can't have a swapchain */
+static gboolean
+_is_surface_minimized (GulkanSwapchainRenderer *self, VkSurfaceKHR surface)
 {
-  GulkanSwapchainRendererClass *klass
-    = GULKAN_SWAPCHAIN_RENDERER_GET_CLASS (self);
-  if (klass->init_draw_cmd == NULL)
+  GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
+  GulkanDevice  *gulkan_device = gulkan_context_get_device (context);
+
+  VkPhysicalDevice physical_device
+    = gulkan_device_get_physical_handle (gulkan_device);
+
+  VkSurfaceCapabilitiesKHR surface_caps;
+  VkResult res
+    = vkGetPhysicalDeviceSurfaceCapabilitiesKHR (physical_device, surface,
+                                                 &surface_caps);
+  if (res != VK_SUCCESS)
     return FALSE;
 
+  return surface_caps.currentExtent.width == 0
+         || surface_caps.currentExtent.height == 0;
+}
+
+/*
+ * Recreates an out of date swapchain at the start of a frame, instead of
+ * waiting for the window system to report a resize. Frames are skipped while
+ * the window is minimized.
+ */
+static gboolean
+_rebuild_swapchain (GulkanSwapchainRenderer *self)
+{
   GulkanSwapchainRendererPrivate *priv
     = gulkan_swapchain_renderer_get_instance_private (self);
 
-  VkResult res;
-
-  VkCommandBufferBeginInfo info = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-    .flags = 0,
-  };
+  VkSurfaceKHR surface = gulkan_swapchain_get_surface (priv->swapchain);
+  if (_is_surface_minimized (self, surface))
+    return FALSE;
 
-  uint32_t size = gulkan_swapchain_get_size (priv->swapchain);
+  g_debug ("Swapchain out of date, rebuilding.");
 
   VkExtent2D extent = gulkan_renderer_get_extent (GULKAN_RENDERER (self));
 
-  const VkViewport viewport = {
-    .x = 0,
-    .y = 0,
-    .width = (float) extent.width,
-    .height = (float) extent.height,
-    .minDepth = 0,
-    .maxDepth = 1,
-  };
-  VkRect2D render_area = {{0, 0}, extent};
-
-  for (uint32_t i = 0; i < size; i++)
-    {
-      VkCommandBuffer cmd_buffer = priv->buffers[i].cmd_buffer;
-      res = vkBeginCommandBuffer (cmd_buffer, &info);
-      vk_check_error ("vkBeginCommandBuffer", res, FALSE);
-
-      RenderBuffer *b = &priv->buffers[i];
-
-      gulkan_render_pass_begin (priv->pass, extent, priv->clear_color, b->fb,
-                                b->cmd_buffer);
+  if (!gulkan_swapchain_renderer_resize (self, surface, extent))
+    return FALSE;
 
-      vkCmdSetViewport (cmd_buffer, 0, 1, &viewport);
-      vkCmdSetScissor (cmd_buffer, 0, 1, &render_area);
+  extent = gulkan_renderer_get_extent (GULKAN_RENDERER (self));
+  g_signal_emit (self, signals[SWAPCHAIN_REBUILT], 0, &extent);
 
-      klass->init_draw_cmd (self, cmd_buffer);
+  return TRUE;
+}
 
-      vkCmdEndRenderPass (cmd_buffer);
+static void
+_union_rect (VkRect2D *rect, const VkRect2D *other)
+{
+  if (other->extent.width == 0 || other->extent.height == 0)
+    return;
 
-      res = vkEndCommandBuffer (cmd_buffer);
-      vk_check_error ("vkEndCommandBuffer", res, FALSE);
+  if (rect->extent.width == 0 || rect->extent.height == 0)
+    {
+      *rect = *other;
+      return;
     }
 
-  return TRUE;
+  int32_t x0 = MIN (rect->offset.x, other->offset.x);
+  int32_t y0 = MIN (rect->offset.y, other->offset.y);
+  int64_t x1 = MAX (rect->offset.x + (int64_t) rect->extent.width,
+                    other->offset.x + (int64_t) other->extent.width);
+  int64_t y1 = MAX (rect->offset.y + (int64_t) rect->extent.height,
+                    other->offset.y + (int64_t) other->extent.height);
+
+  *rect = (VkRect2D){
+    .offset = {x0, y0},
+    .extent = {(uint32_t) (x1 - x0), (uint32_t) (y1 - y0)},
+  };
 }
 
 static gboolean
-_is_extent_valid (VkExtent2D *extent)
+_rect_equal (const VkRect2D *a, const VkRect2D *b)
 {
-  return extent->width < UINT32_MAX && extent->height < UINT32_MAX
-         && extent->width > 0 && extent->height > 0;
+  return a->offset.x == b->offset.x && a->offset.y == b->offset.y
+         && a->extent.width == b->extent.width
+         && a->extent.height == b->extent.height;
 }
 
-void
-gulkan_swapchain_renderer_initialize (GulkanSwapchainRenderer *self,
-                                      VkClearColorValue        clear_color,
-                                      gconstpointer            pipeline_data)
+static VkRect2D
+_clamp_rect (VkRect2D rect, VkExtent2D extent)
 {
-  GulkanSwapchainRendererPrivate *priv
-    = gulkan_swapchain_renderer_get_instance_private (self);
-  priv->clear_color = clear_color;
-  priv->pipeline_data = pipeline_data;
+  int64_t x0 = CLAMP (rect.offset.x, 0, (int64_t) extent.width);
+  int64_t y0 = CLAMP (rect.offset.y, 0, (int64_t) extent.height);
+  int64_t x1 = CLAMP (rect.offset.x + (int64_t) rect.extent.width, x0,
+                      (int64_t) extent.width);
+  int64_t y1 = CLAMP (rect.offset.y + (int64_t) rect.extent.height, y0,
+                      (int64_t) extent.height);
+
+  return (VkRect2D){
+    .offset = {(int32_t) x0, (int32_t) y0},
+    .extent = {(uint32_t) (x1 - x0), (uint32_t) (y1 - y0)},
+  };
 }
 
 static gboolean
-_do_init (GulkanSwapchainRenderer *self)
+_record_cmd_buffer (GulkanSwapchainRenderer *self,
+                    RenderBuffer            *b,
+                    GulkanRenderPass        *pass,
+                    VkRect2D                 area);
+
+/*
+ * A swapchain image holds the frame it was last rendered with, which can be
+ * several frames old. Each image accumulates the damage since then, and with
+ * partial rendering only that area is rendered again. The command buffer of
+ * the image needs to be idle. It is recorded again if the area changed, or
+ * on every frame with record_each_frame.
+ */
+static gboolean
+_update_damage (GulkanSwapchainRenderer *self, RenderBuffer *b)
 {
   GulkanSwapchainRendererPrivate *priv
     = gulkan_swapchain_renderer_get_instance_private (self);
-  GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
-  GulkanDevice  *gulkan_device = gulkan_context_get_device (context);
 
-  priv->pass
-    = gulkan_render_pass_new (gulkan_device, VK_SAMPLE_COUNT_1_BIT,
-                              gulkan_swapchain_get_format (priv->swapchain),
-                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, FALSE);
-  if (!priv->pass)
+  for (uint32_t i = 0; i < priv->buffer_count; i++)
     {
-      g_printerr ("Could not init render pass.\n");
-      return FALSE;
+      RenderBuffer *buffer = &priv->buffers[i];
+      if (priv->damage->len == 0)
+        buffer->full_damage = TRUE;
+      for (uint32_t j = 0; j < priv->damage->len; j++)
+        _union_rect (&buffer->damage,
+                     &g_array_index (priv->damage, VkRect2D, j));
     }
 
-  if (!_init_render_buffers (self))
-    return FALSE;
+  VkExtent2D extent = gulkan_renderer_get_extent (GULKAN_RENDERER (self));
+  VkRect2D   full_area = {{0, 0}, extent};
 
-  if (!_init_sync (self))
-    return FALSE;
+  VkRect2D area = b->full_damage ? full_area : _clamp_rect (b->damage, extent);
+  b->full_damage = FALSE;
+  b->damage = (VkRect2D){0};
 
-  GulkanSwapchainRendererClass *klass
-    = GULKAN_SWAPCHAIN_RENDERER_GET_CLASS (self);
-  if (klass->init_pipeline == NULL)
-    return FALSE;
+  if (!priv->partial_pass)
+    {
+      if (!priv->record_each_frame)
+        return TRUE;
+      return _record_cmd_buffer (self, b, priv->pass, full_area);
+    }
 
-  if (!klass->init_pipeline (self, priv->pipeline_data))
-    return FALSE;
+  /* Nothing changed, rendering the recorded area again is harmless */
+  if (area.extent.width == 0 || area.extent.height == 0)
+    area = b->recorded_area;
 
-  return TRUE;
-}
+  if (!priv->record_each_frame && _rect_equal (&area, &b->recorded_area))
+    return TRUE;
 
-static void
-gulkan_swapchain_renderer_class_init (GulkanSwapchainRendererClass *klass)
-{
-  GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  object_class->finalize = _finalize;
+  gboolean is_full = _rect_equal (&area, &full_area);
 
-  GulkanRendererClass *parent_class = GULKAN_RENDERER_CLASS (klass);
-  parent_class->draw = _draw;
+  return _record_cmd_buffer (self, b, is_full ? priv->pass : priv->partial_pass,
+                             area);
 }
 
-gboolean
-gulkan_swapchain_renderer_resize (GulkanSwapchainRenderer *self,
-                                  VkSurfaceKHR             surface,
-                                  VkExtent2D               expose_extent)
+static gboolean
+_draw_frame (GulkanSwapchainRenderer *self, gboolean *presented)
 {
   GulkanSwapchainRendererPrivate *priv
     = gulkan_swapchain_renderer_get_instance_private (self);
 
+  // Wait for swapchain to init. XCB backend needs this.
+  if (!priv->swapchain || priv->slot_count == 0)
+    {
+      return TRUE;
+    }
+
   GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
   GulkanDevice  *gulkan_device = gulkan_context_get_device (context);
+  VkDevice       device = gulkan_device_get_handle (gulkan_device);
 
-  g_debug ("gulkan_swapchain_renderer_resize: Got expose extent %dx%d\n",
-           expose_extent.width, expose_extent.height);
+  VkResult res;
 
-  VkExtent2D extent;
-  if (_is_extent_valid (&expose_extent))
+  if (gulkan_swapchain_is_out_of_date (priv->swapchain)
+      && !_rebuild_swapchain (self))
+    return TRUE;
+
+  /* The acquire semaphore is free once the frame that waited on it is done */
+  FrameSlot *slot = &priv->slots[priv->frame_count % priv->slot_count];
+  if (slot->last_index >= 0 && slot->last_index < priv->buffer_count)
+    {
+      res = vkWaitForFences (device, 1, &priv->buffers[slot->last_index].fence,
+                             VK_TRUE, UINT64_MAX);
+      vk_check_error ("vkWaitForFences", res, FALSE);
+    }
+
+  /*
+   * Take ownership of textures uploaded on the transfer queue. Done before
+   * acquiring, so a failure leaves no signaled acquire semaphore behind.
+   */
+  GulkanQueue *gulkan_queue = gulkan_device_get_graphics_queue (gulkan_device);
+  VkQueue      queue = gulkan_queue_get_handle (gulkan_queue);
+  if (!gulkan_queue_flush_acquires (gulkan_queue))
+    return FALSE;
+
+  slot->start_time = g_get_monotonic_time ();
+
+  uint32_t index;
+  if (!gulkan_swapchain_acquire (priv->swapchain,
+                                 slot->acquire_to_submit_semaphore, &index))
+    {
+      /* Retry once, so the frame is not dropped. The rebuild waited for all
+       * frames and may have reallocated the slots. */
+      if (!gulkan_swapchain_is_out_of_date (priv->swapchain)
+          || !_rebuild_swapchain (self))
+        return TRUE;
+
+      slot = &priv->slots[priv->frame_count % priv->slot_count];
+      slot->start_time = g_get_monotonic_time ();
+
+      if (!gulkan_swapchain_acquire (priv->swapchain,
+                                     slot->acquire_to_submit_semaphore, &index))
+        return TRUE;
+    }
+
+  g_assert (index < gulkan_swapchain_get_size (priv->swapchain));
+
+  RenderBuffer *b = &priv->buffers[index];
+  slot->last_index = index;
+
+  res = vkWaitForFences (device, 1, &b->fence, VK_TRUE, UINT64_MAX);
+  vk_check_error ("vkWaitForFences", res, FALSE);
+
+  if (!_update_damage (self, b))
+    return FALSE;
+
+  /* Nothing may fail between the fence reset and the submit signaling it */
+  res = vkResetFences (device, 1, &b->fence);
+  vk_check_error ("vkResetFences", res, FALSE);
+
+  VkSubmitInfo submit_info = {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .waitSemaphoreCount = 1,
+    .pWaitSemaphores = &slot->acquire_to_submit_semaphore,
+    .pWaitDstStageMask =
+      (VkPipelineStageFlags[]){
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      },
+    .commandBufferCount = 1,
+    .pCommandBuffers = &b->cmd_buffer,
+    .signalSemaphoreCount = 1,
+    .pSignalSemaphores = &b->submit_to_present_semaphore,
+  };
+
+  res = vkQueueSubmit (queue, 1, &submit_info, b->fence);
+  vk_check_error ("vkQueueSubmit", res, FALSE);
+
+  /* The frame request is committed along with the present */
+  if (priv->frame_window)
+    gulkan_window_request_frame (priv->frame_window);
+
+  gulkan_swapchain_present_damage (priv->swapchain,
+                                   &b->submit_to_present_semaphore, index,
+                                   (const VkRect2D *) priv->damage->data,
+                                   priv->damage->len);
+  g_array_set_size (priv->damage, 0);
+  *presented = TRUE;
+
+  slot->present_id = gulkan_swapchain_get_present_id (priv->swapchain);
+  priv->frame_count++;
+
+  if (gulkan_device_supports_present_wait (gulkan_device))
+    _pace_frames (self);
+
+  return TRUE;
+}
+
+static gboolean
+_frame_retry_cb (gpointer data)
+{
+  GulkanSwapchainRenderer        *self = GULKAN_SWAPCHAIN_RENDERER (data);
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  priv->frame_retry_source = 0;
+  gulkan_renderer_queue_draw (GULKAN_RENDERER (self));
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+_cancel_frame_retry (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  if (priv->frame_retry_source)
+    {
+      g_source_remove (priv->frame_retry_source);
+      priv->frame_retry_source = 0;
+    }
+}
+
+/*
+ * A frame that was not presented commits no frame request, so draws driven
+ * by a window would stop. Request the next frame, and draw again after a
+ * while in case the window system can't signal without a present.
+ */
+static gboolean
+_draw (GulkanRenderer *renderer)
+{
+  GulkanSwapchainRenderer        *self = GULKAN_SWAPCHAIN_RENDERER (renderer);
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  gboolean presented = FALSE;
+  gboolean ret = _draw_frame (self, &presented);
+
+  if (!priv->frame_window)
+    return ret;
+
+  if (presented)
+    {
+      _cancel_frame_retry (self);
+      return ret;
+    }
+
+  gulkan_window_request_frame (priv->frame_window);
+  if (!priv->frame_retry_source)
+    priv->frame_retry_source = g_timeout_add (GULKAN_FRAME_RETRY_MS,
+                                              _frame_retry_cb, self);
+
+  return ret;
+}
+
+static gboolean
+_record_cmd_buffer (GulkanSwapchainRenderer *self,
+                    RenderBuffer            *b,
+                    GulkanRenderPass        *pass,
+                    VkRect2D                 area)
+{
+  GulkanSwapchainRendererClass *klass
+    = GULKAN_SWAPCHAIN_RENDERER_GET_CLASS (self);
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  VkCommandBufferBeginInfo info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = 0,
+  };
+
+  VkExtent2D extent = gulkan_renderer_get_extent (GULKAN_RENDERER (self));
+
+  const VkViewport viewport = {
+    .x = 0,
+    .y = 0,
+    .width = (float) extent.width,
+    .height = (float) extent.height,
+    .minDepth = 0,
+    .maxDepth = 1,
+  };
+
+  VkCommandBuffer cmd_buffer = b->cmd_buffer;
+  VkResult        res = vkBeginCommandBuffer (cmd_buffer, &info);
+  vk_check_error ("vkBeginCommandBuffer", res, FALSE);
+
+  if (pass)
+    gulkan_render_pass_begin_area (pass, area, priv->clear_color, b->fb,
+                                   cmd_buffer);
+  else
+    gulkan_frame_buffer_begin_rendering (b->fb, cmd_buffer, priv->clear_color);
+
+  vkCmdSetViewport (cmd_buffer, 0, 1, &viewport);
+  vkCmdSetScissor (cmd_buffer, 0, 1, &area);
+
+  klass->init_draw_cmd (self, cmd_buffer);
+
+  if (pass)
+    vkCmdEndRenderPass (cmd_buffer);
+  else
+    gulkan_frame_buffer_end_rendering (b->fb, cmd_buffer,
+                                       VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+  res = vkEndCommandBuffer (cmd_buffer);
+  vk_check_error ("vkEndCommandBuffer", res, FALSE);
+
+  b->recorded_area = area;
+
+  return TRUE;
+}
+
+gboolean
+gulkan_swapchain_renderer_init_draw_cmd_buffers (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererClass *klass
+    = GULKAN_SWAPCHAIN_RENDERER_GET_CLASS (self);
+  if (klass->init_draw_cmd == NULL)
+    return FALSE;
+
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  uint32_t size = gulkan_swapchain_get_size (priv->swapchain);
+
+  VkExtent2D extent = gulkan_renderer_get_extent (GULKAN_RENDERER (self));
+  VkRect2D   render_area = {{0, 0}, extent};
+
+  for (uint32_t i = 0; i < size; i++)
+    if (!_record_cmd_buffer (self, &priv->buffers[i], priv->pass, render_area))
+      return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+_is_extent_valid (VkExtent2D *extent)
+{
+  return extent->width < UINT32_MAX && extent->height < UINT32_MAX
+         && extent->width > 0 && extent->height > 0;
+}
+
+void
+gulkan_swapchain_renderer_initialize (GulkanSwapchainRenderer *self,
+                                      VkClearColorValue        clear_color,
+                                      gconstpointer            pipeline_data)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+  priv->clear_color = clear_color;
+  priv->pipeline_data = pipeline_data;
+}
+
+static gboolean
+_do_init (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+  GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
+  GulkanDevice  *gulkan_device = gulkan_context_get_device (context);
+
+  priv->initialized = TRUE;
+
+  if (priv->use_dynamic_rendering
+      && !gulkan_device_supports_dynamic_rendering (gulkan_device))
+    {
+      g_warning ("Dynamic rendering not supported, using a render pass.");
+      priv->use_dynamic_rendering = FALSE;
+    }
+
+  if (priv->partial_render && priv->use_dynamic_rendering)
+    {
+      g_warning ("Partial rendering requires a render pass, disabling it.");
+      priv->partial_render = FALSE;
+    }
+
+  /* Dynamic rendering uses the swapchain image views directly */
+  if (!priv->use_dynamic_rendering)
+    {
+      priv->pass
+        = gulkan_render_pass_new (gulkan_device, VK_SAMPLE_COUNT_1_BIT,
+                                  gulkan_swapchain_get_format (priv->swapchain),
+                                  VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, FALSE);
+      if (!priv->pass)
+        {
+          g_printerr ("Could not init render pass.\n");
+          return FALSE;
+        }
+    }
+
+  if (priv->partial_render)
+    {
+      priv->partial_pass = gulkan_render_pass_new_preserving (
+        gulkan_device, VK_SAMPLE_COUNT_1_BIT,
+        gulkan_swapchain_get_format (priv->swapchain),
+        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, FALSE);
+      if (!priv->partial_pass)
+        {
+          g_printerr ("Could not init partial render pass.\n");
+          return FALSE;
+        }
+    }
+
+  GulkanSwapchainRendererClass *klass
+    = GULKAN_SWAPCHAIN_RENDERER_GET_CLASS (self);
+  if (klass->init_pipeline == NULL)
+    return FALSE;
+
+  if (!klass->init_pipeline (self, priv->pipeline_data))
+    return FALSE;
+
+  return TRUE;
+}
+
+static void
+gulkan_swapchain_renderer_class_init (GulkanSwapchainRendererClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  object_class->finalize = _finalize;
+
+  GulkanRendererClass *parent_class = GULKAN_RENDERER_CLASS (klass);
+  parent_class->draw = _draw;
+
+  /**
+   * GulkanSwapchainRenderer::swapchain-rebuilt:
+   * @self: a #GulkanSwapchainRenderer
+   * @extent: (type gpointer): the new #VkExtent2D
+   *
+   * Emitted when drawing recreated a swapchain that was reported out of date
+   * or suboptimal. Command buffers were already recorded again.
+   */
+  signals[SWAPCHAIN_REBUILT] = g_signal_new ("swapchain-rebuilt",
+                                             G_TYPE_FROM_CLASS (klass),
+                                             G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+                                             NULL, G_TYPE_NONE, 1,
+                                             G_TYPE_POINTER
+                                               | G_SIGNAL_TYPE_STATIC_SCOPE);
+}
+
+/*
+ * Returns TRUE when the swapchain needs to be recreated for the settings to
+ * take effect. Unsupported present modes fall back to the current one.
+ */
+static gboolean
+_apply_swapchain_settings (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  VkPresentModeKHR current = gulkan_swapchain_get_present_mode (priv->swapchain);
+
+  if (priv->present_mode != current
+      && !gulkan_swapchain_set_present_mode (priv->swapchain,
+                                             priv->present_mode))
+    {
+      g_warning ("Present mode %d not supported, using %d.",
+                 priv->present_mode, current);
+      priv->present_mode = current;
+    }
+
+  gboolean needs_images
+    = gulkan_swapchain_set_image_count (priv->swapchain, priv->image_count);
+
+  return priv->present_mode != current || needs_images;
+}
+
+gboolean
+gulkan_swapchain_renderer_resize (GulkanSwapchainRenderer *self,
+                                  VkSurfaceKHR             surface,
+                                  VkExtent2D               expose_extent)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  GulkanContext *context = gulkan_renderer_get_context (GULKAN_RENDERER (self));
+
+  g_debug ("gulkan_swapchain_renderer_resize: Got expose extent %dx%d\n",
+           expose_extent.width, expose_extent.height);
+
+  VkExtent2D extent;
+  if (_is_extent_valid (&expose_extent))
     {
       extent = expose_extent;
     }
@@ -397,26 +1005,57 @@ gulkan_swapchain_renderer_resize (GulkanSwapchainRenderer *self,
 
   if (priv->swapchain)
     {
-      for (uint32_t i = 0; i < gulkan_swapchain_get_size (priv->swapchain); i++)
-        g_object_unref (priv->buffers[i].fb);
-      g_object_unref (priv->swapchain);
-    }
+      /* Keep the old swapchain until the window is shown again */
+      if (surface == gulkan_swapchain_get_surface (priv->swapchain)
+          && _is_surface_minimized (self, surface))
+        {
+          g_debug ("Surface is minimized, not recreating swapchain.");
+          return TRUE;
+        }
 
-  priv->swapchain = gulkan_swapchain_new (context, surface, extent,
-                                          VK_PRESENT_MODE_FIFO_KHR,
-                                          priv->format,
-                                          VK_COLOR_SPACE_SRGB_NONLINEAR_KHR);
+      /* Retiring the old swapchain requires its images to be idle */
+      if (!_wait_render_buffers (self))
+        return FALSE;
 
-  if (!priv->swapchain)
+      _apply_swapchain_settings (self);
+
+      if (!gulkan_swapchain_reset_surface (priv->swapchain, surface, extent))
+        {
+          g_printerr ("Could not recreate swapchain.\n");
+          return FALSE;
+        }
+    }
+  else
     {
-      g_printerr ("Could not init swapchain.\n");
-      return FALSE;
+      /* FIFO is always supported, other modes are checked on the surface */
+      priv->swapchain
+        = gulkan_swapchain_new (context, surface, extent,
+                                VK_PRESENT_MODE_FIFO_KHR, priv->format,
+                                VK_COLOR_SPACE_SRGB_NONLINEAR_KHR);
+
+      if (!priv->swapchain)
+        {
+          g_printerr ("Could not init swapchain.\n");
+          return FALSE;
+        }
+
+      if (_apply_swapchain_settings (self)
+          && !gulkan_swapchain_resize (priv->swapchain, extent))
+        {
+          g_printerr ("Could not recreate swapchain.\n");
+          return FALSE;
+        }
     }
 
-  gulkan_renderer_set_extent (GULKAN_RENDERER (self), extent);
+  if (!_init_frame_slots (self))
+    return FALSE;
+
+  /* The surface may not match the requested extent */
+  gulkan_renderer_set_extent (GULKAN_RENDERER (self),
+                              gulkan_swapchain_get_extent (priv->swapchain));
 
   // Init render pass and pipeline on first resize
-  if (!priv->pass)
+  if (!priv->initialized)
     {
       if (!_do_init (self))
         {
@@ -424,44 +1063,309 @@ gulkan_swapchain_renderer_resize (GulkanSwapchainRenderer *self,
         }
     }
 
-  size_t   size = gulkan_swapchain_get_size (priv->swapchain);
-  VkImage *images = g_malloc (sizeof (VkImage) * size);
-  gulkan_swapchain_get_images (priv->swapchain, images);
+  if (!_init_render_buffers (self))
+    return FALSE;
 
-  VkFormat format = gulkan_swapchain_get_format (priv->swapchain);
+  if (!gulkan_swapchain_renderer_init_draw_cmd_buffers (self))
+    return FALSE;
 
-  GulkanQueue  *gulkan_queue = gulkan_device_get_graphics_queue (gulkan_device);
-  VkCommandPool pool = gulkan_queue_get_command_pool (gulkan_queue);
+  /* Restart the frame callbacks, the window may not request a frame itself */
+  if (priv->frame_window)
+    gulkan_renderer_queue_draw (GULKAN_RENDERER (self));
 
-  VkCommandBufferAllocateInfo alloc_info = {
-    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-    .commandPool = pool,
-    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-    .commandBufferCount = 1,
-  };
-  VkDevice device = gulkan_device_get_handle (gulkan_device);
+  return TRUE;
+}
 
-  for (uint32_t i = 0; i < size; i++)
+/**
+ * gulkan_swapchain_renderer_get_surface:
+ * @self: a #GulkanSwapchainRenderer
+ *
+ * Passing this surface to gulkan_swapchain_renderer_resize() recreates the
+ * swapchain from the previous one, instead of creating it from scratch.
+ *
+ * Returns: (transfer none): the current #VkSurfaceKHR, or %VK_NULL_HANDLE
+ * before the first resize
+ */
+VkSurfaceKHR
+gulkan_swapchain_renderer_get_surface (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  if (!priv->swapchain)
+    return VK_NULL_HANDLE;
+
+  return gulkan_swapchain_get_surface (priv->swapchain);
+}
+
+/**
+ * gulkan_swapchain_renderer_set_present_mode:
+ * @self: a #GulkanSwapchainRenderer
+ * @present_mode: a #VkPresentModeKHR
+ *
+ * Takes effect on the next gulkan_swapchain_renderer_resize(). Modes the
+ * surface does not support are ignored with a warning. The default is
+ * %VK_PRESENT_MODE_FIFO_KHR.
+ */
+void
+gulkan_swapchain_renderer_set_present_mode (GulkanSwapchainRenderer *self,
+                                            VkPresentModeKHR present_mode)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  priv->present_mode = present_mode;
+}
+
+/**
+ * gulkan_swapchain_renderer_get_present_mode:
+ * @self: a #GulkanSwapchainRenderer
+ *
+ * Returns: the requested #VkPresentModeKHR, or the one in use if the
+ * requested one was not supported
+ */
+VkPresentModeKHR
+gulkan_swapchain_renderer_get_present_mode (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  return priv->present_mode;
+}
+
+/**
+ * gulkan_swapchain_renderer_set_image_count:
+ * @self: a #GulkanSwapchainRenderer
+ * @image_count: the minimum number of swapchain images, or 0 for the minimum
+ * of the surface
+ *
+ * Takes effect on the next gulkan_swapchain_renderer_resize().
+ */
+void
+gulkan_swapchain_renderer_set_image_count (GulkanSwapchainRenderer *self,
+                                           uint32_t                 image_count)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  priv->image_count = image_count;
+}
+
+/**
+ * gulkan_swapchain_renderer_get_image_count:
+ * @self: a #GulkanSwapchainRenderer
+ *
+ * Returns: the number of swapchain images, or the requested count before
+ * the first resize
+ */
+uint32_t
+gulkan_swapchain_renderer_get_image_count (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  if (priv->swapchain)
+    return gulkan_swapchain_get_size (priv->swapchain);
+
+  return priv->image_count;
+}
+
+/**
+ * gulkan_swapchain_renderer_set_max_queued_frames:
+ * @self: a #GulkanSwapchainRenderer
+ * @max_queued_frames: number of frames that may be queued for presentation
+ *
+ * Fewer queued frames lower the latency, more of them absorb spikes in
+ * frame time. With gulkan_device_supports_present_wait() drawing blocks until
+ * no more than @max_queued_frames presents are pending. Otherwise it only
+ * bounds the frames recorded ahead of the GPU. Defaults to 2, takes effect on
+ * the next gulkan_swapchain_renderer_resize().
+ */
+void
+gulkan_swapchain_renderer_set_max_queued_frames (GulkanSwapchainRenderer *self,
+                                                 uint32_t max_queued_frames)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  priv->max_queued_frames = MAX (max_queued_frames, 1);
+}
+
+/**
+ * gulkan_swapchain_renderer_get_max_queued_frames:
+ * @self: a #GulkanSwapchainRenderer
+ *
+ * Returns: the maximum number of queued frames
+ */
+uint32_t
+gulkan_swapchain_renderer_get_max_queued_frames (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  return priv->max_queued_frames;
+}
+
+/**
+ * gulkan_swapchain_renderer_get_present_latency:
+ * @self: a #GulkanSwapchainRenderer
+ *
+ * Measured from the start of a draw until its present was shown, which
+ * requires gulkan_device_supports_present_wait().
+ *
+ * Returns: the latency of the last frame in microseconds, or -1 if unknown
+ */
+gint64
+gulkan_swapchain_renderer_get_present_latency (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  return priv->present_latency;
+}
+
+static void
+_frame_ready_cb (GulkanWindow *window, GulkanSwapchainRenderer *self)
+{
+  (void) window;
+  gulkan_renderer_queue_draw (GULKAN_RENDERER (self));
+}
+
+/**
+ * gulkan_swapchain_renderer_set_frame_window:
+ * @self: a #GulkanSwapchainRenderer
+ * @window: (nullable): the #GulkanWindow the swapchain presents to, or %NULL
+ *
+ * Renders only when @window signals "frame-ready", instead of when the
+ * application calls gulkan_renderer_draw(). Each draw requests the next
+ * frame, so rendering follows the compositor and stops while the window is
+ * hidden. Frames that could not be presented, e.g. while minimized, are
+ * retried after a short timeout. Draws are dispatched from the default main
+ * context. %NULL returns to drawing on demand.
+ */
+void
+gulkan_swapchain_renderer_set_frame_window (GulkanSwapchainRenderer *self,
+                                            GulkanWindow            *window)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  if (priv->frame_window == window)
+    return;
+
+  _cancel_frame_retry (self);
+
+  if (priv->frame_window)
     {
-      RenderBuffer *b = &priv->buffers[i];
-      b->fb = gulkan_frame_buffer_new_from_image (gulkan_device, priv->pass,
-                                                  images[i], extent, format, 1);
-      if (!b->fb)
-        {
-          g_printerr ("Error: Creating framebuffer failed.\n");
-          return FALSE;
-        }
+      g_signal_handler_disconnect (priv->frame_window,
+                                   priv->frame_ready_handler);
+      priv->frame_ready_handler = 0;
+      g_clear_object (&priv->frame_window);
+    }
+
+  if (!window)
+    return;
+
+  priv->frame_window = g_object_ref (window);
+  priv->frame_ready_handler = g_signal_connect (window, "frame-ready",
+                                                (GCallback) _frame_ready_cb,
+                                                self);
+
+  if (priv->swapchain)
+    gulkan_renderer_queue_draw (GULKAN_RENDERER (self));
+}
+
+/**
+ * gulkan_swapchain_renderer_set_damage:
+ * @self: a #GulkanSwapchainRenderer
+ * @rects: (array length=count) (nullable): rectangles in pixels that changed
+ * @count: the number of rectangles, 0 for a full frame
+ *
+ * Sets the damage of the next draw, after which it is reset to a full frame.
+ * It is passed to the compositor with gulkan_swapchain_present_damage(), and
+ * with gulkan_swapchain_renderer_set_partial_render() limits rendering to the
+ * damaged area.
+ */
+void
+gulkan_swapchain_renderer_set_damage (GulkanSwapchainRenderer *self,
+                                      const VkRect2D          *rects,
+                                      uint32_t                 count)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  g_array_set_size (priv->damage, 0);
+  if (count > 0)
+    g_array_append_vals (priv->damage, rects, count);
+}
+
+/**
+ * gulkan_swapchain_renderer_set_partial_render:
+ * @self: a #GulkanSwapchainRenderer
+ * @partial_render: whether to only render damaged areas
+ *
+ * Command buffers are recorded again with the damaged area of the image as
+ * render area and scissor, so content outside of it is kept. Drawing with
+ * a damaged area needs to result in the same pixels as a full frame. Needs
+ * to be set before the first resize and is not supported with dynamic
+ * rendering.
+ */
+void
+gulkan_swapchain_renderer_set_partial_render (GulkanSwapchainRenderer *self,
+                                              gboolean partial_render)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
 
-      /* Redo command buffers */
-      VkResult res = vkAllocateCommandBuffers (device, &alloc_info,
-                                               &b->cmd_buffer);
-      vk_check_error ("vkAllocateCommandBuffers", res, FALSE);
+  if (priv->initialized)
+    {
+      g_warning ("Partial rendering needs to be set before initialization.");
+      return;
     }
 
-  g_free (images);
+  priv->partial_render = partial_render;
+}
 
-  if (!gulkan_swapchain_renderer_init_draw_cmd_buffers (self))
-    return FALSE;
+/**
+ * gulkan_swapchain_renderer_set_record_each_frame:
+ * @self: a #GulkanSwapchainRenderer
+ * @record_each_frame: whether to record command buffers on every draw
+ *
+ * By default the command buffer of each swapchain image is recorded once,
+ * so @init_draw_cmd can only use state that does not change between frames.
+ * With @record_each_frame it is recorded again on every draw, once the GPU is
+ * done with the image and the frame slot, see
+ * gulkan_swapchain_renderer_get_frame_slot().
+ */
+void
+gulkan_swapchain_renderer_set_record_each_frame (GulkanSwapchainRenderer *self,
+                                                 gboolean record_each_frame)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
 
-  return TRUE;
+  priv->record_each_frame = record_each_frame;
+}
+
+/**
+ * gulkan_swapchain_renderer_get_frame_slot:
+ * @self: a #GulkanSwapchainRenderer
+ *
+ * Frames cycle through gulkan_swapchain_renderer_get_max_queued_frames()
+ * slots. When @init_draw_cmd is called for a draw, the frame that last used
+ * the slot has completed, so per slot resources can be written without
+ * waiting. This requires gulkan_swapchain_renderer_set_record_each_frame().
+ *
+ * Returns: the slot of the frame that is drawn next
+ */
+uint32_t
+gulkan_swapchain_renderer_get_frame_slot (GulkanSwapchainRenderer *self)
+{
+  GulkanSwapchainRendererPrivate *priv
+    = gulkan_swapchain_renderer_get_instance_private (self);
+
+  if (priv->slot_count == 0)
+    return 0;
+
+  return (uint32_t) (priv->frame_count % priv->slot_count);
 }
@@ -12,6 +12,7 @@
 
 #include "gulkan-render-pass.h"
 #include "gulkan-renderer.h"
+#include "gulkan-window.h"
 
 G_BEGIN_DECLS
 
@@ -41,6 +42,13 @@ struct _GulkanSwapchainRendererClass
 GulkanRenderPass *
 gulkan_swapchain_renderer_get_render_pass (GulkanSwapchainRenderer *self);
 
+void
+gulkan_swapchain_renderer_set_dynamic_rendering (GulkanSwapchainRenderer *self,
+                                                 gboolean use_dynamic_rendering);
+
+VkFormat
+gulkan_swapchain_renderer_get_format (GulkanSwapchainRenderer *self);
+
 void
 gulkan_swapchain_renderer_initialize (GulkanSwapchainRenderer *self,
                                       VkClearColorValue        clear_color,
@@ -51,6 +59,53 @@ gulkan_swapchain_renderer_resize (GulkanSwapchainRenderer *self,
                                   VkSurfaceKHR             surface,
                                   VkExtent2D               extent);
 
+VkSurfaceKHR
+gulkan_swapchain_renderer_get_surface (GulkanSwapchainRenderer *self);
+
+void
+gulkan_swapchain_renderer_set_present_mode (GulkanSwapchainRenderer *self,
+                                            VkPresentModeKHR present_mode);
+
+VkPresentModeKHR
+gulkan_swapchain_renderer_get_present_mode (GulkanSwapchainRenderer *self);
+
+void
+gulkan_swapchain_renderer_set_image_count (GulkanSwapchainRenderer *self,
+                                           uint32_t                 image_count);
+
+uint32_t
+gulkan_swapchain_renderer_get_image_count (GulkanSwapchainRenderer *self);
+
+void
+gulkan_swapchain_renderer_set_max_queued_frames (GulkanSwapchainRenderer *self,
+                                                 uint32_t max_queued_frames);
+
+uint32_t
+gulkan_swapchain_renderer_get_max_queued_frames (GulkanSwapchainRenderer *self);
+
+gint64
+gulkan_swapchain_renderer_get_present_latency (GulkanSwapchainRenderer *self);
+
+void
+gulkan_swapchain_renderer_set_damage (GulkanSwapchainRenderer *self,
+                                      const VkRect2D          *rects,
+                                      uint32_t                 count);
+
+void
+gulkan_swapchain_renderer_set_partial_render (GulkanSwapchainRenderer *self,
+                                              gboolean partial_render);
+
+void
+gulkan_swapchain_renderer_set_record_each_frame (GulkanSwapchainRenderer *self,
+                                                 gboolean record_each_frame);
+
+uint32_t
+gulkan_swapchain_renderer_get_frame_slot (GulkanSwapchainRenderer *self);
+
+void
+gulkan_swapchain_renderer_set_frame_window (GulkanSwapchainRenderer *self,
+                                            GulkanWindow            *window);
+
 gboolean
 gulkan_swapchain_renderer_init_draw_cmd_buffers (GulkanSwapchainRenderer *self);
 
@@ -20,7 +20,16 @@ struct _GulkanSwapchain
   VkSurfaceFormatKHR surface_format;
   VkPresentModeKHR   present_mode;
 
+  /* Requested image count, 0 for the surface minimum */
+  uint32_t image_count;
   uint32_t size;
+
+  /* Id of the last present, only counted with present wait support */
+  uint64_t present_id;
+
+  /* Set when acquire or present reported an out of date or suboptimal
+   * swapchain, cleared on recreation */
+  gboolean out_of_date;
 };
 
 G_DEFINE_TYPE (GulkanSwapchain, gulkan_swapchain, G_TYPE_OBJECT)
@@ -52,7 +61,10 @@ gulkan_swapchain_init (GulkanSwapchain *self)
 {
   self->handle = VK_NULL_HANDLE;
   self->surface = VK_NULL_HANDLE;
+  self->image_count = 0;
   self->size = 0;
+  self->present_id = 0;
+  self->out_of_date = FALSE;
 }
 
 static gboolean
@@ -130,48 +142,67 @@ _find_surface_present_mode (VkPhysicalDevice  device,
   return FALSE;
 }
 
-gboolean
-gulkan_swapchain_reset_surface (GulkanSwapchain *self,
-                                VkSurfaceKHR     surface,
-                                VkExtent2D       extent)
+/* The requested image count, clamped to what the surface supports */
+static uint32_t
+_get_min_image_count (GulkanSwapchain                *self,
+                      const VkSurfaceCapabilitiesKHR *surface_caps)
 {
-  if (self->surface != VK_NULL_HANDLE)
-    {
-      VkInstance instance = gulkan_context_get_instance_handle (self->context);
-      vkDestroySurfaceKHR (instance, self->surface, NULL);
-    }
-  self->surface = surface;
-  self->extent = extent;
-
-  GulkanDevice *gulkan_device = gulkan_context_get_device (self->context);
-
-  GulkanQueue *gulkan_queue = gulkan_device_get_graphics_queue (gulkan_device);
-
-  if (!gulkan_queue_supports_surface (gulkan_queue, surface))
-    {
-      g_printerr ("Device does not support surface.\n");
-      return FALSE;
-    }
+  uint32_t count = MAX (surface_caps->minImageCount, self->image_count);
+  if (surface_caps->maxImageCount > 0)
+    count = MIN (count, surface_caps->maxImageCount);
+  return count;
+}
 
+/*
+ * Creates a new swapchain for the current surface and extent. The previous
+ * one is handed to the driver as oldSwapchain, so it can reuse its resources,
+ * and is retired. Callers need to make sure none of its images are in use.
+ */
+static gboolean
+_create_handle (GulkanSwapchain *self)
+{
+  GulkanDevice    *gulkan_device = gulkan_context_get_device (self->context);
   VkPhysicalDevice physical_device
     = gulkan_device_get_physical_handle (gulkan_device);
 
   VkSurfaceCapabilitiesKHR surface_caps;
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR (physical_device, surface,
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR (physical_device, self->surface,
                                              &surface_caps);
 
   g_assert (surface_caps.supportedCompositeAlpha
             & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR);
 
+  /* The surface dictates the extent when it has one, e.g. on X11 */
+  if (surface_caps.currentExtent.width != UINT32_MAX)
+    self->extent = surface_caps.currentExtent;
+
+  self->extent.width = CLAMP (self->extent.width,
+                              surface_caps.minImageExtent.width,
+                              surface_caps.maxImageExtent.width);
+  self->extent.height = CLAMP (self->extent.height,
+                               surface_caps.minImageExtent.height,
+                               surface_caps.maxImageExtent.height);
+
+  /* Minimized windows can't have a swapchain, keep the old one until then */
+  if (self->extent.width == 0 || self->extent.height == 0)
+    {
+      g_debug ("Surface has zero extent, not creating swapchain.");
+      return FALSE;
+    }
+
   VkDevice device = gulkan_device_get_handle (gulkan_device);
 
+  uint32_t min_image_count = _get_min_image_count (self, &surface_caps);
+
+  VkSwapchainKHR old_swapchain = self->handle;
+
   VkSwapchainCreateInfoKHR info = {
     .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
     .surface = self->surface,
-    .minImageCount = surface_caps.minImageCount,
+    .minImageCount = min_image_count,
     .imageFormat = self->surface_format.format,
     .imageColorSpace = self->surface_format.colorSpace,
-    .imageExtent = extent,
+    .imageExtent = self->extent,
     .imageArrayLayers = 1,
     .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
     .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
@@ -180,17 +211,208 @@ gulkan_swapchain_reset_surface (GulkanSwapchain *self,
     .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
     .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
     .presentMode = self->present_mode,
+    .oldSwapchain = old_swapchain,
   };
 
   VkResult res = vkCreateSwapchainKHR (device, &info, NULL, &self->handle);
+
+  /* The old swapchain is retired even if creation failed */
+  if (old_swapchain != VK_NULL_HANDLE)
+    vkDestroySwapchainKHR (device, old_swapchain, NULL);
+
+  if (res != VK_SUCCESS)
+    self->handle = VK_NULL_HANDLE;
   vk_check_error ("vkCreateSwapchainKHR", res, FALSE);
 
   vkGetSwapchainImagesKHR (device, self->handle, &self->size, NULL);
   g_assert (self->size > 0);
 
+  self->out_of_date = FALSE;
+
   return TRUE;
 }
 
+/**
+ * gulkan_swapchain_reset_surface:
+ * @self: a #GulkanSwapchain
+ * @surface: (transfer full): a #VkSurfaceKHR
+ * @extent: the new extent
+ *
+ * Creates a swapchain for a new surface. The previous surface is destroyed.
+ * Use gulkan_swapchain_resize() when only the extent changed.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_swapchain_reset_surface (GulkanSwapchain *self,
+                                VkSurfaceKHR     surface,
+                                VkExtent2D       extent)
+{
+  if (surface == self->surface)
+    return gulkan_swapchain_resize (self, extent);
+
+  /* A swapchain can't be recreated for a different surface */
+  if (self->handle != VK_NULL_HANDLE)
+    {
+      VkDevice device = gulkan_context_get_device_handle (self->context);
+      vkDestroySwapchainKHR (device, self->handle, NULL);
+      self->handle = VK_NULL_HANDLE;
+    }
+
+  if (self->surface != VK_NULL_HANDLE)
+    {
+      VkInstance instance = gulkan_context_get_instance_handle (self->context);
+      vkDestroySurfaceKHR (instance, self->surface, NULL);
+    }
+  self->surface = surface;
+  self->extent = extent;
+
+  GulkanDevice *gulkan_device = gulkan_context_get_device (self->context);
+
+  GulkanQueue *gulkan_queue = gulkan_device_get_graphics_queue (gulkan_device);
+
+  if (!gulkan_queue_supports_surface (gulkan_queue, surface))
+    {
+      g_printerr ("Device does not support surface.\n");
+      return FALSE;
+    }
+
+  return _create_handle (self);
+}
+
+/**
+ * gulkan_swapchain_resize:
+ * @self: a #GulkanSwapchain
+ * @extent: the new extent
+ *
+ * Recreates the swapchain for the current surface, retiring the previous
+ * one. All work using the previous images must have completed. Surfaces with
+ * a fixed size override @extent, see gulkan_swapchain_get_extent().
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_swapchain_resize (GulkanSwapchain *self, VkExtent2D extent)
+{
+  self->extent = extent;
+  return _create_handle (self);
+}
+
+/**
+ * gulkan_swapchain_set_present_mode:
+ * @self: a #GulkanSwapchain
+ * @present_mode: a #VkPresentModeKHR
+ *
+ * Takes effect on the next gulkan_swapchain_resize().
+ *
+ * Returns: %TRUE if the surface supports @present_mode
+ */
+gboolean
+gulkan_swapchain_set_present_mode (GulkanSwapchain *self,
+                                   VkPresentModeKHR present_mode)
+{
+  GulkanDevice    *gulkan_device = gulkan_context_get_device (self->context);
+  VkPhysicalDevice physical_device
+    = gulkan_device_get_physical_handle (gulkan_device);
+
+  return _find_surface_present_mode (physical_device, self->surface,
+                                     present_mode, &self->present_mode);
+}
+
+/**
+ * gulkan_swapchain_get_present_mode:
+ * @self: a #GulkanSwapchain
+ *
+ * Returns: the #VkPresentModeKHR
+ */
+VkPresentModeKHR
+gulkan_swapchain_get_present_mode (GulkanSwapchain *self)
+{
+  return self->present_mode;
+}
+
+/**
+ * gulkan_swapchain_set_image_count:
+ * @self: a #GulkanSwapchain
+ * @image_count: the minimum number of images to request, or 0 for the
+ * minimum of the surface
+ *
+ * The count is clamped to what the surface supports. An image more than the
+ * minimum avoids blocking on acquire. Takes effect on the next
+ * gulkan_swapchain_resize().
+ *
+ * Returns: %TRUE if the current swapchain has fewer images than requested,
+ * so it needs to be recreated
+ */
+gboolean
+gulkan_swapchain_set_image_count (GulkanSwapchain *self, uint32_t image_count)
+{
+  self->image_count = image_count;
+
+  if (self->handle == VK_NULL_HANDLE)
+    return FALSE;
+
+  GulkanDevice    *gulkan_device = gulkan_context_get_device (self->context);
+  VkPhysicalDevice physical_device
+    = gulkan_device_get_physical_handle (gulkan_device);
+
+  VkSurfaceCapabilitiesKHR surface_caps;
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR (physical_device, self->surface,
+                                             &surface_caps);
+
+  /* Drivers may create more images than the minimum */
+  return _get_min_image_count (self, &surface_caps) > self->size;
+}
+
+/**
+ * gulkan_swapchain_get_present_id:
+ * @self: a #GulkanSwapchain
+ *
+ * Presents are tagged with increasing ids if
+ * gulkan_device_supports_present_wait().
+ *
+ * Returns: the id of the last present, or 0
+ */
+uint64_t
+gulkan_swapchain_get_present_id (GulkanSwapchain *self)
+{
+  return self->present_id;
+}
+
+/**
+ * gulkan_swapchain_wait_for_present:
+ * @self: a #GulkanSwapchain
+ * @present_id: an id from gulkan_swapchain_get_present_id()
+ * @timeout: timeout in nanoseconds
+ *
+ * Returns: %TRUE once the present with @present_id is visible, %FALSE on
+ * timeout, error, or without present wait support
+ */
+gboolean
+gulkan_swapchain_wait_for_present (GulkanSwapchain *self,
+                                   uint64_t         present_id,
+                                   uint64_t         timeout)
+{
+  GulkanDevice *gulkan_device = gulkan_context_get_device (self->context);
+
+  VkResult res = gulkan_device_wait_for_present (gulkan_device, self->handle,
+                                                 present_id, timeout);
+
+  return res == VK_SUCCESS || res == VK_SUBOPTIMAL_KHR;
+}
+
+/**
+ * gulkan_swapchain_get_surface:
+ * @self: a #GulkanSwapchain
+ *
+ * Returns: (transfer none): the #VkSurfaceKHR
+ */
+VkSurfaceKHR
+gulkan_swapchain_get_surface (GulkanSwapchain *self)
+{
+  return self->surface;
+}
+
 static gboolean
 _init (GulkanSwapchain *self,
        VkSurfaceKHR     surface,
@@ -293,11 +515,15 @@ gulkan_swapchain_acquire (GulkanSwapchain *self,
                                         signal_semaphore, VK_NULL_HANDLE,
                                         index);
 
-  if (res != VK_SUBOPTIMAL_KHR)
+  /* A suboptimal image was still acquired and needs to be presented */
+  if (res == VK_SUBOPTIMAL_KHR || res == VK_ERROR_OUT_OF_DATE_KHR)
     {
-      vk_check_error ("vkAcquireNextImageKHR", res, FALSE);
+      self->out_of_date = TRUE;
+      return res == VK_SUBOPTIMAL_KHR;
     }
 
+  vk_check_error ("vkAcquireNextImageKHR", res, FALSE);
+
   return TRUE;
 }
 
@@ -305,13 +531,97 @@ gboolean
 gulkan_swapchain_present (GulkanSwapchain *self,
                           VkSemaphore     *wait_semaphore,
                           uint32_t         index)
+{
+  return gulkan_swapchain_present_damage (self, wait_semaphore, index, NULL, 0);
+}
+
+/**
+ * gulkan_swapchain_present_damage:
+ * @self: a #GulkanSwapchain
+ * @wait_semaphore: semaphore to wait on before presenting
+ * @index: the index of the acquired image
+ * @damage: (array length=damage_count) (nullable): the rectangles that
+ * changed since the previous present
+ * @damage_count: the number of rectangles in @damage, 0 for the full image
+ *
+ * Passes @damage to the compositor with %VK_KHR_INCREMENTAL_PRESENT if
+ * gulkan_device_supports_incremental_present(), so it only needs to
+ * recomposite what changed. Rectangles are clipped to the swapchain extent.
+ * The whole image is presented without support, or when no rectangle is
+ * left after clipping.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_swapchain_present_damage (GulkanSwapchain *self,
+                                 VkSemaphore     *wait_semaphore,
+                                 uint32_t         index,
+                                 const VkRect2D  *damage,
+                                 uint32_t         damage_count)
 {
   GulkanDevice *gulkan_device = gulkan_context_get_device (self->context);
   GulkanQueue  *gulkan_queue = gulkan_device_get_graphics_queue (gulkan_device);
   VkQueue       queue = gulkan_queue_get_handle (gulkan_queue);
 
+  const void *next = NULL;
+
+  /* Tag presents, so frame pacing can wait for them to be shown */
+  VkPresentIdKHR present_id_info = {
+    .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+    .swapchainCount = 1,
+    .pPresentIds = (uint64_t[]){self->present_id + 1},
+  };
+
+  gboolean use_present_id = gulkan_device_supports_present_wait (gulkan_device);
+  if (use_present_id)
+    next = &present_id_info;
+
+  /* Rectangles need to be inside of the image, empty ones are dropped */
+  VkRectLayerKHR *rects = NULL;
+  uint32_t        rect_count = 0;
+  if (damage_count > 0
+      && gulkan_device_supports_incremental_present (gulkan_device))
+    {
+      rects = g_malloc (sizeof (VkRectLayerKHR) * damage_count);
+      for (uint32_t i = 0; i < damage_count; i++)
+        {
+          int64_t x0 = MAX (damage[i].offset.x, 0);
+          int64_t y0 = MAX (damage[i].offset.y, 0);
+          int64_t x1 = MIN ((int64_t) damage[i].offset.x
+                              + damage[i].extent.width,
+                            (int64_t) self->extent.width);
+          int64_t y1 = MIN ((int64_t) damage[i].offset.y
+                              + damage[i].extent.height,
+                            (int64_t) self->extent.height);
+          if (x1 <= x0 || y1 <= y0)
+            continue;
+
+          rects[rect_count++] = (VkRectLayerKHR){
+            .offset = {(int32_t) x0, (int32_t) y0},
+            .extent = {(uint32_t) (x1 - x0), (uint32_t) (y1 - y0)},
+            .layer = 0,
+          };
+        }
+    }
+
+  VkPresentRegionKHR region = {
+    .rectangleCount = rect_count,
+    .pRectangles = rects,
+  };
+
+  VkPresentRegionsKHR regions_info = {
+    .sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR,
+    .pNext = next,
+    .swapchainCount = 1,
+    .pRegions = &region,
+  };
+
+  if (rect_count > 0)
+    next = &regions_info;
+
   VkPresentInfoKHR info = {
     .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+    .pNext = next,
     .waitSemaphoreCount = 1,
     .pWaitSemaphores = wait_semaphore,
     .swapchainCount = 1,
@@ -322,16 +632,39 @@ gulkan_swapchain_present (GulkanSwapchain *self,
 
   VkResult res = vkQueuePresentKHR (queue, &info);
 
-  if (res != VK_SUBOPTIMAL_KHR)
+  g_free (rects);
+
+  if (use_present_id)
+    self->present_id++;
+
+  /* The wait semaphore is consumed even if the present was rejected */
+  if (res == VK_SUBOPTIMAL_KHR || res == VK_ERROR_OUT_OF_DATE_KHR)
     {
-      vk_check_error ("vkQueuePresentKHR", res, FALSE);
+      self->out_of_date = TRUE;
+      return TRUE;
     }
 
-  vkQueueWaitIdle (queue);
+  vk_check_error ("vkQueuePresentKHR", res, FALSE);
 
   return TRUE;
 }
 
+/**
+ * gulkan_swapchain_is_out_of_date:
+ * @self: a #GulkanSwapchain
+ *
+ * Acquire and present mark the swapchain when it no longer matches the
+ * surface, e.g. after a fullscreen toggle or a move to another monitor.
+ * The mark is cleared once it is recreated with gulkan_swapchain_resize().
+ *
+ * Returns: %TRUE if the swapchain should be recreated
+ */
+gboolean
+gulkan_swapchain_is_out_of_date (GulkanSwapchain *self)
+{
+  return self->out_of_date;
+}
+
 /**
  * gulkan_swapchain_get_extent:
  * @self: a #GulkanSwapchain
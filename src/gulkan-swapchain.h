@@ -50,6 +50,13 @@ gulkan_swapchain_present (GulkanSwapchain *self,
                           VkSemaphore     *wait_semaphore,
                           uint32_t         index);
 
+gboolean
+gulkan_swapchain_present_damage (GulkanSwapchain *self,
+                                 VkSemaphore     *wait_semaphore,
+                                 uint32_t         index,
+                                 const VkRect2D  *damage,
+                                 uint32_t         damage_count);
+
 void
 gulkan_swapchain_get_images (GulkanSwapchain *self, VkImage *swap_chain_images);
 
@@ -61,6 +68,33 @@ gulkan_swapchain_reset_surface (GulkanSwapchain *self,
                                 VkSurfaceKHR     surface,
                                 VkExtent2D       extent);
 
+gboolean
+gulkan_swapchain_resize (GulkanSwapchain *self, VkExtent2D extent);
+
+gboolean
+gulkan_swapchain_is_out_of_date (GulkanSwapchain *self);
+
+VkSurfaceKHR
+gulkan_swapchain_get_surface (GulkanSwapchain *self);
+
+gboolean
+gulkan_swapchain_set_present_mode (GulkanSwapchain *self,
+                                   VkPresentModeKHR present_mode);
+
+VkPresentModeKHR
+gulkan_swapchain_get_present_mode (GulkanSwapchain *self);
+
+gboolean
+gulkan_swapchain_set_image_count (GulkanSwapchain *self, uint32_t image_count);
+
+uint64_t
+gulkan_swapchain_get_present_id (GulkanSwapchain *self);
+
+gboolean
+gulkan_swapchain_wait_for_present (GulkanSwapchain *self,
+                                   uint64_t         present_id,
+                                   uint64_t         timeout);
+
 G_END_DECLS
 
 #endif /* GULKAN_SWAPCHAIN_H_ */
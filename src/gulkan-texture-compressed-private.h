@@ -0,0 +1,63 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GULKAN_TEXTURE_COMPRESSED_PRIVATE_H_
+#define GULKAN_TEXTURE_COMPRESSED_PRIVATE_H_
+
+#include <glib.h>
+#include <vulkan/vulkan.h>
+
+G_BEGIN_DECLS
+
+#define GULKAN_COMPRESSED_IMAGE_MAX_LEVELS 16
+
+/*
+ * A 2D image with all of its mip levels, as stored in a KTX2 or DDS
+ * container. Level data is not copied, offsets point into @data.
+ */
+typedef struct
+{
+  VkFormat      format;
+  VkExtent2D    extent;
+  uint32_t      levels;
+  const guint8 *data;
+  gsize         size;
+  VkDeviceSize  level_offset[GULKAN_COMPRESSED_IMAGE_MAX_LEVELS];
+  VkDeviceSize  level_size[GULKAN_COMPRESSED_IMAGE_MAX_LEVELS];
+} GulkanCompressedImage;
+
+gboolean
+gulkan_compressed_image_parse_ktx2 (const guint8          *data,
+                                    gsize                  size,
+                                    GulkanCompressedImage *image);
+
+gboolean
+gulkan_compressed_image_parse_dds (const guint8          *data,
+                                   gsize                  size,
+                                   GulkanCompressedImage *image);
+
+gboolean
+gulkan_compressed_image_parse (const guint8          *data,
+                               gsize                  size,
+                               GulkanCompressedImage *image);
+
+gboolean
+gulkan_format_get_block_info (VkFormat    format,
+                              VkExtent2D *block_extent,
+                              uint32_t   *block_size);
+
+VkFormat
+gulkan_compressed_image_get_decoded_format (VkFormat format);
+
+guint8 *
+gulkan_compressed_image_decode (const GulkanCompressedImage *image,
+                                VkBufferImageCopy           *regions,
+                                gsize                       *size);
+
+G_END_DECLS
+
+#endif /* GULKAN_TEXTURE_COMPRESSED_PRIVATE_H_ */
@@ -0,0 +1,730 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "gulkan-texture-compressed-private.h"
+
+#include <string.h>
+
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_SIZE 24
+
+#define DDS_MAGIC 0x20534444 /* "DDS " */
+#define DDS_HEADER_SIZE 128
+#define DDS_DX10_HEADER_SIZE 20
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS2_CUBEMAP 0x200
+
+#define DDS_FOURCC(a, b, c, d)                                                 \
+  ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16)             \
+   | ((uint32_t) (d) << 24))
+
+static const guint8 ktx2_identifier[12] = {
+  0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n',
+};
+
+struct DxgiFormatTableEntry
+{
+  uint32_t dxgi_format;
+  VkFormat vk_format;
+};
+
+// clang-format off
+static struct DxgiFormatTableEntry DXGIVKFormatTable[] = {
+  { .dxgi_format = 71, .vk_format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK, },
+  { .dxgi_format = 72, .vk_format = VK_FORMAT_BC1_RGBA_SRGB_BLOCK, },
+  { .dxgi_format = 74, .vk_format = VK_FORMAT_BC2_UNORM_BLOCK, },
+  { .dxgi_format = 75, .vk_format = VK_FORMAT_BC2_SRGB_BLOCK, },
+  { .dxgi_format = 77, .vk_format = VK_FORMAT_BC3_UNORM_BLOCK, },
+  { .dxgi_format = 78, .vk_format = VK_FORMAT_BC3_SRGB_BLOCK, },
+  { .dxgi_format = 80, .vk_format = VK_FORMAT_BC4_UNORM_BLOCK, },
+  { .dxgi_format = 81, .vk_format = VK_FORMAT_BC4_SNORM_BLOCK, },
+  { .dxgi_format = 83, .vk_format = VK_FORMAT_BC5_UNORM_BLOCK, },
+  { .dxgi_format = 84, .vk_format = VK_FORMAT_BC5_SNORM_BLOCK, },
+  { .dxgi_format = 95, .vk_format = VK_FORMAT_BC6H_UFLOAT_BLOCK, },
+  { .dxgi_format = 96, .vk_format = VK_FORMAT_BC6H_SFLOAT_BLOCK, },
+  { .dxgi_format = 98, .vk_format = VK_FORMAT_BC7_UNORM_BLOCK, },
+  { .dxgi_format = 99, .vk_format = VK_FORMAT_BC7_SRGB_BLOCK, },
+
+  { .dxgi_format = 0, .vk_format = VK_FORMAT_UNDEFINED, },
+};
+// clang-format on
+
+static uint32_t
+_read_u32 (const guint8 *data, gsize offset)
+{
+  uint32_t value;
+  memcpy (&value, data + offset, sizeof (value));
+  return GUINT32_FROM_LE (value);
+}
+
+static uint64_t
+_read_u64 (const guint8 *data, gsize offset)
+{
+  uint64_t value;
+  memcpy (&value, data + offset, sizeof (value));
+  return GUINT64_FROM_LE (value);
+}
+
+static VkFormat
+_dxgi_format_to_vulkan (uint32_t dxgi_format)
+{
+  for (int i = 0; DXGIVKFormatTable[i].vk_format != VK_FORMAT_UNDEFINED; i++)
+    if (DXGIVKFormatTable[i].dxgi_format == dxgi_format)
+      return DXGIVKFormatTable[i].vk_format;
+
+  return VK_FORMAT_UNDEFINED;
+}
+
+static VkFormat
+_dds_fourcc_to_vulkan (uint32_t fourcc)
+{
+  switch (fourcc)
+    {
+      case DDS_FOURCC ('D', 'X', 'T', '1'):
+        return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+      case DDS_FOURCC ('D', 'X', 'T', '2'):
+      case DDS_FOURCC ('D', 'X', 'T', '3'):
+        return VK_FORMAT_BC2_UNORM_BLOCK;
+      case DDS_FOURCC ('D', 'X', 'T', '4'):
+      case DDS_FOURCC ('D', 'X', 'T', '5'):
+        return VK_FORMAT_BC3_UNORM_BLOCK;
+      case DDS_FOURCC ('A', 'T', 'I', '1'):
+      case DDS_FOURCC ('B', 'C', '4', 'U'):
+        return VK_FORMAT_BC4_UNORM_BLOCK;
+      case DDS_FOURCC ('A', 'T', 'I', '2'):
+      case DDS_FOURCC ('B', 'C', '5', 'U'):
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+      default:
+        return VK_FORMAT_UNDEFINED;
+    }
+}
+
+gboolean
+gulkan_format_get_block_info (VkFormat    format,
+                              VkExtent2D *block_extent,
+                              uint32_t   *block_size)
+{
+  VkExtent2D extent = {4, 4};
+  uint32_t   size;
+
+  switch (format)
+    {
+      case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+      case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+      case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+      case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+      case VK_FORMAT_BC4_UNORM_BLOCK:
+      case VK_FORMAT_BC4_SNORM_BLOCK:
+      case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+      case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+      case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+      case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+      case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+      case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+        size = 8;
+        break;
+      case VK_FORMAT_BC2_UNORM_BLOCK:
+      case VK_FORMAT_BC2_SRGB_BLOCK:
+      case VK_FORMAT_BC3_UNORM_BLOCK:
+      case VK_FORMAT_BC3_SRGB_BLOCK:
+      case VK_FORMAT_BC5_UNORM_BLOCK:
+      case VK_FORMAT_BC5_SNORM_BLOCK:
+      case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+      case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+      case VK_FORMAT_BC7_UNORM_BLOCK:
+      case VK_FORMAT_BC7_SRGB_BLOCK:
+      case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+      case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+      case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+      case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+      case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_5x4_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_5x4_SRGB_BLOCK:
+        extent = (VkExtent2D){5, 4};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_5x5_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_5x5_SRGB_BLOCK:
+        extent = (VkExtent2D){5, 5};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_6x5_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_6x5_SRGB_BLOCK:
+        extent = (VkExtent2D){6, 5};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_6x6_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_6x6_SRGB_BLOCK:
+        extent = (VkExtent2D){6, 6};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_8x5_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_8x5_SRGB_BLOCK:
+        extent = (VkExtent2D){8, 5};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_8x6_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_8x6_SRGB_BLOCK:
+        extent = (VkExtent2D){8, 6};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_8x8_SRGB_BLOCK:
+        extent = (VkExtent2D){8, 8};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_10x5_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_10x5_SRGB_BLOCK:
+        extent = (VkExtent2D){10, 5};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_10x6_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_10x6_SRGB_BLOCK:
+        extent = (VkExtent2D){10, 6};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_10x8_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_10x8_SRGB_BLOCK:
+        extent = (VkExtent2D){10, 8};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_10x10_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_10x10_SRGB_BLOCK:
+        extent = (VkExtent2D){10, 10};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_12x10_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_12x10_SRGB_BLOCK:
+        extent = (VkExtent2D){12, 10};
+        size = 16;
+        break;
+      case VK_FORMAT_ASTC_12x12_UNORM_BLOCK:
+      case VK_FORMAT_ASTC_12x12_SRGB_BLOCK:
+        extent = (VkExtent2D){12, 12};
+        size = 16;
+        break;
+      /* Uncompressed formats have 1x1 blocks of one texel */
+      case VK_FORMAT_R8_UNORM:
+      case VK_FORMAT_R8_SNORM:
+      case VK_FORMAT_R8_UINT:
+      case VK_FORMAT_R8_SRGB:
+        extent = (VkExtent2D){1, 1};
+        size = 1;
+        break;
+      case VK_FORMAT_R8G8_UNORM:
+      case VK_FORMAT_R8G8_SNORM:
+      case VK_FORMAT_R8G8_UINT:
+      case VK_FORMAT_R8G8_SRGB:
+      case VK_FORMAT_R16_UNORM:
+      case VK_FORMAT_R16_SNORM:
+      case VK_FORMAT_R16_UINT:
+      case VK_FORMAT_R16_SFLOAT:
+      case VK_FORMAT_R5G6B5_UNORM_PACK16:
+      case VK_FORMAT_B5G6R5_UNORM_PACK16:
+      case VK_FORMAT_R4G4B4A4_UNORM_PACK16:
+      case VK_FORMAT_B4G4R4A4_UNORM_PACK16:
+      case VK_FORMAT_R5G5B5A1_UNORM_PACK16:
+      case VK_FORMAT_A1R5G5B5_UNORM_PACK16:
+        extent = (VkExtent2D){1, 1};
+        size = 2;
+        break;
+      case VK_FORMAT_R8G8B8_UNORM:
+      case VK_FORMAT_R8G8B8_SRGB:
+      case VK_FORMAT_B8G8R8_UNORM:
+      case VK_FORMAT_B8G8R8_SRGB:
+        extent = (VkExtent2D){1, 1};
+        size = 3;
+        break;
+      case VK_FORMAT_R8G8B8A8_UNORM:
+      case VK_FORMAT_R8G8B8A8_SNORM:
+      case VK_FORMAT_R8G8B8A8_UINT:
+      case VK_FORMAT_R8G8B8A8_SRGB:
+      case VK_FORMAT_B8G8R8A8_UNORM:
+      case VK_FORMAT_B8G8R8A8_SRGB:
+      case VK_FORMAT_A2R10G10B10_UNORM_PACK32:
+      case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+      case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+      case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+      case VK_FORMAT_R16G16_UNORM:
+      case VK_FORMAT_R16G16_SNORM:
+      case VK_FORMAT_R16G16_SFLOAT:
+      case VK_FORMAT_R32_UINT:
+      case VK_FORMAT_R32_SFLOAT:
+        extent = (VkExtent2D){1, 1};
+        size = 4;
+        break;
+      case VK_FORMAT_R16G16B16_UNORM:
+      case VK_FORMAT_R16G16B16_SFLOAT:
+        extent = (VkExtent2D){1, 1};
+        size = 6;
+        break;
+      case VK_FORMAT_R16G16B16A16_UNORM:
+      case VK_FORMAT_R16G16B16A16_SNORM:
+      case VK_FORMAT_R16G16B16A16_SFLOAT:
+      case VK_FORMAT_R32G32_UINT:
+      case VK_FORMAT_R32G32_SFLOAT:
+        extent = (VkExtent2D){1, 1};
+        size = 8;
+        break;
+      case VK_FORMAT_R32G32B32_UINT:
+      case VK_FORMAT_R32G32B32_SFLOAT:
+        extent = (VkExtent2D){1, 1};
+        size = 12;
+        break;
+      case VK_FORMAT_R32G32B32A32_UINT:
+      case VK_FORMAT_R32G32B32A32_SFLOAT:
+        extent = (VkExtent2D){1, 1};
+        size = 16;
+        break;
+      default:
+        return FALSE;
+    }
+
+  if (block_extent)
+    *block_extent = extent;
+  if (block_size)
+    *block_size = size;
+
+  return TRUE;
+}
+
+static VkDeviceSize
+_get_level_size (VkFormat format, VkExtent2D extent, uint32_t level)
+{
+  VkExtent2D block_extent;
+  uint32_t   block_size;
+  if (!gulkan_format_get_block_info (format, &block_extent, &block_size))
+    return 0;
+
+  uint32_t width = MAX (extent.width >> level, 1);
+  uint32_t height = MAX (extent.height >> level, 1);
+
+  VkDeviceSize blocks_x = (width + block_extent.width - 1) / block_extent.width;
+  VkDeviceSize blocks_y = (height + block_extent.height - 1)
+                          / block_extent.height;
+
+  return blocks_x * blocks_y * block_size;
+}
+
+static gboolean
+_validate_levels (GulkanCompressedImage *image)
+{
+  for (uint32_t i = 0; i < image->levels; i++)
+    {
+      VkDeviceSize offset = image->level_offset[i];
+      VkDeviceSize size = image->level_size[i];
+
+      if (offset > image->size || size > image->size - offset)
+        {
+          g_printerr ("Mip level %d exceeds the container size.\n", i);
+          return FALSE;
+        }
+
+      /* Formats without known block info have no size to check against */
+      VkDeviceSize expected_size = _get_level_size (image->format,
+                                                    image->extent, i);
+      if (size < expected_size)
+        {
+          g_printerr ("Mip level %d is too small: %lu < %lu bytes.\n", i,
+                      size, expected_size);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+gboolean
+gulkan_compressed_image_parse_ktx2 (const guint8          *data,
+                                    gsize                  size,
+                                    GulkanCompressedImage *image)
+{
+  if (size < KTX2_HEADER_SIZE
+      || memcmp (data, ktx2_identifier, sizeof (ktx2_identifier)) != 0)
+    {
+      g_printerr ("Data is not a KTX2 container.\n");
+      return FALSE;
+    }
+
+  VkFormat format = (VkFormat) _read_u32 (data, 12);
+  uint32_t width = _read_u32 (data, 20);
+  uint32_t height = _read_u32 (data, 24);
+  uint32_t depth = _read_u32 (data, 28);
+  uint32_t layers = _read_u32 (data, 32);
+  uint32_t faces = _read_u32 (data, 36);
+  /* A level count of 0 requests generating mip maps, we only use level 0 */
+  uint32_t levels = MAX (_read_u32 (data, 40), 1);
+  uint32_t supercompression = _read_u32 (data, 44);
+
+  if (format == VK_FORMAT_UNDEFINED)
+    {
+      g_printerr ("KTX2: Textures without a VkFormat are not supported.\n");
+      return FALSE;
+    }
+
+  if (supercompression != 0)
+    {
+      g_printerr ("KTX2: Supercompression scheme %d is not supported.\n",
+                  supercompression);
+      return FALSE;
+    }
+
+  if (width == 0 || height == 0 || depth > 1 || layers > 1 || faces != 1)
+    {
+      g_printerr ("KTX2: Only single layer 2D textures are supported.\n");
+      return FALSE;
+    }
+
+  if (levels > GULKAN_COMPRESSED_IMAGE_MAX_LEVELS)
+    {
+      g_printerr ("KTX2: Too many mip levels (%d).\n", levels);
+      return FALSE;
+    }
+
+  if (size < KTX2_HEADER_SIZE + levels * KTX2_LEVEL_INDEX_SIZE)
+    {
+      g_printerr ("KTX2: Level index is truncated.\n");
+      return FALSE;
+    }
+
+  *image = (GulkanCompressedImage){
+    .format = format,
+    .extent = {width, height},
+    .levels = levels,
+    .data = data,
+    .size = size,
+  };
+
+  for (uint32_t i = 0; i < levels; i++)
+    {
+      gsize index_offset = KTX2_HEADER_SIZE + i * KTX2_LEVEL_INDEX_SIZE;
+      image->level_offset[i] = _read_u64 (data, index_offset);
+      image->level_size[i] = _read_u64 (data, index_offset + 8);
+    }
+
+  return _validate_levels (image);
+}
+
+gboolean
+gulkan_compressed_image_parse_dds (const guint8          *data,
+                                   gsize                  size,
+                                   GulkanCompressedImage *image)
+{
+  if (size < DDS_HEADER_SIZE || _read_u32 (data, 0) != DDS_MAGIC
+      || _read_u32 (data, 4) != DDS_HEADER_SIZE - 4)
+    {
+      g_printerr ("Data is not a DDS container.\n");
+      return FALSE;
+    }
+
+  uint32_t flags = _read_u32 (data, 8);
+  uint32_t height = _read_u32 (data, 12);
+  uint32_t width = _read_u32 (data, 16);
+  uint32_t levels = 1;
+  if (flags & DDSD_MIPMAPCOUNT)
+    levels = MAX (_read_u32 (data, 28), 1);
+
+  uint32_t pixel_format_flags = _read_u32 (data, 80);
+  uint32_t fourcc = _read_u32 (data, 84);
+  uint32_t caps2 = _read_u32 (data, 112);
+
+  if (!(pixel_format_flags & DDPF_FOURCC))
+    {
+      g_printerr ("DDS: Only block compressed formats are supported.\n");
+      return FALSE;
+    }
+
+  if (width == 0 || height == 0 || (caps2 & DDSCAPS2_CUBEMAP))
+    {
+      g_printerr ("DDS: Only 2D textures are supported.\n");
+      return FALSE;
+    }
+
+  if (levels > GULKAN_COMPRESSED_IMAGE_MAX_LEVELS)
+    {
+      g_printerr ("DDS: Too many mip levels (%d).\n", levels);
+      return FALSE;
+    }
+
+  VkFormat format;
+  gsize    data_offset = DDS_HEADER_SIZE;
+  if (fourcc == DDS_FOURCC ('D', 'X', '1', '0'))
+    {
+      if (size < DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE)
+        {
+          g_printerr ("DDS: DX10 header is truncated.\n");
+          return FALSE;
+        }
+
+      uint32_t array_size = _read_u32 (data, DDS_HEADER_SIZE + 12);
+      if (array_size > 1)
+        {
+          g_printerr ("DDS: Texture arrays are not supported.\n");
+          return FALSE;
+        }
+
+      format = _dxgi_format_to_vulkan (_read_u32 (data, DDS_HEADER_SIZE));
+      data_offset += DDS_DX10_HEADER_SIZE;
+    }
+  else
+    {
+      format = _dds_fourcc_to_vulkan (fourcc);
+    }
+
+  if (format == VK_FORMAT_UNDEFINED)
+    {
+      g_printerr ("DDS: Unsupported pixel format.\n");
+      return FALSE;
+    }
+
+  *image = (GulkanCompressedImage){
+    .format = format,
+    .extent = {width, height},
+    .levels = levels,
+    .data = data,
+    .size = size,
+  };
+
+  /* DDS levels are tightly packed, largest first */
+  VkDeviceSize offset = data_offset;
+  for (uint32_t i = 0; i < levels; i++)
+    {
+      image->level_offset[i] = offset;
+      image->level_size[i] = _get_level_size (format, image->extent, i);
+      offset += image->level_size[i];
+    }
+
+  return _validate_levels (image);
+}
+
+gboolean
+gulkan_compressed_image_parse (const guint8          *data,
+                               gsize                  size,
+                               GulkanCompressedImage *image)
+{
+  if (size >= sizeof (ktx2_identifier)
+      && memcmp (data, ktx2_identifier, sizeof (ktx2_identifier)) == 0)
+    return gulkan_compressed_image_parse_ktx2 (data, size, image);
+
+  if (size >= 4 && _read_u32 (data, 0) == DDS_MAGIC)
+    return gulkan_compressed_image_parse_dds (data, size, image);
+
+  g_printerr ("Unknown texture container.\n");
+  return FALSE;
+}
+
+VkFormat
+gulkan_compressed_image_get_decoded_format (VkFormat format)
+{
+  switch (format)
+    {
+      case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+      case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+      case VK_FORMAT_BC2_UNORM_BLOCK:
+      case VK_FORMAT_BC3_UNORM_BLOCK:
+        return VK_FORMAT_R8G8B8A8_UNORM;
+      case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+      case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+      case VK_FORMAT_BC2_SRGB_BLOCK:
+      case VK_FORMAT_BC3_SRGB_BLOCK:
+        return VK_FORMAT_R8G8B8A8_SRGB;
+      default:
+        return VK_FORMAT_UNDEFINED;
+    }
+}
+
+static void
+_rgb565_to_rgba (uint16_t color, guint8 *rgba)
+{
+  guint8 r = (color >> 11) & 0x1f;
+  guint8 g = (color >> 5) & 0x3f;
+  guint8 b = color & 0x1f;
+
+  rgba[0] = (guint8) ((r << 3) | (r >> 2));
+  rgba[1] = (guint8) ((g << 2) | (g >> 4));
+  rgba[2] = (guint8) ((b << 3) | (b >> 2));
+  rgba[3] = 255;
+}
+
+static void
+_decode_color_block (const guint8 *block,
+                     gboolean      allow_punchthrough,
+                     guint8        texels[16][4])
+{
+  uint16_t c0 = (uint16_t) (block[0] | block[1] << 8);
+  uint16_t c1 = (uint16_t) (block[2] | block[3] << 8);
+  uint32_t indices = _read_u32 (block, 4);
+
+  guint8 palette[4][4];
+  _rgb565_to_rgba (c0, palette[0]);
+  _rgb565_to_rgba (c1, palette[1]);
+
+  if (c0 > c1 || !allow_punchthrough)
+    {
+      for (int c = 0; c < 3; c++)
+        {
+          palette[2][c] = (guint8) ((2 * palette[0][c] + palette[1][c]) / 3);
+          palette[3][c] = (guint8) ((palette[0][c] + 2 * palette[1][c]) / 3);
+        }
+      palette[2][3] = 255;
+      palette[3][3] = 255;
+    }
+  else
+    {
+      for (int c = 0; c < 3; c++)
+        palette[2][c] = (guint8) ((palette[0][c] + palette[1][c]) / 2);
+      palette[2][3] = 255;
+      memset (palette[3], 0, 4);
+    }
+
+  for (int i = 0; i < 16; i++)
+    memcpy (texels[i], palette[(indices >> (2 * i)) & 3], 4);
+}
+
+static void
+_decode_explicit_alpha_block (const guint8 *block, guint8 texels[16][4])
+{
+  for (int i = 0; i < 16; i++)
+    {
+      guint8 alpha = (block[i / 2] >> (4 * (i % 2))) & 0xf;
+      texels[i][3] = (guint8) (alpha * 17);
+    }
+}
+
+static void
+_decode_interpolated_alpha_block (const guint8 *block, guint8 texels[16][4])
+{
+  guint8 palette[8];
+  palette[0] = block[0];
+  palette[1] = block[1];
+
+  if (palette[0] > palette[1])
+    {
+      for (int i = 2; i < 8; i++)
+        palette[i] = (guint8) (((8 - i) * palette[0] + (i - 1) * palette[1])
+                               / 7);
+    }
+  else
+    {
+      for (int i = 2; i < 6; i++)
+        palette[i] = (guint8) (((6 - i) * palette[0] + (i - 1) * palette[1])
+                               / 5);
+      palette[6] = 0;
+      palette[7] = 255;
+    }
+
+  uint64_t indices = 0;
+  for (int i = 0; i < 6; i++)
+    indices |= (uint64_t) block[2 + i] << (8 * i);
+
+  for (int i = 0; i < 16; i++)
+    texels[i][3] = palette[(indices >> (3 * i)) & 7];
+}
+
+static void
+_decode_block (VkFormat format, const guint8 *block, guint8 texels[16][4])
+{
+  switch (format)
+    {
+      case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+      case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        _decode_color_block (block, TRUE, texels);
+        for (int i = 0; i < 16; i++)
+          texels[i][3] = 255;
+        break;
+      case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+      case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        _decode_color_block (block, TRUE, texels);
+        break;
+      case VK_FORMAT_BC2_UNORM_BLOCK:
+      case VK_FORMAT_BC2_SRGB_BLOCK:
+        _decode_color_block (block + 8, FALSE, texels);
+        _decode_explicit_alpha_block (block, texels);
+        break;
+      case VK_FORMAT_BC3_UNORM_BLOCK:
+      case VK_FORMAT_BC3_SRGB_BLOCK:
+        _decode_color_block (block + 8, FALSE, texels);
+        _decode_interpolated_alpha_block (block, texels);
+        break;
+      default:
+        g_assert_not_reached ();
+    }
+}
+
+static void
+_decode_level (const GulkanCompressedImage *image,
+               uint32_t                     level,
+               guint8                      *pixels)
+{
+  uint32_t block_size;
+  gulkan_format_get_block_info (image->format, NULL, &block_size);
+
+  uint32_t width = MAX (image->extent.width >> level, 1);
+  uint32_t height = MAX (image->extent.height >> level, 1);
+  uint32_t blocks_x = (width + 3) / 4;
+  uint32_t blocks_y = (height + 3) / 4;
+
+  const guint8 *block = image->data + image->level_offset[level];
+  for (uint32_t by = 0; by < blocks_y; by++)
+    for (uint32_t bx = 0; bx < blocks_x; bx++)
+      {
+        guint8 texels[16][4];
+        _decode_block (image->format, block, texels);
+        block += block_size;
+
+        for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++)
+          for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++)
+            {
+              gsize offset = ((by * 4 + y) * width + bx * 4 + x) * 4;
+              memcpy (pixels + offset, texels[y * 4 + x], 4);
+            }
+      }
+}
+
+/*
+ * Decodes all levels to RGBA8 for devices that can't sample the
+ * compressed format. Only the BC1-3 formats are decoded.
+ */
+guint8 *
+gulkan_compressed_image_decode (const GulkanCompressedImage *image,
+                                VkBufferImageCopy           *regions,
+                                gsize                       *size)
+{
+  if (gulkan_compressed_image_get_decoded_format (image->format)
+      == VK_FORMAT_UNDEFINED)
+    return NULL;
+
+  *size = 0;
+  for (uint32_t i = 0; i < image->levels; i++)
+    {
+      uint32_t width = MAX (image->extent.width >> i, 1);
+      uint32_t height = MAX (image->extent.height >> i, 1);
+
+      regions[i] = (VkBufferImageCopy){
+        .bufferOffset = *size,
+        .imageSubresource = {
+          .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+          .mipLevel = i,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+        .imageExtent = {width, height, 1},
+      };
+
+      *size += (gsize) width * height * 4;
+    }
+
+  guint8 *pixels = g_malloc (*size);
+  for (uint32_t i = 0; i < image->levels; i++)
+    _decode_level (image, i, pixels + regions[i].bufferOffset);
+
+  return pixels;
+}
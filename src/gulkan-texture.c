@@ -26,6 +26,7 @@
 
 #include "gulkan-buffer.h"
 #include "gulkan-cmd-buffer.h"
+#include "gulkan-texture-compressed-private.h"
 #include <vulkan/vulkan.h>
 
 #include <drm_fourcc.h>
@@ -40,6 +41,15 @@ struct _GulkanTexture
   VkDeviceMemory image_memory;
   VkImageView    image_view;
 
+  /* Memory of planes 1..n of disjoint images, plane 0 is in image_memory */
+  VkDeviceMemory plane_memory[GULKAN_DMABUF_MAX_PLANES - 1];
+
+  VkSamplerYcbcrConversion ycbcr_conversion;
+  VkFilter                 chroma_filter;
+
+  VkSemaphore                           release_semaphore;
+  VkExternalSemaphoreHandleTypeFlagBits release_handle_type;
+
   guint mip_levels;
 
   VkExtent2D extent;
@@ -47,6 +57,7 @@ struct _GulkanTexture
   VkFormat format;
 
   VkSampler sampler;
+  gboolean  shared_sampler;
 };
 
 G_DEFINE_TYPE (GulkanTexture, gulkan_texture, G_TYPE_OBJECT)
@@ -79,7 +90,9 @@ static struct DrmFormatTableEntry DRMVKFormatTable[] = {
   { .drm_format = DRM_FORMAT_RGBX8888, .vk_format = VK_FORMAT_A8B8G8R8_UNORM_PACK32, }, // TODO
   { .drm_format = DRM_FORMAT_BGRX8888, .vk_format = VK_FORMAT_A8B8G8R8_UNORM_PACK32, }, // TODO
 
-  // { .DRMFormat = DRM_FORMAT_NV12, .vkFormat = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM, },
+  { .drm_format = DRM_FORMAT_NV12, .vk_format = VK_FORMAT_G8_B8R8_2PLANE_420_UNORM, },
+  { .drm_format = DRM_FORMAT_P010, .vk_format = VK_FORMAT_G10X6_B10X6R10X6_2PLANE_420_UNORM_3PACK16, },
+  { .drm_format = DRM_FORMAT_YUV420, .vk_format = VK_FORMAT_G8_B8_R8_3PLANE_420_UNORM, },
 
   { .drm_format = DRM_FORMAT_INVALID, .vk_format = VK_FORMAT_UNDEFINED, },
 };
@@ -103,15 +116,41 @@ drm_format_to_vulkan (uint32_t drm_format)
 static GulkanMipMap
 _generate_mipmaps (GdkPixbuf *pixbuf);
 
+static VkAccessFlags
+_get_access_flags (VkImageLayout layout);
+
 static void
 gulkan_texture_init (GulkanTexture *self)
 {
   self->image = VK_NULL_HANDLE;
   self->image_memory = VK_NULL_HANDLE;
   self->image_view = VK_NULL_HANDLE;
+  for (uint32_t i = 0; i < G_N_ELEMENTS (self->plane_memory); i++)
+    self->plane_memory[i] = VK_NULL_HANDLE;
+  self->ycbcr_conversion = VK_NULL_HANDLE;
+  self->chroma_filter = VK_FILTER_NEAREST;
+  self->release_semaphore = VK_NULL_HANDLE;
+  self->release_handle_type = 0;
   self->format = VK_FORMAT_UNDEFINED;
   self->mip_levels = 1;
   self->sampler = VK_NULL_HANDLE;
+  self->shared_sampler = FALSE;
+}
+
+static void
+_clear_sampler (GulkanTexture *self)
+{
+  if (self->sampler == VK_NULL_HANDLE)
+    return;
+
+  GulkanDevice *device = gulkan_context_get_device (self->context);
+  if (self->shared_sampler)
+    gulkan_device_release_sampler (device, self->sampler);
+  else
+    vkDestroySampler (gulkan_device_get_handle (device), self->sampler, NULL);
+
+  self->sampler = VK_NULL_HANDLE;
+  self->shared_sampler = FALSE;
 }
 
 static void
@@ -123,9 +162,11 @@ _finalize (GObject *gobject)
   vkDestroyImageView (device, self->image_view, NULL);
   vkDestroyImage (device, self->image, NULL);
   vkFreeMemory (device, self->image_memory, NULL);
+  for (uint32_t i = 0; i < G_N_ELEMENTS (self->plane_memory); i++)
+    vkFreeMemory (device, self->plane_memory[i], NULL);
+  vkDestroySemaphore (device, self->release_semaphore, NULL);
 
-  if (self->sampler != VK_NULL_HANDLE)
-    vkDestroySampler (device, self->sampler, NULL);
+  _clear_sampler (self);
 
   g_object_unref (self->context);
 
@@ -193,6 +234,184 @@ _upload_pixels (GulkanTexture           *self,
   return TRUE;
 }
 
+static guint
+_count_mip_levels (VkExtent2D extent)
+{
+  guint    levels = 1;
+  uint32_t width = extent.width;
+  uint32_t height = extent.height;
+  while (width > 1 && height > 1)
+    {
+      width /= 2;
+      height /= 2;
+      levels++;
+    }
+  return levels;
+}
+
+static gboolean
+_can_blit_mipmaps (GulkanDevice *device, VkFormat format)
+{
+  VkFormatFeatureFlags features
+    = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT
+      | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return gulkan_device_format_supports (device, format,
+                                        VK_IMAGE_TILING_OPTIMAL, features);
+}
+
+static void
+_record_mip_barrier (GulkanTexture       *self,
+                     VkCommandBuffer      cmd_buffer,
+                     uint32_t             base_level,
+                     uint32_t             level_count,
+                     VkImageLayout        src_layout,
+                     VkImageLayout        dst_layout,
+                     VkPipelineStageFlags src_stage_mask,
+                     VkPipelineStageFlags dst_stage_mask)
+{
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = _get_access_flags (src_layout),
+    .dstAccessMask = _get_access_flags (dst_layout),
+    .oldLayout = src_layout,
+    .newLayout = dst_layout,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = self->image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = base_level,
+      .levelCount = level_count,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+  };
+
+  vkCmdPipelineBarrier (cmd_buffer, src_stage_mask, dst_stage_mask, 0, 0, NULL,
+                        0, NULL, 1, &barrier);
+}
+
+/*
+ * Uploads the first level and blits the remaining levels on the GPU.
+ * Blitting needs a graphics queue, dedicated transfer queues can't do it.
+ */
+static gboolean
+_upload_pixels_blit_mipmaps (GulkanTexture *self,
+                             guchar        *pixels,
+                             gsize          size,
+                             VkImageLayout  layout)
+{
+  GulkanDevice *device = gulkan_context_get_device (self->context);
+  GulkanQueue  *queue = gulkan_device_get_graphics_queue (device);
+
+  GulkanBuffer *staging_buffer
+    = gulkan_buffer_new (device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+  if (!staging_buffer)
+    return FALSE;
+
+  if (!gulkan_buffer_upload (staging_buffer, pixels, size))
+    {
+      g_object_unref (staging_buffer);
+      return FALSE;
+    }
+
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  GMutex          *mutex = gulkan_queue_get_pool_mutex (queue);
+
+  g_mutex_lock (mutex);
+  if (!gulkan_cmd_buffer_begin_one_time (cmd_buffer))
+    {
+      g_mutex_unlock (mutex);
+      gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+      g_object_unref (staging_buffer);
+      return FALSE;
+    }
+
+  VkCommandBuffer cmd = gulkan_cmd_buffer_get_handle (cmd_buffer);
+
+  _record_mip_barrier (self, cmd, 0, self->mip_levels,
+                       VK_IMAGE_LAYOUT_UNDEFINED,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+  VkBufferImageCopy region = {
+    .imageSubresource = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .mipLevel = 0,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+    .imageExtent = {
+      .width = self->extent.width,
+      .height = self->extent.height,
+      .depth = 1,
+    },
+  };
+  vkCmdCopyBufferToImage (cmd, gulkan_buffer_get_handle (staging_buffer),
+                          self->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                          &region);
+
+  for (uint32_t i = 1; i < self->mip_levels; i++)
+    {
+      _record_mip_barrier (self, cmd, i - 1, 1,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+      VkImageBlit blit = {
+        .srcSubresource = {
+          .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+          .mipLevel = i - 1,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+        .srcOffsets[1] = {
+          .x = (int32_t) MAX (self->extent.width >> (i - 1), 1),
+          .y = (int32_t) MAX (self->extent.height >> (i - 1), 1),
+          .z = 1,
+        },
+        .dstSubresource = {
+          .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+          .mipLevel = i,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+        .dstOffsets[1] = {
+          .x = (int32_t) MAX (self->extent.width >> i, 1),
+          .y = (int32_t) MAX (self->extent.height >> i, 1),
+          .z = 1,
+        },
+      };
+
+      vkCmdBlitImage (cmd, self->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                      self->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                      &blit, VK_FILTER_LINEAR);
+    }
+
+  _record_mip_barrier (self, cmd, self->mip_levels - 1, 1,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+  _record_mip_barrier (self, cmd, 0, self->mip_levels,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, layout,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+  g_mutex_unlock (mutex);
+
+  gboolean ret = gulkan_queue_end_submit (queue, cmd_buffer);
+
+  g_object_unref (staging_buffer);
+  gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+
+  return ret;
+}
+
 GulkanTexture *
 gulkan_texture_new_from_pixbuf (GulkanContext *context,
                                 GdkPixbuf     *pixbuf,
@@ -207,7 +426,22 @@ gulkan_texture_new_from_pixbuf (GulkanContext *context,
 
   GulkanTexture *self;
 
-  if (create_mipmaps)
+  if (create_mipmaps
+      && _can_blit_mipmaps (gulkan_context_get_device (context), format))
+    {
+      gsize   size = gdk_pixbuf_get_byte_length (pixbuf);
+      guchar *pixels = gdk_pixbuf_get_pixels (pixbuf);
+      self = gulkan_texture_new_mip_levels (context, extent,
+                                            _count_mip_levels (extent), format);
+
+      if (!_upload_pixels_blit_mipmaps (self, pixels, size, layout))
+        {
+          g_printerr ("ERROR: Could not upload pixels.\n");
+          g_object_unref (self);
+          self = NULL;
+        }
+    }
+  else if (create_mipmaps)
     {
       GulkanMipMap mipmap = _generate_mipmaps (pixbuf);
 
@@ -304,6 +538,177 @@ gulkan_texture_new_from_cairo_surface (GulkanContext   *context,
   return self;
 }
 
+static GulkanTexture *
+_new_from_decoded_image (GulkanContext         *context,
+                         GulkanCompressedImage *image,
+                         VkImageLayout          layout)
+{
+  VkBufferImageCopy regions[GULKAN_COMPRESSED_IMAGE_MAX_LEVELS];
+  gsize             size;
+  guint8 *pixels = gulkan_compressed_image_decode (image, regions, &size);
+  if (!pixels)
+    {
+      g_printerr ("Format %s is not supported by the device.\n",
+                  vk_format_string (image->format));
+      return NULL;
+    }
+
+  VkFormat format = gulkan_compressed_image_get_decoded_format (image->format);
+  g_debug ("Decoding %s to %s on the CPU.", vk_format_string (image->format),
+           vk_format_string (format));
+
+  GulkanTexture *self = gulkan_texture_new_mip_levels (context, image->extent,
+                                                       image->levels, format);
+
+  if (self && !_upload_pixels (self, pixels, size, regions, layout))
+    {
+      g_printerr ("ERROR: Could not upload pixels.\n");
+      g_object_unref (self);
+      self = NULL;
+    }
+
+  g_free (pixels);
+
+  return self;
+}
+
+/**
+ * gulkan_texture_new_from_compressed_bytes:
+ * @context: a #GulkanContext
+ * @bytes: the contents of a KTX2 or DDS file
+ * @layout: the layout to transfer the texture to after upload
+ *
+ * Uploads all mip levels of the container without re-encoding. Block
+ * compressed formats the device can't sample are decoded on the CPU.
+ *
+ * Returns: (transfer full): a new #GulkanTexture or %NULL on failure.
+ */
+GulkanTexture *
+gulkan_texture_new_from_compressed_bytes (GulkanContext *context,
+                                          GBytes        *bytes,
+                                          VkImageLayout  layout)
+{
+  gsize         size;
+  const guint8 *data = g_bytes_get_data (bytes, &size);
+
+  GulkanCompressedImage image;
+  if (!gulkan_compressed_image_parse (data, size, &image))
+    return NULL;
+
+  if (!gulkan_device_format_supports (gulkan_context_get_device (context),
+                                      image.format, VK_IMAGE_TILING_OPTIMAL,
+                                      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+    return _new_from_decoded_image (context, &image, layout);
+
+  uint32_t block_size;
+  if (!gulkan_format_get_block_info (image.format, NULL, &block_size))
+    {
+      g_printerr ("Unknown texel block size for format %s.\n",
+                  vk_format_string (image.format));
+      return NULL;
+    }
+
+  /* Copy offsets must be multiples of both the block size and 4 */
+  uint32_t alignment = block_size;
+  while (alignment % 4 != 0)
+    alignment += block_size;
+
+  /* Stage the container data directly if the levels are aligned for copy */
+  gboolean     aligned = TRUE;
+  VkDeviceSize start = image.size;
+  VkDeviceSize end = 0;
+  for (uint32_t i = 0; i < image.levels; i++)
+    {
+      if (image.level_offset[i] % alignment != 0)
+        aligned = FALSE;
+      start = MIN (start, image.level_offset[i]);
+      end = MAX (end, image.level_offset[i] + image.level_size[i]);
+    }
+
+  VkBufferImageCopy regions[GULKAN_COMPRESSED_IMAGE_MAX_LEVELS];
+  VkDeviceSize      packed_size = 0;
+  for (uint32_t i = 0; i < image.levels; i++)
+    {
+      VkDeviceSize offset;
+      if (aligned)
+        {
+          offset = image.level_offset[i] - start;
+        }
+      else
+        {
+          packed_size = (packed_size + alignment - 1) / alignment * alignment;
+          offset = packed_size;
+          packed_size += image.level_size[i];
+        }
+
+      regions[i] = (VkBufferImageCopy){
+        .bufferOffset = offset,
+        .imageSubresource = {
+          .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+          .mipLevel = i,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+        .imageExtent = {
+          .width = MAX (image.extent.width >> i, 1),
+          .height = MAX (image.extent.height >> i, 1),
+          .depth = 1,
+        },
+      };
+    }
+
+  guint8 *packed = NULL;
+  if (!aligned)
+    {
+      packed = g_malloc (packed_size);
+      for (uint32_t i = 0; i < image.levels; i++)
+        memcpy (packed + regions[i].bufferOffset,
+                image.data + image.level_offset[i], image.level_size[i]);
+    }
+
+  GulkanTexture *self = gulkan_texture_new_mip_levels (context, image.extent,
+                                                       image.levels,
+                                                       image.format);
+
+  if (self
+      && !_upload_pixels (self, aligned ? (guchar *) data + start : packed,
+                          aligned ? end - start : packed_size, regions, layout))
+    {
+      g_printerr ("ERROR: Could not upload pixels.\n");
+      g_object_unref (self);
+      self = NULL;
+    }
+
+  g_free (packed);
+
+  return self;
+}
+
+GulkanTexture *
+gulkan_texture_new_from_compressed_resource (GulkanContext *context,
+                                             const char    *resource_path,
+                                             VkImageLayout  layout)
+{
+  GError *error = NULL;
+  GBytes *bytes = g_resources_lookup_data (resource_path,
+                                           G_RESOURCE_LOOKUP_FLAGS_NONE,
+                                           &error);
+  if (error != NULL)
+    {
+      g_printerr ("Unable to read resource '%s': %s\n", resource_path,
+                  error->message);
+      g_error_free (error);
+      return NULL;
+    }
+
+  GulkanTexture *texture
+    = gulkan_texture_new_from_compressed_bytes (context, bytes, layout);
+
+  g_bytes_unref (bytes);
+
+  return texture;
+}
+
 GulkanTexture *
 gulkan_texture_new (GulkanContext *context, VkExtent2D extent, VkFormat format)
 {
@@ -323,26 +728,21 @@ gulkan_texture_new_mip_levels (GulkanContext *context,
   self->format = format;
   self->mip_levels = mip_levels;
 
-  VkDevice vk_device = gulkan_context_get_device_handle (context);
+  VkDevice      vk_device = gulkan_context_get_device_handle (context);
+  GulkanDevice *device = gulkan_context_get_device (context);
 
-  /* TODO: Check with vkGetPhysicalDeviceFormatProperties */
-  VkImageTiling tiling;
-  switch (format)
+  VkImageTiling tiling = VK_IMAGE_TILING_OPTIMAL;
+  if (!gulkan_device_format_supports (device, format, VK_IMAGE_TILING_OPTIMAL,
+                                      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
     {
-      case VK_FORMAT_R8G8B8_SRGB:
-      case VK_FORMAT_R8G8B8_UNORM:
+      if (mip_levels == 1
+          && gulkan_device_format_supports (device, format,
+                                            VK_IMAGE_TILING_LINEAR,
+                                            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
         tiling = VK_IMAGE_TILING_LINEAR;
-        break;
-      case VK_FORMAT_R8G8B8A8_SRGB:
-      case VK_FORMAT_R8G8B8A8_UNORM:
-      case VK_FORMAT_B8G8R8A8_UNORM:
-      case VK_FORMAT_B8G8R8A8_SRGB:
-        tiling = VK_IMAGE_TILING_OPTIMAL;
-        break;
-      default:
-        g_printerr ("Warning: No tiling for format %s (%d) specified.\n",
+      else
+        g_printerr ("Warning: Format %s (%d) can't be sampled.\n",
                     vk_format_string (format), format);
-        tiling = VK_IMAGE_TILING_OPTIMAL;
     }
 
   VkImageCreateInfo image_info = {
@@ -371,7 +771,7 @@ gulkan_texture_new_mip_levels (GulkanContext *context,
     .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
     .allocationSize = memory_requirements.size,
   };
-  gulkan_device_memory_type_from_properties (gulkan_context_get_device (context),
+  gulkan_device_memory_type_from_properties (device,
                                              memory_requirements.memoryTypeBits,
                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                                              &memory_info.memoryTypeIndex);
@@ -525,6 +925,306 @@ gulkan_texture_upload_pixels (GulkanTexture *self,
   return _upload_pixels (self, pixels, size, &buffer_image_copy, layout);
 }
 
+/**
+ * gulkan_texture_upload_pixels_async:
+ * @self: a #GulkanTexture
+ * @pixels: pixel data of the texture
+ * @size: size of @pixels in bytes
+ * @layout: the layout the texture is used in on the graphics queue
+ *
+ * Copies the pixels on the transfer queue without waiting for completion.
+ * Ownership of the image is released to the graphics queue family. The
+ * matching acquire, waiting on the upload semaphore, is submitted with the
+ * next gulkan_queue_flush_acquires() on the graphics queue.
+ *
+ * Returns: %TRUE if the upload was submitted
+ */
+gboolean
+gulkan_texture_upload_pixels_async (GulkanTexture *self,
+                                    guchar        *pixels,
+                                    gsize          size,
+                                    VkImageLayout  layout)
+{
+  if (self->mip_levels != 1)
+    {
+      g_warning ("Trying to upload one mip level to multi level texture.\n");
+      return FALSE;
+    }
+
+  GulkanDevice *device = gulkan_context_get_device (self->context);
+  VkDevice      vk_device = gulkan_device_get_handle (device);
+  GulkanQueue  *transfer_queue = gulkan_device_get_transfer_queue (device);
+  GulkanQueue  *graphics_queue = gulkan_device_get_graphics_queue (device);
+  uint32_t transfer_family = gulkan_queue_get_family_index (transfer_queue);
+  uint32_t graphics_family = gulkan_queue_get_family_index (graphics_queue);
+
+  GulkanBuffer *staging_buffer
+    = gulkan_buffer_new (device, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  if (!staging_buffer)
+    return FALSE;
+
+  if (!gulkan_buffer_upload (staging_buffer, pixels, size))
+    {
+      g_object_unref (staging_buffer);
+      return FALSE;
+    }
+
+  VkSemaphoreCreateInfo semaphore_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+  };
+  VkSemaphore semaphore;
+  VkResult    res = vkCreateSemaphore (vk_device, &semaphore_info, NULL,
+                                       &semaphore);
+  if (gulkan_has_error (res, "vkCreateSemaphore", __FILE__, __LINE__))
+    {
+      g_object_unref (staging_buffer);
+      return FALSE;
+    }
+
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (transfer_queue);
+  GMutex          *mutex = gulkan_queue_get_pool_mutex (transfer_queue);
+
+  g_mutex_lock (mutex);
+  if (!gulkan_cmd_buffer_begin_one_time (cmd_buffer))
+    {
+      g_mutex_unlock (mutex);
+      gulkan_queue_free_cmd_buffer (transfer_queue, cmd_buffer);
+      vkDestroySemaphore (vk_device, semaphore, NULL);
+      g_object_unref (staging_buffer);
+      return FALSE;
+    }
+
+  VkCommandBuffer cmd = gulkan_cmd_buffer_get_handle (cmd_buffer);
+
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = 0,
+    .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = self->image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = 0,
+      .levelCount = 1,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+  };
+  vkCmdPipelineBarrier (cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1,
+                        &barrier);
+
+  VkBufferImageCopy region = {
+    .imageSubresource = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .mipLevel = 0,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+    .imageExtent = {
+      .width = self->extent.width,
+      .height = self->extent.height,
+      .depth = 1,
+    },
+  };
+  vkCmdCopyBufferToImage (cmd, gulkan_buffer_get_handle (staging_buffer),
+                          self->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                          &region);
+
+  /* Release, the layout transition is shared with the acquire barrier */
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = 0;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = layout;
+  if (transfer_family != graphics_family)
+    {
+      barrier.srcQueueFamilyIndex = transfer_family;
+      barrier.dstQueueFamilyIndex = graphics_family;
+    }
+  vkCmdPipelineBarrier (cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0,
+                        NULL, 1, &barrier);
+  g_mutex_unlock (mutex);
+
+  if (!gulkan_cmd_buffer_end (cmd_buffer)
+      || !gulkan_queue_submit_async (transfer_queue, cmd_buffer, 0, NULL, NULL,
+                                     semaphore, G_OBJECT (staging_buffer)))
+    {
+      gulkan_queue_free_cmd_buffer (transfer_queue, cmd_buffer);
+      vkDestroySemaphore (vk_device, semaphore, NULL);
+      g_object_unref (staging_buffer);
+      return FALSE;
+    }
+
+  /* The queue keeps the staging buffer alive until the copy finished */
+  g_object_unref (staging_buffer);
+
+  /* Acquire on the graphics queue once the upload semaphore signaled */
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = _get_access_flags (layout);
+  if (transfer_family == graphics_family)
+    barrier.oldLayout = layout;
+
+  gulkan_queue_add_acquire (graphics_queue, semaphore,
+                            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, &barrier,
+                            G_OBJECT (self));
+
+  return TRUE;
+}
+
+/**
+ * gulkan_texture_release_to_fd:
+ * @self: a #GulkanTexture
+ * @queue: the #GulkanQueue that last used the texture
+ * @layout: the layout the texture is in and is handed over in
+ * @handle_type: %VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT or
+ * %VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_OPAQUE_FD_BIT
+ * @fd: (out): a semaphore fd that signals once the texture can be used by
+ * the consumer, owned by the caller
+ *
+ * Releases the texture to an external API or process without waiting. The
+ * consumer needs to wait on @fd before accessing the shared memory.
+ * Each texture uses one exported semaphore, so an opaque fd can only be
+ * released again after the consumer waited on it.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_texture_release_to_fd (GulkanTexture                        *self,
+                              GulkanQueue                          *queue,
+                              VkImageLayout                         layout,
+                              VkExternalSemaphoreHandleTypeFlagBits handle_type,
+                              int                                  *fd)
+{
+  GulkanDevice *device = gulkan_context_get_device (self->context);
+
+  if (self->release_semaphore == VK_NULL_HANDLE)
+    {
+      self->release_semaphore
+        = gulkan_device_create_export_semaphore (device, handle_type);
+      if (self->release_semaphore == VK_NULL_HANDLE)
+        return FALSE;
+      self->release_handle_type = handle_type;
+    }
+  else if (self->release_handle_type != handle_type)
+    {
+      g_printerr ("Texture was already released with handle type %d\n",
+                  self->release_handle_type);
+      return FALSE;
+    }
+
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  GMutex          *mutex = gulkan_queue_get_pool_mutex (queue);
+
+  g_mutex_lock (mutex);
+  if (!gulkan_cmd_buffer_begin_one_time (cmd_buffer))
+    {
+      g_mutex_unlock (mutex);
+      gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+      return FALSE;
+    }
+
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = _get_access_flags (layout),
+    .dstAccessMask = 0,
+    .oldLayout = layout,
+    .newLayout = layout,
+    .srcQueueFamilyIndex = gulkan_queue_get_family_index (queue),
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL,
+    .image = self->image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = 0,
+      .levelCount = self->mip_levels,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+  };
+  vkCmdPipelineBarrier (gulkan_cmd_buffer_get_handle (cmd_buffer),
+                        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0,
+                        NULL, 1, &barrier);
+  g_mutex_unlock (mutex);
+
+  if (!gulkan_cmd_buffer_end (cmd_buffer)
+      || !gulkan_queue_submit_async (queue, cmd_buffer, 0, NULL, NULL,
+                                     self->release_semaphore, G_OBJECT (self)))
+    {
+      gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+      return FALSE;
+    }
+
+  return gulkan_device_export_semaphore_fd (device, self->release_semaphore,
+                                            handle_type, fd);
+}
+
+/**
+ * gulkan_texture_acquire_from_fd:
+ * @self: a #GulkanTexture
+ * @queue: the #GulkanQueue that will use the texture
+ * @fd: (transfer full): a semaphore fd signaled by the producer
+ * @handle_type: the handle type of @fd
+ * @src_layout: the layout the producer left the texture in
+ * @dst_layout: the layout to use the texture in
+ *
+ * Acquires the texture from an external producer. Instead of waiting on the
+ * CPU, the acquire is submitted with the next gulkan_queue_flush_acquires()
+ * on @queue and makes later work on @queue wait for the producer. The
+ * texture is kept alive until then. @fd is closed if the import fails.
+ *
+ * Returns: %TRUE if the semaphore was imported
+ */
+gboolean
+gulkan_texture_acquire_from_fd (
+  GulkanTexture                        *self,
+  GulkanQueue                          *queue,
+  int                                   fd,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type,
+  VkImageLayout                         src_layout,
+  VkImageLayout                         dst_layout)
+{
+  GulkanDevice *device = gulkan_context_get_device (self->context);
+
+  /* Vulkan only takes ownership of the fd on a successful import */
+  VkSemaphore semaphore = gulkan_device_import_semaphore_fd (device, fd,
+                                                             handle_type);
+  if (semaphore == VK_NULL_HANDLE)
+    {
+      if (fd >= 0)
+        close (fd);
+      return FALSE;
+    }
+
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = 0,
+    .dstAccessMask = _get_access_flags (dst_layout),
+    .oldLayout = src_layout,
+    .newLayout = dst_layout,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_EXTERNAL,
+    .dstQueueFamilyIndex = gulkan_queue_get_family_index (queue),
+    .image = self->image,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .baseMipLevel = 0,
+      .levelCount = self->mip_levels,
+      .baseArrayLayer = 0,
+      .layerCount = 1,
+    },
+  };
+
+  gulkan_queue_add_acquire (queue, semaphore,
+                            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, &barrier,
+                            G_OBJECT (self));
+
+  return TRUE;
+}
+
 gboolean
 gulkan_texture_upload_pixels_region (GulkanTexture *self,
                                      guchar        *region_pixels,
@@ -688,9 +1388,14 @@ gulkan_texture_new_from_dmabuf (GulkanContext *context,
   return self;
 }
 
+/*
+ * Pass a VK_IMAGE_ASPECT_MEMORY_PLANE_N_BIT_EXT as @plane_aspect for a plane
+ * of a disjoint image, 0 otherwise.
+ */
 static gboolean
 _import_fd_into_memory (GulkanTexture        *self,
                         int                   fd,
+                        VkImageAspectFlagBits plane_aspect,
                         VkDeviceMemory       *memory,
                         VkMemoryRequirements *out_memory_requirements)
 {
@@ -716,9 +1421,13 @@ _import_fd_into_memory (GulkanTexture        *self,
                                 fd, &fd_props);
   vk_check_error ("vkGetMemoryFdPropertiesKHR", res, FALSE);
 
+  VkImagePlaneMemoryRequirementsInfo plane_req_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_PLANE_MEMORY_REQUIREMENTS_INFO,
+    .planeAspect = plane_aspect,
+  };
   VkImageMemoryRequirementsInfo2 req_info = {
     .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
-    .pNext = NULL,
+    .pNext = plane_aspect != 0 ? &plane_req_info : NULL,
     .image = self->image,
   };
   VkMemoryDedicatedRequirements ded_req = {
@@ -740,6 +1449,10 @@ _import_fd_into_memory (GulkanTexture        *self,
   gboolean use_ded_mem = (gboolean) ded_req.prefersDedicatedAllocation
                          | (gboolean) ded_req.requiresDedicatedAllocation;
 
+  /* Disjoint images can't have dedicated allocations */
+  if (plane_aspect != 0)
+    use_ded_mem = FALSE;
+
   g_debug ("%susing dedicated memory allocation", use_ded_mem ? "" : "NOT ");
 
   *out_memory_requirements = memory_requirements.memoryRequirements;
@@ -835,15 +1548,150 @@ is_fd_same_memory (int fd1, int fd2)
 }
 #endif
 
+static uint32_t
+_get_format_plane_count (VkFormat format)
+{
+  switch (format)
+    {
+      case VK_FORMAT_G8_B8R8_2PLANE_420_UNORM:
+      case VK_FORMAT_G10X6_B10X6R10X6_2PLANE_420_UNORM_3PACK16:
+        return 2;
+      case VK_FORMAT_G8_B8_R8_3PLANE_420_UNORM:
+        return 3;
+      default:
+        return 1;
+    }
+}
+
+/*
+ * Video decoders produce narrow range YCbCr, BT.2020 for 10 bit and BT.709
+ * otherwise. Chroma is cosited horizontally and centered vertically (MPEG-2),
+ * when the driver supports it.
+ */
+static gboolean
+_init_ycbcr_conversion (GulkanTexture *self, VkFormatFeatureFlags features)
+{
+  if (!(features
+        & (VK_FORMAT_FEATURE_COSITED_CHROMA_SAMPLES_BIT
+           | VK_FORMAT_FEATURE_MIDPOINT_CHROMA_SAMPLES_BIT)))
+    {
+      g_printerr ("Format %d does not support YCbCr conversion\n",
+                  self->format);
+      return FALSE;
+    }
+
+  VkChromaLocation x_location = VK_CHROMA_LOCATION_MIDPOINT;
+  VkChromaLocation y_location = VK_CHROMA_LOCATION_MIDPOINT;
+  if (features & VK_FORMAT_FEATURE_COSITED_CHROMA_SAMPLES_BIT)
+    {
+      x_location = VK_CHROMA_LOCATION_COSITED_EVEN;
+      if (!(features & VK_FORMAT_FEATURE_MIDPOINT_CHROMA_SAMPLES_BIT))
+        y_location = VK_CHROMA_LOCATION_COSITED_EVEN;
+    }
+
+  self->chroma_filter
+    = (features
+       & VK_FORMAT_FEATURE_SAMPLED_IMAGE_YCBCR_CONVERSION_LINEAR_FILTER_BIT)
+        ? VK_FILTER_LINEAR
+        : VK_FILTER_NEAREST;
+
+  VkSamplerYcbcrModelConversion model
+    = self->format == VK_FORMAT_G10X6_B10X6R10X6_2PLANE_420_UNORM_3PACK16
+        ? VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_2020
+        : VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_709;
+
+  VkSamplerYcbcrConversionCreateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_CREATE_INFO,
+    .format = self->format,
+    .ycbcrModel = model,
+    .ycbcrRange = VK_SAMPLER_YCBCR_RANGE_ITU_NARROW,
+    .components = {
+      .r = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .g = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .b = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .a = VK_COMPONENT_SWIZZLE_IDENTITY,
+    },
+    .xChromaOffset = x_location,
+    .yChromaOffset = y_location,
+    .chromaFilter = self->chroma_filter,
+    .forceExplicitReconstruction = VK_FALSE,
+  };
+
+  GulkanDevice *device = gulkan_context_get_device (self->context);
+  self->ycbcr_conversion = gulkan_device_request_ycbcr_conversion (device,
+                                                                   &info);
+  return self->ycbcr_conversion != VK_NULL_HANDLE;
+}
+
+static gboolean
+_bind_disjoint_memory (GulkanTexture                 *self,
+                       struct GulkanDmabufAttributes *attribs)
+{
+  VkDevice vk_device = gulkan_context_get_device_handle (self->context);
+
+  VkBindImagePlaneMemoryInfo plane_infos[GULKAN_DMABUF_MAX_PLANES];
+  VkBindImageMemoryInfo      bind_infos[GULKAN_DMABUF_MAX_PLANES];
+
+  for (int i = 0; i < attribs->n_planes; i++)
+    {
+      VkImageAspectFlagBits aspect = (VkImageAspectFlagBits) (
+        VK_IMAGE_ASPECT_MEMORY_PLANE_0_BIT_EXT << i);
+      VkDeviceMemory *memory = i == 0 ? &self->image_memory
+                                      : &self->plane_memory[i - 1];
+
+      VkMemoryRequirements memory_req;
+      int                  fd = dup (attribs->fd[i]);
+      if (!_import_fd_into_memory (self, fd, aspect, memory, &memory_req))
+        {
+          g_printerr ("Failed to import fd %d into plane %d\n",
+                      attribs->fd[i], i);
+          close (fd);
+          return FALSE;
+        }
+
+      plane_infos[i] = (VkBindImagePlaneMemoryInfo){
+        .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_PLANE_MEMORY_INFO,
+        .planeAspect = aspect,
+      };
+      /* The plane offset is part of the explicit modifier layout */
+      bind_infos[i] = (VkBindImageMemoryInfo){
+        .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO,
+        .pNext = &plane_infos[i],
+        .image = self->image,
+        .memory = *memory,
+        .memoryOffset = 0,
+      };
+    }
+
+  VkResult res = vkBindImageMemory2 (vk_device, (uint32_t) attribs->n_planes,
+                                     bind_infos);
+  vk_check_error ("vkBindImageMemory2", res, FALSE);
+
+  return TRUE;
+}
+
+/**
+ * gulkan_texture_new_from_dmabuf_attribs:
+ * @context: a #GulkanContext
+ * @attribs: a #GulkanDmabufAttributes
+ *
+ * Imports a dmabuf without copying it. Multi-planar YUV formats like NV12,
+ * P010 and YUV420 are sampled through a #VkSamplerYcbcrConversion, which
+ * requires the sampler from gulkan_texture_init_sampler() to be set as
+ * immutable sampler in the descriptor set layout.
+ * Planes in distinct memory are imported as a disjoint image.
+ *
+ * Returns: (transfer full) (nullable): a new #GulkanTexture
+ */
 GulkanTexture *
 gulkan_texture_new_from_dmabuf_attribs (GulkanContext                 *context,
                                         struct GulkanDmabufAttributes *attribs)
 {
   // TODO: gracefully handle the no drm modifier case (fallback?)
 
-  if (attribs->n_planes > 2)
+  if (attribs->n_planes < 1 || attribs->n_planes > GULKAN_DMABUF_MAX_PLANES)
     {
-      g_printerr ("dmabuf with more than 2 planes not supported\n");
+      g_printerr ("dmabuf with %d planes not supported\n", attribs->n_planes);
       return NULL;
     }
 
@@ -853,14 +1701,11 @@ gulkan_texture_new_from_dmabuf_attribs (GulkanContext                 *context,
       return NULL;
     }
 
-  if (attribs->n_planes > 1)
+  gboolean disjoint = FALSE;
+  for (int i = 1; i < attribs->n_planes; i++)
     {
-      if (!is_fd_same_memory (attribs->fd[0], attribs->fd[1]))
-        {
-          g_printerr ("gulkan does not support importing distinct memory "
-                      "planes");
-          return NULL;
-        }
+      if (!is_fd_same_memory (attribs->fd[0], attribs->fd[i]))
+        disjoint = TRUE;
     }
 
   GulkanTexture *self = (GulkanTexture *) g_object_new (GULKAN_TYPE_TEXTURE, 0);
@@ -869,6 +1714,14 @@ gulkan_texture_new_from_dmabuf_attribs (GulkanContext                 *context,
     = gulkan_context_get_physical_device_handle (context);
 
   VkFormat vk_format = drm_format_to_vulkan (attribs->format);
+  uint32_t format_planes = _get_format_plane_count (vk_format);
+
+  if (disjoint && format_planes == 1)
+    {
+      g_printerr ("gulkan does not support importing distinct memory "
+                  "planes for single plane formats\n");
+      return NULL;
+    }
 
   VkSharingMode sharing_mode = VK_SHARING_MODE_EXCLUSIVE;
   VkImageTiling tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
@@ -881,12 +1734,7 @@ gulkan_texture_new_from_dmabuf_attribs (GulkanContext                 *context,
   g_debug ("DRM format %d -> Vk format %d", attribs->format, vk_format);
   g_debug ("modifier: %lu", attribs->modifier);
 
-  /*
-   * TODO: we have multiple planes for drm modifier compression etc, but we do
-   * not handle images for VK_IMAGE_CREATE_DISJOINT_BIT, which are ycbcr images
-   * separated into multiple planes
-   */
-  VkImageCreateFlags image_flags = 0;
+  VkImageCreateFlags image_flags = disjoint ? VK_IMAGE_CREATE_DISJOINT_BIT : 0;
 
   self->extent = (VkExtent2D){
     .width = (uint32_t) attribs->width,
@@ -895,47 +1743,37 @@ gulkan_texture_new_from_dmabuf_attribs (GulkanContext                 *context,
   self->context = g_object_ref (context);
   self->format = vk_format;
 
+  // check that the drm modifier we got is supported by the vulkan driver
   VkDrmFormatModifierPropertiesEXT supported_modifier_props = {0};
+  if (!gulkan_device_get_drm_format_modifier_properties (
+        gulkan_context_get_device (context), vk_format, attribs->modifier,
+        &supported_modifier_props))
+    {
+      g_printerr ("modifier %lu not supported", attribs->modifier);
+      return NULL;
+    }
 
-  // check that the drm modifier we got is supported by the vulkan driver
-  {
-    VkDrmFormatModifierPropertiesListEXT modifier_prop_list = {
-      .sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT,
-    };
-    VkFormatProperties2 format_props = {
-      .sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2,
-      .pNext = &modifier_prop_list,
-    };
-    vkGetPhysicalDeviceFormatProperties2 (vk_physical_device, vk_format,
-                                          &format_props);
-
-    modifier_prop_list.pDrmFormatModifierProperties
-      = g_malloc (sizeof (VkDrmFormatModifierPropertiesEXT)
-                  * modifier_prop_list.drmFormatModifierCount);
-    vkGetPhysicalDeviceFormatProperties2 (vk_physical_device, vk_format,
-                                          &format_props);
-
-    g_debug ("%d Supported modifiers:",
-             modifier_prop_list.drmFormatModifierCount);
-    for (uint32_t i = 0; i < modifier_prop_list.drmFormatModifierCount; i++)
-      {
-        VkDrmFormatModifierPropertiesEXT *m = &modifier_prop_list
-                                                 .pDrmFormatModifierProperties
-                                                   [i];
-        g_debug ("modifier %lu: planes %d tiling features %d,",
-                 m->drmFormatModifier, m->drmFormatModifierPlaneCount,
-                 m->drmFormatModifierTilingFeatures);
-
-        if (m->drmFormatModifier == attribs->modifier)
-          {
-            supported_modifier_props = modifier_prop_list
-                                         .pDrmFormatModifierProperties[i];
-          }
-      }
+  if (supported_modifier_props.drmFormatModifierPlaneCount
+      != (uint32_t) attribs->n_planes)
+    {
+      g_printerr ("modifier %lu needs %d planes, got %d\n", attribs->modifier,
+                  supported_modifier_props.drmFormatModifierPlaneCount,
+                  attribs->n_planes);
+      return NULL;
+    }
 
-    g_free (modifier_prop_list.pDrmFormatModifierProperties);
-    modifier_prop_list.pDrmFormatModifierProperties = NULL;
+  VkFormatFeatureFlags features
+    = supported_modifier_props.drmFormatModifierTilingFeatures;
 
+  if (disjoint && !(features & VK_FORMAT_FEATURE_DISJOINT_BIT))
+    {
+      g_printerr ("disjoint planes not supported for modifier %lu\n",
+                  attribs->modifier);
+      return NULL;
+    }
+
+  // check that images with this modifier can be imported
+  {
     VkPhysicalDeviceImageDrmFormatModifierInfoEXT modifier_format_info = {
       .sType
       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_DRM_FORMAT_MODIFIER_INFO_EXT,
@@ -983,19 +1821,6 @@ gulkan_texture_new_from_dmabuf_attribs (GulkanContext                 *context,
       }
   }
 
-  if (supported_modifier_props.drmFormatModifier != attribs->modifier)
-    {
-      g_printerr ("modifier %lu not supported", attribs->modifier);
-      return NULL;
-    }
-
-  if (supported_modifier_props.drmFormatModifierTilingFeatures
-      & VK_FORMAT_FEATURE_DISJOINT_BIT)
-    {
-      g_printerr ("disjointed image format not supported by gulkan");
-      return NULL;
-    }
-
   static PFN_vkGetImageDrmFormatModifierPropertiesEXT
     GetImageDrmFormatModifierPropertiesEXT
     = NULL;
@@ -1067,61 +1892,42 @@ gulkan_texture_new_from_dmabuf_attribs (GulkanContext                 *context,
       return NULL;
     }
 
-  VkMemoryRequirements memory_req;
-
-  int fd = dup (attribs->fd[0]);
-  g_debug ("dup fd %d -> %d", attribs->fd[0], fd);
-  if (!_import_fd_into_memory (self, fd, &self->image_memory, &memory_req))
+  if (disjoint)
     {
-      g_printerr ("Failed to import fd %d into plane 0\n", attribs->fd[0]);
-      close (fd);
-      return NULL;
+      if (!_bind_disjoint_memory (self, attribs))
+        return NULL;
     }
+  else
+    {
+      VkMemoryRequirements memory_req;
 
-#if 0
-  /* when tiling is VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT whe should be
-   * able to use VkBindImagePlaneMemoryInfo even when our image is not disjoint.
-   * TODO: this causes a validation error
-   */
-  VkBindImagePlaneMemoryInfo bind_image_plane0_info = {
-    .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_PLANE_MEMORY_INFO,
-    .pNext = NULL,
-    .planeAspect = VK_IMAGE_ASPECT_PLANE_0_BIT,
-  };
-  VkBindImagePlaneMemoryInfo bind_image_plane1_info = {
-    .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_PLANE_MEMORY_INFO,
-    .pNext = NULL,
-    .planeAspect = VK_IMAGE_ASPECT_PLANE_1_BIT,
-  };
+      int fd = dup (attribs->fd[0]);
+      g_debug ("dup fd %d -> %d", attribs->fd[0], fd);
+      if (!_import_fd_into_memory (self, fd, 0, &self->image_memory,
+                                   &memory_req))
+        {
+          g_printerr ("Failed to import fd %d into plane 0\n",
+                      attribs->fd[0]);
+          close (fd);
+          return NULL;
+        }
 
-  VkBindImageMemoryInfo bind_image_memory_infos[GULKAN_DMABUF_MAX_PLANES] = {
-    {
-      .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO,
-      .pNext = &bind_image_plane0_info,
-      .image = self->image,
-      .memory = self->image_memory,
-      .memoryOffset = attribs->offset[0],
-    },
-    {
-      .sType = VK_STRUCTURE_TYPE_BIND_IMAGE_MEMORY_INFO,
-      .pNext = &bind_image_plane1_info,
-      .image = self->image,
-      .memory = self->image_memory,
-      .memoryOffset = attribs->offset[1],
+      // gamescope uses vkBindImageMemory instead of vkBindImageMemory2
+      res = vkBindImageMemory (vk_device, self->image, self->image_memory, 0);
+      vk_check_error ("vkBindImageMemory", res, NULL);
     }
-  };
 
-  // TODO: the second bind with attribs->offset[1] causes a GPU hang on amd
-  res = vkBindImageMemory2 (vk_device, attribs->n_planes, bind_image_memory_infos);
-  vk_check_error ("vkBindImageMemory2", res, NULL);
-#else
-  // gamescope uses vkBindImageMemory instead of vkBindImageMemory2
-  res = vkBindImageMemory (vk_device, self->image, self->image_memory, 0);
-  vk_check_error ("vkBindImageMemory", res, NULL);
-#endif
+  if (format_planes > 1 && !_init_ycbcr_conversion (self, features))
+    return NULL;
+
+  VkSamplerYcbcrConversionInfo conversion_info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
+    .conversion = self->ycbcr_conversion,
+  };
 
   VkImageViewCreateInfo image_view_info =  {
     .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .pNext = self->ycbcr_conversion != VK_NULL_HANDLE ? &conversion_info : NULL,
     .flags = 0,
     .image = self->image,
     .viewType = VK_IMAGE_VIEW_TYPE_2D,
@@ -1321,6 +2127,8 @@ _get_access_flags (VkImageLayout layout)
     {
       case VK_IMAGE_LAYOUT_UNDEFINED:
         return 0;
+      case VK_IMAGE_LAYOUT_GENERAL:
+        return VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
       case VK_IMAGE_LAYOUT_PREINITIALIZED:
         return VK_ACCESS_HOST_WRITE_BIT;
       case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
@@ -1365,7 +2173,6 @@ gulkan_texture_record_transfer_full (GulkanTexture       *self,
 {
   GulkanDevice *device = gulkan_context_get_device (self->context);
   GulkanQueue  *gulkan_queue = gulkan_device_get_transfer_queue (device);
-  uint32_t      queue_index = gulkan_queue_get_family_index (gulkan_queue);
   GMutex       *mutex = gulkan_queue_get_pool_mutex (gulkan_queue);
 
   VkImageMemoryBarrier image_memory_barrier =
@@ -1383,8 +2190,9 @@ gulkan_texture_record_transfer_full (GulkanTexture       *self,
       .baseArrayLayer = 0,
       .layerCount = 1,
     },
-    .srcQueueFamilyIndex = queue_index,
-    .dstQueueFamilyIndex = queue_index,
+    /* No ownership transfer, see gulkan_texture_upload_pixels_async */
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
   };
 
   g_mutex_lock (mutex);
@@ -1514,9 +2322,20 @@ gulkan_texture_get_sampler (GulkanTexture *self)
   return self->sampler;
 }
 
+/**
+ * gulkan_texture_set_sampler:
+ * @self: a #GulkanTexture
+ * @sampler: a #VkSampler
+ *
+ * The texture takes ownership of @sampler and destroys it on finalize.
+ */
 void
 gulkan_texture_set_sampler (GulkanTexture *self, VkSampler sampler)
 {
+  if (sampler == self->sampler)
+    return;
+
+  _clear_sampler (self);
   self->sampler = sampler;
 }
 
@@ -1544,16 +2363,53 @@ gulkan_texture_init_sampler (GulkanTexture       *self,
     .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
     .unnormalizedCoordinates = VK_FALSE,
     .minLod = 0.0f,
-    .maxLod = (float) self->mip_levels,
+    /* The view clamps to its levels, so textures can share the sampler */
+    .maxLod = VK_LOD_CLAMP_NONE,
+  };
+
+  VkSamplerYcbcrConversionInfo conversion_info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
+    .conversion = self->ycbcr_conversion,
   };
 
-  VkDevice device = gulkan_context_get_device_handle (self->context);
-  VkResult res = vkCreateSampler (device, &info, NULL, &self->sampler);
-  vk_check_error ("vkCreateSampler", res, FALSE);
+  /* YCbCr samplers need to match the chroma filter and clamp to edge */
+  if (self->ycbcr_conversion != VK_NULL_HANDLE)
+    {
+      info.pNext = &conversion_info;
+      info.magFilter = self->chroma_filter;
+      info.minFilter = self->chroma_filter;
+      info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      info.anisotropyEnable = VK_FALSE;
+      info.maxAnisotropy = 1.0f;
+    }
+
+  GulkanDevice *device = gulkan_context_get_device (self->context);
+  VkSampler     sampler = gulkan_device_request_sampler (device, &info);
+  if (sampler == VK_NULL_HANDLE)
+    return FALSE;
+
+  _clear_sampler (self);
+  self->sampler = sampler;
+  self->shared_sampler = TRUE;
 
   return TRUE;
 }
 
+/**
+ * gulkan_texture_get_ycbcr_conversion:
+ * @self: a #GulkanTexture
+ *
+ * Returns: (transfer none): the #VkSamplerYcbcrConversion of multi-planar
+ * textures, VK_NULL_HANDLE otherwise
+ */
+VkSamplerYcbcrConversion
+gulkan_texture_get_ycbcr_conversion (GulkanTexture *self)
+{
+  return self->ycbcr_conversion;
+}
+
 VkDescriptorImageInfo *
 gulkan_texture_get_descriptor_info (GulkanTexture *self)
 {
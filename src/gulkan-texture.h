@@ -83,6 +83,16 @@ gulkan_texture_new_from_cairo_surface (GulkanContext   *context,
                                        VkFormat         format,
                                        VkImageLayout    layout);
 
+GulkanTexture *
+gulkan_texture_new_from_compressed_bytes (GulkanContext *context,
+                                          GBytes        *bytes,
+                                          VkImageLayout  layout);
+
+GulkanTexture *
+gulkan_texture_new_from_compressed_resource (GulkanContext *context,
+                                             const char    *resource_path,
+                                             VkImageLayout  layout);
+
 GulkanTexture *
 gulkan_texture_new_from_dmabuf (GulkanContext *context,
                                 int            fd,
@@ -101,6 +111,22 @@ gulkan_texture_new_export_fd (GulkanContext *context,
                               gsize         *size,
                               int           *fd);
 
+gboolean
+gulkan_texture_release_to_fd (GulkanTexture                        *self,
+                              GulkanQueue                          *queue,
+                              VkImageLayout                         layout,
+                              VkExternalSemaphoreHandleTypeFlagBits handle_type,
+                              int                                  *fd);
+
+gboolean
+gulkan_texture_acquire_from_fd (
+  GulkanTexture                        *self,
+  GulkanQueue                          *queue,
+  int                                   fd,
+  VkExternalSemaphoreHandleTypeFlagBits handle_type,
+  VkImageLayout                         src_layout,
+  VkImageLayout                         dst_layout);
+
 void
 gulkan_texture_record_transfer (GulkanTexture  *self,
                                 VkCommandBuffer cmd_buffer,
@@ -137,6 +163,12 @@ gulkan_texture_upload_pixels (GulkanTexture *self,
                               gsize          size,
                               VkImageLayout  layout);
 
+gboolean
+gulkan_texture_upload_pixels_async (GulkanTexture *self,
+                                    guchar        *pixels,
+                                    gsize          size,
+                                    VkImageLayout  layout);
+
 gboolean
 gulkan_texture_upload_pixels_region (GulkanTexture *self,
                                      guchar        *region_pixels,
@@ -178,6 +210,9 @@ gulkan_texture_init_sampler (GulkanTexture       *self,
                              VkFilter             filter,
                              VkSamplerAddressMode address_mode);
 
+VkSamplerYcbcrConversion
+gulkan_texture_get_ycbcr_conversion (GulkanTexture *self);
+
 VkDescriptorImageInfo *
 gulkan_texture_get_descriptor_info (GulkanTexture *self);
 
@@ -0,0 +1,31 @@
+/*
+ * gulkan
+ * Copyright 2018 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GULKAN_VERTEX_BUFFER_PRIVATE_H_
+#define GULKAN_VERTEX_BUFFER_PRIVATE_H_
+
+#include "gulkan-vertex-buffer.h"
+
+G_BEGIN_DECLS
+
+/* Mapped instance data of a frame slot, or NULL without instance buffer */
+const uint8_t *
+gulkan_vertex_buffer_get_instance_data (GulkanVertexBuffer *self,
+                                        uint32_t            frame_slot);
+
+/* Mapped dynamic storage of a frame slot, or NULL without it */
+const uint8_t *
+gulkan_vertex_buffer_get_dynamic_data (GulkanVertexBuffer *self,
+                                       uint32_t            frame_slot);
+
+/* Number of vertices drawn by gulkan_vertex_buffer_draw() */
+uint32_t
+gulkan_vertex_buffer_get_vertex_count (GulkanVertexBuffer *self);
+
+G_END_DECLS
+
+#endif /* GULKAN_VERTEX_BUFFER_PRIVATE_H_ */
@@ -5,16 +5,38 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include "gulkan-vertex-buffer.h"
+#include "gulkan-vertex-buffer-private.h"
+#include "gulkan-vertex-format.h"
+
+#if defined(__SSE2__)
+#define GULKAN_VERTEX_BUFFER_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define GULKAN_VERTEX_BUFFER_NEON
+#include <arm_neon.h>
+#endif
 
 typedef struct
 {
-  size_t         stride;
+  VkFormat       format;
+  size_t         element_size;
   size_t         size;
   size_t         offset;
   const uint8_t *bytes;
 } GulkanVertexAttribute;
 
+typedef struct
+{
+  VkFormat format;
+  size_t   offset;
+} GulkanInstanceAttribute;
+
+typedef struct
+{
+  VkDeviceSize start;
+  VkDeviceSize end;
+} GulkanRange;
+
 typedef struct
 {
   VkBuffer     *buffers;
@@ -41,6 +63,26 @@ struct _GulkanVertexBuffer
   GSList *attributes;
 
   GulkanVertexBindingCache binding_cache;
+
+  GSList       *instance_attributes;
+  /* First location of the instance attributes, -1 to follow the vertex ones */
+  int64_t       instance_location;
+  GulkanBuffer *instance_buffer;
+  uint8_t      *instance_map;
+  VkDeviceSize  instance_size;
+  VkDeviceSize  instance_slice_size;
+  uint32_t      instance_slice_count;
+  uint32_t      instance_slice;
+  uint32_t      max_instances;
+  uint32_t      instance_count;
+
+  uint8_t      *dynamic_map;
+  uint8_t      *dynamic_shadow;
+  VkDeviceSize  dynamic_size;
+  VkDeviceSize  dynamic_slice_size;
+  uint32_t      dynamic_slice_count;
+  uint32_t      dynamic_slice;
+  GulkanRange  *dynamic_dirty;
 };
 
 G_DEFINE_TYPE (GulkanVertexBuffer, gulkan_vertex_buffer, G_TYPE_OBJECT)
@@ -64,6 +106,14 @@ gulkan_vertex_buffer_init (GulkanVertexBuffer *self)
   self->array = g_array_new (FALSE, FALSE, sizeof (float));
   self->attributes = NULL;
   self->index_type = VK_INDEX_TYPE_UINT16;
+  self->instance_attributes = NULL;
+  self->instance_location = -1;
+  self->instance_buffer = NULL;
+  self->instance_map = NULL;
+  self->instance_count = 0;
+  self->dynamic_map = NULL;
+  self->dynamic_shadow = NULL;
+  self->dynamic_dirty = NULL;
 }
 
 GulkanVertexBuffer *
@@ -90,23 +140,305 @@ _get_attributes_size (GulkanVertexBuffer *self)
   return size;
 }
 
+static VkFormat
+_get_format_for_stride (size_t stride)
+{
+  switch (stride)
+    {
+      case 1:
+        return VK_FORMAT_R32_SFLOAT;
+      case 2:
+        return VK_FORMAT_R32G32_SFLOAT;
+      case 3:
+        return VK_FORMAT_R32G32B32_SFLOAT;
+      case 4:
+        return VK_FORMAT_R32G32B32A32_SFLOAT;
+      default:
+        g_warning ("Unspecified format for stride of %ld.", stride);
+        return VK_FORMAT_R32G32B32A32_SFLOAT;
+    }
+}
+
+static gboolean
+_check_vertex_format (GulkanVertexBuffer *self, VkFormat format)
+{
+  if (gulkan_vertex_format_get_size (format) == 0)
+    {
+      g_warning ("Unsupported vertex attribute format %d.", format);
+      return FALSE;
+    }
+
+  VkFormatProperties props = gulkan_device_get_format_properties (self->device,
+                                                                  format);
+  if (!(props.bufferFeatures & VK_FORMAT_FEATURE_VERTEX_BUFFER_BIT))
+    g_warning ("Format %d can't be used for vertex buffers on this device.",
+               format);
+
+  return TRUE;
+}
+
 void
 gulkan_vertex_buffer_add_attribute (GulkanVertexBuffer *self,
                                     size_t              stride,
                                     size_t              size,
                                     size_t              offset,
                                     const uint8_t      *bytes)
+{
+  gulkan_vertex_buffer_add_attribute_format (self,
+                                             _get_format_for_stride (stride),
+                                             size, offset, bytes);
+}
+
+/**
+ * gulkan_vertex_buffer_add_attribute_format:
+ * @self: a #GulkanVertexBuffer
+ * @format: the #VkFormat of one element, for example
+ * %VK_FORMAT_R16G16B16A16_SFLOAT or %VK_FORMAT_A2B10G10R10_SNORM_PACK32
+ * @size: size of @bytes to upload
+ * @offset: byte offset into @bytes
+ * @bytes: tightly packed elements of @format
+ *
+ * Like gulkan_vertex_buffer_add_attribute(), for data that was packed to a
+ * compact format, see gulkan_vertex_pack_half() and friends.
+ */
+void
+gulkan_vertex_buffer_add_attribute_format (GulkanVertexBuffer *self,
+                                           VkFormat            format,
+                                           size_t              size,
+                                           size_t              offset,
+                                           const uint8_t      *bytes)
 {
   g_assert (bytes != NULL);
 
+  if (!_check_vertex_format (self, format))
+    return;
+
   GulkanVertexAttribute *attribute = g_malloc (sizeof (GulkanVertexAttribute));
   attribute->size = size;
-  attribute->stride = stride;
+  attribute->format = format;
+  attribute->element_size = gulkan_vertex_format_get_size (format);
   attribute->offset = offset;
   attribute->bytes = bytes;
   self->attributes = g_slist_append (self->attributes, attribute);
 }
 
+/**
+ * gulkan_vertex_buffer_add_instance_attribute:
+ * @self: a #GulkanVertexBuffer
+ * @stride: number of float components of the attribute
+ * @offset: byte offset of the attribute inside one instance record
+ *
+ * Adds an attribute that advances once per instance instead of once per
+ * vertex. All instance attributes share one interleaved binding, which
+ * follows the vertex bindings, and take consecutive locations starting at
+ * gulkan_vertex_buffer_set_instance_location().
+ */
+void
+gulkan_vertex_buffer_add_instance_attribute (GulkanVertexBuffer *self,
+                                             size_t              stride,
+                                             size_t              offset)
+{
+  gulkan_vertex_buffer_add_instance_attribute_format (
+    self, _get_format_for_stride (stride), offset);
+}
+
+/**
+ * gulkan_vertex_buffer_add_instance_attribute_format:
+ * @self: a #GulkanVertexBuffer
+ * @format: the #VkFormat of the attribute
+ * @offset: byte offset of the attribute inside one instance record
+ *
+ * Like gulkan_vertex_buffer_add_instance_attribute(), with an explicit
+ * format.
+ */
+void
+gulkan_vertex_buffer_add_instance_attribute_format (GulkanVertexBuffer *self,
+                                                    VkFormat            format,
+                                                    size_t              offset)
+{
+  if (!_check_vertex_format (self, format))
+    return;
+
+  GulkanInstanceAttribute *attribute = g_malloc (
+    sizeof (GulkanInstanceAttribute));
+  attribute->format = format;
+  attribute->offset = offset;
+  self->instance_attributes = g_slist_append (self->instance_attributes,
+                                              attribute);
+}
+
+/**
+ * gulkan_vertex_buffer_set_instance_location:
+ * @self: a #GulkanVertexBuffer
+ * @location: shader location of the first instance attribute
+ *
+ * Defaults to the location after the attributes added with
+ * gulkan_vertex_buffer_add_attribute(). Interleaved buffers describe their
+ * vertex attributes themselves, so they need to set the location after
+ * their last one. Their instance binding is 1.
+ */
+void
+gulkan_vertex_buffer_set_instance_location (GulkanVertexBuffer *self,
+                                            uint32_t            location)
+{
+  self->instance_location = location;
+}
+
+static uint32_t
+_get_instance_location (GulkanVertexBuffer *self)
+{
+  if (self->instance_location >= 0)
+    return (uint32_t) self->instance_location;
+  return g_slist_length (self->attributes);
+}
+
+/**
+ * gulkan_vertex_buffer_alloc_instances:
+ * @self: a #GulkanVertexBuffer
+ * @instance_size: size of one instance record in bytes
+ * @max_instances: maximum number of instances drawn at once
+ * @frame_count: number of frames that may be in flight, for example
+ * gulkan_swapchain_renderer_get_max_queued_frames()
+ *
+ * Allocates a persistently mapped instance buffer with one slice per frame
+ * slot, see gulkan_vertex_buffer_update_instances().
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean
+gulkan_vertex_buffer_alloc_instances (GulkanVertexBuffer *self,
+                                      VkDeviceSize        instance_size,
+                                      uint32_t            max_instances,
+                                      uint32_t            frame_count)
+{
+  if (instance_size == 0 || max_instances == 0)
+    {
+      g_printerr ("Instance buffer can't be empty.\n");
+      return FALSE;
+    }
+
+  if (self->instance_buffer)
+    {
+      gulkan_buffer_unmap (self->instance_buffer);
+      g_clear_object (&self->instance_buffer);
+      self->instance_map = NULL;
+    }
+
+  self->instance_size = instance_size;
+  self->max_instances = max_instances;
+  self->instance_slice_count = MAX (frame_count, 1);
+  self->instance_slice_size = (instance_size * max_instances + 15)
+                              & ~(VkDeviceSize) 15;
+  self->instance_slice = 0;
+  self->instance_count = 0;
+
+  self->instance_buffer
+    = gulkan_buffer_new (self->device,
+                         self->instance_slice_size
+                           * self->instance_slice_count,
+                         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                           | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (!self->instance_buffer)
+    return FALSE;
+
+  if (!gulkan_buffer_map (self->instance_buffer, (void **) &self->instance_map))
+    {
+      g_clear_object (&self->instance_buffer);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * gulkan_vertex_buffer_update_instances:
+ * @self: a #GulkanVertexBuffer
+ * @frame_slot: the frame slot that draws the instances
+ * @data: @count tightly packed instance records
+ * @count: number of instances to draw
+ *
+ * Writes the instance data into the slice of @frame_slot, which the GPU
+ * needs to be done with. With a #GulkanSwapchainRenderer that is the case
+ * for gulkan_swapchain_renderer_get_frame_slot() while recording. The
+ * following binds and draws use this slice and count.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean
+gulkan_vertex_buffer_update_instances (GulkanVertexBuffer *self,
+                                       uint32_t            frame_slot,
+                                       const void         *data,
+                                       uint32_t            count)
+{
+  if (!self->instance_map)
+    {
+      g_printerr ("Instance buffer is not allocated.\n");
+      return FALSE;
+    }
+
+  if (count > self->max_instances)
+    {
+      g_warning ("Instance count %u exceeds maximum of %u.", count,
+                 self->max_instances);
+      count = self->max_instances;
+    }
+
+  self->instance_slice = frame_slot % self->instance_slice_count;
+
+  if (count > 0)
+    memcpy (self->instance_map
+              + self->instance_slice * self->instance_slice_size,
+            data, self->instance_size * count);
+
+  self->instance_count = count;
+
+  return TRUE;
+}
+
+uint32_t
+gulkan_vertex_buffer_get_instance_count (GulkanVertexBuffer *self)
+{
+  return self->instance_count;
+}
+
+const uint8_t *
+gulkan_vertex_buffer_get_instance_data (GulkanVertexBuffer *self,
+                                        uint32_t            frame_slot)
+{
+  if (!self->instance_map)
+    return NULL;
+
+  uint32_t slice = frame_slot % self->instance_slice_count;
+  return self->instance_map + slice * self->instance_slice_size;
+}
+
+uint32_t
+gulkan_vertex_buffer_get_vertex_count (GulkanVertexBuffer *self)
+{
+  return self->count;
+}
+
+const uint8_t *
+gulkan_vertex_buffer_get_dynamic_data (GulkanVertexBuffer *self,
+                                       uint32_t            frame_slot)
+{
+  if (!self->dynamic_map)
+    return NULL;
+
+  uint32_t slice = frame_slot % self->dynamic_slice_count;
+  return self->dynamic_map + slice * self->dynamic_slice_size;
+}
+
+static uint32_t
+_get_instance_binding (GulkanVertexBuffer *self)
+{
+  /* Interleaved arrays use a single binding. */
+  if (!self->attributes)
+    return 1;
+  return g_slist_length (self->attributes);
+}
+
 GulkanBuffer *
 gulkan_vertex_buffer_get_index_buffer (GulkanVertexBuffer *self)
 {
@@ -126,6 +458,13 @@ gulkan_vertex_buffer_upload (GulkanVertexBuffer *self)
   if (!self->buffer)
     return FALSE;
 
+  /* Separate attributes are drawn unindexed unless index data follows. */
+  if (!self->index_buffer && self->attributes)
+    {
+      GulkanVertexAttribute *first = self->attributes->data;
+      self->count = (uint32_t) (first->size / first->element_size);
+    }
+
   uint32_t binding_count = g_slist_length (self->attributes);
   self->binding_cache.buffers = g_malloc (sizeof (VkBuffer) * binding_count);
   self->binding_cache.offsets = g_malloc (sizeof (VkDeviceSize)
@@ -172,28 +511,65 @@ gulkan_vertex_buffer_finalize (GObject *gobject)
   if (!self->device)
     return;
 
+  if (self->dynamic_map)
+    gulkan_buffer_unmap (self->buffer);
+  g_free (self->dynamic_shadow);
+  g_free (self->dynamic_dirty);
+
   g_clear_object (&self->buffer);
   g_clear_object (&self->index_buffer);
 
+  if (self->instance_buffer)
+    {
+      gulkan_buffer_unmap (self->instance_buffer);
+      g_clear_object (&self->instance_buffer);
+    }
+
   g_slist_free_full (self->attributes, g_free);
+  g_slist_free_full (self->instance_attributes, g_free);
 
   g_clear_object (&self->device);
 }
 
+/* The slice of a dynamic buffer of the last next_frame() slot. */
+static VkDeviceSize
+_get_buffer_offset (GulkanVertexBuffer *self)
+{
+  return self->dynamic_map ? self->dynamic_slice * self->dynamic_slice_size
+                           : 0;
+}
+
+/**
+ * gulkan_vertex_buffer_draw:
+ * @self: a #GulkanVertexBuffer
+ * @cmd_buffer: the command buffer to record into
+ *
+ * Binds the vertex buffer and draws all vertices. With dynamic storage the
+ * slice of the last gulkan_vertex_buffer_next_frame() slot is recorded
+ * into @cmd_buffer, so it needs to be recorded again every frame, see
+ * gulkan_swapchain_renderer_set_record_each_frame().
+ */
 void
 gulkan_vertex_buffer_draw (GulkanVertexBuffer *self, VkCommandBuffer cmd_buffer)
 {
-  VkDeviceSize offsets[1] = {0};
+  VkDeviceSize offsets[1] = {_get_buffer_offset (self)};
   VkBuffer     buffer = gulkan_buffer_get_handle (self->buffer);
   vkCmdBindVertexBuffers (cmd_buffer, 0, 1, &buffer, &offsets[0]);
   vkCmdDraw (cmd_buffer, self->count, 1, 0, 0);
 }
 
+/**
+ * gulkan_vertex_buffer_draw_indexed:
+ * @self: a #GulkanVertexBuffer
+ * @cmd_buffer: the command buffer to record into
+ *
+ * Indexed variant of gulkan_vertex_buffer_draw().
+ */
 void
 gulkan_vertex_buffer_draw_indexed (GulkanVertexBuffer *self,
                                    VkCommandBuffer     cmd_buffer)
 {
-  VkDeviceSize offsets[1] = {0};
+  VkDeviceSize offsets[1] = {_get_buffer_offset (self)};
   VkBuffer     buffer = gulkan_buffer_get_handle (self->buffer);
   VkBuffer     index_buffer = gulkan_buffer_get_handle (self->index_buffer);
   vkCmdBindVertexBuffers (cmd_buffer, 0, 1, &buffer, &offsets[0]);
@@ -210,42 +586,131 @@ gulkan_vertex_buffer_bind_with_offsets (GulkanVertexBuffer *self,
                           self->binding_cache.offsets);
 }
 
+/**
+ * gulkan_vertex_buffer_bind_instances:
+ * @self: a #GulkanVertexBuffer
+ * @cmd_buffer: the command buffer to record into
+ *
+ * Binds the instance buffer slice written by the last
+ * gulkan_vertex_buffer_update_instances() call. The slice is recorded into
+ * @cmd_buffer, so it needs to be recorded again for every update, see
+ * gulkan_swapchain_renderer_set_record_each_frame().
+ */
 void
-gulkan_vertex_buffer_reset (GulkanVertexBuffer *self)
+gulkan_vertex_buffer_bind_instances (GulkanVertexBuffer *self,
+                                     VkCommandBuffer     cmd_buffer)
 {
-  g_array_free (self->array, TRUE);
-
-  self->array = g_array_new (FALSE, FALSE, sizeof (float));
-  self->count = 0;
+  VkBuffer     buffer = gulkan_buffer_get_handle (self->instance_buffer);
+  VkDeviceSize offset = self->instance_slice * self->instance_slice_size;
+  vkCmdBindVertexBuffers (cmd_buffer, _get_instance_binding (self), 1, &buffer,
+                          &offset);
 }
 
 static void
-_append_float (GArray *array, float v)
+_bind_instanced (GulkanVertexBuffer *self, VkCommandBuffer cmd_buffer)
 {
-  g_array_append_val (array, v);
+  if (self->attributes)
+    {
+      gulkan_vertex_buffer_bind_with_offsets (self, cmd_buffer);
+    }
+  else
+    {
+      VkDeviceSize offset = _get_buffer_offset (self);
+      VkBuffer     buffer = gulkan_buffer_get_handle (self->buffer);
+      vkCmdBindVertexBuffers (cmd_buffer, 0, 1, &buffer, &offset);
+    }
+
+  gulkan_vertex_buffer_bind_instances (self, cmd_buffer);
 }
 
-static void
-gulkan_vertex_buffer_append_vec2f (GulkanVertexBuffer *self, float u, float v)
+/**
+ * gulkan_vertex_buffer_draw_instanced:
+ * @self: a #GulkanVertexBuffer
+ * @cmd_buffer: the command buffer to record into
+ *
+ * Draws the vertices once for every instance of the last update. Like
+ * gulkan_vertex_buffer_bind_instances(), the instance count is recorded
+ * into @cmd_buffer.
+ */
+void
+gulkan_vertex_buffer_draw_instanced (GulkanVertexBuffer *self,
+                                     VkCommandBuffer     cmd_buffer)
 {
-  _append_float (self->array, u);
-  _append_float (self->array, v);
+  if (self->instance_count == 0)
+    return;
+
+  _bind_instanced (self, cmd_buffer);
+  vkCmdDraw (cmd_buffer, self->count, self->instance_count, 0, 0);
 }
 
-static void
-gulkan_vertex_buffer_append_vec3 (GulkanVertexBuffer *self, graphene_vec3_t *v)
+/**
+ * gulkan_vertex_buffer_draw_indexed_instanced:
+ * @self: a #GulkanVertexBuffer
+ * @cmd_buffer: the command buffer to record into
+ *
+ * Indexed variant of gulkan_vertex_buffer_draw_instanced().
+ */
+void
+gulkan_vertex_buffer_draw_indexed_instanced (GulkanVertexBuffer *self,
+                                             VkCommandBuffer     cmd_buffer)
 {
-  _append_float (self->array, graphene_vec3_get_x (v));
-  _append_float (self->array, graphene_vec3_get_y (v));
-  _append_float (self->array, graphene_vec3_get_z (v));
+  if (self->instance_count == 0)
+    return;
+
+  VkBuffer index_buffer = gulkan_buffer_get_handle (self->index_buffer);
+  _bind_instanced (self, cmd_buffer);
+  vkCmdBindIndexBuffer (cmd_buffer, index_buffer, 0, self->index_type);
+  vkCmdDrawIndexed (cmd_buffer, self->count, self->instance_count, 0, 0, 0);
 }
 
-static void
-gulkan_vertex_buffer_append_vec4 (GulkanVertexBuffer *self, graphene_vec4_t *v)
+/**
+ * gulkan_vertex_buffer_reset:
+ * @self: a #GulkanVertexBuffer
+ *
+ * Clears the vertex array. Its storage is kept, so geometry rebuilt every
+ * frame does not grow the array again.
+ */
+void
+gulkan_vertex_buffer_reset (GulkanVertexBuffer *self)
+{
+  g_array_set_size (self->array, 0);
+  self->count = 0;
+}
+
+/**
+ * gulkan_vertex_buffer_reserve:
+ * @self: a #GulkanVertexBuffer
+ * @vertex_count: number of vertices that will be appended
+ * @components: number of floats per vertex
+ *
+ * Grows the vertex array once, so the following appends don't reallocate.
+ */
+void
+gulkan_vertex_buffer_reserve (GulkanVertexBuffer *self,
+                              uint32_t            vertex_count,
+                              uint32_t            components)
+{
+  guint len = self->array->len;
+  /* GArray keeps its allocation when shrinking */
+  g_array_set_size (self->array, len + vertex_count * components);
+  g_array_set_size (self->array, len);
+}
+
+/**
+ * gulkan_vertex_buffer_append_vertices:
+ * @self: a #GulkanVertexBuffer
+ * @interleaved: (array): @vertex_count vertices of @components floats each
+ * @vertex_count: number of vertices
+ * @components: number of floats per vertex
+ */
+void
+gulkan_vertex_buffer_append_vertices (GulkanVertexBuffer *self,
+                                      const float        *interleaved,
+                                      uint32_t            vertex_count,
+                                      uint32_t            components)
 {
-  _append_float (self->array, graphene_vec4_get_x (v));
-  _append_float (self->array, graphene_vec4_get_y (v));
-  _append_float (self->array, graphene_vec4_get_z (v));
+  g_array_append_vals (self->array, interleaved, vertex_count * components);
+  self->count += vertex_count;
 }
 
 void
@@ -253,10 +718,10 @@ gulkan_vertex_buffer_append_with_color (GulkanVertexBuffer *self,
                                         graphene_vec4_t    *vec,
                                         graphene_vec3_t    *color)
 {
-  gulkan_vertex_buffer_append_vec4 (self, vec);
-  gulkan_vertex_buffer_append_vec3 (self, color);
-
-  self->count++;
+  float vertex[6];
+  graphene_vec4_to_float (vec, vertex);
+  graphene_vec3_to_float (color, &vertex[3]);
+  gulkan_vertex_buffer_append_vertices (self, vertex, 1, 6);
 }
 
 void
@@ -265,10 +730,11 @@ gulkan_vertex_buffer_append_position_uv (GulkanVertexBuffer *self,
                                          float               u,
                                          float               v)
 {
-  gulkan_vertex_buffer_append_vec4 (self, vec);
-  gulkan_vertex_buffer_append_vec2f (self, u, v);
-
-  self->count++;
+  float vertex[5];
+  graphene_vec4_to_float (vec, vertex);
+  vertex[3] = u;
+  vertex[4] = v;
+  gulkan_vertex_buffer_append_vertices (self, vertex, 1, 5);
 }
 
 gboolean
@@ -371,6 +837,11 @@ gulkan_vertex_buffer_map_array (GulkanVertexBuffer *self)
       return FALSE;
     }
 
+  if (self->dynamic_map)
+    return gulkan_vertex_buffer_update_range (self, 0, self->array->data,
+                                              self->array->len
+                                                * sizeof (float));
+
   if (!gulkan_buffer_upload (self->buffer, self->array->data,
                              self->array->len * sizeof (float)))
     {
@@ -380,50 +851,366 @@ gulkan_vertex_buffer_map_array (GulkanVertexBuffer *self)
   return TRUE;
 }
 
+/**
+ * gulkan_vertex_buffer_alloc_dynamic:
+ * @self: a #GulkanVertexBuffer
+ * @size: size of the vertex data in bytes
+ * @frame_count: number of frames that may be in flight, for example
+ * gulkan_swapchain_renderer_get_max_queued_frames()
+ *
+ * Allocates a persistently mapped vertex buffer for geometry that changes
+ * every frame, with one copy per frame slot. Writes only go to the copy of
+ * the current frame, see gulkan_vertex_buffer_next_frame().
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_vertex_buffer_alloc_dynamic (GulkanVertexBuffer *self,
+                                    VkDeviceSize        size,
+                                    uint32_t            frame_count)
+{
+  if (size == 0)
+    {
+      g_printerr ("Dynamic vertex buffer can't be empty.\n");
+      return FALSE;
+    }
+
+  if (self->dynamic_map)
+    {
+      gulkan_buffer_unmap (self->buffer);
+      self->dynamic_map = NULL;
+    }
+  g_clear_object (&self->buffer);
+  g_clear_pointer (&self->dynamic_shadow, g_free);
+  g_clear_pointer (&self->dynamic_dirty, g_free);
+
+  /* Slices start at atom boundaries so flushes don't overlap */
+  VkPhysicalDeviceProperties *props
+    = gulkan_device_get_physical_device_properties (self->device);
+  VkDeviceSize atom_size = MAX (props->limits.nonCoherentAtomSize, 4);
+
+  self->dynamic_size = size;
+  self->dynamic_slice_size = (size + atom_size - 1) / atom_size * atom_size;
+  self->dynamic_slice_count = MAX (frame_count, 1);
+  self->dynamic_slice = 0;
+
+  /* Not requiring coherent memory allows cached types, flushed by range */
+  self->buffer = gulkan_buffer_new (self->device,
+                                    self->dynamic_slice_size
+                                      * self->dynamic_slice_count,
+                                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  if (!self->buffer)
+    return FALSE;
+
+  void *map;
+  if (!gulkan_buffer_map (self->buffer, &map))
+    {
+      g_clear_object (&self->buffer);
+      return FALSE;
+    }
+
+  self->dynamic_map = map;
+  self->dynamic_shadow = g_malloc0 (size);
+  self->dynamic_dirty = g_malloc0 (sizeof (GulkanRange)
+                                   * self->dynamic_slice_count);
+
+  return TRUE;
+}
+
+static gboolean
+_write_slice (GulkanVertexBuffer *self,
+              uint32_t            slice,
+              VkDeviceSize        start,
+              VkDeviceSize        end)
+{
+  VkDeviceSize slice_offset = slice * self->dynamic_slice_size;
+  memcpy (self->dynamic_map + slice_offset + start,
+          self->dynamic_shadow + start, end - start);
+  return gulkan_buffer_flush_range (self->buffer, slice_offset + start,
+                                    end - start);
+}
+
+/* Writes a range of the shadow to the current slice and marks the others */
+static gboolean
+_commit_range (GulkanVertexBuffer *self, VkDeviceSize start, VkDeviceSize end)
+{
+  for (uint32_t i = 0; i < self->dynamic_slice_count; i++)
+    {
+      if (i == self->dynamic_slice)
+        continue;
+
+      GulkanRange *dirty = &self->dynamic_dirty[i];
+      if (dirty->end <= dirty->start)
+        {
+          *dirty = (GulkanRange){.start = start, .end = end};
+        }
+      else
+        {
+          dirty->start = MIN (dirty->start, start);
+          dirty->end = MAX (dirty->end, end);
+        }
+    }
+
+  return _write_slice (self, self->dynamic_slice, start, end);
+}
+
+/**
+ * gulkan_vertex_buffer_next_frame:
+ * @self: a #GulkanVertexBuffer with dynamic storage
+ * @frame_slot: the frame slot about to be recorded
+ *
+ * Switches to the copy of @frame_slot, which the GPU needs to be done with,
+ * and brings it up to date with the ranges written since it was last used.
+ * With a #GulkanSwapchainRenderer that is the case for
+ * gulkan_swapchain_renderer_get_frame_slot() while recording. Call once per
+ * frame before updating and recording draws.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_vertex_buffer_next_frame (GulkanVertexBuffer *self,
+                                 uint32_t            frame_slot)
+{
+  if (!self->dynamic_map)
+    {
+      g_printerr ("Vertex buffer has no dynamic storage.\n");
+      return FALSE;
+    }
+
+  self->dynamic_slice = frame_slot % self->dynamic_slice_count;
+
+  GulkanRange *dirty = &self->dynamic_dirty[self->dynamic_slice];
+  if (dirty->end <= dirty->start)
+    return TRUE;
+
+  gboolean res = _write_slice (self, self->dynamic_slice, dirty->start,
+                               dirty->end);
+  *dirty = (GulkanRange){0};
+
+  return res;
+}
+
+/**
+ * gulkan_vertex_buffer_update_range:
+ * @self: a #GulkanVertexBuffer with dynamic storage
+ * @offset: byte offset of the range to update
+ * @data: new contents of the range
+ * @size: size of the range in bytes
+ *
+ * Writes the range to the copy of the current frame and only flushes the
+ * touched atoms. The other copies catch up in
+ * gulkan_vertex_buffer_next_frame().
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_vertex_buffer_update_range (GulkanVertexBuffer *self,
+                                   VkDeviceSize        offset,
+                                   const void         *data,
+                                   VkDeviceSize        size)
+{
+  if (!self->dynamic_map)
+    {
+      g_printerr ("Vertex buffer has no dynamic storage.\n");
+      return FALSE;
+    }
+
+  if (offset + size > self->dynamic_size)
+    {
+      g_printerr ("Range %lu+%lu exceeds dynamic vertex buffer size %lu.\n",
+                  offset, size, self->dynamic_size);
+      return FALSE;
+    }
+
+  if (size == 0)
+    return TRUE;
+
+  memcpy (self->dynamic_shadow + offset, data, size);
+
+  return _commit_range (self, offset, offset + size);
+}
+
+static void
+_transform_with_color (const float *positions,
+                       uint32_t     count,
+                       const float  m[16],
+                       const float  color[3],
+                       float       *dst)
+{
+  uint32_t i = 0;
+
+#if defined(GULKAN_VERTEX_BUFFER_SSE2)
+  __m128 row0 = _mm_loadu_ps (m);
+  __m128 row1 = _mm_loadu_ps (m + 4);
+  __m128 row2 = _mm_loadu_ps (m + 8);
+  __m128 row3 = _mm_loadu_ps (m + 12);
+  __m128 col = _mm_setr_ps (color[0], color[1], color[2], 0.0f);
+
+  /* Two vertices are 12 floats, 3 unaligned stores */
+  for (; i + 2 <= count; i += 2)
+    {
+      const float *p = positions + i * 3;
+      __m128       r0 = _mm_add_ps (
+        _mm_add_ps (_mm_mul_ps (_mm_set1_ps (p[0]), row0),
+                    _mm_mul_ps (_mm_set1_ps (p[1]), row1)),
+        _mm_add_ps (_mm_mul_ps (_mm_set1_ps (p[2]), row2), row3));
+      __m128 r1 = _mm_add_ps (
+        _mm_add_ps (_mm_mul_ps (_mm_set1_ps (p[3]), row0),
+                    _mm_mul_ps (_mm_set1_ps (p[4]), row1)),
+        _mm_add_ps (_mm_mul_ps (_mm_set1_ps (p[5]), row2), row3));
+
+      /* (r0.z, r0.z, r, r) and (r1.z, r1.z, r, r) */
+      __m128 t0 = _mm_shuffle_ps (r0, col, _MM_SHUFFLE (0, 0, 2, 2));
+      __m128 t1 = _mm_shuffle_ps (r1, col, _MM_SHUFFLE (0, 0, 2, 2));
+
+      float *d = dst + i * 6;
+      _mm_storeu_ps (d, _mm_shuffle_ps (r0, t0, _MM_SHUFFLE (2, 0, 1, 0)));
+      _mm_storeu_ps (d + 4, _mm_shuffle_ps (col, r1, _MM_SHUFFLE (1, 0, 2, 1)));
+      _mm_storeu_ps (d + 8, _mm_shuffle_ps (t1, col, _MM_SHUFFLE (2, 1, 2, 0)));
+    }
+#elif defined(GULKAN_VERTEX_BUFFER_NEON)
+  float32x4_t row0 = vld1q_f32 (m);
+  float32x4_t row1 = vld1q_f32 (m + 4);
+  float32x4_t row2 = vld1q_f32 (m + 8);
+  float32x4_t row3 = vld1q_f32 (m + 12);
+
+  for (; i < count; i++)
+    {
+      const float *p = positions + i * 3;
+      float32x4_t  r = vmlaq_n_f32 (row3, row0, p[0]);
+      r = vmlaq_n_f32 (r, row1, p[1]);
+      r = vmlaq_n_f32 (r, row2, p[2]);
+
+      /* w is overwritten by the color */
+      float *d = dst + i * 6;
+      vst1q_f32 (d, r);
+      d[3] = color[0];
+      d[4] = color[1];
+      d[5] = color[2];
+    }
+#endif
+
+  for (; i < count; i++)
+    {
+      const float *p = positions + i * 3;
+      float       *d = dst + i * 6;
+      for (int j = 0; j < 3; j++)
+        d[j] = p[0] * m[j] + p[1] * m[4 + j] + p[2] * m[8 + j] + m[12 + j];
+      d[3] = color[0];
+      d[4] = color[1];
+      d[5] = color[2];
+    }
+}
+
+/**
+ * gulkan_vertex_buffer_write_with_color:
+ * @self: a #GulkanVertexBuffer with dynamic storage
+ * @first_vertex: first vertex to write
+ * @positions: (array): @count positions of 3 floats each
+ * @count: number of vertices
+ * @mat: (nullable): transformation applied to the positions
+ * @color: color of all written vertices
+ *
+ * Writes vertices in the layout of gulkan_vertex_buffer_append_with_color()
+ * straight to the dynamic storage of the current frame, without going
+ * through the vertex array. The draw count grows to the end of the written
+ * range, so vertices can be updated in any order.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gulkan_vertex_buffer_write_with_color (GulkanVertexBuffer      *self,
+                                       uint32_t                 first_vertex,
+                                       const float             *positions,
+                                       uint32_t                 count,
+                                       const graphene_matrix_t *mat,
+                                       const graphene_vec3_t   *color)
+{
+  VkDeviceSize vertex_size = 6 * sizeof (float);
+  VkDeviceSize start = first_vertex * vertex_size;
+  VkDeviceSize end = start + count * vertex_size;
+
+  if (!self->dynamic_map)
+    {
+      g_printerr ("Vertex buffer has no dynamic storage.\n");
+      return FALSE;
+    }
+
+  if (end > self->dynamic_size)
+    {
+      g_printerr ("%u vertices exceed dynamic vertex buffer size %lu.\n",
+                  first_vertex + count, self->dynamic_size);
+      return FALSE;
+    }
+
+  float m[16];
+  if (mat)
+    {
+      graphene_matrix_to_float (mat, m);
+    }
+  else
+    {
+      graphene_matrix_t identity;
+      graphene_matrix_init_identity (&identity);
+      graphene_matrix_to_float (&identity, m);
+    }
+
+  float c[3];
+  graphene_vec3_to_float (color, c);
+
+  /* The shadow is 4 byte aligned, as float data is written to it */
+  _transform_with_color (positions, count, m, c,
+                         (float *) (void *) (self->dynamic_shadow + start));
+
+  self->count = MAX (self->count, first_vertex + count);
+
+  return _commit_range (self, start, end);
+}
+
 gboolean
 gulkan_vertex_buffer_is_initialized (GulkanVertexBuffer *self)
 {
   return self->buffer != VK_NULL_HANDLE;
 }
 
+uint32_t
+gulkan_vertex_buffer_get_binding_count (GulkanVertexBuffer *self)
+{
+  uint32_t count = g_slist_length (self->attributes);
+  if (self->instance_attributes)
+    count++;
+  return count;
+}
+
 VkVertexInputBindingDescription *
 gulkan_vertex_buffer_create_binding_desc (GulkanVertexBuffer *self)
 {
-  uint32_t binding_count = g_slist_length (self->attributes);
+  uint32_t vertex_binding_count = g_slist_length (self->attributes);
+  uint32_t binding_count = gulkan_vertex_buffer_get_binding_count (self);
   VkVertexInputBindingDescription *desc
     = g_malloc (sizeof (VkVertexInputBindingDescription) * binding_count);
 
-  for (guint i = 0; i < binding_count; i++)
+  for (guint i = 0; i < vertex_binding_count; i++)
     {
       GSList                *entry = g_slist_nth (self->attributes, i);
       GulkanVertexAttribute *attribute = entry->data;
 
       desc[i] = (VkVertexInputBindingDescription){
         .binding = i,
-        .stride = (uint32_t) (attribute->stride * sizeof (float)),
+        .stride = (uint32_t) attribute->element_size,
         .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
       };
     }
-  return desc;
-}
 
-static VkFormat
-_get_format_for_stride (size_t stride)
-{
-  switch (stride)
-    {
-      case 1:
-        return VK_FORMAT_R32_SFLOAT;
-      case 2:
-        return VK_FORMAT_R32G32_SFLOAT;
-      case 3:
-        return VK_FORMAT_R32G32B32_SFLOAT;
-      case 4:
-        return VK_FORMAT_R32G32B32A32_SFLOAT;
-      default:
-        g_warning ("Unspecified format for stride of %ld.", stride);
-        return VK_FORMAT_R32G32B32A32_SFLOAT;
-    }
+  if (self->instance_attributes)
+    desc[vertex_binding_count] = (VkVertexInputBindingDescription){
+      .binding = _get_instance_binding (self),
+      .stride = (uint32_t) self->instance_size,
+      .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+    };
+
+  return desc;
 }
 
 VkVertexInputAttributeDescription *
@@ -431,7 +1218,8 @@ gulkan_vertex_buffer_create_attrib_desc (GulkanVertexBuffer *self)
 {
   uint32_t binding_count = g_slist_length (self->attributes);
   VkVertexInputAttributeDescription *desc
-    = g_malloc (sizeof (VkVertexInputAttributeDescription) * binding_count);
+    = g_malloc (sizeof (VkVertexInputAttributeDescription)
+                * gulkan_vertex_buffer_get_attrib_count (self));
 
   for (guint i = 0; i < binding_count; i++)
     {
@@ -441,17 +1229,33 @@ gulkan_vertex_buffer_create_attrib_desc (GulkanVertexBuffer *self)
       desc[i] = (VkVertexInputAttributeDescription){
         .location = i,
         .binding = i,
-        .format = _get_format_for_stride (attribute->stride),
+        .format = attribute->format,
         .offset = 0,
       };
     }
+
+  uint32_t index = binding_count;
+  uint32_t location = _get_instance_location (self);
+  for (GSList *l = self->instance_attributes; l; l = l->next)
+    {
+      GulkanInstanceAttribute *attribute = l->data;
+
+      desc[index++] = (VkVertexInputAttributeDescription){
+        .location = location++,
+        .binding = _get_instance_binding (self),
+        .format = attribute->format,
+        .offset = (uint32_t) attribute->offset,
+      };
+    }
+
   return desc;
 }
 
 uint32_t
 gulkan_vertex_buffer_get_attrib_count (GulkanVertexBuffer *self)
 {
-  return g_slist_length (self->attributes);
+  return g_slist_length (self->attributes)
+         + g_slist_length (self->instance_attributes);
 }
 
 VkPrimitiveTopology
@@ -39,9 +39,28 @@ void
 gulkan_vertex_buffer_draw_indexed (GulkanVertexBuffer *self,
                                    VkCommandBuffer     cmd_buffer);
 
+void
+gulkan_vertex_buffer_draw_instanced (GulkanVertexBuffer *self,
+                                     VkCommandBuffer     cmd_buffer);
+
+void
+gulkan_vertex_buffer_draw_indexed_instanced (GulkanVertexBuffer *self,
+                                             VkCommandBuffer     cmd_buffer);
+
 void
 gulkan_vertex_buffer_reset (GulkanVertexBuffer *self);
 
+void
+gulkan_vertex_buffer_reserve (GulkanVertexBuffer *self,
+                              uint32_t            vertex_count,
+                              uint32_t            components);
+
+void
+gulkan_vertex_buffer_append_vertices (GulkanVertexBuffer *self,
+                                      const float        *interleaved,
+                                      uint32_t            vertex_count,
+                                      uint32_t            components);
+
 gboolean
 gulkan_vertex_buffer_map_array (GulkanVertexBuffer *self);
 
@@ -74,6 +93,29 @@ gulkan_vertex_buffer_append_with_color (GulkanVertexBuffer *self,
                                         graphene_vec4_t    *vec,
                                         graphene_vec3_t    *color);
 
+gboolean
+gulkan_vertex_buffer_alloc_dynamic (GulkanVertexBuffer *self,
+                                    VkDeviceSize        size,
+                                    uint32_t            frame_count);
+
+gboolean
+gulkan_vertex_buffer_next_frame (GulkanVertexBuffer *self,
+                                 uint32_t            frame_slot);
+
+gboolean
+gulkan_vertex_buffer_update_range (GulkanVertexBuffer *self,
+                                   VkDeviceSize        offset,
+                                   const void         *data,
+                                   VkDeviceSize        size);
+
+gboolean
+gulkan_vertex_buffer_write_with_color (GulkanVertexBuffer      *self,
+                                       uint32_t                 first_vertex,
+                                       const float             *positions,
+                                       uint32_t                 count,
+                                       const graphene_matrix_t *mat,
+                                       const graphene_vec3_t   *color);
+
 gboolean
 gulkan_vertex_buffer_is_initialized (GulkanVertexBuffer *self);
 
@@ -88,6 +130,46 @@ gulkan_vertex_buffer_add_attribute (GulkanVertexBuffer *self,
                                     size_t              offset,
                                     const uint8_t      *bytes);
 
+void
+gulkan_vertex_buffer_add_attribute_format (GulkanVertexBuffer *self,
+                                           VkFormat            format,
+                                           size_t              size,
+                                           size_t              offset,
+                                           const uint8_t      *bytes);
+
+void
+gulkan_vertex_buffer_add_instance_attribute (GulkanVertexBuffer *self,
+                                             size_t              stride,
+                                             size_t              offset);
+
+void
+gulkan_vertex_buffer_add_instance_attribute_format (GulkanVertexBuffer *self,
+                                                    VkFormat            format,
+                                                    size_t              offset);
+
+void
+gulkan_vertex_buffer_set_instance_location (GulkanVertexBuffer *self,
+                                            uint32_t            location);
+
+gboolean
+gulkan_vertex_buffer_alloc_instances (GulkanVertexBuffer *self,
+                                      VkDeviceSize        instance_size,
+                                      uint32_t            max_instances,
+                                      uint32_t            frame_count);
+
+gboolean
+gulkan_vertex_buffer_update_instances (GulkanVertexBuffer *self,
+                                       uint32_t            frame_slot,
+                                       const void         *data,
+                                       uint32_t            count);
+
+uint32_t
+gulkan_vertex_buffer_get_instance_count (GulkanVertexBuffer *self);
+
+void
+gulkan_vertex_buffer_bind_instances (GulkanVertexBuffer *self,
+                                     VkCommandBuffer     cmd_buffer);
+
 GulkanBuffer *
 gulkan_vertex_buffer_get_index_buffer (GulkanVertexBuffer *self);
 
@@ -100,6 +182,9 @@ gulkan_vertex_buffer_get_topology (GulkanVertexBuffer *self);
 uint32_t
 gulkan_vertex_buffer_get_attrib_count (GulkanVertexBuffer *self);
 
+uint32_t
+gulkan_vertex_buffer_get_binding_count (GulkanVertexBuffer *self);
+
 VkVertexInputAttributeDescription *
 gulkan_vertex_buffer_create_attrib_desc (GulkanVertexBuffer *self);
 
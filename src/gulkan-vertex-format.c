@@ -0,0 +1,462 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "gulkan-vertex-format.h"
+
+#if defined(__SSE2__)
+#define GULKAN_PACK_SSE2
+#include <emmintrin.h>
+#endif
+
+/* F16C is not part of the x86-64 baseline, it is detected at runtime. */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define GULKAN_PACK_F16C
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define GULKAN_PACK_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * gulkan_vertex_format_get_size:
+ * @format: a vertex attribute #VkFormat
+ *
+ * Returns: the size of one element in bytes, or 0 if @format is not a
+ * supported vertex attribute format
+ */
+gsize
+gulkan_vertex_format_get_size (VkFormat format)
+{
+  switch (format)
+    {
+      case VK_FORMAT_R32_SFLOAT:
+      case VK_FORMAT_R16G16_SFLOAT:
+      case VK_FORMAT_R16G16_SNORM:
+      case VK_FORMAT_R8G8B8A8_UNORM:
+      case VK_FORMAT_R8G8B8A8_SNORM:
+      case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+      case VK_FORMAT_A2B10G10R10_SNORM_PACK32:
+        return 4;
+      case VK_FORMAT_R32G32_SFLOAT:
+      case VK_FORMAT_R16G16B16A16_SFLOAT:
+      case VK_FORMAT_R16G16B16A16_SNORM:
+        return 8;
+      case VK_FORMAT_R32G32B32_SFLOAT:
+        return 12;
+      case VK_FORMAT_R32G32B32A32_SFLOAT:
+        return 16;
+      default:
+        return 0;
+    }
+}
+
+/*
+ * Clamps to [lo, 1], NaN included, scales and rounds half away from zero.
+ * The SIMD paths below round the same way.
+ */
+static inline int32_t
+_quantize (float v, float lo, float scale)
+{
+  if (!(v >= lo))
+    v = lo;
+  if (v > 1.0f)
+    v = 1.0f;
+  v *= scale;
+  return (int32_t) (v < 0.0f ? v - 0.5f : v + 0.5f);
+}
+
+/* Round to nearest even, like F16C and NEON conversions. */
+static uint16_t
+_float_to_half (float f)
+{
+  union
+  {
+    float    f;
+    uint32_t u;
+  } v = {.f = f};
+
+  uint32_t sign = (v.u >> 16) & 0x8000;
+  uint32_t abs = v.u & 0x7fffffff;
+
+  /* Inf and NaN, keeping NaNs quiet */
+  if (abs >= 0x7f800000)
+    return (uint16_t) (sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+
+  /* Rounds to more than 65504 */
+  if (abs >= 0x477ff000)
+    return (uint16_t) (sign | 0x7c00);
+
+  /* Half subnormals */
+  if (abs < 0x38800000)
+    {
+      if (abs < 0x33000000)
+        return (uint16_t) sign;
+
+      uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+      uint32_t shift = 126 - (abs >> 23);
+      uint32_t h = mantissa >> shift;
+      uint32_t rest = mantissa & ((1u << shift) - 1);
+      uint32_t halfway = 1u << (shift - 1);
+      if (rest > halfway || (rest == halfway && (h & 1)))
+        h++;
+      return (uint16_t) (sign | h);
+    }
+
+  uint32_t h = (abs - 0x38000000) >> 13;
+  uint32_t rest = abs & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+    h++;
+  return (uint16_t) (sign | h);
+}
+
+#ifdef GULKAN_PACK_SSE2
+static inline __m128i
+_quantize_sse2 (__m128 v, __m128 lo, __m128 scale)
+{
+  /* maxps returns the second operand for NaN */
+  v = _mm_min_ps (_mm_max_ps (v, lo), _mm_set1_ps (1.0f));
+  v = _mm_mul_ps (v, scale);
+  __m128 half = _mm_or_ps (_mm_and_ps (v, _mm_set1_ps (-0.0f)),
+                           _mm_set1_ps (0.5f));
+  return _mm_cvttps_epi32 (_mm_add_ps (v, half));
+}
+#endif
+
+#ifdef GULKAN_PACK_NEON
+static inline int32x4_t
+_quantize_neon (float32x4_t v, float32x4_t lo, float32x4_t scale)
+{
+  v = vminnmq_f32 (vmaxnmq_f32 (v, lo), vdupq_n_f32 (1.0f));
+  v = vmulq_f32 (v, scale);
+  uint32x4_t  sign = vandq_u32 (vreinterpretq_u32_f32 (v),
+                                vdupq_n_u32 (0x80000000));
+  float32x4_t half = vreinterpretq_f32_u32 (
+    vorrq_u32 (sign, vreinterpretq_u32_f32 (vdupq_n_f32 (0.5f))));
+  return vcvtq_s32_f32 (vaddq_f32 (v, half));
+}
+#endif
+
+#ifdef GULKAN_PACK_F16C
+static gboolean
+_has_f16c (void)
+{
+  static gsize    initialized = 0;
+  static gboolean supported = FALSE;
+
+  if (g_once_init_enter (&initialized))
+    {
+      unsigned int eax, ebx, ecx, edx;
+      if (__get_cpuid (1, &eax, &ebx, &ecx, &edx) && (ecx & bit_OSXSAVE)
+          && (ecx & bit_AVX) && (ecx & bit_F16C))
+        {
+          /* The OS needs to save the YMM state for VEX instructions */
+          unsigned int xcr0, xcr0_high;
+          __asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+          supported = (xcr0 & 0x6) == 0x6;
+        }
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return supported;
+}
+
+__attribute__ ((target ("f16c"))) static void
+_pack_half_f16c (const float *src, uint16_t *dst, gsize count)
+{
+  gsize i = 0;
+  for (; i + 4 <= count; i += 4)
+    {
+      __m128i h = _mm_cvtps_ph (_mm_loadu_ps (src + i),
+                                _MM_FROUND_TO_NEAREST_INT);
+      _mm_storel_epi64 ((__m128i *) (void *) (dst + i), h);
+    }
+  for (; i < count; i++)
+    dst[i] = _float_to_half (src[i]);
+}
+#endif
+
+/**
+ * gulkan_vertex_pack_half:
+ * @src: (array length=count): floats to convert
+ * @dst: (array length=count): destination for IEEE half floats
+ * @count: number of floats
+ *
+ * Packs positions or UVs for %VK_FORMAT_R16G16_SFLOAT and
+ * %VK_FORMAT_R16G16B16A16_SFLOAT attributes.
+ */
+void
+gulkan_vertex_pack_half (const float *src, uint16_t *dst, gsize count)
+{
+  gsize i = 0;
+
+#if defined(GULKAN_PACK_F16C)
+  if (_has_f16c ())
+    {
+      _pack_half_f16c (src, dst, count);
+      return;
+    }
+#elif defined(GULKAN_PACK_NEON)
+  for (; i + 4 <= count; i += 4)
+    {
+      float16x4_t h = vcvt_f16_f32 (vld1q_f32 (src + i));
+      vst1_u16 (dst + i, vreinterpret_u16_f16 (h));
+    }
+#endif
+
+  for (; i < count; i++)
+    dst[i] = _float_to_half (src[i]);
+}
+
+/**
+ * gulkan_vertex_pack_unorm8:
+ * @src: (array length=count): floats in [0, 1]
+ * @dst: (array length=count): destination bytes
+ * @count: number of floats
+ *
+ * Packs colors for %VK_FORMAT_R8G8B8A8_UNORM attributes.
+ */
+void
+gulkan_vertex_pack_unorm8 (const float *src, uint8_t *dst, gsize count)
+{
+  gsize i = 0;
+
+#if defined(GULKAN_PACK_SSE2)
+  __m128 lo = _mm_setzero_ps ();
+  __m128 scale = _mm_set1_ps (255.0f);
+  for (; i + 16 <= count; i += 16)
+    {
+      __m128i a = _quantize_sse2 (_mm_loadu_ps (src + i), lo, scale);
+      __m128i b = _quantize_sse2 (_mm_loadu_ps (src + i + 4), lo, scale);
+      __m128i c = _quantize_sse2 (_mm_loadu_ps (src + i + 8), lo, scale);
+      __m128i d = _quantize_sse2 (_mm_loadu_ps (src + i + 12), lo, scale);
+      __m128i packed = _mm_packus_epi16 (_mm_packs_epi32 (a, b),
+                                         _mm_packs_epi32 (c, d));
+      _mm_storeu_si128 ((__m128i *) (void *) (dst + i), packed);
+    }
+#elif defined(GULKAN_PACK_NEON)
+  float32x4_t lo = vdupq_n_f32 (0.0f);
+  float32x4_t scale = vdupq_n_f32 (255.0f);
+  for (; i + 8 <= count; i += 8)
+    {
+      int32x4_t a = _quantize_neon (vld1q_f32 (src + i), lo, scale);
+      int32x4_t b = _quantize_neon (vld1q_f32 (src + i + 4), lo, scale);
+      vst1_u8 (dst + i,
+               vqmovun_s16 (vcombine_s16 (vqmovn_s32 (a), vqmovn_s32 (b))));
+    }
+#endif
+
+  for (; i < count; i++)
+    dst[i] = (uint8_t) _quantize (src[i], 0.0f, 255.0f);
+}
+
+/**
+ * gulkan_vertex_pack_snorm8:
+ * @src: (array length=count): floats in [-1, 1]
+ * @dst: (array length=count): destination bytes
+ * @count: number of floats
+ *
+ * Packs normals or tangents for %VK_FORMAT_R8G8B8A8_SNORM attributes.
+ */
+void
+gulkan_vertex_pack_snorm8 (const float *src, int8_t *dst, gsize count)
+{
+  gsize i = 0;
+
+#if defined(GULKAN_PACK_SSE2)
+  __m128 lo = _mm_set1_ps (-1.0f);
+  __m128 scale = _mm_set1_ps (127.0f);
+  for (; i + 16 <= count; i += 16)
+    {
+      __m128i a = _quantize_sse2 (_mm_loadu_ps (src + i), lo, scale);
+      __m128i b = _quantize_sse2 (_mm_loadu_ps (src + i + 4), lo, scale);
+      __m128i c = _quantize_sse2 (_mm_loadu_ps (src + i + 8), lo, scale);
+      __m128i d = _quantize_sse2 (_mm_loadu_ps (src + i + 12), lo, scale);
+      __m128i packed = _mm_packs_epi16 (_mm_packs_epi32 (a, b),
+                                        _mm_packs_epi32 (c, d));
+      _mm_storeu_si128 ((__m128i *) (void *) (dst + i), packed);
+    }
+#elif defined(GULKAN_PACK_NEON)
+  float32x4_t lo = vdupq_n_f32 (-1.0f);
+  float32x4_t scale = vdupq_n_f32 (127.0f);
+  for (; i + 8 <= count; i += 8)
+    {
+      int32x4_t a = _quantize_neon (vld1q_f32 (src + i), lo, scale);
+      int32x4_t b = _quantize_neon (vld1q_f32 (src + i + 4), lo, scale);
+      vst1_s8 (dst + i,
+               vqmovn_s16 (vcombine_s16 (vqmovn_s32 (a), vqmovn_s32 (b))));
+    }
+#endif
+
+  for (; i < count; i++)
+    dst[i] = (int8_t) _quantize (src[i], -1.0f, 127.0f);
+}
+
+/**
+ * gulkan_vertex_pack_snorm16:
+ * @src: (array length=count): floats in [-1, 1]
+ * @dst: (array length=count): destination shorts
+ * @count: number of floats
+ *
+ * Packs for %VK_FORMAT_R16G16_SNORM and %VK_FORMAT_R16G16B16A16_SNORM
+ * attributes.
+ */
+void
+gulkan_vertex_pack_snorm16 (const float *src, int16_t *dst, gsize count)
+{
+  gsize i = 0;
+
+#if defined(GULKAN_PACK_SSE2)
+  __m128 lo = _mm_set1_ps (-1.0f);
+  __m128 scale = _mm_set1_ps (32767.0f);
+  for (; i + 8 <= count; i += 8)
+    {
+      __m128i a = _quantize_sse2 (_mm_loadu_ps (src + i), lo, scale);
+      __m128i b = _quantize_sse2 (_mm_loadu_ps (src + i + 4), lo, scale);
+      _mm_storeu_si128 ((__m128i *) (void *) (dst + i),
+                        _mm_packs_epi32 (a, b));
+    }
+#elif defined(GULKAN_PACK_NEON)
+  float32x4_t lo = vdupq_n_f32 (-1.0f);
+  float32x4_t scale = vdupq_n_f32 (32767.0f);
+  for (; i + 8 <= count; i += 8)
+    {
+      int32x4_t a = _quantize_neon (vld1q_f32 (src + i), lo, scale);
+      int32x4_t b = _quantize_neon (vld1q_f32 (src + i + 4), lo, scale);
+      vst1q_s16 (dst + i, vcombine_s16 (vqmovn_s32 (a), vqmovn_s32 (b)));
+    }
+#endif
+
+  for (; i < count; i++)
+    dst[i] = (int16_t) _quantize (src[i], -1.0f, 32767.0f);
+}
+
+static inline uint32_t
+_pack_2_10_10_10 (int32_t x, int32_t y, int32_t z)
+{
+  return ((uint32_t) x & 0x3ff) | (((uint32_t) y & 0x3ff) << 10)
+         | (((uint32_t) z & 0x3ff) << 20);
+}
+
+/**
+ * gulkan_vertex_pack_normals_2_10_10_10:
+ * @xyz: (array): @count tightly packed normals of 3 floats each
+ * @dst: (array length=count): destination words
+ * @count: number of normals
+ *
+ * Packs normals for %VK_FORMAT_A2B10G10R10_SNORM_PACK32 attributes, with
+ * x in the lowest bits and an alpha of 0.
+ */
+void
+gulkan_vertex_pack_normals_2_10_10_10 (const float *xyz,
+                                       uint32_t    *dst,
+                                       gsize        count)
+{
+  gsize i = 0;
+
+#if defined(GULKAN_PACK_SSE2)
+  __m128  lo = _mm_set1_ps (-1.0f);
+  __m128  scale = _mm_set1_ps (511.0f);
+  __m128i mask = _mm_set1_epi32 (0x3ff);
+  for (; i + 4 <= count; i += 4)
+    {
+      const float *p = xyz + i * 3;
+      __m128i      x = _quantize_sse2 (_mm_setr_ps (p[0], p[3], p[6], p[9]),
+                                       lo, scale);
+      __m128i      y = _quantize_sse2 (_mm_setr_ps (p[1], p[4], p[7], p[10]),
+                                       lo, scale);
+      __m128i      z = _quantize_sse2 (_mm_setr_ps (p[2], p[5], p[8], p[11]),
+                                       lo, scale);
+      __m128i packed
+        = _mm_or_si128 (_mm_and_si128 (x, mask),
+                        _mm_or_si128 (_mm_slli_epi32 (_mm_and_si128 (y, mask),
+                                                      10),
+                                      _mm_slli_epi32 (_mm_and_si128 (z, mask),
+                                                      20)));
+      _mm_storeu_si128 ((__m128i *) (void *) (dst + i), packed);
+    }
+#elif defined(GULKAN_PACK_NEON)
+  float32x4_t lo = vdupq_n_f32 (-1.0f);
+  float32x4_t scale = vdupq_n_f32 (511.0f);
+  uint32x4_t  mask = vdupq_n_u32 (0x3ff);
+  for (; i + 4 <= count; i += 4)
+    {
+      float32x4x3_t v = vld3q_f32 (xyz + i * 3);
+      uint32x4_t    x = vandq_u32 (vreinterpretq_u32_s32 (
+                                  _quantize_neon (v.val[0], lo, scale)),
+                                mask);
+      uint32x4_t    y = vandq_u32 (vreinterpretq_u32_s32 (
+                                  _quantize_neon (v.val[1], lo, scale)),
+                                mask);
+      uint32x4_t    z = vandq_u32 (vreinterpretq_u32_s32 (
+                                  _quantize_neon (v.val[2], lo, scale)),
+                                mask);
+      vst1q_u32 (dst + i, vorrq_u32 (x, vorrq_u32 (vshlq_n_u32 (y, 10),
+                                                   vshlq_n_u32 (z, 20))));
+    }
+#endif
+
+  for (; i < count; i++)
+    {
+      const float *p = xyz + i * 3;
+      dst[i] = _pack_2_10_10_10 (_quantize (p[0], -1.0f, 511.0f),
+                                 _quantize (p[1], -1.0f, 511.0f),
+                                 _quantize (p[2], -1.0f, 511.0f));
+    }
+}
+
+static inline float
+_abs (float v)
+{
+  return v < 0.0f ? -v : v;
+}
+
+static inline float
+_sign (float v)
+{
+  return v < 0.0f ? -1.0f : 1.0f;
+}
+
+/**
+ * gulkan_vertex_pack_normals_octahedral:
+ * @xyz: (array): @count tightly packed unit normals of 3 floats each
+ * @dst: (array): 2 * @count destination shorts
+ * @count: number of normals
+ *
+ * Packs normals with the octahedral mapping for %VK_FORMAT_R16G16_SNORM
+ * attributes, the shader has to decode them.
+ */
+void
+gulkan_vertex_pack_normals_octahedral (const float *xyz,
+                                       int16_t     *dst,
+                                       gsize        count)
+{
+  for (gsize i = 0; i < count; i++)
+    {
+      const float *p = xyz + i * 3;
+      float        l1 = _abs (p[0]) + _abs (p[1]) + _abs (p[2]);
+      float        u = 0.0f;
+      float        v = 0.0f;
+
+      if (l1 > 0.0f)
+        {
+          u = p[0] / l1;
+          v = p[1] / l1;
+          if (p[2] < 0.0f)
+            {
+              float folded_u = (1.0f - _abs (v)) * _sign (u);
+              v = (1.0f - _abs (u)) * _sign (v);
+              u = folded_u;
+            }
+        }
+
+      dst[i * 2] = (int16_t) _quantize (u, -1.0f, 32767.0f);
+      dst[i * 2 + 1] = (int16_t) _quantize (v, -1.0f, 32767.0f);
+    }
+}
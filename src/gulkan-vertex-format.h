@@ -0,0 +1,47 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GULKAN_VERTEX_FORMAT_H_
+#define GULKAN_VERTEX_FORMAT_H_
+
+#if !defined(GULKAN_INSIDE) && !defined(GULKAN_COMPILATION)
+#error "Only <gulkan.h> can be included directly."
+#endif
+
+#include <glib.h>
+#include <vulkan/vulkan.h>
+
+G_BEGIN_DECLS
+
+gsize
+gulkan_vertex_format_get_size (VkFormat format);
+
+void
+gulkan_vertex_pack_half (const float *src, uint16_t *dst, gsize count);
+
+void
+gulkan_vertex_pack_unorm8 (const float *src, uint8_t *dst, gsize count);
+
+void
+gulkan_vertex_pack_snorm8 (const float *src, int8_t *dst, gsize count);
+
+void
+gulkan_vertex_pack_snorm16 (const float *src, int16_t *dst, gsize count);
+
+void
+gulkan_vertex_pack_normals_2_10_10_10 (const float *xyz,
+                                       uint32_t    *dst,
+                                       gsize        count);
+
+void
+gulkan_vertex_pack_normals_octahedral (const float *xyz,
+                                       int16_t     *dst,
+                                       gsize        count);
+
+G_END_DECLS
+
+#endif /* GULKAN_VERTEX_FORMAT_H_ */
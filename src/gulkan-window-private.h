@@ -0,0 +1,26 @@
+/*
+ * gulkan
+ * Copyright 2022 Lubosz Sarnecki
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef GULKAN_WINDOW_PRIVATE_H_
+#define GULKAN_WINDOW_PRIVATE_H_
+
+#include "gulkan-window.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Used by the backends. Return TRUE when the event was accumulated for
+ * gulkan_window_flush_input() and must not be emitted right away.
+ */
+gboolean
+gulkan_window_queue_position (GulkanWindow *self, VkOffset2D offset);
+
+gboolean
+gulkan_window_queue_axis (GulkanWindow *self, uint32_t axis, double value);
+
+G_END_DECLS
+
+#endif /* GULKAN_WINDOW_PRIVATE_H_ */
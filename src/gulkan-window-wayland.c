@@ -5,6 +5,7 @@
  */
 
 #include "gulkan-window-wayland.h"
+#include "gulkan-window-private.h"
 
 #include <errno.h>
 #include <poll.h>
@@ -28,6 +29,7 @@ struct _GulkanWindowWayland
   struct wl_pointer    *pointer;
   struct wl_seat       *seat;
   struct wl_surface    *surface;
+  struct wl_callback   *frame_callback;
 
   struct xdg_wm_base  *wm_base;
   struct xdg_surface  *surface_xdg;
@@ -50,6 +52,7 @@ enum
   POINTER_AXIS_EVENT,
   KEY_EVENT,
   CLOSE_EVENT,
+  FRAME_READY_EVENT,
   LAST_SIGNAL
 };
 
@@ -66,6 +69,7 @@ gulkan_window_wayland_init (GulkanWindowWayland *self)
   self->pointer = NULL;
   self->seat = NULL;
   self->surface = NULL;
+  self->frame_callback = NULL;
   self->compositor = NULL;
   self->display = NULL;
   self->xkb = NULL;
@@ -89,6 +93,8 @@ _finalize (GObject *gobject)
     wl_pointer_destroy (self->pointer);
   if (self->seat)
     wl_seat_destroy (self->seat);
+  if (self->frame_callback)
+    wl_callback_destroy (self->frame_callback);
   if (self->surface)
     wl_surface_destroy (self->surface);
   if (self->compositor)
@@ -146,6 +152,40 @@ _create_surface (GulkanWindow *window,
   return vkCreateWaylandSurfaceKHR (instance, &info, NULL, surface);
 }
 
+static void
+_frame_done_cb (void *data, struct wl_callback *callback, uint32_t time)
+{
+  (void) time;
+
+  GulkanWindowWayland *self = GULKAN_WINDOW_WAYLAND (data);
+
+  wl_callback_destroy (callback);
+  self->frame_callback = NULL;
+
+  gulkan_window_flush_input (GULKAN_WINDOW (self));
+  g_signal_emit (self, signals[FRAME_READY_EVENT], 0);
+}
+
+static const struct wl_callback_listener frame_listener = {
+  .done = _frame_done_cb,
+};
+
+/*
+ * The callback is committed along with the next present. Compositors don't
+ * signal it while the surface is not visible, which pauses rendering.
+ */
+static void
+_request_frame (GulkanWindow *window)
+{
+  GulkanWindowWayland *self = GULKAN_WINDOW_WAYLAND (window);
+
+  if (self->frame_callback)
+    return;
+
+  self->frame_callback = wl_surface_frame (self->surface);
+  wl_callback_add_listener (self->frame_callback, &frame_listener, self);
+}
+
 static void
 _toggle_fullscreen (GulkanWindow *window)
 {
@@ -224,6 +264,28 @@ _poll_events (GulkanWindow *window)
     }
 }
 
+static int
+_get_fd (GulkanWindow *window)
+{
+  GulkanWindowWayland *self = GULKAN_WINDOW_WAYLAND (window);
+  return wl_display_get_fd (self->display);
+}
+
+/* Requests need to be flushed before sleeping, or no events will arrive */
+static gboolean
+_prepare_events (GulkanWindow *window)
+{
+  GulkanWindowWayland *self = GULKAN_WINDOW_WAYLAND (window);
+
+  if (wl_display_prepare_read (self->display) != 0)
+    return TRUE;
+
+  wl_display_cancel_read (self->display);
+  wl_display_flush (self->display);
+
+  return FALSE;
+}
+
 static void
 _pointer_motion_cb (void              *data,
                     struct wl_pointer *pointer,
@@ -242,6 +304,10 @@ _pointer_motion_cb (void              *data,
       .y = wl_fixed_to_int (y),
     },
   };
+
+  if (gulkan_window_queue_position (GULKAN_WINDOW (self), event.offset))
+    return;
+
   g_signal_emit (self, signals[POINTER_POSITION_EVENT], 0, &event);
 }
 
@@ -264,6 +330,8 @@ _pointer_button_cb (void              *data,
     .is_pressed = state == 1,
   };
 
+  /* Deliver coalesced motion first, so clicks happen where expected */
+  gulkan_window_flush_input (GULKAN_WINDOW (self));
   g_signal_emit (self, signals[POINTER_BUTTON_EVENT], 0, &event);
 }
 
@@ -277,12 +345,18 @@ _pointer_axis_cb (void              *data,
   (void) pointer;
   (void) time;
 
+  GulkanWindowWayland *self = GULKAN_WINDOW_WAYLAND (data);
+
+  /* Summed unrounded, small steps of smooth scrolling would truncate to 0 */
+  if (gulkan_window_queue_axis (GULKAN_WINDOW (self), axis,
+                                wl_fixed_to_double (value)))
+    return;
+
   GulkanAxisEvent event = {
     .axis = axis,
     .value = wl_fixed_to_int (value),
   };
 
-  GulkanWindowWayland *self = GULKAN_WINDOW_WAYLAND (data);
   g_signal_emit (self, signals[POINTER_AXIS_EVENT], 0, &event);
 }
 
@@ -309,6 +383,7 @@ _keyboard_key_cb (void               *data,
     .is_pressed = state == 1,
   };
 
+  gulkan_window_flush_input (GULKAN_WINDOW (self));
   g_signal_emit (self, signals[KEY_EVENT], 0, &event);
 }
 
@@ -614,6 +689,9 @@ gulkan_window_wayland_class_init (GulkanWindowWaylandClass *klass)
   parent_class->create_surface = _create_surface;
   parent_class->required_extensions = _required_extensions;
   parent_class->poll_events = _poll_events;
+  parent_class->get_fd = _get_fd;
+  parent_class->prepare_events = _prepare_events;
+  parent_class->request_frame = _request_frame;
   parent_class->toggle_fullscreen = _toggle_fullscreen;
   parent_class->has_support = _has_support;
   parent_class->can_run = _can_run;
@@ -653,4 +731,9 @@ gulkan_window_wayland_class_init (GulkanWindowWaylandClass *klass)
   signals[CLOSE_EVENT] = g_signal_new ("close", G_TYPE_FROM_CLASS (klass),
                                        G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
                                        G_TYPE_NONE, 0);
+
+  signals[FRAME_READY_EVENT] = g_signal_new ("frame-ready",
+                                             G_TYPE_FROM_CLASS (klass),
+                                             G_SIGNAL_RUN_FIRST, 0, NULL, NULL,
+                                             NULL, G_TYPE_NONE, 0);
 }
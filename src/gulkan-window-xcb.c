@@ -5,15 +5,22 @@
  */
 
 #include "gulkan-window-xcb.h"
+#include "gulkan-window-private.h"
 
 #include <xcb/xcb.h>
 #include <xcb/xcb_keysyms.h>
+#if defined(GULKAN_HAVE_XCB_PRESENT)
+#include <xcb/present.h>
+#endif
 
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_xcb.h>
 
 #include "gulkan-context.h"
 
+/* Frames are requested without Present events after this long */
+#define GULKAN_XCB_FRAME_TIMEOUT_MS 100
+
 struct _GulkanWindowXcb
 {
   GulkanWindow parent;
@@ -27,6 +34,21 @@ struct _GulkanWindowXcb
   xcb_atom_t atom_wm_delete_window;
 
   VkExtent2D last_extent;
+
+  /* Taken from the queue by prepare_events, handled on the next poll */
+  xcb_generic_event_t *queued_event;
+
+  gboolean is_mapped;
+  gboolean is_obscured;
+  gboolean frame_requested;
+  guint    frame_idle;
+  guint    frame_timeout;
+
+  /* Present extension, opcode is 0 when the server lacks it */
+  uint8_t  present_opcode;
+  uint32_t present_eid;
+  /* Drivers may present without Present pixmaps, so no event arrives */
+  gboolean present_complete_seen;
 };
 
 G_DEFINE_TYPE (GulkanWindowXcb, gulkan_window_xcb, GULKAN_TYPE_WINDOW)
@@ -39,6 +61,7 @@ enum
   POINTER_AXIS_EVENT,
   KEY_EVENT,
   CLOSE_EVENT,
+  FRAME_READY_EVENT,
   LAST_SIGNAL
 };
 
@@ -51,12 +74,26 @@ gulkan_window_xcb_init (GulkanWindowXcb *self)
   self->window = XCB_NONE;
   self->syms = NULL;
   self->screen = NULL;
+  self->queued_event = NULL;
+  self->is_mapped = FALSE;
+  self->is_obscured = FALSE;
+  self->frame_requested = FALSE;
+  self->frame_idle = 0;
+  self->frame_timeout = 0;
+  self->present_opcode = 0;
+  self->present_eid = 0;
+  self->present_complete_seen = FALSE;
 }
 
 static void
 _finalize (GObject *gobject)
 {
   GulkanWindowXcb *self = GULKAN_WINDOW_XCB (gobject);
+  free (self->queued_event);
+  if (self->frame_idle)
+    g_source_remove (self->frame_idle);
+  if (self->frame_timeout)
+    g_source_remove (self->frame_timeout);
   xcb_destroy_window (self->connection, self->window);
   xcb_disconnect (self->connection);
   xcb_key_symbols_free (self->syms);
@@ -212,6 +249,10 @@ _handle_motion_notify (GulkanWindowXcb                 *self,
       .y = xcb_event->event_y,
     },
   };
+
+  if (gulkan_window_queue_position (GULKAN_WINDOW (self), event.offset))
+    return;
+
   g_signal_emit (self, signals[POINTER_POSITION_EVENT], 0, &event);
 }
 
@@ -288,7 +329,9 @@ _handle_button_press (GulkanWindowXcb                *self,
             .axis = 0,
             .value = xcb_event->detail == XCB_BUTTON_INDEX_4 ? -10 : 10,
           };
-          g_signal_emit (self, signals[POINTER_AXIS_EVENT], 0, &event);
+          if (!gulkan_window_queue_axis (GULKAN_WINDOW (self), event.axis,
+                                         event.value))
+            g_signal_emit (self, signals[POINTER_AXIS_EVENT], 0, &event);
           break;
         }
       case XCB_BUTTON_INDEX_6:
@@ -298,7 +341,9 @@ _handle_button_press (GulkanWindowXcb                *self,
             .axis = 1,
             .value = xcb_event->detail == XCB_BUTTON_INDEX_6 ? -10 : 10,
           };
-          g_signal_emit (self, signals[POINTER_AXIS_EVENT], 0, &event);
+          if (!gulkan_window_queue_axis (GULKAN_WINDOW (self), event.axis,
+                                         event.value))
+            g_signal_emit (self, signals[POINTER_AXIS_EVENT], 0, &event);
           break;
         }
       default:
@@ -374,6 +419,135 @@ _handle_configure (GulkanWindowXcb                    *self,
   g_signal_emit (self, signals[CONFIGURE_EVENT], 0, &event);
 }
 
+static gboolean
+_is_visible (GulkanWindowXcb *self)
+{
+  return self->is_mapped && !self->is_obscured;
+}
+
+static void
+_emit_frame_ready (GulkanWindowXcb *self)
+{
+  if (!self->frame_requested || !_is_visible (self))
+    return;
+
+  self->frame_requested = FALSE;
+
+  if (self->frame_timeout)
+    {
+      g_source_remove (self->frame_timeout);
+      self->frame_timeout = 0;
+    }
+
+  gulkan_window_flush_input (GULKAN_WINDOW (self));
+  g_signal_emit (self, signals[FRAME_READY_EVENT], 0);
+}
+
+static gboolean
+_frame_idle_cb (gpointer data)
+{
+  GulkanWindowXcb *self = GULKAN_WINDOW_XCB (data);
+  self->frame_idle = 0;
+  _emit_frame_ready (self);
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * The present did not complete in time, or was never made. If no present
+ * ever completed while visible, the driver doesn't use Present pixmaps.
+ */
+static gboolean
+_frame_timeout_cb (gpointer data)
+{
+  GulkanWindowXcb *self = GULKAN_WINDOW_XCB (data);
+  self->frame_timeout = 0;
+
+  if (!self->present_complete_seen && _is_visible (self))
+    {
+      g_debug ("No Present events, requesting frames on idle.");
+      self->present_opcode = 0;
+    }
+
+  _emit_frame_ready (self);
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * With the Present extension the frame is ready when the previous present
+ * completed, or after a timeout. Without it, it is ready right away. Either
+ * way hidden windows hold the frame back until they are shown again.
+ */
+static void
+_request_frame (GulkanWindow *window)
+{
+  GulkanWindowXcb *self = GULKAN_WINDOW_XCB (window);
+
+  self->frame_requested = TRUE;
+
+  if (self->present_opcode == 0)
+    {
+      if (!self->frame_idle)
+        self->frame_idle = g_idle_add (_frame_idle_cb, self);
+    }
+  else if (!self->frame_timeout)
+    {
+      self->frame_timeout = g_timeout_add (GULKAN_XCB_FRAME_TIMEOUT_MS,
+                                           _frame_timeout_cb, self);
+    }
+}
+
+static void
+_set_visibility (GulkanWindowXcb *self,
+                 gboolean         is_mapped,
+                 gboolean         is_obscured)
+{
+  gboolean was_visible = _is_visible (self);
+
+  self->is_mapped = is_mapped;
+  self->is_obscured = is_obscured;
+
+  if (!was_visible && _is_visible (self))
+    _emit_frame_ready (self);
+}
+
+#if defined(GULKAN_HAVE_XCB_PRESENT)
+static void
+_handle_generic_event (GulkanWindowXcb              *self,
+                       const xcb_ge_generic_event_t *event)
+{
+  if (self->present_opcode == 0 || event->extension != self->present_opcode
+      || event->event_type != XCB_PRESENT_EVENT_COMPLETE_NOTIFY)
+    return;
+
+  const xcb_present_complete_notify_event_t *complete
+    = (const xcb_present_complete_notify_event_t *) event;
+
+  if (complete->window == self->window
+      && complete->kind == XCB_PRESENT_COMPLETE_KIND_PIXMAP)
+    {
+      self->present_complete_seen = TRUE;
+      _emit_frame_ready (self);
+    }
+}
+
+static void
+_init_present (GulkanWindowXcb *self)
+{
+  const xcb_query_extension_reply_t *ext
+    = xcb_get_extension_data (self->connection, &xcb_present_id);
+  if (!ext || !ext->present)
+    {
+      g_debug ("X server has no Present extension.");
+      return;
+    }
+
+  self->present_opcode = ext->major_opcode;
+  self->present_eid = xcb_generate_id (self->connection);
+  xcb_present_select_input (self->connection, self->present_eid, self->window,
+                            XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY);
+}
+#endif
+
 static void
 _handle_event (GulkanWindowXcb *self, const xcb_generic_event_t *event)
 {
@@ -386,16 +560,21 @@ _handle_event (GulkanWindowXcb *self, const xcb_generic_event_t *event)
       case XCB_MOTION_NOTIFY:
         _handle_motion_notify (self, (xcb_motion_notify_event_t *) event);
         break;
+      /* Deliver coalesced motion first, so clicks happen where expected */
       case XCB_BUTTON_PRESS:
+        gulkan_window_flush_input (GULKAN_WINDOW (self));
         _handle_button_press (self, (xcb_button_press_event_t *) event);
         break;
       case XCB_BUTTON_RELEASE:
+        gulkan_window_flush_input (GULKAN_WINDOW (self));
         _handle_button_release (self, (xcb_button_release_event_t *) event);
         break;
       case XCB_KEY_PRESS:
+        gulkan_window_flush_input (GULKAN_WINDOW (self));
         _handle_key_press (self, (xcb_key_press_event_t *) event);
         break;
       case XCB_KEY_RELEASE:
+        gulkan_window_flush_input (GULKAN_WINDOW (self));
         _handle_key_release (self, (xcb_key_release_event_t *) event);
         break;
       case XCB_DESTROY_NOTIFY:
@@ -404,6 +583,26 @@ _handle_event (GulkanWindowXcb *self, const xcb_generic_event_t *event)
       case XCB_CONFIGURE_NOTIFY:
         _handle_configure (self, (const xcb_configure_notify_event_t *) event);
         break;
+      case XCB_MAP_NOTIFY:
+        _set_visibility (self, TRUE, self->is_obscured);
+        break;
+      case XCB_UNMAP_NOTIFY:
+        _set_visibility (self, FALSE, self->is_obscured);
+        break;
+      case XCB_VISIBILITY_NOTIFY:
+        {
+          const xcb_visibility_notify_event_t *visibility
+            = (const xcb_visibility_notify_event_t *) event;
+          _set_visibility (self, self->is_mapped,
+                           visibility->state
+                             == XCB_VISIBILITY_FULLY_OBSCURED);
+          break;
+        }
+#if defined(GULKAN_HAVE_XCB_PRESENT)
+      case XCB_GE_GENERIC:
+        _handle_generic_event (self, (const xcb_ge_generic_event_t *) event);
+        break;
+#endif
       default:
         break;
     }
@@ -414,6 +613,13 @@ _poll_events (GulkanWindow *window)
 {
   GulkanWindowXcb     *self = GULKAN_WINDOW_XCB (window);
   xcb_generic_event_t *event;
+
+  if (self->queued_event)
+    {
+      _handle_event (self, self->queued_event);
+      g_clear_pointer (&self->queued_event, free);
+    }
+
   while ((event = xcb_poll_for_event (self->connection)))
     {
       _handle_event (self, event);
@@ -421,6 +627,30 @@ _poll_events (GulkanWindow *window)
     }
 }
 
+static int
+_get_fd (GulkanWindow *window)
+{
+  GulkanWindowXcb *self = GULKAN_WINDOW_XCB (window);
+  return xcb_get_file_descriptor (self->connection);
+}
+
+/*
+ * Events read while waiting for a reply sit in the xcb queue and won't wake
+ * the fd. There is no way to peek, so the first one is kept for polling.
+ */
+static gboolean
+_prepare_events (GulkanWindow *window)
+{
+  GulkanWindowXcb *self = GULKAN_WINDOW_XCB (window);
+
+  xcb_flush (self->connection);
+
+  if (!self->queued_event)
+    self->queued_event = xcb_poll_for_queued_event (self->connection);
+
+  return self->queued_event != NULL;
+}
+
 static gboolean
 _initialize (GulkanWindow *window, VkExtent2D extent, const char *title)
 {
@@ -438,7 +668,7 @@ _initialize (GulkanWindow *window, VkExtent2D extent, const char *title)
     XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_KEY_RELEASE
       | XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_STRUCTURE_NOTIFY
       | XCB_EVENT_MASK_POINTER_MOTION | XCB_EVENT_MASK_BUTTON_PRESS
-      | XCB_EVENT_MASK_BUTTON_RELEASE,
+      | XCB_EVENT_MASK_BUTTON_RELEASE | XCB_EVENT_MASK_VISIBILITY_CHANGE,
   };
 
   xcb_create_window (self->connection, XCB_COPY_FROM_PARENT, self->window,
@@ -456,6 +686,10 @@ _initialize (GulkanWindow *window, VkExtent2D extent, const char *title)
 
   _update_window_title (self, title);
 
+#if defined(GULKAN_HAVE_XCB_PRESENT)
+  _init_present (self);
+#endif
+
   xcb_map_window (self->connection, self->window);
 
   return TRUE;
@@ -472,6 +706,9 @@ gulkan_window_xcb_class_init (GulkanWindowXcbClass *klass)
   parent_class->create_surface = _create_surface;
   parent_class->required_extensions = _required_extensions;
   parent_class->poll_events = _poll_events;
+  parent_class->get_fd = _get_fd;
+  parent_class->prepare_events = _prepare_events;
+  parent_class->request_frame = _request_frame;
   parent_class->toggle_fullscreen = _toggle_fullscreen;
   parent_class->has_support = _has_support;
   parent_class->can_run = _can_run;
@@ -511,4 +748,9 @@ gulkan_window_xcb_class_init (GulkanWindowXcbClass *klass)
   signals[CLOSE_EVENT] = g_signal_new ("close", G_TYPE_FROM_CLASS (klass),
                                        G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL,
                                        G_TYPE_NONE, 0);
+
+  signals[FRAME_READY_EVENT] = g_signal_new ("frame-ready",
+                                             G_TYPE_FROM_CLASS (klass),
+                                             G_SIGNAL_RUN_FIRST, 0, NULL, NULL,
+                                             NULL, G_TYPE_NONE, 0);
 }
@@ -4,7 +4,7 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include "gulkan-window.h"
+#include "gulkan-window-private.h"
 
 #if defined(GULKAN_HAVE_WAYLAND)
 #include "gulkan-window-wayland.h"
@@ -14,9 +14,20 @@
 #include "gulkan-window-xcb.h"
 #endif
 
+/* Axes of GulkanAxisEvent, vertical and horizontal scrolling */
+#define GULKAN_WINDOW_AXIS_COUNT 2
+
 typedef struct _GulkanWindowPrivate
 {
   GObject parent;
+
+  gboolean coalesce_input;
+
+  gboolean   has_position;
+  VkOffset2D position;
+
+  /* Summed scrolling, fractions stay for the next flush */
+  double axis[GULKAN_WINDOW_AXIS_COUNT];
 } GulkanWindowPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (GulkanWindow, gulkan_window, G_TYPE_OBJECT)
@@ -101,15 +112,16 @@ gulkan_window_new (VkExtent2D extent, const char *title)
 static void
 gulkan_window_init (GulkanWindow *self)
 {
-  (void) self;
+  GulkanWindowPrivate *priv = gulkan_window_get_instance_private (self);
+  priv->coalesce_input = FALSE;
+  priv->has_position = FALSE;
+  for (uint32_t i = 0; i < GULKAN_WINDOW_AXIS_COUNT; i++)
+    priv->axis[i] = 0.0;
 }
 
 static void
 _finalize (GObject *gobject)
 {
-  GulkanWindow        *self = GULKAN_WINDOW (gobject);
-  GulkanWindowPrivate *priv = gulkan_window_get_instance_private (self);
-  (void) priv;
   G_OBJECT_CLASS (gulkan_window_parent_class)->finalize (gobject);
 }
 
@@ -149,6 +161,214 @@ gulkan_window_poll_events (GulkanWindow *self)
   klass->poll_events (self);
 }
 
+/*
+ * Sleeps on the connection fd of the window and dispatches its events when
+ * it becomes readable. Backends may have read events into their queue
+ * already, which prepare_events reports, since the fd won't wake for them.
+ */
+typedef struct
+{
+  GSource       source;
+  GulkanWindow *window;
+  gpointer      fd_tag;
+} GulkanWindowSource;
+
+static gboolean
+_source_prepare (GSource *source, gint *timeout)
+{
+  GulkanWindowSource *self = (GulkanWindowSource *) source;
+  GulkanWindowClass  *klass = GULKAN_WINDOW_GET_CLASS (self->window);
+
+  *timeout = -1;
+
+  if (klass->prepare_events == NULL)
+    return FALSE;
+  return klass->prepare_events (self->window);
+}
+
+static gboolean
+_source_check (GSource *source)
+{
+  GulkanWindowSource *self = (GulkanWindowSource *) source;
+  return g_source_query_unix_fd (source, self->fd_tag) != 0;
+}
+
+static gboolean
+_source_dispatch (GSource *source, GSourceFunc callback, gpointer user_data)
+{
+  GulkanWindowSource *self = (GulkanWindowSource *) source;
+
+  GIOCondition condition = g_source_query_unix_fd (source, self->fd_tag);
+  if (condition & (G_IO_ERR | G_IO_HUP))
+    {
+      g_printerr ("Lost connection to the window system.\n");
+      return G_SOURCE_REMOVE;
+    }
+
+  gulkan_window_poll_events (self->window);
+
+  if (callback)
+    return callback (user_data);
+
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+_source_finalize (GSource *source)
+{
+  GulkanWindowSource *self = (GulkanWindowSource *) source;
+  g_object_unref (self->window);
+}
+
+static GSourceFuncs _source_funcs = {
+  .prepare = _source_prepare,
+  .check = _source_check,
+  .dispatch = _source_dispatch,
+  .finalize = _source_finalize,
+};
+
+/**
+ * gulkan_window_create_source:
+ * @self: a #GulkanWindow
+ *
+ * Creates a source that dispatches the window events when they arrive, so an
+ * idle main loop sleeps instead of polling the window. Replaces calling
+ * gulkan_window_poll_events() periodically. The optional callback, set with
+ * g_source_set_callback(), runs after the events were dispatched.
+ *
+ * Returns: (transfer full) (nullable): a #GSource to attach to a
+ * #GMainContext, or %NULL if the backend has no connection fd
+ */
+GSource *
+gulkan_window_create_source (GulkanWindow *self)
+{
+  GulkanWindowClass *klass = GULKAN_WINDOW_GET_CLASS (self);
+  if (klass->get_fd == NULL)
+    return NULL;
+
+  int fd = klass->get_fd (self);
+  if (fd < 0)
+    return NULL;
+
+  GSource *source = g_source_new (&_source_funcs, sizeof (GulkanWindowSource));
+  g_source_set_name (source, "GulkanWindow");
+
+  GulkanWindowSource *window_source = (GulkanWindowSource *) source;
+  window_source->window = g_object_ref (self);
+  window_source->fd_tag = g_source_add_unix_fd (source, fd,
+                                                G_IO_IN | G_IO_ERR | G_IO_HUP);
+
+  return source;
+}
+
+/**
+ * gulkan_window_request_frame:
+ * @self: a #GulkanWindow
+ *
+ * Requests a "frame-ready" signal for when the window system is ready for a
+ * new frame. Needs to be called before presenting the current one. Windows
+ * that are hidden don't signal until they are visible again.
+ */
+void
+gulkan_window_request_frame (GulkanWindow *self)
+{
+  GulkanWindowClass *klass = GULKAN_WINDOW_GET_CLASS (self);
+  if (klass->request_frame == NULL)
+    return;
+  klass->request_frame (self);
+}
+
+/**
+ * gulkan_window_set_coalesce_input:
+ * @self: a #GulkanWindow
+ * @coalesce_input: whether to accumulate pointer events
+ *
+ * High rate pointers send far more events than frames are drawn. When
+ * coalescing, "pointer-position" is only emitted with the latest position,
+ * and "pointer-axis" once per axis with the whole units of the summed
+ * value, on gulkan_window_flush_input(). Fractions of smooth scrolling are
+ * kept for the next flush. This happens before "frame-ready" and before
+ * button and key events, which are still delivered right away, so they
+ * stay in order with the pointer. Disabling emits pending events.
+ */
+void
+gulkan_window_set_coalesce_input (GulkanWindow *self, gboolean coalesce_input)
+{
+  GulkanWindowPrivate *priv = gulkan_window_get_instance_private (self);
+
+  if (!coalesce_input)
+    {
+      gulkan_window_flush_input (self);
+      for (uint32_t i = 0; i < GULKAN_WINDOW_AXIS_COUNT; i++)
+        priv->axis[i] = 0.0;
+    }
+
+  priv->coalesce_input = coalesce_input;
+}
+
+/**
+ * gulkan_window_flush_input:
+ * @self: a #GulkanWindow
+ *
+ * Emits the pointer events accumulated since the last flush. Applications
+ * that do not render on "frame-ready" call this once per frame.
+ */
+void
+gulkan_window_flush_input (GulkanWindow *self)
+{
+  GulkanWindowPrivate *priv = gulkan_window_get_instance_private (self);
+
+  if (priv->has_position)
+    {
+      priv->has_position = FALSE;
+      GulkanPositionEvent event = {
+        .offset = priv->position,
+      };
+      g_signal_emit_by_name (self, "pointer-position", &event);
+    }
+
+  for (uint32_t i = 0; i < GULKAN_WINDOW_AXIS_COUNT; i++)
+    {
+      int32_t value = (int32_t) priv->axis[i];
+      if (value == 0)
+        continue;
+
+      GulkanAxisEvent event = {
+        .axis = i,
+        .value = value,
+      };
+      priv->axis[i] -= value;
+      g_signal_emit_by_name (self, "pointer-axis", &event);
+    }
+}
+
+gboolean
+gulkan_window_queue_position (GulkanWindow *self, VkOffset2D offset)
+{
+  GulkanWindowPrivate *priv = gulkan_window_get_instance_private (self);
+
+  if (!priv->coalesce_input)
+    return FALSE;
+
+  priv->position = offset;
+  priv->has_position = TRUE;
+
+  return TRUE;
+}
+
+gboolean
+gulkan_window_queue_axis (GulkanWindow *self, uint32_t axis, double value)
+{
+  GulkanWindowPrivate *priv = gulkan_window_get_instance_private (self);
+
+  if (!priv->coalesce_input || axis >= GULKAN_WINDOW_AXIS_COUNT)
+    return FALSE;
+
+  priv->axis[axis] += value;
+
+  return TRUE;
+}
+
 void
 gulkan_window_toggle_fullscreen (GulkanWindow *self)
 {
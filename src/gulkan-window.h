@@ -67,6 +67,12 @@ struct _GulkanWindowClass
 
   void (*poll_events) (GulkanWindow *self);
 
+  int (*get_fd) (GulkanWindow *self);
+
+  gboolean (*prepare_events) (GulkanWindow *self);
+
+  void (*request_frame) (GulkanWindow *self);
+
   void (*toggle_fullscreen) (GulkanWindow *self);
 
   gboolean (*has_support) (GulkanWindow *self, GulkanContext *context);
@@ -88,6 +94,18 @@ gulkan_window_required_extensions (GulkanWindow *self);
 void
 gulkan_window_poll_events (GulkanWindow *self);
 
+GSource *
+gulkan_window_create_source (GulkanWindow *self);
+
+void
+gulkan_window_request_frame (GulkanWindow *self);
+
+void
+gulkan_window_set_coalesce_input (GulkanWindow *self, gboolean coalesce_input);
+
+void
+gulkan_window_flush_input (GulkanWindow *self);
+
 void
 gulkan_window_toggle_fullscreen (GulkanWindow *self);
 
@@ -16,13 +16,17 @@
 
 #include "gulkan-buffer.h"
 #include "gulkan-cmd-buffer.h"
+#include "gulkan-compute-pipeline.h"
 #include "gulkan-context.h"
 #include "gulkan-descriptor-pool.h"
 #include "gulkan-descriptor-set.h"
 #include "gulkan-device.h"
+#include "gulkan-dmabuf-cache.h"
 #include "gulkan-frame-buffer.h"
 #include "gulkan-geometry.h"
+#include "gulkan-indirect-buffer.h"
 #include "gulkan-instance.h"
+#include "gulkan-mesh-pool.h"
 #include "gulkan-pipeline.h"
 #include "gulkan-queue.h"
 #include "gulkan-render-pass.h"
@@ -33,6 +37,7 @@
 #include "gulkan-uniform-buffer.h"
 #include "gulkan-version.h"
 #include "gulkan-vertex-buffer.h"
+#include "gulkan-vertex-format.h"
 #include "gulkan-window.h"
 
 #undef GULKAN_INSIDE
@@ -7,6 +7,11 @@
 
 #include "gulkan.h"
 
+#include <unistd.h>
+
+#include "gulkan-indirect-buffer-private.h"
+#include "gulkan-vertex-buffer-private.h"
+
 static void
 _test_minimal ()
 {
@@ -47,11 +52,730 @@ _test_extensions ()
   g_object_unref (instance);
 }
 
+static void
+_test_sampler_cache ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert_nonnull (instance);
+
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert_nonnull (device);
+
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE, NULL));
+
+  VkSamplerCreateInfo info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+    .magFilter = VK_FILTER_LINEAR,
+    .minFilter = VK_FILTER_LINEAR,
+    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+    .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .maxLod = VK_LOD_CLAMP_NONE,
+  };
+
+  VkSampler a = gulkan_device_request_sampler (device, &info);
+  VkSampler b = gulkan_device_request_sampler (device, &info);
+  g_assert (a != VK_NULL_HANDLE);
+  g_assert (a == b);
+
+  info.magFilter = VK_FILTER_NEAREST;
+  VkSampler c = gulkan_device_request_sampler (device, &info);
+  g_assert (c != VK_NULL_HANDLE);
+  g_assert (c != a);
+
+  gulkan_device_release_sampler (device, a);
+  gulkan_device_release_sampler (device, b);
+  gulkan_device_release_sampler (device, c);
+
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
+static void
+_test_ycbcr_conversion ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert_nonnull (instance);
+
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert_nonnull (device);
+
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE, NULL));
+
+  /* A single plane 4:2:2 format, which still needs a conversion */
+  VkFormat           format = VK_FORMAT_G8B8G8R8_422_UNORM;
+  VkFormatProperties props = gulkan_device_get_format_properties (device,
+                                                                  format);
+  if (!gulkan_device_supports_ycbcr_conversion (device)
+      || !(props.optimalTilingFeatures
+           & VK_FORMAT_FEATURE_MIDPOINT_CHROMA_SAMPLES_BIT))
+    {
+      g_object_unref (device);
+      g_object_unref (instance);
+      return;
+    }
+
+  VkSamplerYcbcrConversionCreateInfo conversion_info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_CREATE_INFO,
+    .format = format,
+    .ycbcrModel = VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_709,
+    .ycbcrRange = VK_SAMPLER_YCBCR_RANGE_ITU_NARROW,
+    .xChromaOffset = VK_CHROMA_LOCATION_MIDPOINT,
+    .yChromaOffset = VK_CHROMA_LOCATION_MIDPOINT,
+    .chromaFilter = VK_FILTER_NEAREST,
+  };
+
+  VkSamplerYcbcrConversion a
+    = gulkan_device_request_ycbcr_conversion (device, &conversion_info);
+  VkSamplerYcbcrConversion b
+    = gulkan_device_request_ycbcr_conversion (device, &conversion_info);
+  g_assert (a != VK_NULL_HANDLE);
+  g_assert (a == b);
+
+  conversion_info.ycbcrModel = VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_601;
+  VkSamplerYcbcrConversion c
+    = gulkan_device_request_ycbcr_conversion (device, &conversion_info);
+  g_assert (c != VK_NULL_HANDLE);
+  g_assert (c != a);
+
+  /* Samplers with different conversions are not shared */
+  VkSamplerYcbcrConversionInfo sampler_conversion = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
+    .conversion = a,
+  };
+  VkSamplerCreateInfo sampler_info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+    .pNext = &sampler_conversion,
+    .magFilter = VK_FILTER_NEAREST,
+    .minFilter = VK_FILTER_NEAREST,
+    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+  };
+
+  VkSampler sampler_a = gulkan_device_request_sampler (device, &sampler_info);
+  sampler_conversion.conversion = c;
+  VkSampler sampler_c = gulkan_device_request_sampler (device, &sampler_info);
+  g_assert (sampler_a != VK_NULL_HANDLE);
+  g_assert (sampler_c != VK_NULL_HANDLE);
+  g_assert (sampler_a != sampler_c);
+
+  gulkan_device_release_sampler (device, sampler_a);
+  gulkan_device_release_sampler (device, sampler_c);
+
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
+static void
+_test_queue_counts ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert_nonnull (instance);
+
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert_nonnull (device);
+
+  gulkan_device_set_queue_count (device, GULKAN_QUEUE_GRAPHICS, 2);
+
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE, NULL));
+
+  g_assert_cmpuint (gulkan_device_get_queue_count (device,
+                                                   GULKAN_QUEUE_GRAPHICS),
+                    ==, 2);
+  g_assert_nonnull (gulkan_device_get_queue (device, GULKAN_QUEUE_GRAPHICS, 1));
+  g_assert_null (gulkan_device_get_queue (device, GULKAN_QUEUE_GRAPHICS, 2));
+
+  GulkanQueue *compute = gulkan_device_get_compute_queue (device);
+  g_assert_nonnull (compute);
+  g_assert (gulkan_queue_get_handle (compute) != VK_NULL_HANDLE);
+
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
+static void
+_test_buffer_export ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert_nonnull (instance);
+
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert_nonnull (device);
+
+  GSList *extensions = NULL;
+  extensions = g_slist_append (extensions, "VK_KHR_external_memory_fd");
+
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE,
+                                  extensions));
+
+  g_slist_free (extensions);
+
+  VkBufferUsageFlags    usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+  /* Plain buffers don't carry external memory */
+  GulkanBuffer *plain = gulkan_buffer_new (device, 4096, usage, properties);
+  g_assert_nonnull (plain);
+
+  int fd = -1;
+  g_assert_false (
+    gulkan_buffer_export_fd (plain, VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+                             &fd));
+
+  GulkanBuffer *exportable = gulkan_buffer_new_exportable (device, 4096, usage,
+                                                           properties);
+  g_assert_nonnull (exportable);
+
+  g_assert (
+    gulkan_buffer_export_fd (exportable,
+                             VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT,
+                             &fd));
+  g_assert_cmpint (fd, >=, 0);
+  close (fd);
+
+  /* Without VK_EXT_external_memory_dma_buf dmabufs are not exported */
+  VkExternalMemoryHandleTypeFlagBits dma_buf
+    = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+  g_assert_false (gulkan_device_supports_memory_handle_type (device, dma_buf));
+  g_assert_false (gulkan_buffer_export_fd (exportable, dma_buf, &fd));
+
+  g_object_unref (exportable);
+  g_object_unref (plain);
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
+static void
+_test_indirect_buffer ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE, NULL));
+
+  GulkanIndirectBuffer *indirect = gulkan_indirect_buffer_new (device, 2, 2);
+  g_assert_nonnull (indirect);
+  g_assert_cmpuint (gulkan_indirect_buffer_get_draw_count (indirect), ==, 0);
+
+  /* Drawing the whole capacity of a new buffer only adds empty draws */
+  const VkDrawIndexedIndirectCommand *commands
+    = gulkan_indirect_buffer_get_commands (indirect);
+  VkDrawIndexedIndirectCommand empty = {0};
+  for (uint32_t i = 0; i < 2; i++)
+    g_assert (memcmp (&commands[i], &empty, sizeof (empty)) == 0);
+
+  VkDrawIndexedIndirectCommand cmds[3] = {
+    {.indexCount = 36, .instanceCount = 1},
+    {.indexCount = 6, .instanceCount = 4, .firstIndex = 36},
+    {.indexCount = 3, .instanceCount = 1, .vertexOffset = 8},
+  };
+
+  gulkan_indirect_buffer_reset (indirect, 0);
+  g_assert (gulkan_indirect_buffer_append (indirect, &cmds[0]));
+  g_assert (gulkan_indirect_buffer_append (indirect, &cmds[1]));
+  g_assert_cmpuint (gulkan_indirect_buffer_get_draw_count (indirect), ==, 2);
+
+  g_assert (!gulkan_indirect_buffer_set_commands (indirect, 0, cmds, 3));
+  g_assert (gulkan_indirect_buffer_set_commands (indirect, 0, &cmds[1], 1));
+  g_assert_cmpuint (gulkan_indirect_buffer_get_draw_count (indirect), ==, 1);
+  g_assert (memcmp (&commands[0], &cmds[1], sizeof (empty)) == 0);
+  g_assert (memcmp (&commands[1], &empty, sizeof (empty)) == 0);
+
+  gulkan_indirect_buffer_reset (indirect, 0);
+  g_assert_cmpuint (gulkan_indirect_buffer_get_draw_count (indirect), ==, 0);
+  g_assert (memcmp (&commands[0], &empty, sizeof (empty)) == 0);
+
+  /* Each frame slot writes its own slice */
+  g_assert (gulkan_indirect_buffer_set_commands (indirect, 0, cmds, 1));
+  g_assert (gulkan_indirect_buffer_set_commands (indirect, 1, cmds, 2));
+  g_assert_cmpuint (gulkan_indirect_buffer_get_draw_count (indirect), ==, 2);
+  const VkDrawIndexedIndirectCommand *next_commands
+    = gulkan_indirect_buffer_get_commands (indirect);
+  g_assert (next_commands != commands);
+  g_assert (memcmp (&next_commands[1], &cmds[1], sizeof (empty)) == 0);
+  g_assert (memcmp (&commands[1], &empty, sizeof (empty)) == 0);
+
+  gulkan_indirect_buffer_reset (indirect, 2);
+  g_assert (gulkan_indirect_buffer_get_commands (indirect) == commands);
+  g_assert_cmpuint (gulkan_indirect_buffer_get_draw_count (indirect), ==, 0);
+  g_assert (memcmp (&next_commands[0], &cmds[0], sizeof (empty)) == 0);
+
+  /* The GPU reset clears the commands of the slice as well */
+  g_assert (gulkan_indirect_buffer_set_commands (indirect, 0, cmds, 2));
+
+  GulkanQueue     *queue = gulkan_device_get_graphics_queue (device);
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  g_assert (gulkan_cmd_buffer_begin_one_time (cmd_buffer));
+  gulkan_indirect_buffer_cmd_reset_count (indirect, 1,
+                                          gulkan_cmd_buffer_get_handle (
+                                            cmd_buffer));
+  g_assert (gulkan_queue_end_submit (queue, cmd_buffer));
+  gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+
+  g_assert_cmpuint (gulkan_indirect_buffer_get_draw_count (indirect), ==, 0);
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      g_assert (memcmp (&next_commands[i], &empty, sizeof (empty)) == 0);
+      g_assert (memcmp (&commands[i], &cmds[i], sizeof (empty)) == 0);
+    }
+
+  g_object_unref (indirect);
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
+/* Copies the start of @buffer through the device, as a draw would read it */
+static void
+_read_back (GulkanDevice *device,
+            GulkanBuffer *buffer,
+            void         *data,
+            VkDeviceSize  size)
+{
+  GulkanBuffer *host
+    = gulkan_buffer_new (device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                           | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  g_assert_nonnull (host);
+
+  GulkanQueue     *queue = gulkan_device_get_graphics_queue (device);
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  g_assert (gulkan_cmd_buffer_begin_one_time (cmd_buffer));
+
+  VkBufferCopy region = {.size = size};
+  vkCmdCopyBuffer (gulkan_cmd_buffer_get_handle (cmd_buffer),
+                   gulkan_buffer_get_handle (buffer),
+                   gulkan_buffer_get_handle (host), 1, &region);
+
+  g_assert (gulkan_queue_end_submit (queue, cmd_buffer));
+  gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+
+  void *map;
+  g_assert (gulkan_buffer_map (host, &map));
+  memcpy (data, map, size);
+  gulkan_buffer_unmap (host);
+
+  g_object_unref (host);
+}
+
+static void
+_test_mesh_pool ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE, NULL));
+
+  GulkanMeshPool *pool = gulkan_mesh_pool_new (device, sizeof (float) * 3, 9,
+                                               9);
+  g_assert_nonnull (pool);
+
+  /* Three triangles with distinct vertices and index orders */
+  float vertices[3][9];
+  for (uint32_t i = 0; i < 3; i++)
+    for (uint32_t j = 0; j < 9; j++)
+      vertices[i][j] = (float) (i * 10 + j + 1);
+
+  uint32_t indices[3][3] = {
+    {0, 1, 2},
+    {2, 1, 0},
+    {1, 2, 0},
+  };
+
+  guint a = gulkan_mesh_pool_add (pool, vertices[0], 3, indices[0], 3);
+  guint b = gulkan_mesh_pool_add (pool, vertices[1], 3, indices[1], 3);
+  guint c = gulkan_mesh_pool_add (pool, vertices[2], 3, indices[2], 3);
+  g_assert (a && b && c);
+  g_assert_cmpuint (gulkan_mesh_pool_add (pool, vertices[0], 3, indices[0], 3),
+                    ==, 0);
+
+  GulkanMeshRange range;
+  g_assert (gulkan_mesh_pool_get_range (pool, c, &range));
+  g_assert_cmpint (range.vertex_offset, ==, 6);
+  g_assert_cmpuint (range.first_index, ==, 6);
+
+  gulkan_mesh_pool_remove (pool, b);
+  g_assert_cmpuint (gulkan_mesh_pool_get_mesh_count (pool), ==, 2);
+
+  /* The hole of b is still read by frames in flight. */
+  g_assert (!gulkan_mesh_pool_collect (pool, G_MAXUINT64));
+  g_assert (gulkan_mesh_pool_collect (pool, G_MAXUINT64));
+
+  g_assert (gulkan_mesh_pool_get_range (pool, c, &range));
+  g_assert_cmpint (range.vertex_offset, ==, 3);
+  g_assert_cmpuint (range.first_index, ==, 3);
+
+  /* c was copied into the hole of b, a did not move */
+  float    pool_vertices[18];
+  uint32_t pool_indices[6];
+  _read_back (device, gulkan_mesh_pool_get_vertex_buffer (pool), pool_vertices,
+              sizeof (pool_vertices));
+  _read_back (device, gulkan_mesh_pool_get_index_buffer (pool), pool_indices,
+              sizeof (pool_indices));
+
+  g_assert (memcmp (pool_vertices, vertices[0], sizeof (vertices[0])) == 0);
+  g_assert (memcmp (&pool_vertices[9], vertices[2], sizeof (vertices[2]))
+            == 0);
+  g_assert (memcmp (pool_indices, indices[0], sizeof (indices[0])) == 0);
+  g_assert (memcmp (&pool_indices[3], indices[2], sizeof (indices[2])) == 0);
+
+  VkDrawIndexedIndirectCommand command;
+  g_assert (gulkan_mesh_pool_get_draw_command (pool, c, 4, &command));
+  g_assert_cmpuint (command.instanceCount, ==, 4);
+  g_assert_cmpint (command.vertexOffset, ==, 3);
+  g_assert (!gulkan_mesh_pool_get_draw_command (pool, b, 1, &command));
+
+  g_object_unref (pool);
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
+static void
+_test_vertex_buffer_formats ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE, NULL));
+
+  GulkanVertexBuffer *vb
+    = gulkan_vertex_buffer_new (device, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+  float    positions[9] = {0, 0, 0, 1, 0, 0, 0, 1, 0};
+  float    colors[12] = {1, 0, 0, 1, 0, 1, 0, 1, 0, 0, 1, 1};
+  uint16_t half_positions[12];
+  uint8_t  unorm_colors[12];
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      gulkan_vertex_pack_half (&positions[i * 3], &half_positions[i * 4], 3);
+      half_positions[i * 4 + 3] = 0x3c00;
+    }
+  gulkan_vertex_pack_unorm8 (colors, unorm_colors, 12);
+
+  /* Packed formats keep their own element size as binding stride */
+  gulkan_vertex_buffer_add_attribute_format (vb,
+                                             VK_FORMAT_R16G16B16A16_SFLOAT,
+                                             sizeof (half_positions), 0,
+                                             (uint8_t *) half_positions);
+  gulkan_vertex_buffer_add_attribute_format (vb, VK_FORMAT_R8G8B8A8_UNORM,
+                                             sizeof (unorm_colors), 0,
+                                             unorm_colors);
+  gulkan_vertex_buffer_add_attribute (vb, 3, sizeof (positions), 0,
+                                      (uint8_t *) positions);
+  g_assert (gulkan_vertex_buffer_upload (vb));
+
+  g_assert_cmpuint (gulkan_vertex_buffer_get_binding_count (vb), ==, 3);
+  g_assert_cmpuint (gulkan_vertex_buffer_get_attrib_count (vb), ==, 3);
+
+  VkVertexInputBindingDescription *bindings
+    = gulkan_vertex_buffer_create_binding_desc (vb);
+  g_assert_cmpuint (bindings[0].stride, ==, 8);
+  g_assert_cmpuint (bindings[1].stride, ==, 4);
+  g_assert_cmpuint (bindings[2].stride, ==, 12);
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      g_assert_cmpuint (bindings[i].binding, ==, i);
+      g_assert_cmpuint (bindings[i].inputRate, ==, VK_VERTEX_INPUT_RATE_VERTEX);
+    }
+  g_free (bindings);
+
+  VkVertexInputAttributeDescription *attribs
+    = gulkan_vertex_buffer_create_attrib_desc (vb);
+  g_assert_cmpuint (attribs[0].format, ==, VK_FORMAT_R16G16B16A16_SFLOAT);
+  g_assert_cmpuint (attribs[1].format, ==, VK_FORMAT_R8G8B8A8_UNORM);
+  g_assert_cmpuint (attribs[2].format, ==, VK_FORMAT_R32G32B32_SFLOAT);
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      g_assert_cmpuint (attribs[i].location, ==, i);
+      g_assert_cmpuint (attribs[i].binding, ==, i);
+      g_assert_cmpuint (attribs[i].offset, ==, 0);
+    }
+  g_free (attribs);
+
+  g_object_unref (vb);
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
+static void
+_test_dynamic_vertex_buffer ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE, NULL));
+
+  GulkanVertexBuffer *vb
+    = gulkan_vertex_buffer_new (device, VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
+
+  float line[6] = {0, 0, 0, 1, 1, 1};
+
+  g_assert (!gulkan_vertex_buffer_update_range (vb, 0, line, sizeof (line)));
+  g_assert_null (gulkan_vertex_buffer_get_dynamic_data (vb, 0));
+  g_assert (gulkan_vertex_buffer_alloc_dynamic (vb, sizeof (line) * 4, 3));
+  g_assert (gulkan_vertex_buffer_is_initialized (vb));
+
+  /* Each frame writes one line, into the slice of its slot only */
+  float lines[4][6];
+  for (uint32_t i = 0; i < 4; i++)
+    for (uint32_t j = 0; j < 6; j++)
+      lines[i][j] = (float) (i * 6 + j);
+
+  for (uint32_t frame = 0; frame < 4; frame++)
+    {
+      g_assert (gulkan_vertex_buffer_next_frame (vb, frame));
+      g_assert (gulkan_vertex_buffer_update_range (vb, sizeof (line) * frame,
+                                                   lines[frame],
+                                                   sizeof (line)));
+    }
+
+  /* Slot 0 wrote the last line, the older slots catch up when reused */
+  const uint8_t *slice = gulkan_vertex_buffer_get_dynamic_data (vb, 0);
+  g_assert (memcmp (slice, lines, sizeof (lines)) == 0);
+
+  slice = gulkan_vertex_buffer_get_dynamic_data (vb, 1);
+  g_assert (memcmp (slice, lines, sizeof (lines[0]) * 2) == 0);
+  g_assert (gulkan_vertex_buffer_next_frame (vb, 4));
+  g_assert (memcmp (slice, lines, sizeof (lines)) == 0);
+
+  slice = gulkan_vertex_buffer_get_dynamic_data (vb, 2);
+  g_assert (memcmp (slice, lines, sizeof (lines[0]) * 3) == 0);
+  g_assert (gulkan_vertex_buffer_next_frame (vb, 5));
+  g_assert (memcmp (slice, lines, sizeof (lines)) == 0);
+
+  g_assert (!gulkan_vertex_buffer_update_range (vb, sizeof (line) * 4, line,
+                                                sizeof (line)));
+
+  /* Position and color vertices are 6 floats, 4 of them fit */
+  graphene_vec3_t color;
+  graphene_vec3_init (&color, 1, 0, 0);
+  g_assert (gulkan_vertex_buffer_write_with_color (vb, 0, line, 2, NULL,
+                                                   &color));
+  g_assert (gulkan_vertex_buffer_write_with_color (vb, 2, line, 2, NULL,
+                                                   &color));
+  g_assert (!gulkan_vertex_buffer_write_with_color (vb, 3, line, 2, NULL,
+                                                    &color));
+
+  g_object_unref (vb);
+
+  /* Rays rebuilt in the vertex array each frame are mapped to their slot */
+  vb = gulkan_vertex_buffer_new (device, VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
+  g_assert (gulkan_vertex_buffer_alloc_dynamic (vb, sizeof (line) * 2, 2));
+
+  graphene_vec4_t   center;
+  graphene_matrix_t mat;
+  graphene_vec4_init (&center, 0, 0, 0, 1);
+  graphene_matrix_init_translate (&mat, &GRAPHENE_POINT3D_INIT (1, 2, 3));
+
+  for (uint32_t frame = 0; frame < 2; frame++)
+    {
+      g_assert (gulkan_vertex_buffer_next_frame (vb, frame));
+      gulkan_vertex_buffer_reset (vb);
+      gulkan_geometry_append_ray (vb, &center, (float) (frame + 1), &mat);
+      g_assert (gulkan_vertex_buffer_map_array (vb));
+    }
+
+  for (uint32_t frame = 0; frame < 2; frame++)
+    {
+      const uint8_t *data = gulkan_vertex_buffer_get_dynamic_data (vb, frame);
+      const float   *ray = (const float *) (const void *) data;
+      g_assert_cmpfloat (ray[0], ==, 1.0f);
+      g_assert_cmpfloat (ray[2], ==, 3.0f);
+      g_assert_cmpfloat (ray[7], ==, 2.0f);
+      g_assert_cmpfloat (ray[8], ==, 3.0f - (float) (frame + 1));
+    }
+
+  g_object_unref (vb);
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
+static void
+_test_write_with_color ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE, NULL));
+
+  GulkanVertexBuffer *vb
+    = gulkan_vertex_buffer_new (device, VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
+  g_assert (gulkan_vertex_buffer_alloc_dynamic (vb, 6 * sizeof (float) * 8,
+                                                2));
+  g_assert (gulkan_vertex_buffer_next_frame (vb, 0));
+
+  /* An odd count leaves a vertex for the scalar tail of the SIMD loop */
+  float positions[5 * 3];
+  for (uint32_t i = 0; i < G_N_ELEMENTS (positions); i++)
+    positions[i] = (float) i * 0.5f - 3.0f;
+
+  graphene_matrix_t mat;
+  graphene_matrix_init_scale (&mat, 2.0f, 0.5f, 1.5f);
+  graphene_matrix_rotate_y (&mat, 30.0f);
+  graphene_matrix_translate (&mat, &GRAPHENE_POINT3D_INIT (1, -2, 3));
+
+  graphene_vec3_t color;
+  graphene_vec3_init (&color, 0.25f, 0.5f, 0.75f);
+
+  g_assert (gulkan_vertex_buffer_write_with_color (vb, 1, positions, 5, &mat,
+                                                   &color));
+  g_assert_cmpuint (gulkan_vertex_buffer_get_vertex_count (vb), ==, 6);
+
+  const uint8_t *data = gulkan_vertex_buffer_get_dynamic_data (vb, 0);
+  const float   *vertices = (const float *) (const void *) data;
+  for (uint32_t i = 0; i < 5; i++)
+    {
+      graphene_vec4_t position;
+      graphene_vec4_init (&position, positions[i * 3], positions[i * 3 + 1],
+                          positions[i * 3 + 2], 1.0f);
+      graphene_matrix_transform_vec4 (&mat, &position, &position);
+
+      float expected[4];
+      graphene_vec4_to_float (&position, expected);
+
+      const float *vertex = &vertices[(i + 1) * 6];
+      for (uint32_t j = 0; j < 3; j++)
+        g_assert_cmpfloat_with_epsilon (vertex[j], expected[j], 1e-4f);
+      g_assert_cmpfloat (vertex[3], ==, 0.25f);
+      g_assert_cmpfloat (vertex[4], ==, 0.5f);
+      g_assert_cmpfloat (vertex[5], ==, 0.75f);
+    }
+
+  /* Updating earlier vertices keeps the later ones drawn */
+  g_assert (gulkan_vertex_buffer_write_with_color (vb, 0, positions, 1, NULL,
+                                                   &color));
+  g_assert_cmpuint (gulkan_vertex_buffer_get_vertex_count (vb), ==, 6);
+  for (uint32_t j = 0; j < 3; j++)
+    g_assert_cmpfloat (vertices[j], ==, positions[j]);
+
+  g_object_unref (vb);
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
+static void
+_test_instanced_vertex_buffer ()
+{
+  GulkanInstance *instance = gulkan_instance_new ();
+  g_assert (gulkan_instance_create (instance, NULL));
+
+  GulkanDevice *device = gulkan_device_new ();
+  g_assert (gulkan_device_create (device, instance, VK_NULL_HANDLE, NULL));
+
+  /* Separate attributes, instance locations follow them */
+  GulkanVertexBuffer *vb
+    = gulkan_vertex_buffer_new (device, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+  float positions[9] = {0, 0, 0, 1, 0, 0, 0, 1, 0};
+  float uvs[6] = {0, 0, 1, 0, 0, 1};
+  gulkan_vertex_buffer_add_attribute (vb, 3, sizeof (positions), 0,
+                                      (uint8_t *) positions);
+  gulkan_vertex_buffer_add_attribute (vb, 2, sizeof (uvs), 0,
+                                      (uint8_t *) uvs);
+  gulkan_vertex_buffer_add_instance_attribute (vb, 4, 0);
+  gulkan_vertex_buffer_add_instance_attribute (vb, 2, 4 * sizeof (float));
+  g_assert (gulkan_vertex_buffer_upload (vb));
+
+  g_assert_cmpuint (gulkan_vertex_buffer_get_binding_count (vb), ==, 3);
+  g_assert_cmpuint (gulkan_vertex_buffer_get_attrib_count (vb), ==, 4);
+
+  g_assert (!gulkan_vertex_buffer_alloc_instances (vb, 0, 8, 2));
+  g_assert (gulkan_vertex_buffer_alloc_instances (vb, 6 * sizeof (float), 8,
+                                                  2));
+
+  VkVertexInputBindingDescription *bindings
+    = gulkan_vertex_buffer_create_binding_desc (vb);
+  g_assert_cmpuint (bindings[1].inputRate, ==, VK_VERTEX_INPUT_RATE_VERTEX);
+  g_assert_cmpuint (bindings[2].binding, ==, 2);
+  g_assert_cmpuint (bindings[2].stride, ==, 6 * sizeof (float));
+  g_assert_cmpuint (bindings[2].inputRate, ==, VK_VERTEX_INPUT_RATE_INSTANCE);
+  g_free (bindings);
+
+  VkVertexInputAttributeDescription *attribs
+    = gulkan_vertex_buffer_create_attrib_desc (vb);
+  g_assert_cmpuint (attribs[2].location, ==, 2);
+  g_assert_cmpuint (attribs[2].binding, ==, 2);
+  g_assert_cmpuint (attribs[2].format, ==, VK_FORMAT_R32G32B32A32_SFLOAT);
+  g_assert_cmpuint (attribs[2].offset, ==, 0);
+  g_assert_cmpuint (attribs[3].location, ==, 3);
+  g_assert_cmpuint (attribs[3].format, ==, VK_FORMAT_R32G32_SFLOAT);
+  g_assert_cmpuint (attribs[3].offset, ==, 4 * sizeof (float));
+  g_free (attribs);
+
+  /* Each frame slot has its own slice, updating one keeps the other */
+  float first[12] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+  float second[6] = {-1, -2, -3, -4, -5, -6};
+  g_assert (gulkan_vertex_buffer_update_instances (vb, 0, first, 2));
+  g_assert (gulkan_vertex_buffer_update_instances (vb, 1, second, 1));
+  g_assert_cmpuint (gulkan_vertex_buffer_get_instance_count (vb), ==, 1);
+
+  const uint8_t *slice = gulkan_vertex_buffer_get_instance_data (vb, 0);
+  g_assert (memcmp (slice, first, sizeof (first)) == 0);
+  slice = gulkan_vertex_buffer_get_instance_data (vb, 1);
+  g_assert (memcmp (slice, second, sizeof (second)) == 0);
+
+  /* Slots beyond the allocated frames wrap around */
+  g_assert (gulkan_vertex_buffer_update_instances (vb, 2, second, 1));
+  slice = gulkan_vertex_buffer_get_instance_data (vb, 0);
+  g_assert (memcmp (slice, second, sizeof (second)) == 0);
+
+  g_object_unref (vb);
+
+  /* Interleaved buffers set the location after their own attributes */
+  vb = gulkan_vertex_buffer_new (device, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+  g_assert (!gulkan_vertex_buffer_update_instances (vb, 0, first, 1));
+
+  gulkan_vertex_buffer_add_instance_attribute (vb, 4, 0);
+  gulkan_vertex_buffer_set_instance_location (vb, 2);
+
+  g_assert_cmpuint (gulkan_vertex_buffer_get_binding_count (vb), ==, 1);
+  g_assert_cmpuint (gulkan_vertex_buffer_get_attrib_count (vb), ==, 1);
+
+  bindings = gulkan_vertex_buffer_create_binding_desc (vb);
+  g_assert_cmpuint (bindings[0].binding, ==, 1);
+  g_assert_cmpuint (bindings[0].inputRate, ==, VK_VERTEX_INPUT_RATE_INSTANCE);
+  g_free (bindings);
+
+  attribs = gulkan_vertex_buffer_create_attrib_desc (vb);
+  g_assert_cmpuint (attribs[0].location, ==, 2);
+  g_assert_cmpuint (attribs[0].binding, ==, 1);
+  g_free (attribs);
+
+  g_object_unref (vb);
+  g_object_unref (device);
+  g_object_unref (instance);
+}
+
 int
 main ()
 {
   _test_minimal ();
   _test_extensions ();
+  _test_sampler_cache ();
+  _test_ycbcr_conversion ();
+  _test_queue_counts ();
+  _test_buffer_export ();
+  _test_indirect_buffer ();
+  _test_mesh_pool ();
+  _test_vertex_buffer_formats ();
+  _test_dynamic_vertex_buffer ();
+  _test_write_with_color ();
+  _test_instanced_vertex_buffer ();
 
   return 0;
 }
@@ -8,6 +8,71 @@
 #include <gulkan.h>
 
 #include "../examples/common/common.h"
+#include "gulkan-vertex-buffer-private.h"
+
+/* Records which frame slot each command buffer was recorded for */
+#define TEST_TYPE_SLOT_RENDERER test_slot_renderer_get_type ()
+G_DECLARE_FINAL_TYPE (TestSlotRenderer,
+                      test_slot_renderer,
+                      TEST,
+                      SLOT_RENDERER,
+                      GulkanSwapchainRenderer)
+
+struct _TestSlotRenderer
+{
+  GulkanSwapchainRenderer parent;
+
+  GArray *slots;
+};
+
+G_DEFINE_TYPE (TestSlotRenderer,
+               test_slot_renderer,
+               GULKAN_TYPE_SWAPCHAIN_RENDERER)
+
+static void
+test_slot_renderer_init (TestSlotRenderer *self)
+{
+  self->slots = g_array_new (FALSE, FALSE, sizeof (uint32_t));
+}
+
+static void
+_slot_renderer_finalize (GObject *gobject)
+{
+  TestSlotRenderer *self = TEST_SLOT_RENDERER (gobject);
+  g_array_unref (self->slots);
+  G_OBJECT_CLASS (test_slot_renderer_parent_class)->finalize (gobject);
+}
+
+static void
+_slot_renderer_init_draw_cmd (GulkanSwapchainRenderer *renderer,
+                              VkCommandBuffer          cmd_buffer)
+{
+  (void) cmd_buffer;
+  TestSlotRenderer *self = TEST_SLOT_RENDERER (renderer);
+  uint32_t          slot = gulkan_swapchain_renderer_get_frame_slot (renderer);
+  g_array_append_val (self->slots, slot);
+}
+
+static gboolean
+_slot_renderer_init_pipeline (GulkanSwapchainRenderer *renderer,
+                              gconstpointer            data)
+{
+  (void) renderer;
+  (void) data;
+  return TRUE;
+}
+
+static void
+test_slot_renderer_class_init (TestSlotRendererClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  object_class->finalize = _slot_renderer_finalize;
+
+  GulkanSwapchainRendererClass *parent_class
+    = GULKAN_SWAPCHAIN_RENDERER_CLASS (klass);
+  parent_class->init_draw_cmd = _slot_renderer_init_draw_cmd;
+  parent_class->init_pipeline = _slot_renderer_init_pipeline;
+}
 
 static void
 _test_without_context ()
@@ -76,11 +141,812 @@ _test_with_init ()
   g_object_unref (window);
 }
 
+static void
+_test_frame_slots ()
+{
+  VkExtent2D    extent = {100, 100};
+  GulkanWindow *window = gulkan_window_new (extent, "Test");
+  g_assert_nonnull (window);
+
+  GSList *instance_ext_list = gulkan_window_required_extensions (window);
+  GSList *device_ext_list
+    = g_slist_append (NULL, (gpointer) VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
+  GulkanContext *context
+    = gulkan_context_new_from_extensions (instance_ext_list, device_ext_list,
+                                          VK_NULL_HANDLE);
+  g_assert (gulkan_window_has_support (window, context));
+
+  g_slist_free (instance_ext_list);
+  g_slist_free (device_ext_list);
+
+  TestSlotRenderer *slot_renderer = (TestSlotRenderer *)
+    g_object_new (TEST_TYPE_SLOT_RENDERER, 0);
+  GulkanSwapchainRenderer *renderer = GULKAN_SWAPCHAIN_RENDERER (slot_renderer);
+  gulkan_renderer_set_context (GULKAN_RENDERER (slot_renderer), context);
+
+  const uint32_t slot_count = 3;
+  gulkan_swapchain_renderer_set_max_queued_frames (renderer, slot_count);
+  gulkan_swapchain_renderer_set_record_each_frame (renderer, TRUE);
+
+  VkSurfaceKHR surface;
+  VkInstance   instance = gulkan_context_get_instance_handle (context);
+  g_assert (gulkan_window_create_surface (window, instance, &surface)
+            == VK_SUCCESS);
+  g_assert (gulkan_swapchain_renderer_resize (renderer, surface, extent));
+
+  /* Every image is recorded once on resize */
+  uint32_t image_count = gulkan_swapchain_renderer_get_image_count (renderer);
+  g_assert_cmpuint (slot_renderer->slots->len, ==, image_count);
+  g_array_set_size (slot_renderer->slots, 0);
+
+  /*
+   * Draw enough frames that the acquire semaphore of each slot and the
+   * present semaphore of each image are reused several times.
+   */
+  uint32_t frame_count = 3 * MAX (image_count, slot_count);
+  for (uint32_t i = 0; i < frame_count; i++)
+    {
+      g_assert_cmpuint (gulkan_swapchain_renderer_get_frame_slot (renderer),
+                        ==, i % slot_count);
+      g_assert (gulkan_renderer_draw (GULKAN_RENDERER (slot_renderer)));
+    }
+
+  g_assert_cmpuint (slot_renderer->slots->len, ==, frame_count);
+  for (uint32_t i = 0; i < frame_count; i++)
+    g_assert_cmpuint (g_array_index (slot_renderer->slots, uint32_t, i), ==,
+                      i % slot_count);
+
+  /* The ring is resized on the next resize */
+  gulkan_swapchain_renderer_set_max_queued_frames (renderer, 1);
+  g_assert (gulkan_swapchain_renderer_resize (renderer, surface, extent));
+  g_array_set_size (slot_renderer->slots, 0);
+
+  for (uint32_t i = 0; i < image_count + 1; i++)
+    g_assert (gulkan_renderer_draw (GULKAN_RENDERER (slot_renderer)));
+
+  g_assert_cmpuint (slot_renderer->slots->len, ==, image_count + 1);
+  for (uint32_t i = 0; i < slot_renderer->slots->len; i++)
+    g_assert_cmpuint (g_array_index (slot_renderer->slots, uint32_t, i), ==, 0);
+
+  gulkan_device_wait_idle (gulkan_context_get_device (context));
+
+  g_object_unref (slot_renderer);
+  g_object_unref (context);
+  g_object_unref (window);
+}
+
+static void
+_test_compute_pipeline ()
+{
+  GulkanContext *context = gulkan_context_new ();
+  g_assert_nonnull (context);
+
+  GulkanDevice *device = gulkan_context_get_device (context);
+
+  VkDescriptorSetLayoutBinding bindings[] = {
+    {
+      .binding = 0,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
+  };
+
+  GulkanDescriptorPool *pool = GULKAN_DESCRIPTOR_POOL_NEW (context, bindings,
+                                                           1);
+  g_assert_nonnull (pool);
+
+  GulkanComputePipelineConfig config = {
+    .shader_uri = "/shaders/invert.comp.spv",
+    .local_size = {16, 1, 1},
+  };
+  GulkanComputePipeline *pipeline = gulkan_compute_pipeline_new (context, pool,
+                                                                 &config);
+  g_assert_nonnull (pipeline);
+
+  VkExtent3D groups
+    = gulkan_compute_pipeline_get_group_count (pipeline,
+                                               (VkExtent3D){50, 1, 1});
+  g_assert_cmpuint (groups.width, ==, 4);
+  g_assert_cmpuint (groups.height, ==, 1);
+
+  uint32_t values[50];
+  for (uint32_t i = 0; i < G_N_ELEMENTS (values); i++)
+    values[i] = i;
+
+  GulkanBuffer *buffer
+    = gulkan_buffer_new_from_data (device, values, sizeof (values),
+                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                     | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  g_assert_nonnull (buffer);
+
+  GulkanDescriptorSet *set = gulkan_descriptor_pool_create_set (pool);
+  gulkan_descriptor_set_update_storage_buffer (set, 0, buffer);
+
+  GulkanQueue     *queue = gulkan_device_get_compute_queue (device);
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  g_assert (gulkan_cmd_buffer_begin_one_time (cmd_buffer));
+
+  VkCommandBuffer cmd = gulkan_cmd_buffer_get_handle (cmd_buffer);
+  gulkan_compute_pipeline_bind (pipeline, cmd);
+  gulkan_descriptor_set_bind_compute (set,
+                                      gulkan_compute_pipeline_get_layout (
+                                        pipeline),
+                                      cmd);
+  gulkan_compute_pipeline_dispatch (pipeline, cmd, (VkExtent3D){50, 1, 1});
+
+  g_assert (gulkan_queue_end_submit (queue, cmd_buffer));
+  gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+
+  uint32_t *result;
+  g_assert (gulkan_buffer_map (buffer, (void **) &result));
+  for (uint32_t i = 0; i < G_N_ELEMENTS (values); i++)
+    g_assert_cmpuint (result[i], ==, ~i);
+  gulkan_buffer_unmap (buffer);
+
+  g_object_unref (set);
+  g_object_unref (buffer);
+  g_object_unref (pipeline);
+  g_object_unref (pool);
+  g_object_unref (context);
+}
+
+/*
+ * Records a copy of the color attachment to @pixels, the render pass needs
+ * to end in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL.
+ */
+static void
+_cmd_read_back (GulkanFrameBuffer *fb,
+                VkExtent2D         extent,
+                GulkanBuffer      *pixels,
+                VkCommandBuffer    cmd)
+{
+  VkImageMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+    .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = gulkan_frame_buffer_get_color_image (fb),
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = 1,
+      .layerCount = 1,
+    },
+  };
+  vkCmdPipelineBarrier (cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1,
+                        &barrier);
+
+  VkBufferImageCopy region = {
+    .imageSubresource = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .layerCount = 1,
+    },
+    .imageExtent = {extent.width, extent.height, 1},
+  };
+  vkCmdCopyImageToBuffer (cmd, gulkan_frame_buffer_get_color_image (fb),
+                          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                          gulkan_buffer_get_handle (pixels), 1, &region);
+}
+
+static void
+_test_msaa_resolve ()
+{
+  GulkanContext *context = gulkan_context_new ();
+  g_assert_nonnull (context);
+
+  GulkanDevice *device = gulkan_context_get_device (context);
+  VkExtent2D    extent = {64, 64};
+
+  /* The resolved image is read back */
+  GulkanRenderPass *pass
+    = gulkan_render_pass_new_msaa (device, VK_SAMPLE_COUNT_4_BIT,
+                                   VK_FORMAT_R8G8B8A8_UNORM,
+                                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, TRUE);
+  g_assert_nonnull (pass);
+
+  GulkanFrameBuffer *fb = gulkan_frame_buffer_new_msaa (device, pass, extent,
+                                                        VK_SAMPLE_COUNT_4_BIT,
+                                                        VK_FORMAT_R8G8B8A8_UNORM,
+                                                        TRUE, 1);
+  g_assert_nonnull (fb);
+  g_assert (gulkan_frame_buffer_get_color_image (fb) != VK_NULL_HANDLE);
+
+  VkDeviceSize  size = extent.width * extent.height * 4;
+  GulkanBuffer *pixels
+    = gulkan_buffer_new (device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                           | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  g_assert_nonnull (pixels);
+
+  GulkanQueue     *queue = gulkan_device_get_graphics_queue (device);
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  g_assert (gulkan_cmd_buffer_begin_one_time (cmd_buffer));
+
+  VkCommandBuffer cmd = gulkan_cmd_buffer_get_handle (cmd_buffer);
+  gulkan_render_pass_begin (pass, extent,
+                            (VkClearColorValue){
+                              .float32 = {1.0f, 0.0f, 1.0f, 1.0f},
+                            },
+                            fb, cmd);
+  vkCmdEndRenderPass (cmd);
+
+  /* The single sample color image is the resolve target */
+  _cmd_read_back (fb, extent, pixels, cmd);
+
+  g_assert (gulkan_queue_end_submit (queue, cmd_buffer));
+  gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+
+  uint8_t *data;
+  g_assert (gulkan_buffer_map (pixels, (void **) &data));
+  for (uint32_t i = 0; i < extent.width * extent.height; i++)
+    {
+      g_assert_cmpuint (data[i * 4], ==, 255);
+      g_assert_cmpuint (data[i * 4 + 1], ==, 0);
+      g_assert_cmpuint (data[i * 4 + 2], ==, 255);
+      g_assert_cmpuint (data[i * 4 + 3], ==, 255);
+    }
+  gulkan_buffer_unmap (pixels);
+
+  g_object_unref (pixels);
+  g_object_unref (fb);
+  g_object_unref (pass);
+  g_object_unref (context);
+}
+
+static void
+_test_dynamic_rendering ()
+{
+  const gchar *device_extensions[] = {
+    VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+    VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+    VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+  };
+
+  GSList *device_ext_list = NULL;
+  for (uint64_t i = 0; i < G_N_ELEMENTS (device_extensions); i++)
+    device_ext_list = g_slist_append (device_ext_list,
+                                      (gpointer) device_extensions[i]);
+
+  GulkanContext *context = gulkan_context_new_from_extensions (NULL,
+                                                               device_ext_list,
+                                                               VK_NULL_HANDLE);
+  g_slist_free (device_ext_list);
+  g_assert_nonnull (context);
+
+  GulkanDevice *device = gulkan_context_get_device (context);
+  if (!gulkan_device_supports_dynamic_rendering (device))
+    {
+      g_object_unref (context);
+      return;
+    }
+
+  /* No render pass, so no VkFramebuffer is created */
+  GulkanFrameBuffer *fb = gulkan_frame_buffer_new (device, NULL,
+                                                   (VkExtent2D){64, 64},
+                                                   VK_SAMPLE_COUNT_1_BIT,
+                                                   VK_FORMAT_R8G8B8A8_UNORM,
+                                                   TRUE, 1);
+  g_assert_nonnull (fb);
+  g_assert (gulkan_frame_buffer_get_handle (fb) == VK_NULL_HANDLE);
+  g_assert (gulkan_frame_buffer_get_color_image_view (fb) != VK_NULL_HANDLE);
+  g_assert (gulkan_frame_buffer_get_depth_image_view (fb) != VK_NULL_HANDLE);
+
+  GulkanQueue     *queue = gulkan_device_get_graphics_queue (device);
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  g_assert (gulkan_cmd_buffer_begin_one_time (cmd_buffer));
+
+  VkCommandBuffer cmd = gulkan_cmd_buffer_get_handle (cmd_buffer);
+  gulkan_frame_buffer_begin_rendering (fb, cmd,
+                                       (VkClearColorValue){
+                                         .float32 = {0.0f, 0.0f, 0.0f, 1.0f},
+                                       });
+  gulkan_frame_buffer_end_rendering (fb, cmd,
+                                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  g_assert (gulkan_queue_end_submit (queue, cmd_buffer));
+  gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+
+  g_object_unref (fb);
+  g_object_unref (context);
+}
+
+static void
+_test_partial_render_pass ()
+{
+  GulkanContext *context = gulkan_context_new ();
+  g_assert_nonnull (context);
+
+  GulkanDevice *device = gulkan_context_get_device (context);
+  VkExtent2D    extent = {64, 64};
+
+  /* The image is read back after each pass */
+  GulkanRenderPass *pass
+    = gulkan_render_pass_new (device, VK_SAMPLE_COUNT_1_BIT,
+                              VK_FORMAT_R8G8B8A8_UNORM,
+                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, FALSE);
+  g_assert_nonnull (pass);
+
+  GulkanRenderPass *partial_pass = gulkan_render_pass_new_preserving (
+    device, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM,
+    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, FALSE);
+  g_assert_nonnull (partial_pass);
+
+  /* Frame buffers of the full pass are compatible with the preserving one */
+  GulkanFrameBuffer *fb = gulkan_frame_buffer_new (device, pass, extent,
+                                                   VK_SAMPLE_COUNT_1_BIT,
+                                                   VK_FORMAT_R8G8B8A8_UNORM,
+                                                   FALSE, 1);
+  g_assert_nonnull (fb);
+
+  VkDeviceSize  size = extent.width * extent.height * 4;
+  GulkanBuffer *pixels
+    = gulkan_buffer_new (device, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                           | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  g_assert_nonnull (pixels);
+
+  GulkanQueue     *queue = gulkan_device_get_graphics_queue (device);
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  g_assert (gulkan_cmd_buffer_begin_one_time (cmd_buffer));
+
+  VkCommandBuffer   cmd = gulkan_cmd_buffer_get_handle (cmd_buffer);
+  VkClearColorValue black = {.float32 = {0.0f, 0.0f, 0.0f, 1.0f}};
+  VkClearColorValue white = {.float32 = {1.0f, 1.0f, 1.0f, 1.0f}};
+
+  gulkan_render_pass_begin (pass, extent, black, fb, cmd);
+  vkCmdEndRenderPass (cmd);
+
+  VkRect2D area = {{16, 16}, {8, 8}};
+  gulkan_render_pass_begin_area (partial_pass, area, white, fb, cmd);
+  vkCmdEndRenderPass (cmd);
+
+  _cmd_read_back (fb, extent, pixels, cmd);
+
+  g_assert (gulkan_queue_end_submit (queue, cmd_buffer));
+  gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+
+  /* Only the render area was cleared again, the rest kept the full frame */
+  uint8_t *data;
+  g_assert (gulkan_buffer_map (pixels, (void **) &data));
+  for (uint32_t y = 0; y < extent.height; y++)
+    for (uint32_t x = 0; x < extent.width; x++)
+      {
+        gboolean inside = x >= 16 && x < 24 && y >= 16 && y < 24;
+        uint8_t *texel = &data[(y * extent.width + x) * 4];
+        for (uint32_t c = 0; c < 3; c++)
+          g_assert_cmpuint (texel[c], ==, inside ? 255 : 0);
+        g_assert_cmpuint (texel[3], ==, 255);
+      }
+  gulkan_buffer_unmap (pixels);
+
+  g_object_unref (pixels);
+  g_object_unref (fb);
+  g_object_unref (partial_pass);
+  g_object_unref (pass);
+  g_object_unref (context);
+}
+
+typedef struct
+{
+  float position[4];
+  float color[4];
+  float normal[3];
+} TestVertex;
+
+/* What the draw tests share, a 16x16 frame drawn with the cube shaders */
+typedef struct
+{
+  GulkanDevice         *device;
+  VkExtent2D            extent;
+  GulkanRenderPass     *pass;
+  GulkanFrameBuffer    *fb;
+  GulkanUniformBuffer  *ubo;
+  GulkanPipeline       *pipeline;
+  GulkanDescriptorPool *descriptor_pool;
+  GulkanDescriptorSet  *descriptor_set;
+  GulkanBuffer         *pixels;
+} DrawTest;
+
+static void
+_draw_test_init (DrawTest                                *test,
+                 GulkanContext                           *context,
+                 const VkVertexInputAttributeDescription *attribs,
+                 uint32_t                                 attrib_count,
+                 const VkVertexInputBindingDescription   *bindings,
+                 uint32_t                                 binding_count)
+{
+  test->device = gulkan_context_get_device (context);
+  test->extent = (VkExtent2D){16, 16};
+
+  test->pass = gulkan_render_pass_new (test->device, VK_SAMPLE_COUNT_1_BIT,
+                                       VK_FORMAT_R8G8B8A8_UNORM,
+                                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                       FALSE);
+  g_assert_nonnull (test->pass);
+
+  test->fb = gulkan_frame_buffer_new (test->device, test->pass, test->extent,
+                                      VK_SAMPLE_COUNT_1_BIT,
+                                      VK_FORMAT_R8G8B8A8_UNORM, FALSE, 1);
+  g_assert_nonnull (test->fb);
+
+  test->pixels = gulkan_buffer_new (test->device,
+                                    test->extent.width * test->extent.height
+                                      * 4,
+                                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                      | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  g_assert_nonnull (test->pixels);
+
+  /* Identity model view, model view projection and std140 normal matrix */
+  float transformation[44] = {0};
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      transformation[i * 5] = 1.0f;
+      transformation[16 + i * 5] = 1.0f;
+    }
+  for (uint32_t i = 0; i < 3; i++)
+    transformation[32 + i * 5] = 1.0f;
+
+  test->ubo = gulkan_uniform_buffer_new (test->device,
+                                         sizeof (transformation));
+  g_assert_nonnull (test->ubo);
+  gulkan_uniform_buffer_update (test->ubo, (gpointer *) transformation);
+
+  VkDescriptorSetLayoutBinding set_bindings[] = {
+    {
+      .binding = 0,
+      .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+    },
+  };
+  test->descriptor_pool = GULKAN_DESCRIPTOR_POOL_NEW (context, set_bindings,
+                                                      1);
+  g_assert_nonnull (test->descriptor_pool);
+
+  test->descriptor_set
+    = gulkan_descriptor_pool_create_set (test->descriptor_pool);
+  gulkan_descriptor_set_update_buffer (test->descriptor_set, 0, test->ubo);
+
+  GulkanPipelineConfig config = {
+    .extent = test->extent,
+    .sample_count = VK_SAMPLE_COUNT_1_BIT,
+    .vertex_shader_uri = "/shaders/cube.vert.spv",
+    .fragment_shader_uri = "/shaders/cube.frag.spv",
+    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+    .attribs = attribs,
+    .attrib_count = attrib_count,
+    .bindings = bindings,
+    .binding_count = binding_count,
+    .blend_attachments = (VkPipelineColorBlendAttachmentState[]){
+      {
+        .colorWriteMask =
+          VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+        },
+      },
+    .rasterization_state = &(VkPipelineRasterizationStateCreateInfo){
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .cullMode = VK_CULL_MODE_NONE,
+      .lineWidth = 1.0f,
+    },
+  };
+  test->pipeline = gulkan_pipeline_new (context, test->descriptor_pool,
+                                        test->pass, &config);
+  g_assert_nonnull (test->pipeline);
+}
+
+static void
+_draw_test_finalize (DrawTest *test)
+{
+  g_object_unref (test->pipeline);
+  g_object_unref (test->descriptor_set);
+  g_object_unref (test->descriptor_pool);
+  g_object_unref (test->ubo);
+  g_object_unref (test->pixels);
+  g_object_unref (test->fb);
+  g_object_unref (test->pass);
+}
+
+static GulkanCmdBuffer *
+_draw_test_begin (DrawTest *test)
+{
+  GulkanQueue     *queue = gulkan_device_get_graphics_queue (test->device);
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  g_assert (gulkan_cmd_buffer_begin_one_time (cmd_buffer));
+  return cmd_buffer;
+}
+
+/* Begins the frame with the pipeline and transformation bound */
+static void
+_draw_test_begin_pass (DrawTest *test, VkCommandBuffer cmd)
+{
+  VkClearColorValue black = {.float32 = {0.0f, 0.0f, 0.0f, 1.0f}};
+  gulkan_render_pass_begin (test->pass, test->extent, black, test->fb, cmd);
+
+  gulkan_pipeline_bind (test->pipeline, cmd);
+  VkPipelineLayout layout
+    = gulkan_descriptor_pool_get_pipeline_layout (test->descriptor_pool);
+  gulkan_descriptor_set_bind (test->descriptor_set, layout, cmd);
+}
+
+/* Ends the frame and reads it back into the pixels buffer */
+static void
+_draw_test_end (DrawTest *test, GulkanCmdBuffer *cmd_buffer)
+{
+  GulkanQueue    *queue = gulkan_device_get_graphics_queue (test->device);
+  VkCommandBuffer cmd = gulkan_cmd_buffer_get_handle (cmd_buffer);
+
+  vkCmdEndRenderPass (cmd);
+  _cmd_read_back (test->fb, test->extent, test->pixels, cmd);
+
+  g_assert (gulkan_queue_end_submit (queue, cmd_buffer));
+  gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+}
+
+/* Counts the pixels where @channel is brighter than the others */
+static uint32_t
+_count_pixels (DrawTest *test, uint32_t channel)
+{
+  uint8_t *data;
+  g_assert (gulkan_buffer_map (test->pixels, (void **) &data));
+  uint32_t pixel_count = test->extent.width * test->extent.height;
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < pixel_count; i++)
+    {
+      uint8_t *pixel = &data[i * 4];
+      gboolean brightest = pixel[channel] > 0;
+      for (uint32_t c = 0; c < 3; c++)
+        if (c != channel && pixel[c] >= pixel[channel])
+          brightest = FALSE;
+      if (brightest)
+        count++;
+    }
+  gulkan_buffer_unmap (test->pixels);
+  return count;
+}
+
+/* Returns if any pixel was drawn, and asserts that none or all were */
+static gboolean
+_all_pixels_lit (DrawTest *test)
+{
+  uint8_t *data;
+  g_assert (gulkan_buffer_map (test->pixels, (void **) &data));
+  uint32_t pixel_count = test->extent.width * test->extent.height;
+  uint32_t lit = 0;
+  for (uint32_t i = 0; i < pixel_count; i++)
+    if (data[i * 4] > 0)
+      lit++;
+  gulkan_buffer_unmap (test->pixels);
+
+  g_assert (lit == 0 || lit == pixel_count);
+  return lit > 0;
+}
+
+typedef struct
+{
+  DrawTest              draw;
+  GulkanBuffer         *vertex_buffer;
+  GulkanBuffer         *index_buffer;
+  GulkanIndirectBuffer *indirect;
+} IndirectDrawTest;
+
+/* Returns if the triangle covering the frame was drawn */
+static gboolean
+_draw_indirect (IndirectDrawTest *test,
+                gboolean          with_count,
+                gboolean          reset_count)
+{
+  GulkanCmdBuffer *cmd_buffer = _draw_test_begin (&test->draw);
+  VkCommandBuffer  cmd = gulkan_cmd_buffer_get_handle (cmd_buffer);
+
+  if (reset_count)
+    gulkan_indirect_buffer_cmd_reset_count (test->indirect, 0, cmd);
+
+  _draw_test_begin_pass (&test->draw, cmd);
+
+  VkBuffer     vertex_buffer = gulkan_buffer_get_handle (test->vertex_buffer);
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers (cmd, 0, 1, &vertex_buffer, &offset);
+  vkCmdBindIndexBuffer (cmd, gulkan_buffer_get_handle (test->index_buffer), 0,
+                        VK_INDEX_TYPE_UINT16);
+
+  if (with_count)
+    gulkan_indirect_buffer_draw_count (test->indirect, cmd);
+  else
+    gulkan_indirect_buffer_draw (test->indirect, cmd);
+
+  _draw_test_end (&test->draw, cmd_buffer);
+
+  return _all_pixels_lit (&test->draw);
+}
+
+static void
+_test_indirect_draw ()
+{
+  GulkanContext *context = gulkan_context_new ();
+  g_assert_nonnull (context);
+
+  IndirectDrawTest test;
+
+  VkVertexInputAttributeDescription attribs[] = {
+    {0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof (TestVertex, position)},
+    {1, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof (TestVertex, color)},
+    {2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof (TestVertex, normal)},
+  };
+  VkVertexInputBindingDescription binding = {
+    .binding = 0,
+    .stride = sizeof (TestVertex),
+    .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+  };
+  _draw_test_init (&test.draw, context, attribs, 3, &binding, 1);
+
+  VkMemoryPropertyFlags host_visible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                       | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  /* A white triangle covering the frame, lit from the front */
+  TestVertex vertices[3] = {
+    {{-1.0f, -1.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+    {{3.0f, -1.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+    {{-1.0f, 3.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 1.0f}},
+  };
+  uint16_t indices[3] = {0, 1, 2};
+
+  test.vertex_buffer
+    = gulkan_buffer_new_from_data (test.draw.device, vertices,
+                                   sizeof (vertices),
+                                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                                   host_visible);
+  g_assert_nonnull (test.vertex_buffer);
+
+  test.index_buffer
+    = gulkan_buffer_new_from_data (test.draw.device, indices, sizeof (indices),
+                                   VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                   host_visible);
+  g_assert_nonnull (test.index_buffer);
+
+  test.indirect = gulkan_indirect_buffer_new (test.draw.device, 4, 1);
+  g_assert_nonnull (test.indirect);
+
+  /* Without a draw count the zeroed capacity of a new buffer is drawn */
+  g_assert_false (_draw_indirect (&test, TRUE, FALSE));
+
+  VkDrawIndexedIndirectCommand triangle = {
+    .indexCount = 3,
+    .instanceCount = 1,
+  };
+  VkDrawIndexedIndirectCommand triangles[2] = {triangle, triangle};
+
+  g_assert (
+    gulkan_indirect_buffer_set_commands (test.indirect, 0, &triangle, 1));
+  g_assert (_draw_indirect (&test, FALSE, FALSE));
+  g_assert (_draw_indirect (&test, TRUE, FALSE));
+
+  /* Commands after the count must not be drawn with the fallback either */
+  g_assert (
+    gulkan_indirect_buffer_set_commands (test.indirect, 0, triangles, 2));
+  g_assert (
+    gulkan_indirect_buffer_set_commands (test.indirect, 0, triangles, 0));
+  g_assert_false (_draw_indirect (&test, FALSE, FALSE));
+  g_assert_false (_draw_indirect (&test, TRUE, FALSE));
+
+  /* A GPU reset without a compute pass appending draws nothing */
+  g_assert (
+    gulkan_indirect_buffer_set_commands (test.indirect, 0, triangles, 2));
+  g_assert_false (_draw_indirect (&test, TRUE, TRUE));
+
+  g_object_unref (test.indirect);
+  g_object_unref (test.index_buffer);
+  g_object_unref (test.vertex_buffer);
+  _draw_test_finalize (&test.draw);
+  g_object_unref (context);
+}
+
+static void
+_draw_instanced (DrawTest *test, GulkanVertexBuffer *vertex_buffer)
+{
+  GulkanCmdBuffer *cmd_buffer = _draw_test_begin (test);
+  VkCommandBuffer  cmd = gulkan_cmd_buffer_get_handle (cmd_buffer);
+
+  _draw_test_begin_pass (test, cmd);
+  gulkan_vertex_buffer_draw_instanced (vertex_buffer, cmd);
+  _draw_test_end (test, cmd_buffer);
+}
+
+static void
+_test_instanced_draw ()
+{
+  GulkanContext *context = gulkan_context_new ();
+  g_assert_nonnull (context);
+
+  /* Interleaved position and normal, the color comes from the instance */
+  VkVertexInputAttributeDescription attribs[] = {
+    {0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, 0},
+    {1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 0},
+    {2, 0, VK_FORMAT_R32G32B32_SFLOAT, 4 * sizeof (float)},
+  };
+  VkVertexInputBindingDescription bindings[] = {
+    {
+      .binding = 0,
+      .stride = 7 * sizeof (float),
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+    },
+    {
+      .binding = 1,
+      .stride = 4 * sizeof (float),
+      .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE,
+    },
+  };
+
+  DrawTest test;
+  _draw_test_init (&test, context, attribs, 3, bindings, 2);
+
+  /* A triangle covering the frame, lit from the front */
+  float vertices[3][7] = {
+    {-1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f},
+    {3.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f},
+    {-1.0f, 3.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f},
+  };
+
+  GulkanVertexBuffer *vertex_buffer
+    = gulkan_vertex_buffer_new (test.device,
+                                VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+  gulkan_vertex_buffer_append_vertices (vertex_buffer, &vertices[0][0], 3, 7);
+  g_assert (gulkan_vertex_buffer_alloc_array (vertex_buffer));
+  g_assert (gulkan_vertex_buffer_alloc_instances (vertex_buffer,
+                                                  4 * sizeof (float), 2, 2));
+
+  uint32_t pixel_count = test.extent.width * test.extent.height;
+
+  /* Instances are drawn in order, so the last one covers the frame */
+  float red_green[2][4] = {
+    {1.0f, 0.0f, 0.0f, 1.0f},
+    {0.0f, 1.0f, 0.0f, 1.0f},
+  };
+  g_assert (gulkan_vertex_buffer_update_instances (vertex_buffer, 0,
+                                                   red_green, 2));
+  _draw_instanced (&test, vertex_buffer);
+  g_assert_cmpuint (_count_pixels (&test, 1), ==, pixel_count);
+
+  /* The next frame slot has its own instances */
+  g_assert (gulkan_vertex_buffer_update_instances (vertex_buffer, 1,
+                                                   red_green, 1));
+  _draw_instanced (&test, vertex_buffer);
+  g_assert_cmpuint (_count_pixels (&test, 0), ==, pixel_count);
+
+  const float *first_slot = (const float *)
+    gulkan_vertex_buffer_get_instance_data (vertex_buffer, 0);
+  g_assert_cmpfloat (first_slot[5], ==, 1.0f);
+
+  /* Without instances nothing is drawn */
+  g_assert (gulkan_vertex_buffer_update_instances (vertex_buffer, 0, NULL, 0));
+  _draw_instanced (&test, vertex_buffer);
+  g_assert_false (_all_pixels_lit (&test));
+
+  g_object_unref (vertex_buffer);
+  _draw_test_finalize (&test);
+  g_object_unref (context);
+}
+
 int
 main ()
 {
   _test_without_context ();
   _test_with_context ();
   _test_with_init ();
+  _test_frame_slots ();
+  _test_compute_pipeline ();
+  _test_msaa_resolve ();
+  _test_dynamic_rendering ();
+  _test_partial_render_pass ();
+  _test_indirect_draw ();
+  _test_instanced_draw ();
   return 0;
 }
@@ -5,8 +5,19 @@
  * SPDX-License-Identifier: MIT
  */
 
+#define _GNU_SOURCE
+
 #include "gulkan.h"
 
+#include "gulkan-texture-compressed-private.h"
+
+#include <drm_fourcc.h>
+#include <fcntl.h>
+#include <linux/udmabuf.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 static void
 _test_resource_texture ()
 {
@@ -61,11 +72,405 @@ _test_raw_texture ()
   g_object_unref (pixbuf);
 }
 
+static void
+_test_compressed_texture ()
+{
+  GulkanContext *context = gulkan_context_new ();
+  g_assert_nonnull (context);
+
+  /* KTX2 header and level index for a single 4x4 BC1 level */
+  guint8 ktx2[112] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n',
+                      0x1A, '\n'};
+
+  uint32_t header[] = {VK_FORMAT_BC1_RGBA_UNORM_BLOCK, 1, 4, 4, 0, 0, 1, 1, 0};
+  memcpy (ktx2 + 12, header, sizeof (header));
+
+  uint64_t level_index[] = {104, 8, 8};
+  memcpy (ktx2 + 80, level_index, sizeof (level_index));
+
+  /* Red and blue endpoints, all texels use the blue one */
+  guint8 block[] = {0x00, 0xf8, 0x1f, 0x00, 0x55, 0x55, 0x55, 0x55};
+  memcpy (ktx2 + 104, block, sizeof (block));
+
+  GBytes *bytes = g_bytes_new_static (ktx2, sizeof (ktx2));
+
+  VkImageLayout  layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  GulkanTexture *texture
+    = gulkan_texture_new_from_compressed_bytes (context, bytes, layout);
+  g_assert_nonnull (texture);
+
+  VkExtent2D extent = gulkan_texture_get_extent (texture);
+  g_assert_cmpuint (extent.width, ==, 4);
+  g_assert_cmpuint (extent.height, ==, 4);
+  g_assert_cmpuint (gulkan_texture_get_mip_levels (texture), ==, 1);
+
+  g_object_unref (texture);
+  g_bytes_unref (bytes);
+  g_object_unref (context);
+}
+
+static void
+_test_compressed_dds ()
+{
+  GulkanContext *context = gulkan_context_new ();
+  g_assert_nonnull (context);
+
+  /* DDS header for an 8x8 DXT1 texture with 2 mip levels */
+  guint8   dds[128 + 32 + 8] = {0};
+  uint32_t header[32] = {0};
+  header[0] = 0x20534444;
+  header[1] = 124;
+  header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000;
+  header[3] = 8;
+  header[4] = 8;
+  header[7] = 2;
+  header[19] = 32;
+  header[20] = 0x4;
+  header[21] = 0x31545844; /* "DXT1" */
+  memcpy (dds, header, sizeof (header));
+
+  GulkanCompressedImage image;
+  g_assert_true (gulkan_compressed_image_parse (dds, sizeof (dds), &image));
+  g_assert_cmpint (image.format, ==, VK_FORMAT_BC1_RGBA_UNORM_BLOCK);
+  g_assert_cmpuint (image.levels, ==, 2);
+  /* 2x2 blocks, then a single block, of 8 bytes each */
+  g_assert_cmpuint (image.level_offset[0], ==, 128);
+  g_assert_cmpuint (image.level_size[0], ==, 32);
+  g_assert_cmpuint (image.level_offset[1], ==, 160);
+  g_assert_cmpuint (image.level_size[1], ==, 8);
+
+  /* A truncated last level is rejected */
+  g_assert_false (
+    gulkan_compressed_image_parse (dds, sizeof (dds) - 4, &image));
+
+  GBytes *bytes = g_bytes_new_static (dds, sizeof (dds));
+
+  VkImageLayout  layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  GulkanTexture *texture
+    = gulkan_texture_new_from_compressed_bytes (context, bytes, layout);
+  g_assert_nonnull (texture);
+
+  VkExtent2D extent = gulkan_texture_get_extent (texture);
+  g_assert_cmpuint (extent.width, ==, 8);
+  g_assert_cmpuint (extent.height, ==, 8);
+  g_assert_cmpuint (gulkan_texture_get_mip_levels (texture), ==, 2);
+
+  g_object_unref (texture);
+  g_bytes_unref (bytes);
+  g_object_unref (context);
+}
+
+static void
+_test_uncompressed_ktx2 ()
+{
+  GulkanContext *context = gulkan_context_new ();
+  g_assert_nonnull (context);
+
+  GulkanDevice *device = gulkan_context_get_device (context);
+  VkFormat      format = VK_FORMAT_R32G32B32_SFLOAT;
+  if (!gulkan_device_format_supports (device, format, VK_IMAGE_TILING_OPTIMAL,
+                                      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+    {
+      g_object_unref (context);
+      return;
+    }
+
+  /* 2x2 and 1x1 levels of 12 byte texels, stored smallest first */
+  guint8 ktx2[128 + 12 + 48] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB,
+                                '\r', '\n', 0x1A, '\n'};
+
+  uint32_t header[] = {format, 4, 2, 2, 0, 0, 1, 2, 0};
+  memcpy (ktx2 + 12, header, sizeof (header));
+
+  uint64_t level_index[] = {140, 48, 48, 128, 12, 12};
+  memcpy (ktx2 + 80, level_index, sizeof (level_index));
+
+  GulkanCompressedImage image;
+  g_assert_true (gulkan_compressed_image_parse (ktx2, sizeof (ktx2), &image));
+  g_assert_cmpuint (image.level_size[0], ==, 48);
+  g_assert_cmpuint (image.level_size[1], ==, 12);
+
+  /* Level offsets are not multiples of 12, so levels get repacked */
+  GBytes *bytes = g_bytes_new_static (ktx2, sizeof (ktx2));
+
+  VkImageLayout  layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  GulkanTexture *texture
+    = gulkan_texture_new_from_compressed_bytes (context, bytes, layout);
+  g_assert_nonnull (texture);
+  g_assert_cmpuint (gulkan_texture_get_mip_levels (texture), ==, 2);
+
+  g_object_unref (texture);
+  g_bytes_unref (bytes);
+  g_object_unref (context);
+}
+
+/* Finished async submissions are retired with the next submission */
+static void
+_retire_submissions (GulkanQueue *queue)
+{
+  GulkanCmdBuffer *cmd_buffer = gulkan_queue_request_cmd_buffer (queue);
+  g_assert (gulkan_cmd_buffer_begin_one_time (cmd_buffer));
+  g_assert (gulkan_queue_end_submit (queue, cmd_buffer));
+  gulkan_queue_free_cmd_buffer (queue, cmd_buffer);
+}
+
+static void
+_test_async_upload ()
+{
+  GulkanContext *context = gulkan_context_new ();
+  g_assert_nonnull (context);
+
+  GulkanDevice *device = gulkan_context_get_device (context);
+  GulkanQueue  *queue = gulkan_device_get_graphics_queue (device);
+
+  VkExtent2D     extent = {64, 64};
+  GulkanTexture *texture = gulkan_texture_new (context, extent,
+                                               VK_FORMAT_R8G8B8A8_UNORM);
+  g_assert_nonnull (texture);
+
+  gsize   size = extent.width * extent.height * 4;
+  guchar *pixels = g_malloc0 (size);
+  g_assert (gulkan_texture_upload_pixels_async (
+    texture, pixels, size, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+  g_free (pixels);
+
+  /* The pending acquire keeps the texture alive until it is flushed */
+  g_object_add_weak_pointer (G_OBJECT (texture), (gpointer *) &texture);
+  g_object_unref (texture);
+  g_assert_nonnull (texture);
+
+  g_assert (gulkan_queue_flush_acquires (queue));
+
+  gulkan_device_wait_idle (device);
+  _retire_submissions (queue);
+
+  g_assert_null (texture);
+
+  g_object_unref (context);
+}
+
+static void
+_test_semaphore_fd ()
+{
+  GSList *instance_ext_list
+    = gulkan_context_get_external_memory_instance_extensions ();
+  GSList *device_ext_list
+    = gulkan_context_get_external_memory_device_extensions ();
+
+  GulkanContext *context
+    = gulkan_context_new_from_extensions (instance_ext_list, device_ext_list,
+                                          VK_NULL_HANDLE);
+  g_slist_free_full (instance_ext_list, g_free);
+  g_slist_free_full (device_ext_list, g_free);
+  g_assert_nonnull (context);
+
+  GulkanDevice *device = gulkan_context_get_device (context);
+  VkExternalSemaphoreHandleTypeFlagBits type
+    = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+  if (!gulkan_device_supports_semaphore_fd (device, type))
+    {
+      g_object_unref (context);
+      return;
+    }
+
+  GulkanTexture *texture = gulkan_texture_new (context, (VkExtent2D){64, 64},
+                                               VK_FORMAT_R8G8B8A8_UNORM);
+  g_assert_nonnull (texture);
+
+  g_assert (gulkan_texture_transfer_layout (texture, VK_IMAGE_LAYOUT_UNDEFINED,
+                                            VK_IMAGE_LAYOUT_GENERAL));
+
+  GulkanQueue *queue = gulkan_device_get_transfer_queue (device);
+
+  int fd = -1;
+  g_assert (gulkan_texture_release_to_fd (texture, queue,
+                                          VK_IMAGE_LAYOUT_GENERAL, type, &fd));
+
+  /* Hand the texture back to ourselves, as an external consumer would */
+  g_assert (gulkan_texture_acquire_from_fd (texture, queue, fd, type,
+                                            VK_IMAGE_LAYOUT_GENERAL,
+                                            VK_IMAGE_LAYOUT_GENERAL));
+
+  /* The queued acquire holds a reference until it is flushed */
+  g_object_add_weak_pointer (G_OBJECT (texture), (gpointer *) &texture);
+  g_object_unref (texture);
+  g_assert_nonnull (texture);
+
+  g_assert (gulkan_queue_flush_acquires (queue));
+
+  gulkan_device_wait_idle (device);
+  _retire_submissions (queue);
+
+  g_assert_null (texture);
+
+  g_object_unref (context);
+}
+
+/* Returns a dmabuf fd backed by a memfd, or -1 without udmabuf support */
+static int
+_create_udmabuf (gsize size)
+{
+  int dev = open ("/dev/udmabuf", O_RDWR);
+  if (dev < 0)
+    return -1;
+
+  int fd = -1;
+  int memfd = memfd_create ("gulkan-test", MFD_ALLOW_SEALING);
+  if (memfd >= 0 && ftruncate (memfd, (off_t) size) == 0
+      && fcntl (memfd, F_ADD_SEALS, F_SEAL_SHRINK) == 0)
+    {
+      struct udmabuf_create create = {
+        .memfd = (uint32_t) memfd,
+        .offset = 0,
+        .size = size,
+      };
+      fd = ioctl (dev, UDMABUF_CREATE, &create);
+    }
+
+  if (memfd >= 0)
+    close (memfd);
+  close (dev);
+
+  return fd;
+}
+
+static void
+_test_dmabuf_cache ()
+{
+  GSList *instance_ext_list
+    = gulkan_context_get_external_memory_instance_extensions ();
+  GSList *device_ext_list
+    = gulkan_context_get_external_memory_device_extensions ();
+
+  const gchar *dmabuf_extensions[] = {
+    VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME,
+    VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME,
+    VK_KHR_BIND_MEMORY_2_EXTENSION_NAME,
+    VK_KHR_IMAGE_FORMAT_LIST_EXTENSION_NAME,
+    VK_KHR_SAMPLER_YCBCR_CONVERSION_EXTENSION_NAME,
+    VK_KHR_MAINTENANCE1_EXTENSION_NAME,
+  };
+  for (uint32_t i = 0; i < G_N_ELEMENTS (dmabuf_extensions); i++)
+    device_ext_list = g_slist_append (device_ext_list,
+                                      g_strdup (dmabuf_extensions[i]));
+
+  GulkanContext *context
+    = gulkan_context_new_from_extensions (instance_ext_list, device_ext_list,
+                                          VK_NULL_HANDLE);
+  g_slist_free_full (instance_ext_list, g_free);
+  g_slist_free_full (device_ext_list, g_free);
+  g_assert_nonnull (context);
+
+  struct GulkanDmabufAttributes attribs[3];
+  for (uint32_t i = 0; i < G_N_ELEMENTS (attribs); i++)
+    attribs[i] = (struct GulkanDmabufAttributes){
+      .width = 64,
+      .height = 64,
+      .format = DRM_FORMAT_ARGB8888,
+      .modifier = DRM_FORMAT_MOD_LINEAR,
+      .n_planes = 1,
+      .offset = {0},
+      .stride = {64 * 4},
+      .fd = {_create_udmabuf (64 * 64 * 4)},
+    };
+
+  GulkanDmabufCache *cache = gulkan_dmabuf_cache_new (context, 2);
+
+  GulkanTexture *a = NULL;
+  if (attribs[0].fd[0] >= 0)
+    a = gulkan_dmabuf_cache_get_texture (cache, &attribs[0]);
+
+  /* Skip without udmabuf or if the driver can't import it */
+  if (!a)
+    {
+      for (uint32_t i = 0; i < G_N_ELEMENTS (attribs); i++)
+        if (attribs[i].fd[0] >= 0)
+          close (attribs[i].fd[0]);
+      g_object_unref (cache);
+      g_object_unref (context);
+      return;
+    }
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 1);
+
+  /* A new fd for the same buffer is a hit */
+  struct GulkanDmabufAttributes a_dup = attribs[0];
+  a_dup.fd[0] = dup (attribs[0].fd[0]);
+  GulkanTexture *a_hit = gulkan_dmabuf_cache_get_texture (cache, &a_dup);
+  g_assert (a_hit == a);
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 1);
+  close (a_dup.fd[0]);
+  g_object_unref (a_hit);
+
+  /* A different buffer is a miss */
+  GulkanTexture *b = gulkan_dmabuf_cache_get_texture (cache, &attribs[1]);
+  g_assert_nonnull (b);
+  g_assert (b != a);
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 2);
+
+  /* Touch a, so b is the least recently used entry and gets evicted */
+  a_hit = gulkan_dmabuf_cache_get_texture (cache, &attribs[0]);
+  g_assert (a_hit == a);
+  g_object_unref (a_hit);
+
+  GulkanTexture *c = gulkan_dmabuf_cache_get_texture (cache, &attribs[2]);
+  g_assert_nonnull (c);
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 2);
+
+  a_hit = gulkan_dmabuf_cache_get_texture (cache, &attribs[0]);
+  g_assert (a_hit == a);
+  g_object_unref (a_hit);
+
+  /* b was evicted, so it is imported again */
+  GulkanTexture *b_new = gulkan_dmabuf_cache_get_texture (cache, &attribs[1]);
+  g_assert_nonnull (b_new);
+  g_assert (b_new != b);
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 2);
+
+  gulkan_dmabuf_cache_remove (cache, &attribs[1]);
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 1);
+
+  /* Entries not looked up for more than 2 frames are evicted */
+  gulkan_dmabuf_cache_set_max_idle_frames (cache, 2);
+  gulkan_dmabuf_cache_next_frame (cache);
+  gulkan_dmabuf_cache_next_frame (cache);
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 1);
+
+  a_hit = gulkan_dmabuf_cache_get_texture (cache, &attribs[0]);
+  g_assert (a_hit == a);
+  g_object_unref (a_hit);
+
+  gulkan_dmabuf_cache_next_frame (cache);
+  gulkan_dmabuf_cache_next_frame (cache);
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 1);
+  gulkan_dmabuf_cache_next_frame (cache);
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 0);
+
+  gulkan_dmabuf_cache_clear (cache);
+  g_assert_cmpuint (gulkan_dmabuf_cache_get_size (cache), ==, 0);
+
+  g_object_unref (b_new);
+  g_object_unref (c);
+  g_object_unref (b);
+  g_object_unref (a);
+  g_object_unref (cache);
+
+  for (uint32_t i = 0; i < G_N_ELEMENTS (attribs); i++)
+    close (attribs[i].fd[0]);
+
+  g_object_unref (context);
+}
+
 int
 main ()
 {
   _test_resource_texture ();
   _test_raw_texture ();
+  _test_compressed_texture ();
+  _test_compressed_dds ();
+  _test_uncompressed_ktx2 ();
+  _test_async_upload ();
+  _test_semaphore_fd ();
+  _test_dmabuf_cache ();
 
   return 0;
 }
@@ -0,0 +1,122 @@
+/*
+ * gulkan
+ * Copyright 2023 Collabora Ltd.
+ * Author: Lubosz Sarnecki <lubosz.sarnecki@collabora.com>
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "gulkan.h"
+
+/* Long enough to run through the SIMD paths and their scalar tails. */
+#define COUNT 37
+
+static void
+_test_format_size ()
+{
+  g_assert_cmpuint (gulkan_vertex_format_get_size (VK_FORMAT_R32G32B32_SFLOAT),
+                    ==, 12);
+  g_assert_cmpuint (gulkan_vertex_format_get_size (
+                      VK_FORMAT_R16G16B16A16_SFLOAT),
+                    ==, 8);
+  g_assert_cmpuint (gulkan_vertex_format_get_size (
+                      VK_FORMAT_A2B10G10R10_SNORM_PACK32),
+                    ==, 4);
+  g_assert_cmpuint (gulkan_vertex_format_get_size (VK_FORMAT_D32_SFLOAT), ==,
+                    0);
+}
+
+static void
+_test_half ()
+{
+  float    src[COUNT];
+  uint16_t dst[COUNT];
+  for (int i = 0; i < COUNT; i++)
+    src[i] = 1.0f;
+  src[0] = 0.0f;
+  src[1] = -2.0f;
+  src[2] = 65504.0f;
+  src[3] = 100000.0f;
+  src[COUNT - 1] = 0.5f;
+
+  gulkan_vertex_pack_half (src, dst, COUNT);
+
+  g_assert_cmphex (dst[0], ==, 0x0000);
+  g_assert_cmphex (dst[1], ==, 0xc000);
+  g_assert_cmphex (dst[2], ==, 0x7bff);
+  g_assert_cmphex (dst[3], ==, 0x7c00);
+  g_assert_cmphex (dst[4], ==, 0x3c00);
+  g_assert_cmphex (dst[COUNT - 1], ==, 0x3800);
+}
+
+static void
+_test_norm ()
+{
+  float   src[COUNT];
+  uint8_t unorm8[COUNT];
+  int8_t  snorm8[COUNT];
+  int16_t snorm16[COUNT];
+  for (int i = 0; i < COUNT; i++)
+    src[i] = 0.0f;
+  src[0] = 1.0f;
+  src[1] = -1.0f;
+  src[2] = 2.0f;
+  src[3] = 0.5f;
+  src[COUNT - 1] = -0.5f;
+
+  gulkan_vertex_pack_unorm8 (src, unorm8, COUNT);
+  gulkan_vertex_pack_snorm8 (src, snorm8, COUNT);
+  gulkan_vertex_pack_snorm16 (src, snorm16, COUNT);
+
+  g_assert_cmpint (unorm8[0], ==, 255);
+  g_assert_cmpint (unorm8[1], ==, 0);
+  g_assert_cmpint (unorm8[2], ==, 255);
+  g_assert_cmpint (unorm8[3], ==, 128);
+  g_assert_cmpint (unorm8[COUNT - 1], ==, 0);
+
+  g_assert_cmpint (snorm8[0], ==, 127);
+  g_assert_cmpint (snorm8[1], ==, -127);
+  g_assert_cmpint (snorm8[3], ==, 64);
+  g_assert_cmpint (snorm8[COUNT - 1], ==, -64);
+
+  g_assert_cmpint (snorm16[0], ==, 32767);
+  g_assert_cmpint (snorm16[1], ==, -32767);
+  g_assert_cmpint (snorm16[4], ==, 0);
+  g_assert_cmpint (snorm16[COUNT - 1], ==, -16384);
+}
+
+static void
+_test_normals ()
+{
+  float normals[5 * 3] = {
+    1.0f, 0.0f, 0.0f, 0.0f,  -1.0f, 0.0f, 0.0f, 0.0f,
+    1.0f, 0.0f, 0.0f, -1.0f, 0.0f,  1.0f, 0.0f,
+  };
+
+  uint32_t packed[5];
+  gulkan_vertex_pack_normals_2_10_10_10 (normals, packed, 5);
+  g_assert_cmphex (packed[0], ==, 0x000001ff);
+  g_assert_cmphex (packed[1], ==, 0x00080400);
+  g_assert_cmphex (packed[2], ==, 0x1ff00000);
+  g_assert_cmphex (packed[3], ==, 0x20100000);
+  g_assert_cmphex (packed[4], ==, 0x0007fc00);
+
+  int16_t octahedral[5 * 2];
+  gulkan_vertex_pack_normals_octahedral (normals, octahedral, 5);
+  g_assert_cmpint (octahedral[0], ==, 32767);
+  g_assert_cmpint (octahedral[1], ==, 0);
+  g_assert_cmpint (octahedral[4], ==, 0);
+  g_assert_cmpint (octahedral[5], ==, 0);
+  g_assert_cmpint (octahedral[6], ==, 32767);
+  g_assert_cmpint (octahedral[7], ==, 32767);
+}
+
+int
+main ()
+{
+  _test_format_size ();
+  _test_half ();
+  _test_norm ();
+  _test_normals ();
+
+  return 0;
+}
@@ -8,6 +8,128 @@
 #include "gulkan.h"
 #include <glib.h>
 
+#include "gulkan-window-private.h"
+
+/* A window without backend, which only has the pointer signals */
+#define TEST_TYPE_WINDOW test_window_get_type ()
+G_DECLARE_FINAL_TYPE (TestWindow, test_window, TEST, WINDOW, GulkanWindow)
+
+struct _TestWindow
+{
+  GulkanWindow parent;
+};
+
+G_DEFINE_TYPE (TestWindow, test_window, GULKAN_TYPE_WINDOW)
+
+static void
+test_window_init (TestWindow *self)
+{
+  (void) self;
+}
+
+static void
+test_window_class_init (TestWindowClass *klass)
+{
+  g_signal_new ("pointer-position", G_TYPE_FROM_CLASS (klass),
+                G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1,
+                G_TYPE_POINTER | G_SIGNAL_TYPE_STATIC_SCOPE);
+  g_signal_new ("pointer-axis", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_LAST,
+                0, NULL, NULL, NULL, G_TYPE_NONE, 1,
+                G_TYPE_POINTER | G_SIGNAL_TYPE_STATIC_SCOPE);
+}
+
+static void
+_position_cb (GulkanWindow *window, GulkanPositionEvent *event, GArray *events)
+{
+  (void) window;
+  g_array_append_val (events, *event);
+}
+
+static void
+_axis_cb (GulkanWindow *window, GulkanAxisEvent *event, GArray *events)
+{
+  (void) window;
+  g_array_append_val (events, *event);
+}
+
+static void
+_test_coalesce_input ()
+{
+  GulkanWindow *window = GULKAN_WINDOW (g_object_new (TEST_TYPE_WINDOW, 0));
+
+  GArray *positions = g_array_new (FALSE, FALSE, sizeof (GulkanPositionEvent));
+  GArray *axes = g_array_new (FALSE, FALSE, sizeof (GulkanAxisEvent));
+  g_signal_connect (window, "pointer-position", (GCallback) _position_cb,
+                    positions);
+  g_signal_connect (window, "pointer-axis", (GCallback) _axis_cb, axes);
+
+  /* Without coalescing the backends emit right away */
+  g_assert_false (gulkan_window_queue_position (window, (VkOffset2D){1, 2}));
+  g_assert_false (gulkan_window_queue_axis (window, 0, 1.0));
+
+  gulkan_window_set_coalesce_input (window, TRUE);
+
+  /* Only the latest position is emitted */
+  g_assert (gulkan_window_queue_position (window, (VkOffset2D){1, 2}));
+  g_assert (gulkan_window_queue_position (window, (VkOffset2D){3, 4}));
+  g_assert_false (gulkan_window_queue_axis (window, 2, 1.0));
+  gulkan_window_flush_input (window);
+
+  g_assert_cmpuint (positions->len, ==, 1);
+  GulkanPositionEvent *position = &g_array_index (positions,
+                                                  GulkanPositionEvent, 0);
+  g_assert_cmpint (position->offset.x, ==, 3);
+  g_assert_cmpint (position->offset.y, ==, 4);
+  g_assert_cmpuint (axes->len, ==, 0);
+
+  /* Whole units of the sum are emitted, the fraction is kept */
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      g_assert (gulkan_window_queue_axis (window, 0, 0.5));
+      g_assert (gulkan_window_queue_axis (window, 1, -0.75));
+    }
+  gulkan_window_flush_input (window);
+
+  g_assert_cmpuint (positions->len, ==, 1);
+  g_assert_cmpuint (axes->len, ==, 2);
+  GulkanAxisEvent *axis = &g_array_index (axes, GulkanAxisEvent, 0);
+  g_assert_cmpuint (axis->axis, ==, 0);
+  g_assert_cmpint (axis->value, ==, 1);
+  axis = &g_array_index (axes, GulkanAxisEvent, 1);
+  g_assert_cmpuint (axis->axis, ==, 1);
+  g_assert_cmpint (axis->value, ==, -2);
+
+  /* Scrolling below one unit per frame adds up over several flushes */
+  g_array_set_size (axes, 0);
+  gulkan_window_flush_input (window);
+  g_assert_cmpuint (axes->len, ==, 0);
+
+  g_assert (gulkan_window_queue_axis (window, 0, 0.25));
+  gulkan_window_flush_input (window);
+  g_assert_cmpuint (axes->len, ==, 0);
+
+  g_assert (gulkan_window_queue_axis (window, 0, 0.25));
+  gulkan_window_flush_input (window);
+  g_assert_cmpuint (axes->len, ==, 1);
+  axis = &g_array_index (axes, GulkanAxisEvent, 0);
+  g_assert_cmpuint (axis->axis, ==, 0);
+  g_assert_cmpint (axis->value, ==, 1);
+
+  /* Disabling emits pending events */
+  g_array_set_size (axes, 0);
+  g_assert (gulkan_window_queue_position (window, (VkOffset2D){5, 6}));
+  g_assert (gulkan_window_queue_axis (window, 0, 3.0));
+  gulkan_window_set_coalesce_input (window, FALSE);
+  g_assert_cmpuint (positions->len, ==, 2);
+  g_assert_cmpuint (axes->len, ==, 1);
+  axis = &g_array_index (axes, GulkanAxisEvent, 0);
+  g_assert_cmpint (axis->value, ==, 3);
+
+  g_array_unref (axes);
+  g_array_unref (positions);
+  g_object_unref (window);
+}
+
 static void
 _test_window_xcb ()
 {
@@ -19,6 +141,7 @@ _test_window_xcb ()
 int
 main ()
 {
+  _test_coalesce_input ();
   _test_window_xcb ();
   return 0;
 }